@@ -0,0 +1,516 @@
+/* Copyright (C) 2018 MariaDB Corporation AB
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA */
+
+/*
+  Benchmarks for the client library.
+
+  The benchmarks run against a server stand-in in the same process (see
+  bench_server.c), so the results depend on the client code only and
+  don't need a MariaDB server:
+
+    mariadb_bench [-t seconds] [name ...]
+
+  Only the benchmarks containing one of the given names are run. Each
+  benchmark is repeated with more iterations until it ran for at least
+  the given time (default 1 second). The results are written to stdout
+  in the format used by Go benchmarks, so they can be compared with
+  tools like benchstat:
+
+    BenchmarkTextFetch  500  2345678 ns/op  123456 B/op  1012 allocs/op  56789 wire-B/op
+
+  B/op and allocs/op are the memory allocations of the client (glibc
+  only), wire-B/op the number of protocol bytes the client sent and
+  received (before TLS encryption).
+*/
+
+#include <ma_global.h>
+#include <mysql.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench_server.h"
+
+#define BENCH_ROWS 1000
+#define BENCH_SELECT "SELECT a, b, c FROM t1 LIMIT 1000"
+
+int ma_pvio_register_callback(my_bool register_callback,
+                              void (*callback_function)(int mode, MYSQL *mysql, const uchar *buffer, size_t length));
+
+/* set while a benchmark is measured */
+static my_bool bench_running;
+static unsigned long long bench_wire_bytes;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define BENCH_COUNT_ALLOCATIONS
+/*
+  Allocations are counted by replacing malloc, calloc and realloc. Only
+  the benchmark thread is counted, not the server thread.
+*/
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static __thread my_bool bench_count_allocations;
+static __thread unsigned long long bench_allocations, bench_allocated;
+
+void *malloc(size_t size)
+{
+  if (bench_count_allocations)
+  {
+    bench_allocations++;
+    bench_allocated+= size;
+  }
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+  if (bench_count_allocations)
+  {
+    bench_allocations++;
+    bench_allocated+= nmemb * size;
+  }
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  if (bench_count_allocations)
+  {
+    bench_allocations++;
+    bench_allocated+= size;
+  }
+  return __libc_realloc(ptr, size);
+}
+#endif
+
+static void bench_wire_callback(int mode __attribute__((unused)),
+                                MYSQL *mysql __attribute__((unused)),
+                                const uchar *buffer __attribute__((unused)),
+                                size_t length)
+{
+  /* length is (size_t)-1 if a read or write failed */
+  if (bench_running && (ssize_t)length > 0)
+    bench_wire_bytes+= length;
+}
+
+typedef struct st_bench_ctx {
+  BENCH_SERVER *server;
+  double start;
+  double elapsed;
+} BENCH_CTX;
+
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_start(BENCH_CTX *ctx)
+{
+  bench_wire_bytes= 0;
+#ifdef BENCH_COUNT_ALLOCATIONS
+  bench_allocations= bench_allocated= 0;
+  bench_count_allocations= 1;
+#endif
+  bench_running= 1;
+  ctx->start= bench_now();
+}
+
+static void bench_stop(BENCH_CTX *ctx)
+{
+  ctx->elapsed= bench_now() - ctx->start;
+  bench_running= 0;
+#ifdef BENCH_COUNT_ALLOCATIONS
+  bench_count_allocations= 0;
+#endif
+}
+
+static MYSQL *bench_connect(BENCH_CTX *ctx, unsigned long client_flag,
+                            my_bool tls)
+{
+  MYSQL *mysql= mysql_init(NULL);
+
+  if (!mysql)
+    return NULL;
+  if (tls)
+    mysql_ssl_set(mysql, NULL, NULL, NULL, NULL, NULL);
+  if (!mysql_real_connect(mysql, NULL, "bench", "", "bench", 0,
+                          bench_server_socket(ctx->server), client_flag))
+  {
+    fprintf(stderr, "connect failed: %s\n", mysql_error(mysql));
+    mysql_close(mysql);
+    return NULL;
+  }
+  return mysql;
+}
+
+/* {{{ benchmarks */
+static int bench_connect_common(BENCH_CTX *ctx, unsigned long n, my_bool tls)
+{
+  unsigned long i;
+
+  bench_start(ctx);
+  for (i=0; i < n; i++)
+  {
+    MYSQL *mysql= bench_connect(ctx, 0, tls);
+    if (!mysql)
+      return 1;
+    mysql_close(mysql);
+  }
+  bench_stop(ctx);
+  return 0;
+}
+
+static int bench_connect_plain(BENCH_CTX *ctx, unsigned long n)
+{
+  return bench_connect_common(ctx, n, 0);
+}
+
+static int bench_connect_tls(BENCH_CTX *ctx, unsigned long n)
+{
+  return bench_connect_common(ctx, n, 1);
+}
+
+static int bench_query(BENCH_CTX *ctx, unsigned long n)
+{
+  MYSQL *mysql= bench_connect(ctx, 0, 0);
+  unsigned long i;
+
+  if (!mysql)
+    return 1;
+  bench_start(ctx);
+  for (i=0; i < n; i++)
+  {
+    if (mysql_query(mysql, "SET @a=1"))
+    {
+      fprintf(stderr, "query failed: %s\n", mysql_error(mysql));
+      mysql_close(mysql);
+      return 1;
+    }
+  }
+  bench_stop(ctx);
+  mysql_close(mysql);
+  return 0;
+}
+
+static int bench_text_fetch_common(BENCH_CTX *ctx, unsigned long n,
+                                   unsigned long client_flag, my_bool tls,
+                                   my_bool use_result)
+{
+  MYSQL *mysql= bench_connect(ctx, client_flag, tls);
+  MYSQL_RES *result;
+  unsigned long i, rows;
+
+  if (!mysql)
+    return 1;
+  bench_start(ctx);
+  for (i=0; i < n; i++)
+  {
+    if (mysql_query(mysql, BENCH_SELECT) ||
+        !(result= use_result ? mysql_use_result(mysql) : mysql_store_result(mysql)))
+    {
+      fprintf(stderr, "query failed: %s\n", mysql_error(mysql));
+      mysql_close(mysql);
+      return 1;
+    }
+    for (rows= 0; mysql_fetch_row(result); rows++);
+    mysql_free_result(result);
+    if (rows != BENCH_ROWS)
+    {
+      fprintf(stderr, "expected %d rows, got %lu\n", BENCH_ROWS, rows);
+      mysql_close(mysql);
+      return 1;
+    }
+  }
+  bench_stop(ctx);
+  mysql_close(mysql);
+  return 0;
+}
+
+static int bench_text_fetch(BENCH_CTX *ctx, unsigned long n)
+{
+  return bench_text_fetch_common(ctx, n, 0, 0, 0);
+}
+
+static int bench_text_fetch_unbuffered(BENCH_CTX *ctx, unsigned long n)
+{
+  return bench_text_fetch_common(ctx, n, 0, 0, 1);
+}
+
+static int bench_text_fetch_compressed(BENCH_CTX *ctx, unsigned long n)
+{
+  return bench_text_fetch_common(ctx, n, CLIENT_COMPRESS, 0, 0);
+}
+
+static int bench_text_fetch_tls(BENCH_CTX *ctx, unsigned long n)
+{
+  return bench_text_fetch_common(ctx, n, 0, 1, 0);
+}
+
+static int bench_binary_fetch(BENCH_CTX *ctx, unsigned long n)
+{
+  MYSQL *mysql= bench_connect(ctx, 0, 0);
+  MYSQL_STMT *stmt;
+  MYSQL_BIND bind[3];
+  int a;
+  char b[300], c[300];
+  unsigned long lengths[3], i, rows;
+  my_bool is_null[3];
+  const char *query= BENCH_SELECT;
+
+  if (!mysql)
+    return 1;
+  if (!(stmt= mysql_stmt_init(mysql)) ||
+      mysql_stmt_prepare(stmt, query, (unsigned long)strlen(query)))
+    goto error;
+
+  memset(bind, 0, sizeof(bind));
+  bind[0].buffer_type= MYSQL_TYPE_LONG;
+  bind[0].buffer= &a;
+  bind[1].buffer_type= MYSQL_TYPE_STRING;
+  bind[1].buffer= b;
+  bind[1].buffer_length= sizeof(b);
+  bind[2].buffer_type= MYSQL_TYPE_STRING;
+  bind[2].buffer= c;
+  bind[2].buffer_length= sizeof(c);
+  for (i=0; i < 3; i++)
+  {
+    bind[i].length= &lengths[i];
+    bind[i].is_null= &is_null[i];
+  }
+  if (mysql_stmt_bind_result(stmt, bind))
+    goto error;
+
+  bench_start(ctx);
+  for (i=0; i < n; i++)
+  {
+    int rc;
+
+    if (mysql_stmt_execute(stmt))
+      goto error;
+    for (rows= 0; !(rc= mysql_stmt_fetch(stmt)); rows++);
+    if (rc != MYSQL_NO_DATA || rows != BENCH_ROWS)
+    {
+      fprintf(stderr, "expected %d rows, got %lu\n", BENCH_ROWS, rows);
+      goto error;
+    }
+  }
+  bench_stop(ctx);
+  mysql_stmt_close(stmt);
+  mysql_close(mysql);
+  return 0;
+
+error:
+  fprintf(stderr, "statement failed: %s\n",
+          stmt ? mysql_stmt_error(stmt) : mysql_error(mysql));
+  if (stmt)
+    mysql_stmt_close(stmt);
+  mysql_close(mysql);
+  return 1;
+}
+
+static int bench_bulk_insert(BENCH_CTX *ctx, unsigned long n)
+{
+  MYSQL *mysql= bench_connect(ctx, 0, 0);
+  MYSQL_STMT *stmt;
+  MYSQL_BIND bind[3];
+  int ids[BENCH_ROWS];
+  double prices[BENCH_ROWS];
+  char *names[BENCH_ROWS];
+  unsigned long lengths[BENCH_ROWS], i;
+  unsigned int array_size= BENCH_ROWS;
+  const char *query= "INSERT INTO t1 VALUES (?, ?, ?)";
+
+  if (!mysql)
+    return 1;
+  for (i=0; i < BENCH_ROWS; i++)
+  {
+    ids[i]= (int)i;
+    prices[i]= i * 0.25;
+    names[i]= (char *)"abcdefghijklmnopqrstuvwxyz" + i % 20;
+    lengths[i]= 26 - i % 20;
+  }
+  if (!(stmt= mysql_stmt_init(mysql)) ||
+      mysql_stmt_prepare(stmt, query, (unsigned long)strlen(query)))
+    goto error;
+
+  memset(bind, 0, sizeof(bind));
+  bind[0].buffer_type= MYSQL_TYPE_LONG;
+  bind[0].buffer= ids;
+  bind[1].buffer_type= MYSQL_TYPE_DOUBLE;
+  bind[1].buffer= prices;
+  bind[2].buffer_type= MYSQL_TYPE_STRING;
+  bind[2].buffer= names;
+  bind[2].length= lengths;
+  if (mysql_stmt_attr_set(stmt, STMT_ATTR_ARRAY_SIZE, &array_size) ||
+      mysql_stmt_bind_param(stmt, bind))
+    goto error;
+
+  bench_start(ctx);
+  for (i=0; i < n; i++)
+  {
+    if (mysql_stmt_execute(stmt))
+      goto error;
+    if (mysql_stmt_affected_rows(stmt) != BENCH_ROWS)
+    {
+      fprintf(stderr, "expected %d affected rows\n", BENCH_ROWS);
+      goto error;
+    }
+  }
+  bench_stop(ctx);
+  mysql_stmt_close(stmt);
+  mysql_close(mysql);
+  return 0;
+
+error:
+  fprintf(stderr, "statement failed: %s\n",
+          stmt ? mysql_stmt_error(stmt) : mysql_error(mysql));
+  if (stmt)
+    mysql_stmt_close(stmt);
+  mysql_close(mysql);
+  return 1;
+}
+/* }}} */
+
+typedef struct st_bench {
+  const char *name;
+  int (*run)(BENCH_CTX *ctx, unsigned long n);
+  my_bool tls;
+} BENCH;
+
+static BENCH benchmarks[]= {
+  {"Connect", bench_connect_plain, 0},
+  {"ConnectTLS", bench_connect_tls, 1},
+  {"Query", bench_query, 0},
+  {"TextFetch", bench_text_fetch, 0},
+  {"TextFetchUnbuffered", bench_text_fetch_unbuffered, 0},
+  {"TextFetchCompressed", bench_text_fetch_compressed, 0},
+  {"TextFetchTLS", bench_text_fetch_tls, 1},
+  {"BinaryFetch", bench_binary_fetch, 0},
+  {"BulkInsert", bench_bulk_insert, 0},
+  {NULL, NULL, 0}
+};
+
+/*
+  Runs the benchmark with an increasing number of iterations until it
+  took at least bench_time seconds, like the Go testing package does.
+*/
+static int bench_run(BENCH *bench, BENCH_CTX *ctx, double bench_time)
+{
+  unsigned long n= 1;
+
+  for (;;)
+  {
+    unsigned long last= n;
+
+    if (bench->run(ctx, n))
+      return 1;
+    if (ctx->elapsed >= bench_time || n >= 1000000000)
+      break;
+    /* aim 20% above the requested time, but grow at most 100 times */
+    if (ctx->elapsed > 0)
+      n= (unsigned long)(bench_time * 1.2 * n / ctx->elapsed);
+    else
+      n*= 100;
+    n= MIN(n, last * 100);
+    n= MAX(n, last + 1);
+  }
+
+  printf("Benchmark%s\t%10lu\t%12.0f ns/op", bench->name, n,
+         ctx->elapsed * 1e9 / n);
+#ifdef BENCH_COUNT_ALLOCATIONS
+  printf("\t%10llu B/op\t%8llu allocs/op", bench_allocated / n,
+         bench_allocations / n);
+#endif
+  printf("\t%10llu wire-B/op\n", bench_wire_bytes / n);
+  fflush(stdout);
+  return 0;
+}
+
+static my_bool bench_selected(const char *name, int argc, char **argv)
+{
+  int i;
+
+  if (!argc)
+    return 1;
+  for (i=0; i < argc; i++)
+    if (strstr(name, argv[i]))
+      return 1;
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  BENCH_CTX ctx;
+  BENCH *bench;
+  double bench_time= 1.0;
+  int rc= 0;
+
+  argc--;
+  argv++;
+  if (argc >= 2 && !strcmp(argv[0], "-t"))
+  {
+    bench_time= atof(argv[1]);
+    argc-= 2;
+    argv+= 2;
+  }
+  if (argc && argv[0][0] == '-')
+  {
+    fprintf(stderr, "usage: mariadb_bench [-t seconds] [name ...]\n");
+    return 1;
+  }
+
+  mysql_library_init(0, NULL, NULL);
+  memset(&ctx, 0, sizeof(BENCH_CTX));
+#ifdef BENCH_CERT_DIR
+  ctx.server= bench_server_start(BENCH_CERT_DIR "/server-cert.pem",
+                                 BENCH_CERT_DIR "/server-key.pem");
+#else
+  ctx.server= bench_server_start(NULL, NULL);
+#endif
+  if (!ctx.server)
+  {
+    fprintf(stderr, "couldn't start the server stand-in\n");
+    return 1;
+  }
+  ma_pvio_register_callback(TRUE, bench_wire_callback);
+
+  for (bench= benchmarks; bench->name; bench++)
+  {
+    if (!bench_selected(bench->name, argc, argv))
+      continue;
+    if (bench->tls && !bench_server_tls(ctx.server))
+    {
+      fprintf(stderr, "Benchmark%s skipped: TLS is not available\n",
+              bench->name);
+      continue;
+    }
+    if (bench_run(bench, &ctx, bench_time))
+    {
+      fprintf(stderr, "Benchmark%s failed\n", bench->name);
+      rc= 1;
+    }
+  }
+
+  ma_pvio_register_callback(FALSE, bench_wire_callback);
+  bench_server_stop(ctx.server);
+  mysql_library_end();
+  return rc;
+}
@@ -0,0 +1,848 @@
+/* Copyright (C) 2018 MariaDB Corporation AB
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA */
+
+/*
+  Server stand-in for the benchmarks.
+
+  It speaks the handshake (including TLS and the zlib compressed
+  protocol), accepts any user and password and answers:
+
+    COM_QUERY "SELECT ... LIMIT n"  a result set with n rows
+    COM_QUERY (anything else)       an OK packet
+    COM_STMT_PREPARE                3 columns for SELECT, one parameter
+                                    for each '?'
+    COM_STMT_EXECUTE                a binary result set with n rows for
+                                    SELECT, otherwise an OK packet with
+                                    the number of iterations as affected
+                                    rows (bulk execution)
+
+  Result sets have the columns a (int), b (varchar, NULL in every third
+  row) and c (varchar). They are built once and replayed from a cache, so
+  the server spends as little time as possible per request.
+
+  All connections are handled one after another by a single thread: a
+  benchmark must not open a second connection while another one is in use.
+*/
+
+#include <ma_global.h>
+#include <ma_sys.h>
+#include <mysql.h>
+#include <ma_common.h>
+#include <ma_compress.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/ssl.h>
+#endif
+#include "bench_server.h"
+
+unsigned char *mysql_net_store_length(unsigned char *packet, size_t length);
+
+#define BENCH_SERVER_VERSION "5.5.5-10.3.99-MariaDB-bench"
+#define BENCH_CAPABILITIES (CLIENT_LONG_FLAG | CLIENT_CONNECT_WITH_DB |\
+                            CLIENT_COMPRESS | CLIENT_PROTOCOL_41 |\
+                            CLIENT_TRANSACTIONS | CLIENT_SECURE_CONNECTION |\
+                            CLIENT_MULTI_STATEMENTS | CLIENT_MULTI_RESULTS |\
+                            CLIENT_PS_MULTI_RESULTS | CLIENT_PLUGIN_AUTH)
+#define MAX_PACKET_LENGTH (256L*256L*256L-1)
+#define BENCH_MAX_STMTS 32
+#define BENCH_MAX_RESULTS 16
+/* compressed packets are sent in pieces of net_buffer_length, like the
+   server does */
+#define BENCH_COMP_CHUNK 16384
+#define BENCH_MIN_COMPRESS_LENGTH 50
+
+typedef struct {
+  uchar *data;
+  size_t length;
+  size_t size;
+} BENCH_BUFFER;
+
+typedef struct {
+  my_bool binary;
+  my_bool compressed;
+  unsigned long rows;
+  BENCH_BUFFER packets;
+} BENCH_RESULT;
+
+typedef struct {
+  unsigned long id;
+  my_bool select;
+  unsigned long rows;
+  unsigned int params;
+} BENCH_STMT;
+
+struct st_bench_server {
+  int fd;
+  struct sockaddr_un addr;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  my_bool stop;
+  unsigned long connections;
+#ifdef HAVE_OPENSSL
+  SSL_CTX *ssl_ctx;
+#endif
+  /* canned result sets, only used by the server thread */
+  BENCH_RESULT results[BENCH_MAX_RESULTS];
+  unsigned int result_count;
+};
+
+typedef struct {
+  BENCH_SERVER *server;
+  int fd;
+#ifdef HAVE_OPENSSL
+  SSL *ssl;
+#endif
+  MA_COMPRESSION_CTX *compression;
+  uchar seq;
+  BENCH_BUFFER packet;      /* last packet read, 0 terminated */
+  BENCH_BUFFER in;          /* uncompressed input */
+  size_t in_pos;
+  BENCH_BUFFER out;         /* packets which weren't sent yet */
+  BENCH_BUFFER comp;        /* scratch buffer for compression */
+  BENCH_STMT stmts[BENCH_MAX_STMTS];
+  unsigned long last_stmt_id;
+} BENCH_CONN;
+
+/* {{{ buffers */
+static uchar *bench_reserve(BENCH_BUFFER *buf, size_t length)
+{
+  if (buf->length + length > buf->size)
+  {
+    size_t size= MAX(buf->size * 2, buf->length + length + 1024);
+    uchar *data;
+
+    if (!(data= (uchar *)realloc(buf->data, size)))
+      return NULL;
+    buf->data= data;
+    buf->size= size;
+  }
+  return buf->data + buf->length;
+}
+
+static int bench_write_packet(BENCH_BUFFER *buf, uchar *seq,
+                              const uchar *data, size_t length)
+{
+  uchar *pos;
+
+  if (!(pos= bench_reserve(buf, length + 4)))
+    return 1;
+  int3store(pos, length);
+  pos[3]= (*seq)++;
+  memcpy(pos + 4, data, length);
+  buf->length+= length + 4;
+  return 0;
+}
+
+static uchar *bench_store_string(uchar *pos, const char *str, size_t length)
+{
+  pos= mysql_net_store_length(pos, length);
+  memset(pos, 0, length);
+  if (str)
+    memcpy(pos, str, length);
+  return pos + length;
+}
+
+static int bench_write_ok(BENCH_BUFFER *buf, uchar *seq,
+                          unsigned long long affected_rows)
+{
+  uchar packet[32], *pos= packet;
+
+  *pos++= 0;
+  pos= mysql_net_store_length(pos, affected_rows);
+  *pos++= 0;                                   /* insert id */
+  int2store(pos, SERVER_STATUS_AUTOCOMMIT);
+  int2store(pos + 2, 0);                       /* warnings */
+  pos+= 4;
+  return bench_write_packet(buf, seq, packet, pos - packet);
+}
+
+static int bench_write_eof(BENCH_BUFFER *buf, uchar *seq)
+{
+  uchar packet[5];
+
+  packet[0]= 254;
+  int2store(packet + 1, 0);
+  int2store(packet + 3, SERVER_STATUS_AUTOCOMMIT);
+  return bench_write_packet(buf, seq, packet, 5);
+}
+
+static int bench_write_error(BENCH_BUFFER *buf, uchar *seq,
+                             unsigned int error, const char *message)
+{
+  uchar packet[256], *pos= packet;
+  size_t length= MIN(strlen(message), 200);
+
+  *pos++= 255;
+  int2store(pos, error);
+  pos+= 2;
+  memcpy(pos, "#HY000", 6);
+  pos+= 6;
+  memcpy(pos, message, length);
+  pos+= length;
+  return bench_write_packet(buf, seq, packet, pos - packet);
+}
+
+static int bench_write_column(BENCH_BUFFER *buf, uchar *seq, const char *name,
+                              enum enum_field_types type, unsigned long length)
+{
+  uchar packet[128], *pos= packet;
+
+  pos= bench_store_string(pos, "def", 3);
+  pos= bench_store_string(pos, "bench", 5);
+  pos= bench_store_string(pos, "t1", 2);
+  pos= bench_store_string(pos, "t1", 2);
+  pos= bench_store_string(pos, name, strlen(name));
+  pos= bench_store_string(pos, name, strlen(name));
+  *pos++= 12;
+  int2store(pos, type == MYSQL_TYPE_LONG ? 63 : 33);
+  int4store(pos + 2, length);
+  pos[6]= (uchar)type;
+  int2store(pos + 7, type == MYSQL_TYPE_LONG ? NUM_FLAG : 0);
+  pos[9]= 0;                                   /* decimals */
+  int2store(pos + 10, 0);
+  pos+= 12;
+  return bench_write_packet(buf, seq, packet, pos - packet);
+}
+/* }}} */
+
+/* {{{ canned result sets */
+static int bench_build_result(BENCH_BUFFER *buf, my_bool binary,
+                              unsigned long rows)
+{
+  uchar packet[256], *pos, seq= 1;
+  unsigned long i;
+
+  packet[0]= 3;
+  if (bench_write_packet(buf, &seq, packet, 1) ||
+      bench_write_column(buf, &seq, "a", MYSQL_TYPE_LONG, 11) ||
+      bench_write_column(buf, &seq, "b", MYSQL_TYPE_VAR_STRING, 300) ||
+      bench_write_column(buf, &seq, "c", MYSQL_TYPE_VAR_STRING, 300) ||
+      bench_write_eof(buf, &seq))
+    return 1;
+
+  for (i=0; i < rows; i++)
+  {
+    my_bool b_null= !(i % 3);
+    size_t b_length= i % 100, c_length= i % 7;
+
+    pos= packet;
+    if (binary)
+    {
+      *pos++= 0;
+      /* the null bitmap starts at bit 2 */
+      *pos++= b_null ? 1 << 3 : 0;
+      int4store(pos, (uint32)i);
+      pos+= 4;
+    }
+    else
+    {
+      char number[24];
+      pos= bench_store_string(pos, number, sprintf(number, "%lu", i));
+    }
+    if (b_null)
+    {
+      if (!binary)
+        *pos++= 251;
+    }
+    else
+    {
+      pos= mysql_net_store_length(pos, b_length);
+      memset(pos, 'x', b_length);
+      pos+= b_length;
+    }
+    pos= mysql_net_store_length(pos, c_length);
+    memset(pos, 'z', c_length);
+    pos+= c_length;
+    if (bench_write_packet(buf, &seq, packet, pos - packet))
+      return 1;
+  }
+  return bench_write_eof(buf, &seq);
+}
+
+/* appends data as compressed packets to dst */
+static int bench_compress(BENCH_CONN *conn, BENCH_BUFFER *dst,
+                          const uchar *data, size_t length)
+{
+  while (length)
+  {
+    size_t chunk= MIN(length, BENCH_COMP_CHUNK), comp_length= chunk;
+    uchar *header;
+
+    if (!(header= bench_reserve(dst, chunk + 7)))
+      return 1;
+    if (chunk < BENCH_MIN_COMPRESS_LENGTH ||
+        conn->compression->methods->compress(conn->compression->ctx,
+                                             header + 7, &comp_length,
+                                             data, chunk))
+    {
+      memcpy(header + 7, data, chunk);
+      comp_length= chunk;
+      int3store(header + 4, 0);
+    }
+    else
+      int3store(header + 4, chunk);
+    int3store(header, comp_length);
+    header[3]= 0;
+    dst->length+= comp_length + 7;
+    data+= chunk;
+    length-= chunk;
+  }
+  return 0;
+}
+
+static BENCH_RESULT *bench_get_result(BENCH_CONN *conn, my_bool binary,
+                                      unsigned long rows)
+{
+  BENCH_SERVER *server= conn->server;
+  my_bool compressed= conn->compression != NULL;
+  BENCH_RESULT *result;
+  BENCH_BUFFER packets;
+  unsigned int i;
+
+  for (i=0; i < server->result_count; i++)
+  {
+    result= &server->results[i];
+    if (result->binary == binary && result->compressed == compressed &&
+        result->rows == rows)
+      return result;
+  }
+  /* replace the oldest entry if the cache is full */
+  if (server->result_count == BENCH_MAX_RESULTS)
+  {
+    free(server->results[0].packets.data);
+    memmove(server->results, server->results + 1,
+            (BENCH_MAX_RESULTS - 1) * sizeof(BENCH_RESULT));
+    server->result_count--;
+  }
+  result= &server->results[server->result_count];
+  memset(result, 0, sizeof(BENCH_RESULT));
+  memset(&packets, 0, sizeof(BENCH_BUFFER));
+  if (bench_build_result(&packets, binary, rows) ||
+      (compressed &&
+       bench_compress(conn, &result->packets, packets.data, packets.length)))
+  {
+    free(packets.data);
+    free(result->packets.data);
+    return NULL;
+  }
+  if (compressed)
+    free(packets.data);
+  else
+    result->packets= packets;
+  result->binary= binary;
+  result->compressed= compressed;
+  result->rows= rows;
+  server->result_count++;
+  return result;
+}
+/* }}} */
+
+/* {{{ network i/o */
+static int bench_raw_read(BENCH_CONN *conn, uchar *buffer, size_t length)
+{
+  while (length)
+  {
+    ssize_t r;
+
+#ifdef HAVE_OPENSSL
+    if (conn->ssl)
+      r= SSL_read(conn->ssl, buffer, (int)length);
+    else
+#endif
+      r= read(conn->fd, buffer, length);
+    if (r <= 0)
+      return 1;
+    buffer+= r;
+    length-= r;
+  }
+  return 0;
+}
+
+static int bench_raw_write(BENCH_CONN *conn, const uchar *buffer, size_t length)
+{
+  while (length)
+  {
+    ssize_t r;
+
+#ifdef HAVE_OPENSSL
+    if (conn->ssl)
+      r= SSL_write(conn->ssl, buffer, (int)length);
+    else
+#endif
+      r= write(conn->fd, buffer, length);
+    if (r <= 0)
+      return 1;
+    buffer+= r;
+    length-= r;
+  }
+  return 0;
+}
+
+static int bench_read(BENCH_CONN *conn, uchar *buffer, size_t length)
+{
+  if (!conn->compression)
+    return bench_raw_read(conn, buffer, length);
+
+  while (conn->in.length - conn->in_pos < length)
+  {
+    uchar header[7], *pos;
+    size_t comp_length, uncomp_length;
+
+    if (conn->in_pos)
+    {
+      memmove(conn->in.data, conn->in.data + conn->in_pos,
+              conn->in.length - conn->in_pos);
+      conn->in.length-= conn->in_pos;
+      conn->in_pos= 0;
+    }
+    if (bench_raw_read(conn, header, 7))
+      return 1;
+    comp_length= uint3korr(header);
+    uncomp_length= uint3korr(header + 4);
+    if (!uncomp_length)
+    {
+      if (!(pos= bench_reserve(&conn->in, comp_length)) ||
+          bench_raw_read(conn, pos, comp_length))
+        return 1;
+      conn->in.length+= comp_length;
+      continue;
+    }
+    conn->comp.length= 0;
+    if (!bench_reserve(&conn->comp, comp_length) ||
+        bench_raw_read(conn, conn->comp.data, comp_length) ||
+        !(pos= bench_reserve(&conn->in, uncomp_length)) ||
+        conn->compression->methods->decompress(conn->compression->ctx, pos,
+                                               &uncomp_length,
+                                               conn->comp.data, &comp_length))
+      return 1;
+    conn->in.length+= uncomp_length;
+  }
+  memcpy(buffer, conn->in.data + conn->in_pos, length);
+  conn->in_pos+= length;
+  return 0;
+}
+
+static ulong bench_read_packet(BENCH_CONN *conn)
+{
+  uchar header[4];
+  size_t length;
+
+  conn->packet.length= 0;
+  do
+  {
+    if (bench_read(conn, header, 4))
+      return packet_error;
+    length= uint3korr(header);
+    conn->seq= header[3] + 1;
+    if (!bench_reserve(&conn->packet, length + 1) ||
+        bench_read(conn, conn->packet.data + conn->packet.length, length))
+      return packet_error;
+    conn->packet.length+= length;
+  } while (length == MAX_PACKET_LENGTH);
+  conn->packet.data[conn->packet.length]= 0;
+  return (ulong)conn->packet.length;
+}
+
+static int bench_flush(BENCH_CONN *conn)
+{
+  int rc;
+
+  if (!conn->out.length)
+    return 0;
+  if (conn->compression)
+  {
+    conn->comp.length= 0;
+    rc= bench_compress(conn, &conn->comp, conn->out.data, conn->out.length) ||
+        bench_raw_write(conn, conn->comp.data, conn->comp.length);
+  }
+  else
+    rc= bench_raw_write(conn, conn->out.data, conn->out.length);
+  conn->out.length= 0;
+  return rc;
+}
+/* }}} */
+
+/* {{{ commands */
+static unsigned long bench_limit(const char *query)
+{
+  const char *limit= strstr(query, "LIMIT ");
+  return limit ? strtoul(limit + 6, NULL, 10) : 0;
+}
+
+static int bench_send_result(BENCH_CONN *conn, my_bool binary,
+                             unsigned long rows)
+{
+  BENCH_RESULT *result= bench_get_result(conn, binary, rows);
+
+  if (!result)
+    return bench_write_error(&conn->out, &conn->seq, 1041, "Out of memory");
+  return bench_flush(conn) ||
+         bench_raw_write(conn, result->packets.data, result->packets.length);
+}
+
+static int bench_query(BENCH_CONN *conn)
+{
+  const char *query= (const char *)conn->packet.data + 1;
+
+  if (!strncasecmp(query, "SELECT", 6))
+    return bench_send_result(conn, 0, bench_limit(query));
+  return bench_write_ok(&conn->out, &conn->seq, 0);
+}
+
+static int bench_prepare(BENCH_CONN *conn)
+{
+  const char *query= (const char *)conn->packet.data + 1, *p;
+  BENCH_STMT *stmt= NULL;
+  uchar packet[12];
+  unsigned int i;
+
+  for (i=0; i < BENCH_MAX_STMTS && !stmt; i++)
+    if (!conn->stmts[i].id)
+      stmt= &conn->stmts[i];
+  if (!stmt)
+    return bench_write_error(&conn->out, &conn->seq, 1461,
+                             "Too many prepared statements");
+
+  stmt->id= ++conn->last_stmt_id;
+  stmt->select= !strncasecmp(query, "SELECT", 6);
+  stmt->rows= stmt->select ? bench_limit(query) : 0;
+  stmt->params= 0;
+  for (p= query; *p; p++)
+    if (*p == '?')
+      stmt->params++;
+
+  packet[0]= 0;
+  int4store(packet + 1, (uint32)stmt->id);
+  int2store(packet + 5, stmt->select ? 3 : 0);
+  int2store(packet + 7, stmt->params);
+  packet[9]= 0;
+  int2store(packet + 10, 0);
+  if (bench_write_packet(&conn->out, &conn->seq, packet, 12))
+    return 1;
+  if (stmt->params)
+  {
+    for (i=0; i < stmt->params; i++)
+      if (bench_write_column(&conn->out, &conn->seq, "?",
+                             MYSQL_TYPE_VAR_STRING, 300))
+        return 1;
+    if (bench_write_eof(&conn->out, &conn->seq))
+      return 1;
+  }
+  if (stmt->select &&
+      (bench_write_column(&conn->out, &conn->seq, "a", MYSQL_TYPE_LONG, 11) ||
+       bench_write_column(&conn->out, &conn->seq, "b", MYSQL_TYPE_VAR_STRING, 300) ||
+       bench_write_column(&conn->out, &conn->seq, "c", MYSQL_TYPE_VAR_STRING, 300) ||
+       bench_write_eof(&conn->out, &conn->seq)))
+    return 1;
+  return 0;
+}
+
+static BENCH_STMT *bench_find_stmt(BENCH_CONN *conn)
+{
+  unsigned long id;
+  unsigned int i;
+
+  if (conn->packet.length < 5)
+    return NULL;
+  id= uint4korr(conn->packet.data + 1);
+  for (i=0; i < BENCH_MAX_STMTS; i++)
+    if (conn->stmts[i].id == id)
+      return &conn->stmts[i];
+  return NULL;
+}
+
+static int bench_execute(BENCH_CONN *conn)
+{
+  BENCH_STMT *stmt= bench_find_stmt(conn);
+
+  if (!stmt || conn->packet.length < 10)
+    return bench_write_error(&conn->out, &conn->seq, 1243,
+                             "Unknown prepared statement handler");
+  if (stmt->select)
+    return bench_send_result(conn, 1, stmt->rows);
+  /* bulk executions send the number of rows as iteration count */
+  return bench_write_ok(&conn->out, &conn->seq,
+                        uint4korr(conn->packet.data + 6));
+}
+
+static int bench_handshake(BENCH_CONN *conn)
+{
+  BENCH_SERVER *server= conn->server;
+  uchar packet[128], *pos= packet;
+  unsigned long capabilities= BENCH_CAPABILITIES;
+  uint32 client_flag;
+
+#ifdef HAVE_OPENSSL
+  if (server->ssl_ctx)
+    capabilities|= CLIENT_SSL;
+#endif
+  *pos++= 10;
+  strcpy((char *)pos, BENCH_SERVER_VERSION);
+  pos+= sizeof(BENCH_SERVER_VERSION);
+  int4store(pos, (uint32)++server->connections);
+  pos+= 4;
+  memcpy(pos, "01234567", 8);
+  pos+= 8;
+  *pos++= 0;
+  int2store(pos, capabilities & 0xFFFF);
+  pos[2]= 33;
+  int2store(pos + 3, SERVER_STATUS_AUTOCOMMIT);
+  int2store(pos + 5, capabilities >> 16);
+  pos[7]= SCRAMBLE_LENGTH + 1;
+  memset(pos + 8, 0, 6);
+  int4store(pos + 14, (uint32)(MARIADB_CLIENT_STMT_BULK_OPERATIONS >> 32));
+  pos+= 18;
+  memcpy(pos, "890123456789", 13);
+  pos+= 13;
+  strcpy((char *)pos, "mysql_native_password");
+  pos+= sizeof("mysql_native_password");
+
+  conn->seq= 0;
+  if (bench_write_packet(&conn->out, &conn->seq, packet, pos - packet) ||
+      bench_flush(conn) ||
+      bench_read_packet(conn) == packet_error || conn->packet.length < 4)
+    return 1;
+  client_flag= uint4korr(conn->packet.data);
+
+  /* a short packet requests TLS, the real response follows encrypted */
+  if ((client_flag & CLIENT_SSL) && conn->packet.length == 32)
+  {
+#ifdef HAVE_OPENSSL
+    if (!server->ssl_ctx || !(conn->ssl= SSL_new(server->ssl_ctx)) ||
+        !SSL_set_fd(conn->ssl, conn->fd) || SSL_accept(conn->ssl) != 1 ||
+        bench_read_packet(conn) == packet_error || conn->packet.length < 4)
+      return 1;
+    client_flag= uint4korr(conn->packet.data);
+#else
+    return 1;
+#endif
+  }
+
+  if (bench_write_ok(&conn->out, &conn->seq, 0) || bench_flush(conn))
+    return 1;
+  if ((client_flag & CLIENT_COMPRESS) &&
+      !(conn->compression= ma_compression_init(MA_COMPRESSION_ZLIB, 0)))
+    return 1;
+  return 0;
+}
+
+static void bench_session(BENCH_CONN *conn)
+{
+  if (bench_handshake(conn))
+    return;
+
+  for (;;)
+  {
+    int rc;
+
+    if (bench_read_packet(conn) == packet_error || !conn->packet.length)
+      return;
+    conn->seq= 1;
+    switch (conn->packet.data[0]) {
+    case COM_QUIT:
+      return;
+    case COM_QUERY:
+      rc= bench_query(conn);
+      break;
+    case COM_STMT_PREPARE:
+      rc= bench_prepare(conn);
+      break;
+    case COM_STMT_EXECUTE:
+      rc= bench_execute(conn);
+      break;
+    case COM_STMT_CLOSE:
+    {
+      BENCH_STMT *stmt= bench_find_stmt(conn);
+      if (stmt)
+        stmt->id= 0;
+      continue;
+    }
+    case COM_INIT_DB:
+    case COM_PING:
+    case COM_STMT_RESET:
+    case COM_RESET_CONNECTION:
+      rc= bench_write_ok(&conn->out, &conn->seq, 0);
+      break;
+    default:
+      rc= bench_write_error(&conn->out, &conn->seq, 1047, "Unknown command");
+      break;
+    }
+    if (rc || bench_flush(conn))
+      return;
+  }
+}
+/* }}} */
+
+static void *bench_server_thread(void *arg)
+{
+  BENCH_SERVER *server= (BENCH_SERVER *)arg;
+
+  for (;;)
+  {
+    BENCH_CONN conn;
+    my_bool stop;
+    int fd= accept(server->fd, NULL, NULL);
+
+    pthread_mutex_lock(&server->lock);
+    stop= server->stop;
+    pthread_mutex_unlock(&server->lock);
+    if (stop || fd < 0)
+    {
+      if (fd >= 0)
+        close(fd);
+      if (stop)
+        break;
+      continue;
+    }
+
+    memset(&conn, 0, sizeof(BENCH_CONN));
+    conn.server= server;
+    conn.fd= fd;
+    bench_session(&conn);
+
+#ifdef HAVE_OPENSSL
+    if (conn.ssl)
+    {
+      SSL_shutdown(conn.ssl);
+      SSL_free(conn.ssl);
+    }
+#endif
+    close(fd);
+    if (conn.compression)
+      ma_compression_end(conn.compression);
+    free(conn.packet.data);
+    free(conn.in.data);
+    free(conn.out.data);
+    free(conn.comp.data);
+  }
+  return NULL;
+}
+
+BENCH_SERVER *bench_server_start(const char *cert_file, const char *key_file)
+{
+  BENCH_SERVER *server;
+  const char *tmpdir= getenv("TMPDIR");
+
+  if (!(server= (BENCH_SERVER *)calloc(1, sizeof(BENCH_SERVER))))
+    return NULL;
+  server->fd= -1;
+  server->addr.sun_family= AF_UNIX;
+  if (snprintf(server->addr.sun_path, sizeof(server->addr.sun_path),
+               "%s/mariadb_bench.%d.sock", tmpdir ? tmpdir : "/tmp",
+               (int)getpid()) >= (int)sizeof(server->addr.sun_path))
+    goto error;
+  unlink(server->addr.sun_path);
+
+#ifdef HAVE_OPENSSL
+  /* without certificate, the TLS benchmarks will be skipped */
+  if (cert_file && key_file)
+  {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    /* the test certificates use 1024 bit keys */
+    if ((server->ssl_ctx= SSL_CTX_new(TLS_server_method())))
+      SSL_CTX_set_security_level(server->ssl_ctx, 0);
+#else
+    SSL_library_init();
+    server->ssl_ctx= SSL_CTX_new(SSLv23_server_method());
+#endif
+    if (server->ssl_ctx &&
+        (SSL_CTX_use_certificate_file(server->ssl_ctx, cert_file, SSL_FILETYPE_PEM) != 1 ||
+         SSL_CTX_use_PrivateKey_file(server->ssl_ctx, key_file, SSL_FILETYPE_PEM) != 1))
+    {
+      SSL_CTX_free(server->ssl_ctx);
+      server->ssl_ctx= NULL;
+    }
+  }
+#else
+  (void)cert_file;
+  (void)key_file;
+#endif
+
+  if ((server->fd= socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+      bind(server->fd, (struct sockaddr *)&server->addr, sizeof(server->addr)) ||
+      listen(server->fd, 128))
+    goto error;
+  pthread_mutex_init(&server->lock, NULL);
+  if (pthread_create(&server->thread, NULL, bench_server_thread, server))
+  {
+    pthread_mutex_destroy(&server->lock);
+    goto error;
+  }
+  return server;
+
+error:
+  if (server->fd >= 0)
+  {
+    close(server->fd);
+    unlink(server->addr.sun_path);
+  }
+#ifdef HAVE_OPENSSL
+  if (server->ssl_ctx)
+    SSL_CTX_free(server->ssl_ctx);
+#endif
+  free(server);
+  return NULL;
+}
+
+const char *bench_server_socket(BENCH_SERVER *server)
+{
+  return server->addr.sun_path;
+}
+
+my_bool bench_server_tls(BENCH_SERVER *server)
+{
+#ifdef HAVE_OPENSSL
+  return server->ssl_ctx != NULL;
+#else
+  (void)server;
+  return 0;
+#endif
+}
+
+void bench_server_stop(BENCH_SERVER *server)
+{
+  int fd;
+  unsigned int i;
+
+  pthread_mutex_lock(&server->lock);
+  server->stop= 1;
+  pthread_mutex_unlock(&server->lock);
+  /* wake up the server thread, which is waiting in accept() */
+  if ((fd= socket(AF_UNIX, SOCK_STREAM, 0)) >= 0)
+  {
+    connect(fd, (struct sockaddr *)&server->addr, sizeof(server->addr));
+    close(fd);
+  }
+  pthread_join(server->thread, NULL);
+  pthread_mutex_destroy(&server->lock);
+
+  close(server->fd);
+  unlink(server->addr.sun_path);
+  for (i=0; i < server->result_count; i++)
+    free(server->results[i].packets.data);
+#ifdef HAVE_OPENSSL
+  if (server->ssl_ctx)
+    SSL_CTX_free(server->ssl_ctx);
+#endif
+  free(server);
+}
@@ -0,0 +1,33 @@
+/* Copyright (C) 2018 MariaDB Corporation AB
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA */
+
+#ifndef _bench_server_h_
+#define _bench_server_h_
+
+typedef struct st_bench_server BENCH_SERVER;
+
+/*
+  Starts the server stand-in on a unix socket. If cert_file and key_file
+  are given and the connector was built with OpenSSL, clients may switch
+  to TLS. Returns NULL on error.
+*/
+BENCH_SERVER *bench_server_start(const char *cert_file, const char *key_file);
+const char *bench_server_socket(BENCH_SERVER *server);
+my_bool bench_server_tls(BENCH_SERVER *server);
+void bench_server_stop(BENCH_SERVER *server);
+
+#endif
@@ -251,6 +251,7 @@ SET(HAVE_SYS_CDEFS_H CACHE  INTERNAL "")
 SET(HAVE_SYS_DIR_H CACHE  INTERNAL "")
 SET(HAVE_SYS_ERRLIST CACHE  INTERNAL "")
 SET(HAVE_SYS_FILE_H CACHE  INTERNAL "")
+SET(HAVE_SYS_EPOLL_H CACHE  INTERNAL "")
 SET(HAVE_SYS_FPU_H CACHE  INTERNAL "")
 SET(HAVE_SYS_IOCTL_H CACHE  INTERNAL "")
 SET(HAVE_SYS_IPC_H CACHE  INTERNAL "")
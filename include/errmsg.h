@@ -95,5 +95,8 @@ extern const char *mariadb_client_errors[];	/* Error messages */
 #define CR_FUNCTION_NOT_SUPPORTED 5003
 #define CR_FILE_NOT_FOUND 5004
 #define CR_FILE_READ 5005
+#define CR_STMT_STREAM_ABORTED 5006
+#define CR_PIPELINE_FULL 5007
+#define CR_BULK_RESULT_SET 5008
 
 #endif
@@ -68,6 +68,15 @@ struct st_mysql_options_extension {
   char *connection_handler;
   my_bool (*set_option)(MYSQL *mysql, const char *config_option, const char *config_value);
   HASH userdata;
+  char *compression_algorithms; /* comma separated list, preferred first */
+  unsigned int compression_level;
+  size_t read_ahead_min_size; /* bounds of the adaptive read ahead cache */
+  size_t read_ahead_max_size;
+  unsigned int stmt_cache_size; /* max. number of cached prepared statements */
+  unsigned int result_prefetch_rows; /* rows read ahead by a thread, see ma_prefetch.c */
+  my_bool tls_ktls; /* use kernel TLS offload if available */
+  unsigned int dns_cache_ttl; /* seconds, 0: no DNS cache, see ma_dns_cache.c */
+  my_bool stats_timing; /* read the clock for MA_STATS, see ma_stats.c */
 };
 
 typedef struct st_connection_handler
@@ -80,6 +89,20 @@ typedef struct st_connection_handler
 
 struct st_mariadb_net_extension {
   enum enum_multi_status multi_status;
+  struct st_ma_compression_ctx *compression;
+  unsigned char *comp_buff; /* scratch buffer for compressed packets */
+  size_t comp_buff_size;
+};
+
+/* number of row pointers per chunk of the row index (2^n) */
+#define MA_ROW_INDEX_CHUNK_BITS 10
+#define MA_ROW_INDEX_CHUNK_SIZE (1 << MA_ROW_INDEX_CHUNK_BITS)
+
+/* stored in MYSQL_DATA->extension */
+struct st_mariadb_data_extension {
+  my_bool packed_rows; /* rows contain the raw packet, see mthd_my_read_rows */
+  MYSQL_ROWS ***row_index; /* chunked row index, see ma_data_add_row */
+  size_t row_index_chunks; /* number of allocated chunk pointers */
 };
 
 struct st_mariadb_session_state
@@ -88,11 +111,41 @@ struct st_mariadb_session_state
        *current;
 };
 
+/* latency histograms: enum_server_command up to COM_RESET_CONNECTION and COM_MULTI */
+#define MA_STATS_COMMANDS (COM_RESET_CONNECTION + 2)
+
+/* per connection statistics, see ma_stats.c */
+typedef struct st_ma_stats {
+  MARIADB_STATS counters;
+  unsigned long long *latency[MA_STATS_COMMANDS]; /* allocated on first use */
+  my_bool pending;                  /* a command waits for its response */
+  my_bool sent;                     /* the pending command was sent */
+  unsigned char command;
+  unsigned long long command_start; /* 0 without MARIADB_OPT_STATS_TIMING */
+} MA_STATS;
+
+/* the statistics the I/O layer counts into, see ma_prefetch.c */
+#define MA_IO_STATS(mysql) \
+  ((mysql)->extension->io_stats ? (mysql)->extension->io_stats : \
+    &(mysql)->extension->stats)
+
+#define MA_NET_STATS(net) \
+  (((net)->pvio && (net)->pvio->mysql && (net)->pvio->mysql->extension) ? \
+    MA_IO_STATS((net)->pvio->mysql) : NULL)
+
+#define MA_STATS_TIMING(mysql) \
+  ((mysql)->options.extension && (mysql)->options.extension->stats_timing)
+
 struct st_mariadb_extension {
   MA_CONNECTION_HANDLER *conn_hdlr;
   struct st_mariadb_session_state session_state[SESSION_TRACK_TYPES];
   unsigned long mariadb_client_flag; /* MariaDB specific client flags */
   unsigned long mariadb_server_capabilities; /* MariaDB specific server capabilities */
+  struct st_ma_stmt_cache *stmt_cache; /* see mariadb_stmt.c */
+  struct st_ma_pipeline *pipeline; /* see mariadb_pipeline_begin */
+  struct st_ma_prefetch *prefetch; /* see ma_prefetch.c */
+  MA_STATS stats; /* see ma_stats.c */
+  MA_STATS *io_stats; /* stats of a prefetch reader thread, NULL: stats */
 };
 
 #define OPT_EXT_VAL(a,key) \
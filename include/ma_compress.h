@@ -0,0 +1,71 @@
+/* Copyright (C) 2017 MariaDB Corporation AB
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA */
+
+#ifndef _ma_compress_h_
+#define _ma_compress_h_
+
+enum enum_ma_compression_type {
+  MA_COMPRESSION_NONE= 0,
+  MA_COMPRESSION_ZLIB,
+  MA_COMPRESSION_ZSTD
+};
+
+/* zstd level sent to the server if MARIADB_OPT_COMPRESSION_LEVEL
+   wasn't specified */
+#define MA_ZSTD_DEFAULT_LEVEL 3
+/* the level is sent as a single byte, servers accept up to 22 */
+#define MA_ZSTD_MAX_LEVEL 22
+
+typedef struct st_ma_compression_methods {
+  enum enum_ma_compression_type type;
+  const char *name;
+  /* client capability which needs to be negotiated with the server */
+  unsigned long capability;
+  /* range of MARIADB_OPT_COMPRESSION_LEVEL, 0 is always the default level */
+  unsigned int min_level;
+  unsigned int max_level;
+  void *(*init)(int level);
+  void (*deinit)(void *ctx);
+  /* returns 1 on error or if the data can't be compressed into dst_len bytes.
+     The context lives as long as the connection, so compress and decompress
+     don't need to allocate memory for each packet */
+  my_bool (*compress)(void *ctx, void *dst, size_t *dst_len,
+                      const void *source, size_t source_len);
+  my_bool (*decompress)(void *ctx, void *dst, size_t *dst_len,
+                        const void *source, size_t *source_len);
+} MA_COMPRESSION_METHODS;
+
+typedef struct st_ma_compression_ctx {
+  MA_COMPRESSION_METHODS *methods;
+  int level;
+  void *ctx;
+} MA_COMPRESSION_CTX;
+
+MA_COMPRESSION_METHODS *ma_compression_get_methods(const char *name);
+my_bool ma_compression_check_level(const char *algorithms, unsigned int level);
+MA_COMPRESSION_CTX *ma_compression_init(enum enum_ma_compression_type type,
+                                        int level);
+void ma_compression_end(MA_COMPRESSION_CTX *ctx);
+unsigned long ma_compression_negotiate(MYSQL *mysql);
+
+my_bool _mariadb_compress(NET *net, unsigned char *dst, size_t *complen,
+                          const unsigned char *packet, size_t len);
+my_bool _mariadb_uncompress(NET *net, unsigned char *dst,
+                            const unsigned char *packet,
+                            size_t *len, size_t *complen);
+
+#endif
@@ -37,6 +37,16 @@
 #define MY_CONTEXT_DISABLE
 #endif
 
+#if !defined(MY_CONTEXT_USE_WIN32_FIBERS) && !defined(MY_CONTEXT_DISABLE)
+/*
+  Stacks are taken from a process-wide pool when a call is spawned and
+  returned when it finished (see ma_context.c). Fibers allocate their own
+  stack.
+*/
+#define MY_CONTEXT_USE_STACK_POOL
+struct st_my_context_stack;
+#endif
+
 #ifdef MY_CONTEXT_USE_WIN32_FIBERS
 struct my_context {
   void (*user_func)(void *);
@@ -59,6 +69,7 @@ struct my_context {
   void *user_data;
   void *stack;
   size_t stack_size;
+  struct st_my_context_stack *pooled;
   ucontext_t base_context;
   ucontext_t spawned_context;
   int active;
@@ -79,6 +90,8 @@ struct my_context {
   uint64_t save[9];
   void *stack_top;
   void *stack_bot;
+  size_t stack_size;
+  struct st_my_context_stack *pooled;
 #ifdef HAVE_VALGRIND
   unsigned int valgrind_stack_id;
 #endif
@@ -96,6 +109,8 @@ struct my_context {
   uint64_t save[7];
   void *stack_top;
   void *stack_bot;
+  size_t stack_size;
+  struct st_my_context_stack *pooled;
 #ifdef HAVE_VALGRIND
   unsigned int valgrind_stack_id;
 #endif
@@ -113,7 +128,8 @@ struct my_context {
 #endif
 
 /*
-  Initialize an asynchroneous context object.
+  Initialize an asynchroneous context object. Unless fibers are used, the
+  stack is not allocated before my_context_spawn().
   Returns 0 on success, non-zero on failure.
 */
 extern int my_context_init(struct my_context *c, size_t stack_size);
@@ -165,6 +181,25 @@ extern int my_context_yield(struct my_context *c);
 */
 extern int my_context_continue(struct my_context *c);
 
+/*
+  Stack pool settings, set with mysql_optionsv(NULL, ...) before stacks
+  are allocated: my_context_stack_guard protects the lowest page of each
+  stack, my_context_stack_watermark fills stacks with a pattern to find
+  out how much of the stack was used.
+*/
+extern my_bool my_context_stack_guard;
+extern my_bool my_context_stack_watermark;
+
+/* Frees the stacks in the pool */
+extern void my_context_pool_end(void);
+
+/*
+  Number of stacks used by calls in flight, number of idle stacks in the
+  pool, and the highest stack usage seen (if watermarks are enabled).
+*/
+extern void my_context_pool_stats(unsigned int *in_use, unsigned int *pooled,
+                                  size_t *max_used);
+
 struct st_ma_pvio;
 
 struct mysql_async_context {
@@ -215,6 +250,21 @@ struct mysql_async_context {
     in progress.
   */
   my_bool suspended;
+  /*
+    State of a suspended stackless call (see mariadb_async.c). These calls
+    keep their progress here instead of on the stack of async_context:
+    sm_sent counts the bytes of the command in net->buff that were already
+    sent, sm_offset the bytes in the read ahead cache that were already
+    checked for complete packets, sm_packets the number of packets that
+    still have to arrive.
+  */
+  unsigned int sm_call;
+  unsigned int sm_state;
+  size_t sm_sent;
+  size_t sm_offset;
+  unsigned long sm_packets;
+  my_bool sm_header;
+  void *sm_result;
   /*
     If non-NULL, this is a pointer to a callback hook that will be invoked with
     the user data argument just before the context is suspended, and just after
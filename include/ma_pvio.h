@@ -11,9 +11,28 @@
 #define PVIO_SET_ERROR if (pvio->set_error) \
                         pvio->set_error
 
+/* initial size and default bounds of the read ahead cache, the size
+   adapts to the observed reads (see ma_pvio_cache_read) */
 #define PVIO_READ_AHEAD_CACHE_SIZE 16384
 #define PVIO_READ_AHEAD_CACHE_MIN_SIZE 2048
+#define PVIO_READ_AHEAD_CACHE_MAX_SIZE (1024 * 1024)
+/* number of consecutive small reads before the cache shrinks */
+#define PVIO_READ_AHEAD_CACHE_SHRINK_READS 8
+/* ms to wait for a writable socket before checking for input again */
+#define PVIO_WRITE_READING_SLICE 10
 #define PVIO_EINTR_TRIES 2
+/* maximum number of buffers for a gather write */
+#define PVIO_IOV_MAX 16
+
+#ifdef _WIN32
+typedef struct st_ma_iovec {
+  void *iov_base;
+  size_t iov_len;
+} MA_IOVEC;
+#else
+#include <sys/uio.h>
+typedef struct iovec MA_IOVEC;
+#endif
 
 struct st_ma_pvio_methods;
 typedef struct st_ma_pvio_methods PVIO_METHODS;
@@ -78,6 +97,13 @@ struct st_ma_pvio {
   PVIO_METHODS *methods;
   void (*set_error)(MYSQL *mysql, unsigned int error_nr, const char *sqlstate, const char *format, ...);
   void (*callback)(MARIADB_PVIO *pvio, my_bool is_read, const uchar *buffer, size_t length);
+  /* adaptive read ahead cache */
+  size_t cache_capacity;
+  size_t cache_min_size;
+  size_t cache_max_size;
+  ssize_t cache_last_read;
+  unsigned int cache_small_reads;
+  my_bool read_while_writing; /* see ma_pvio_write_reading */
 };
 
 typedef struct st_ma_pvio_cinfo
@@ -108,14 +134,17 @@ struct st_ma_pvio_methods
   my_bool (*is_alive)(MARIADB_PVIO *pvio);
   my_bool (*has_data)(MARIADB_PVIO *pvio, ssize_t *data_len);
   int(*shutdown)(MARIADB_PVIO *pvio);
+  ssize_t (*writev)(MARIADB_PVIO *pvio, const MA_IOVEC *iov, int iovcnt);
 };
 
 /* Function prototypes */
 MARIADB_PVIO *ma_pvio_init(MA_PVIO_CINFO *cinfo);
 void ma_pvio_close(MARIADB_PVIO *pvio);
 ssize_t ma_pvio_cache_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length);
+int ma_pvio_cache_fill(MARIADB_PVIO *pvio, size_t length);
 ssize_t ma_pvio_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length);
 ssize_t ma_pvio_write(MARIADB_PVIO *pvio, const uchar *buffer, size_t length);
+ssize_t ma_pvio_writev(MARIADB_PVIO *pvio, const MA_IOVEC *iov, int iovcnt);
 int ma_pvio_get_timeout(MARIADB_PVIO *pvio, enum enum_pvio_timeout type);
 my_bool ma_pvio_set_timeout(MARIADB_PVIO *pvio, enum enum_pvio_timeout type, int timeout);
 int ma_pvio_fast_send(MARIADB_PVIO *pvio);
@@ -130,4 +159,16 @@ my_bool ma_pvio_is_alive(MARIADB_PVIO *pvio);
 my_bool ma_pvio_get_handle(MARIADB_PVIO *pvio, void *handle);
 my_bool ma_pvio_has_data(MARIADB_PVIO *pvio, ssize_t *length);
 
+/* DNS cache, see ma_dns_cache.c */
+#define MA_DNS_CACHE_SIZE 256
+struct addrinfo;
+void ma_dns_cache_init(void);
+void ma_dns_cache_end(void);
+my_bool ma_dns_cache_get(const char *host, const char *port, unsigned int ttl,
+                         struct addrinfo **res, int *gai_rc);
+void ma_dns_cache_put(const char *host, const char *port,
+                      const struct addrinfo *res, int gai_rc);
+void ma_dns_cache_free(struct addrinfo *res);
+void ma_dns_cache_stats(MARIADB_DNS_STATS *stats);
+
 #endif /* _ma_pvio_h_ */
@@ -549,9 +549,6 @@ char *ma_strdup_root(MA_MEM_ROOT *root,const char *str);
 char *ma_memdup_root(MA_MEM_ROOT *root,const char *str, size_t len);
 void ma_free_defaults(char **argv);
 void ma_print_defaults(const char *conf_file, const char **groups);
-my_bool _mariadb_compress(unsigned char *, size_t *, size_t *);
-my_bool _mariadb_uncompress(unsigned char *, size_t *, size_t *);
-unsigned char *_mariadb_compress_alloc(const unsigned char *packet, size_t *len, size_t *complen);
 ulong checksum(const unsigned char *mem, uint count);
 
 #if defined(_MSC_VER) && !defined(_WIN32)
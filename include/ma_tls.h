@@ -14,6 +14,11 @@ typedef struct st_ma_pvio_tls {
   void *data;
   MARIADB_PVIO *pvio;
   void *ssl;
+  /* kernel TLS: records written to the socket are encrypted by the kernel,
+     so ma_pvio_write() can bypass the TLS library */
+  my_bool ktls_send;
+  /* kernel TLS decrypts received records, SSL_read() does no crypto */
+  my_bool ktls_recv;
 } MARIADB_TLS;
 
 struct st_ssl_version {
@@ -140,6 +145,32 @@ unsigned int ma_tls_get_finger_print(MARIADB_TLS *ctls, char *fp, unsigned int f
 */
 my_bool ma_tls_get_protocol_version(MARIADB_TLS *ctls, struct st_ssl_version *version);
 
+/* TLS session cache (ma_tls_session.c), shared by all TLS backends */
+#define MA_TLS_SESSION_KEY_LEN 20
+#define MA_TLS_SESSION_CACHE_SIZE 128
+/*
+  ma_tls_options() fills options with the MA_TLS_OPTIONS values which
+  select the TLS context (CA, CA path, certificate, key, cipher, TLS
+  version, CRL, CRL path and key passphrase), in a fixed order. They
+  are part of both the session cache key and the SSL_CTX cache key.
+*/
+#define MA_TLS_OPTIONS 9
+void ma_tls_options(MYSQL *mysql, const char **options);
+void ma_tls_session_cache_init(void);
+void ma_tls_session_cache_end(void);
+void ma_tls_session_key(MYSQL *mysql, unsigned char *key);
+my_bool ma_tls_session_get(const unsigned char *key, unsigned char **data,
+                           size_t *length);
+void ma_tls_session_put(const unsigned char *key, const unsigned char *data,
+                        size_t length, my_bool single_use);
+void ma_tls_session_resumed(void);
+void ma_tls_session_stats(MARIADB_TLS_SESSION_STATS *stats);
+
+#ifdef HAVE_OPENSSL
+/* SSL_CTX cache (secure/openssl.c) */
+void ma_tls_ctx_stats(MARIADB_TLS_CTX_STATS *stats);
+#endif
+
 /* Function prototypes */
 MARIADB_TLS *ma_pvio_tls_init(MYSQL *mysql);
 my_bool ma_pvio_tls_connect(MARIADB_TLS *ctls);
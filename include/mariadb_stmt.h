@@ -63,8 +63,18 @@ enum enum_stmt_attr_type
   STMT_ATTR_CURSOR_TYPE,
   STMT_ATTR_PREFETCH_ROWS,
   STMT_ATTR_PREBIND_PARAMS=200,
+  /*
+    Large arrays are sent in several packets. Inside a transaction a packet
+    is sent before the previous one was answered, so after an error the
+    rows of the next packet may be executed too: roll back on error.
+  */
   STMT_ATTR_ARRAY_SIZE,
-  STMT_ATTR_ROW_SIZE
+  STMT_ATTR_ROW_SIZE,
+  STMT_ATTR_FETCH_ARRAY_SIZE,
+  STMT_ATTR_FETCH_ROW_SIZE,
+  STMT_ATTR_STREAM_RESULT,
+  STMT_ATTR_STREAM_CALLBACK,
+  STMT_ATTR_STREAM_USER_DATA
 };
 
 enum enum_cursor_type
@@ -190,6 +200,14 @@ struct st_mysqlnd_stmt_methods
 
 typedef int  (*mysql_stmt_fetch_row_func)(MYSQL_STMT *stmt, unsigned char **row);
 
+/*
+  Receives a piece of a streamed column value (STMT_ATTR_STREAM_CALLBACK),
+  a non zero return value aborts the fetch of the row.
+*/
+typedef int (*mariadb_stmt_stream_callback)(MYSQL_STMT *stmt, unsigned int column,
+                                            const unsigned char *data, size_t length,
+                                            void *user_data);
+
 struct st_mysql_stmt
 {
   MA_MEM_ROOT              mem_root;
@@ -277,3 +295,4 @@ unsigned int STDCALL mysql_stmt_field_count(MYSQL_STMT *stmt);
 int STDCALL mysql_stmt_next_result(MYSQL_STMT *stmt);
 my_bool STDCALL mysql_stmt_more_results(MYSQL_STMT *stmt);
 int STDCALL mariadb_stmt_execute_direct(MYSQL_STMT *stmt, const char *stmt_str, size_t length);
+int STDCALL mariadb_stmt_fetch_batch(MYSQL_STMT *stmt, unsigned int *rows_fetched);
@@ -231,7 +231,18 @@ extern const char *SQLSTATE_UNKNOWN;
     MARIADB_OPT_FOUND_ROWS,
     MARIADB_OPT_MULTI_RESULTS,
     MARIADB_OPT_MULTI_STATEMENTS,
-    MARIADB_OPT_INTERACTIVE
+    MARIADB_OPT_INTERACTIVE,
+    MARIADB_OPT_COMPRESSION_ALGORITHMS,
+    MARIADB_OPT_COMPRESSION_LEVEL,
+    MARIADB_OPT_READ_AHEAD_MIN_SIZE,
+    MARIADB_OPT_READ_AHEAD_MAX_SIZE,
+    MARIADB_OPT_STMT_CACHE_SIZE,
+    MARIADB_OPT_ASYNC_STACK_GUARD,
+    MARIADB_OPT_ASYNC_STACK_WATERMARK,
+    MARIADB_OPT_RESULT_PREFETCH_ROWS,
+    MARIADB_OPT_TLS_KTLS,           /* hand TLS record encryption to the kernel (Linux, OpenSSL) */
+    MARIADB_OPT_DNS_CACHE_TTL,      /* seconds host name lookups are cached, 0 disables the cache */
+    MARIADB_OPT_STATS_TIMING        /* collect io_wait_ns and latency histograms */
   };
 
   enum mariadb_value {
@@ -268,7 +279,17 @@ extern const char *SQLSTATE_UNKNOWN;
     MARIADB_CONNECTION_SERVER_STATUS,
     MARIADB_CONNECTION_SERVER_CAPABILITIES,
     MARIADB_CONNECTION_EXTENDED_SERVER_CAPABILITIES,
-    MARIADB_CONNECTION_CLIENT_CAPABILITIES
+    MARIADB_CONNECTION_CLIENT_CAPABILITIES,
+    MARIADB_ASYNC_STACKS_IN_USE,
+    MARIADB_ASYNC_STACKS_POOLED,
+    MARIADB_ASYNC_STACK_MAX_USED,
+    MARIADB_CONNECTION_STATS,
+    MARIADB_CONNECTION_COMMAND_LATENCY,
+    MARIADB_TLS_SESSION_CACHE_STATS,
+    MARIADB_CONNECTION_TLS_KTLS,
+    MARIADB_DNS_CACHE_STATS,
+    MARIADB_CONNECTION_READ_AHEAD_SIZE,
+    MARIADB_TLS_CTX_CACHE_STATS
   };
 
   enum mysql_status { MYSQL_STATUS_READY,
@@ -288,6 +309,80 @@ extern const char *SQLSTATE_UNKNOWN;
     MYSQL_PROTOCOL_PIPE, MYSQL_PROTOCOL_MEMORY
   };
 
+  /*
+    Per connection statistics (MARIADB_CONNECTION_STATS), counted since
+    the connection was established or mariadb_reset_stats() was called.
+  */
+  typedef struct st_mariadb_stats {
+    unsigned long long bytes_sent;
+    unsigned long long bytes_received;
+    unsigned long long packets_sent;
+    unsigned long long packets_received;
+    unsigned long long write_calls;      /* send/write system calls */
+    unsigned long long read_calls;       /* recv/read system calls */
+    /* compressed protocol: payload before and after compression */
+    unsigned long long compressed_bytes_sent;
+    unsigned long long uncompressed_bytes_sent;
+    unsigned long long compressed_bytes_received;
+    unsigned long long uncompressed_bytes_received;
+    unsigned long long commands;         /* commands sent to the server */
+    unsigned long long round_trips;      /* commands which got a response */
+    unsigned long long io_wait_ns;       /* time spent in blocking reads and writes,
+                                            only with MARIADB_OPT_STATS_TIMING */
+    unsigned long long read_waits;       /* socket reads which had to wait for data */
+  } MARIADB_STATS;
+
+  /*
+    Number of buckets of the latency histogram (MARIADB_CONNECTION_COMMAND_LATENCY):
+    bucket 0 counts round trips below 1 microsecond, bucket n those between
+    2^(n-1) and 2^n microseconds, the last bucket all longer round trips.
+  */
+#define MARIADB_LATENCY_BUCKETS 24
+
+  /*
+    Directions offloaded to kernel TLS (MARIADB_CONNECTION_TLS_KTLS, unsigned int)
+  */
+#define MARIADB_KTLS_SEND 1
+#define MARIADB_KTLS_RECV 2
+
+  /*
+    Process wide TLS session cache statistics (MARIADB_TLS_SESSION_CACHE_STATS),
+    counted since the TLS library was initialized.
+  */
+  typedef struct st_mariadb_tls_session_stats {
+    unsigned long long hits;             /* cached session offered to the server */
+    unsigned long long misses;           /* no cached session found */
+    unsigned long long resumed;          /* handshakes which resumed a session */
+    unsigned long long stored;           /* sessions and tickets added */
+    unsigned long long evicted;          /* sessions dropped to bound the cache size */
+    unsigned long long entries;          /* sessions currently cached */
+  } MARIADB_TLS_SESSION_STATS;
+
+  /*
+    Process wide statistics of the TLS context cache (MARIADB_TLS_CTX_CACHE_STATS),
+    counted since the TLS library was initialized. OpenSSL only, zero otherwise.
+  */
+  typedef struct st_mariadb_tls_ctx_stats {
+    unsigned long long hits;             /* connections which used a cached context */
+    unsigned long long created;          /* contexts loaded from the TLS options */
+    unsigned long long reloaded;         /* contexts replaced since a file changed */
+    unsigned long long evicted;          /* contexts dropped to bound the cache size */
+    unsigned long long entries;          /* contexts currently cached */
+  } MARIADB_TLS_CTX_STATS;
+
+  /*
+    Process wide DNS cache statistics (MARIADB_DNS_CACHE_STATS), counted
+    since mysql_server_init().
+  */
+  typedef struct st_mariadb_dns_cache_stats {
+    unsigned long long hits;             /* addresses taken from the cache */
+    unsigned long long negative_hits;    /* cached failed lookups */
+    unsigned long long misses;           /* lookups which called getaddrinfo() */
+    unsigned long long stored;           /* lookup results added */
+    unsigned long long evicted;          /* entries dropped to bound the cache size */
+    unsigned long long entries;          /* entries currently cached */
+  } MARIADB_DNS_STATS;
+
 struct st_mysql_options {
     unsigned int connect_timeout, read_timeout, write_timeout;
     unsigned int port, protocol;
@@ -513,6 +608,8 @@ int		STDCALL mysql_query(MYSQL *mysql, const char *q);
 int		STDCALL mysql_send_query(MYSQL *mysql, const char *q,
 					 size_t length);
 my_bool	STDCALL mysql_read_query_result(MYSQL *mysql);
+int		STDCALL mariadb_pipeline_begin(MYSQL *mysql);
+int		STDCALL mariadb_pipeline_end(MYSQL *mysql);
 int		STDCALL mysql_real_query(MYSQL *mysql, const char *q,
 					 size_t length);
 int		STDCALL mysql_shutdown(MYSQL *mysql, enum mysql_enum_shutdown_level shutdown_level);
@@ -577,6 +674,7 @@ unsigned int STDCALL mysql_get_timeout_value(const MYSQL *mysql);
 unsigned int STDCALL mysql_get_timeout_value_ms(const MYSQL *mysql);
 my_bool STDCALL mariadb_reconnect(MYSQL *mysql);
 int STDCALL mariadb_cancel(MYSQL *mysql);
+void STDCALL mariadb_reset_stats(MYSQL *mysql);
 void STDCALL mysql_debug(const char *debug);
 unsigned long STDCALL mysql_net_read_packet(MYSQL *mysql);
 unsigned long STDCALL mysql_net_field_length(unsigned char **packet);
@@ -606,6 +704,20 @@ int STDCALL mysql_stmt_warning_count(MYSQL_STMT *stmt);
 int STDCALL mysql_stmt_next_result_start(int *ret, MYSQL_STMT *stmt);
 int STDCALL mysql_stmt_next_result_cont(int *ret, MYSQL_STMT *stmt, int status);
 
+/*
+  Event loop for the async API (see mariadb_reactor.c): the callback
+  continues the call for the events that occured and returns the new
+  status, 0 if the connection doesn't need to wait anymore.
+*/
+typedef struct st_mariadb_reactor MARIADB_REACTOR;
+typedef int (*mariadb_reactor_callback)(MYSQL *mysql, int ready_status, void *arg);
+
+MARIADB_REACTOR * STDCALL mariadb_reactor_init(void);
+int STDCALL mariadb_reactor_add(MARIADB_REACTOR *reactor, MYSQL *mysql, int status,
+                                mariadb_reactor_callback callback, void *arg);
+int STDCALL mariadb_reactor_run(MARIADB_REACTOR *reactor, int timeout);
+void STDCALL mariadb_reactor_end(MARIADB_REACTOR *reactor);
+
 int STDCALL mysql_set_character_set_start(int *ret, MYSQL *mysql,
                                                    const char *csname);
 int STDCALL mysql_set_character_set_cont(int *ret, MYSQL *mysql,
@@ -817,6 +929,10 @@ struct st_mariadb_api {
   my_bool (STDCALL *mysql_stmt_more_results)(MYSQL_STMT *stmt);
   int (STDCALL *mariadb_stmt_execute_direct)(MYSQL_STMT *stmt, const char *stmtstr, size_t length);
   int (STDCALL *mysql_reset_connection)(MYSQL *mysql);
+  int (STDCALL *mariadb_stmt_fetch_batch)(MYSQL_STMT *stmt, unsigned int *rows_fetched);
+  int (STDCALL *mariadb_pipeline_begin)(MYSQL *mysql);
+  int (STDCALL *mariadb_pipeline_end)(MYSQL *mysql);
+  void (STDCALL *mariadb_reset_stats)(MYSQL *mysql);
 };
   
 /* these methods can be overwritten by db plugins */
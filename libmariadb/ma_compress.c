@@ -22,67 +22,325 @@
 #ifdef HAVE_COMPRESS
 #include <ma_sys.h>
 #include <ma_string.h>
+#include <mysql.h>
+#include <ma_common.h>
+#include <ma_compress.h>
 #include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
-/*
-** This replaces the packet with a compressed packet
-** Returns 1 on error
-** *complen is 0 if the packet wasn't compressed
-*/
+/* zlib */
+typedef struct {
+  z_stream deflate_stream;
+  z_stream inflate_stream;
+} MA_ZLIB_CTX;
+
+static void ma_zlib_deinit(void *ctx)
+{
+  MA_ZLIB_CTX *zctx= (MA_ZLIB_CTX *)ctx;
+  if (!zctx)
+    return;
+  /* both functions are safe to call for streams which were not
+     initialized, since calloc cleared the state */
+  deflateEnd(&zctx->deflate_stream);
+  inflateEnd(&zctx->inflate_stream);
+  free(zctx);
+}
 
-my_bool _mariadb_compress(unsigned char *packet, size_t *len, size_t *complen)
+static void *ma_zlib_init(int level)
 {
-  if (*len < MIN_COMPRESS_LENGTH)
-    *complen=0;
-  else
+  MA_ZLIB_CTX *zctx;
+
+  if (!(zctx= (MA_ZLIB_CTX *)calloc(1, sizeof(MA_ZLIB_CTX))))
+    return NULL;
+  if (deflateInit(&zctx->deflate_stream,
+                  level ? level : Z_DEFAULT_COMPRESSION) != Z_OK ||
+      inflateInit(&zctx->inflate_stream) != Z_OK)
   {
-    unsigned char *compbuf=_mariadb_compress_alloc(packet,len,complen);
-    if (!compbuf)
-      return *complen ? 0 : 1;
-    memcpy(packet,compbuf,*len);
-    free(compbuf);
+    ma_zlib_deinit(zctx);
+    return NULL;
   }
+  return zctx;
+}
+
+static my_bool ma_zlib_compress(void *ctx, void *dst, size_t *dst_len,
+                                const void *source, size_t source_len)
+{
+  z_stream *stream= &((MA_ZLIB_CTX *)ctx)->deflate_stream;
+
+  if (deflateReset(stream) != Z_OK)
+    return 1;
+  stream->next_in= (Bytef *)source;
+  stream->avail_in= (uInt)source_len;
+  stream->next_out= (Bytef *)dst;
+  stream->avail_out= (uInt)*dst_len;
+  /* Z_OK or Z_BUF_ERROR indicate that dst is too small */
+  if (deflate(stream, Z_FINISH) != Z_STREAM_END)
+    return 1;
+  *dst_len= (size_t)stream->total_out;
   return 0;
 }
 
+static my_bool ma_zlib_decompress(void *ctx, void *dst, size_t *dst_len,
+                                  const void *source, size_t *source_len)
+{
+  z_stream *stream= &((MA_ZLIB_CTX *)ctx)->inflate_stream;
 
-unsigned char *_mariadb_compress_alloc(const unsigned char *packet, size_t *len, size_t *complen)
+  if (inflateReset(stream) != Z_OK)
+    return 1;
+  stream->next_in= (Bytef *)source;
+  stream->avail_in= (uInt)*source_len;
+  stream->next_out= (Bytef *)dst;
+  stream->avail_out= (uInt)*dst_len;
+  if (inflate(stream, Z_FINISH) != Z_STREAM_END)
+    return 1;
+  *dst_len= (size_t)stream->total_out;
+  return 0;
+}
+
+#ifdef HAVE_ZSTD
+/* zstd */
+typedef struct {
+  ZSTD_CCtx *cctx;
+  ZSTD_DCtx *dctx;
+  int level;
+} MA_ZSTD_CTX;
+
+static void ma_zstd_deinit(void *ctx)
+{
+  MA_ZSTD_CTX *zctx= (MA_ZSTD_CTX *)ctx;
+  if (!zctx)
+    return;
+  ZSTD_freeCCtx(zctx->cctx);
+  ZSTD_freeDCtx(zctx->dctx);
+  free(zctx);
+}
+
+static void *ma_zstd_init(int level)
 {
-  unsigned char *compbuf;
-  *complen =  *len * 120 / 100 + 12;
-  if (!(compbuf = (unsigned char *) malloc(*complen)))
-    return 0;					/* Not enough memory */
-  if (compress((Bytef*) compbuf,(ulong *) complen, (Bytef*) packet,
-	       (uLong) *len ) != Z_OK)
+  MA_ZSTD_CTX *zctx;
+
+  if (!(zctx= (MA_ZSTD_CTX *)calloc(1, sizeof(MA_ZSTD_CTX))))
+    return NULL;
+  if (!(zctx->cctx= ZSTD_createCCtx()) ||
+      !(zctx->dctx= ZSTD_createDCtx()))
   {
-    free(compbuf);
+    ma_zstd_deinit(zctx);
+    return NULL;
+  }
+  zctx->level= level ? level : MA_ZSTD_DEFAULT_LEVEL;
+  return zctx;
+}
+
+static my_bool ma_zstd_compress(void *ctx, void *dst, size_t *dst_len,
+                                const void *source, size_t source_len)
+{
+  MA_ZSTD_CTX *zctx= (MA_ZSTD_CTX *)ctx;
+  size_t rc= ZSTD_compressCCtx(zctx->cctx, dst, *dst_len, source, source_len,
+                               zctx->level);
+  if (ZSTD_isError(rc))
+    return 1;
+  *dst_len= rc;
+  return 0;
+}
+
+static my_bool ma_zstd_decompress(void *ctx, void *dst, size_t *dst_len,
+                                  const void *source, size_t *source_len)
+{
+  MA_ZSTD_CTX *zctx= (MA_ZSTD_CTX *)ctx;
+  size_t rc= ZSTD_decompressDCtx(zctx->dctx, dst, *dst_len, source,
+                                 *source_len);
+  if (ZSTD_isError(rc))
+    return 1;
+  *dst_len= rc;
+  return 0;
+}
+
+#endif /* HAVE_ZSTD */
+
+static MA_COMPRESSION_METHODS compression_methods[]=
+{
+  {MA_COMPRESSION_ZLIB, "zlib", CLIENT_COMPRESS, 1, 9,
+   ma_zlib_init, ma_zlib_deinit, ma_zlib_compress, ma_zlib_decompress},
+#ifdef HAVE_ZSTD
+  {MA_COMPRESSION_ZSTD, "zstd", CLIENT_ZSTD_COMPRESSION_ALGORITHM,
+   1, MA_ZSTD_MAX_LEVEL,
+   ma_zstd_init, ma_zstd_deinit, ma_zstd_compress, ma_zstd_decompress},
+#endif
+  {MA_COMPRESSION_NONE, NULL, 0, 0, 0, NULL, NULL, NULL, NULL}
+};
+
+MA_COMPRESSION_METHODS *ma_compression_get_methods(const char *name)
+{
+  MA_COMPRESSION_METHODS *methods;
+
+  for (methods= compression_methods; methods->name; methods++)
+    if (!strcasecmp(methods->name, name))
+      return methods;
+  return NULL;
+}
+
+/*
+  Checks if level can be used with the algorithms of a
+  MARIADB_OPT_COMPRESSION_ALGORITHMS list. Unless the list contains
+  "uncompressed", zlib might be negotiated as fallback and needs to accept
+  the level too. Level 0 selects the default level of the algorithm.
+  Returns 1 if the level is out of range for one of the algorithms.
+*/
+my_bool ma_compression_check_level(const char *algorithms, unsigned int level)
+{
+  MA_COMPRESSION_METHODS *methods;
+  const char *token, *end;
+  my_bool fallback= 1;
+
+  if (!level)
     return 0;
+  for (token= algorithms; token && *token; token= *end ? end + 1 : end)
+  {
+    char name[32];
+    size_t length;
+
+    while (*token == ' ')
+      token++;
+    if (!(end= strchr(token, ',')))
+      end= token + strlen(token);
+    if ((length= (size_t)(end - token)) >= sizeof(name))
+      continue;
+    memcpy(name, token, length);
+    name[length]= 0;
+    if (!strcasecmp(name, "uncompressed"))
+    {
+      fallback= 0;
+      break;
+    }
+    if ((methods= ma_compression_get_methods(name)) &&
+        (level < methods->min_level || level > methods->max_level))
+      return 1;
   }
-  if (*complen >= *len)
+  if (fallback)
   {
-    *complen=0;
-    free(compbuf);
-    return 0;
+    methods= ma_compression_get_methods("zlib");
+    return level < methods->min_level || level > methods->max_level;
   }
-  swap(size_t,*len,*complen);			/* *len is now packet length */
-  return compbuf;
+  return 0;
 }
 
-my_bool _mariadb_uncompress (unsigned char *packet, size_t *len, size_t *complen)
+MA_COMPRESSION_CTX *ma_compression_init(enum enum_ma_compression_type type,
+                                        int level)
 {
-  if (*complen)					/* If compressed */
+  MA_COMPRESSION_METHODS *methods;
+  MA_COMPRESSION_CTX *ctx;
+
+  for (methods= compression_methods; methods->name; methods++)
+    if (methods->type == type)
+      break;
+  if (!methods->name)
+    return NULL;
+
+  if (!(ctx= (MA_COMPRESSION_CTX *)calloc(1, sizeof(MA_COMPRESSION_CTX))))
+    return NULL;
+  ctx->methods= methods;
+  ctx->level= level;
+  if (!(ctx->ctx= methods->init(level)))
   {
-    unsigned char *compbuf = (unsigned char *) malloc (*complen);
-    if (!compbuf)
-      return 1;					/* Not enough memory */
-    if (uncompress((Bytef*) compbuf, (uLongf *)complen, (Bytef*) packet, (uLongf)*len) != Z_OK)
-    {						/* Probably wrong packet */
-      free(compbuf);
-      return 1;
+    free(ctx);
+    return NULL;
+  }
+  return ctx;
+}
+
+/*
+  Returns the capability flag of the first algorithm in
+  MARIADB_OPT_COMPRESSION_ALGORITHMS which is supported by client and
+  server. If none of them is available we fall back to zlib, unless
+  "uncompressed" was specified.
+*/
+unsigned long ma_compression_negotiate(MYSQL *mysql)
+{
+  char *algorithms, *token, *save;
+  unsigned long capability= 0;
+  my_bool fallback= 1;
+
+  if (!mysql->options.extension ||
+      !mysql->options.extension->compression_algorithms)
+    return mysql->server_capabilities & CLIENT_COMPRESS;
+
+  if (!(algorithms= strdup(mysql->options.extension->compression_algorithms)))
+    return mysql->server_capabilities & CLIENT_COMPRESS;
+
+  for (token= strtok_r(algorithms, ",", &save); token;
+       token= strtok_r(NULL, ",", &save))
+  {
+    MA_COMPRESSION_METHODS *methods;
+
+    while (*token == ' ')
+      token++;
+    if (!strcasecmp(token, "uncompressed"))
+    {
+      fallback= 0;
+      break;
+    }
+    if ((methods= ma_compression_get_methods(token)) &&
+        methods->capability &&
+        (mysql->server_capabilities & methods->capability))
+    {
+      capability= methods->capability;
+      break;
     }
+  }
+  free(algorithms);
+  if (!capability && fallback)
+    capability= mysql->server_capabilities & CLIENT_COMPRESS;
+  return capability;
+}
+
+void ma_compression_end(MA_COMPRESSION_CTX *ctx)
+{
+  if (!ctx)
+    return;
+  ctx->methods->deinit(ctx->ctx);
+  free(ctx);
+}
+
+/*
+** Compresses len bytes of packet into dst, which must have room for len
+** bytes. Returns 1 on error or if the packet can't be compressed into
+** less than len bytes, otherwise *complen is the compressed length.
+*/
+
+my_bool _mariadb_compress(NET *net, unsigned char *dst, size_t *complen,
+                          const unsigned char *packet, size_t len)
+{
+  MA_COMPRESSION_CTX *ctx= net->extension->compression;
+
+  if (len < MIN_COMPRESS_LENGTH)
+    return 1;
+  *complen= len;
+  if (ctx->methods->compress(ctx->ctx, dst, complen, packet, len) ||
+      *complen >= len)
+    return 1;
+  return 0;
+}
+
+/*
+** Decompresses *len bytes of packet into dst, which must have room for
+** *complen bytes. If *complen is 0 the packet wasn't compressed and is
+** already stored in dst.
+** Returns 1 on error, *len is the length of the uncompressed packet
+*/
+
+my_bool _mariadb_uncompress(NET *net, unsigned char *dst,
+                            const unsigned char *packet,
+                            size_t *len, size_t *complen)
+{
+  MA_COMPRESSION_CTX *ctx= net->extension->compression;
+
+  if (*complen)					/* If compressed */
+  {
+    if (ctx->methods->decompress(ctx->ctx, dst, complen, packet, len))
+      return 1;					/* Probably wrong packet */
     *len = *complen;
-    memcpy(packet,compbuf,*len);
-    free(compbuf);
   }
   else *complen= *len;
   return 0;
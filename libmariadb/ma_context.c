@@ -29,6 +29,229 @@
 #include <valgrind/valgrind.h>
 #endif
 
+#ifdef MY_CONTEXT_USE_STACK_POOL
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+  Process-wide pool of co-routine stacks.
+
+  A connection in non-blocking mode used to allocate its stack when
+  MYSQL_OPT_NONBLOCK was set and kept it until it was closed, even if it
+  was idle. Now my_context_spawn() takes a stack from the pool and it is
+  returned as soon as the spawned function returned, so only connections
+  with a suspended call hold a stack. Up to MY_CONTEXT_POOL_MAX idle
+  stacks are kept for reuse.
+
+  For sizing the stack (MYSQL_OPT_NONBLOCK), the lowest page of new
+  stacks can be protected, so an overflow crashes instead of corrupting
+  memory, and stacks can be filled with a pattern: when a stack is
+  returned, the lowest overwritten byte gives the stack usage.
+*/
+#define MY_CONTEXT_POOL_MAX 32
+#define MY_CONTEXT_STACK_FILL 0xA5
+
+struct st_my_context_stack {
+  struct st_my_context_stack *next;
+  unsigned char *mem;
+  size_t mem_size;
+  /* usable part of the stack, above the guard page */
+  unsigned char *bottom;
+  size_t size;
+  size_t requested_size;
+  my_bool guard;
+  my_bool watermark;
+};
+
+my_bool my_context_stack_guard= 0;
+my_bool my_context_stack_watermark= 0;
+
+static pthread_mutex_t LOCK_context_pool= PTHREAD_MUTEX_INITIALIZER;
+static struct st_my_context_stack *context_pool= NULL;
+static unsigned int context_pool_count= 0;
+static unsigned int context_stacks_in_use= 0;
+static size_t context_stack_max_used= 0;
+
+static void my_context_stack_free(struct st_my_context_stack *s)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  if (s->guard)
+    munmap(s->mem, s->mem_size);
+  else
+#endif
+    free(s->mem);
+  free(s);
+}
+
+static struct st_my_context_stack *my_context_stack_alloc(size_t stack_size)
+{
+  struct st_my_context_stack *s;
+
+  if (!(s= (struct st_my_context_stack *)calloc(1, sizeof(*s))))
+    return NULL;
+  s->requested_size= stack_size;
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  if (my_context_stack_guard)
+  {
+    size_t page= (size_t)sysconf(_SC_PAGESIZE);
+
+    s->mem_size= page + ((stack_size + page - 1) & ~(page - 1));
+    s->mem= (unsigned char *)mmap(NULL, s->mem_size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (s->mem == (unsigned char *)MAP_FAILED)
+    {
+      free(s);
+      return NULL;
+    }
+    if (mprotect(s->mem, page, PROT_NONE))
+    {
+      munmap(s->mem, s->mem_size);
+      free(s);
+      return NULL;
+    }
+    s->guard= 1;
+    s->bottom= s->mem + page;
+    s->size= s->mem_size - page;
+  }
+  else
+#endif
+  {
+    if (!(s->mem= (unsigned char *)malloc(stack_size)))
+    {
+      free(s);
+      return NULL;
+    }
+    s->mem_size= s->size= stack_size;
+    s->bottom= s->mem;
+  }
+  if (my_context_stack_watermark)
+  {
+    memset(s->bottom, MY_CONTEXT_STACK_FILL, s->size);
+    s->watermark= 1;
+  }
+  return s;
+}
+
+/* Gets a stack for c->stack_size from the pool. Returns 0 on success */
+static int my_context_stack_acquire(struct my_context *c)
+{
+  struct st_my_context_stack **prev, *s;
+
+  if (c->pooled)
+    return 0;
+  pthread_mutex_lock(&LOCK_context_pool);
+  for (prev= &context_pool; (s= *prev); prev= &s->next)
+  {
+    if (s->requested_size == c->stack_size)
+    {
+      *prev= s->next;
+      context_pool_count--;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&LOCK_context_pool);
+  if (!s && !(s= my_context_stack_alloc(c->stack_size)))
+    return -1;
+  s->next= NULL;
+  pthread_mutex_lock(&LOCK_context_pool);
+  context_stacks_in_use++;
+  pthread_mutex_unlock(&LOCK_context_pool);
+  c->pooled= s;
+#ifdef HAVE_VALGRIND
+  c->valgrind_stack_id=
+    VALGRIND_STACK_REGISTER(s->bottom, s->bottom + s->size);
+#endif
+  return 0;
+}
+
+/* Returns the stack of c to the pool */
+static void my_context_stack_release(struct my_context *c)
+{
+  struct st_my_context_stack *s= c->pooled;
+  size_t used= 0;
+
+  if (!s)
+    return;
+  c->pooled= NULL;
+#ifdef HAVE_VALGRIND
+  VALGRIND_STACK_DEREGISTER(c->valgrind_stack_id);
+#endif
+  if (s->watermark)
+  {
+    unsigned char *p= s->bottom, *end= s->bottom + s->size;
+
+    while (p < end && *p == MY_CONTEXT_STACK_FILL)
+      p++;
+    used= end - p;
+    /* refill the used part for the next call */
+    memset(p, MY_CONTEXT_STACK_FILL, used);
+  }
+  pthread_mutex_lock(&LOCK_context_pool);
+  context_stacks_in_use--;
+  if (used > context_stack_max_used)
+    context_stack_max_used= used;
+  if (context_pool_count < MY_CONTEXT_POOL_MAX &&
+      s->guard == my_context_stack_guard &&
+      s->watermark == my_context_stack_watermark)
+  {
+    s->next= context_pool;
+    context_pool= s;
+    context_pool_count++;
+    s= NULL;
+  }
+  pthread_mutex_unlock(&LOCK_context_pool);
+  if (s)
+    my_context_stack_free(s);
+}
+
+void my_context_pool_end(void)
+{
+  struct st_my_context_stack *s;
+
+  pthread_mutex_lock(&LOCK_context_pool);
+  while ((s= context_pool))
+  {
+    context_pool= s->next;
+    my_context_stack_free(s);
+  }
+  context_pool_count= 0;
+  pthread_mutex_unlock(&LOCK_context_pool);
+}
+
+void my_context_pool_stats(unsigned int *in_use, unsigned int *pooled,
+                           size_t *max_used)
+{
+  pthread_mutex_lock(&LOCK_context_pool);
+  *in_use= context_stacks_in_use;
+  *pooled= context_pool_count;
+  *max_used= context_stack_max_used;
+  pthread_mutex_unlock(&LOCK_context_pool);
+}
+
+#else
+
+my_bool my_context_stack_guard= 0;
+my_bool my_context_stack_watermark= 0;
+
+void my_context_pool_end(void)
+{
+}
+
+void my_context_pool_stats(unsigned int *in_use, unsigned int *pooled,
+                           size_t *max_used)
+{
+  *in_use= *pooled= 0;
+  *max_used= 0;
+}
+
+#endif /* MY_CONTEXT_USE_STACK_POOL */
+
 #ifdef MY_CONTEXT_USE_UCONTEXT
 /*
   The makecontext() only allows to pass integers into the created context :-(
@@ -81,6 +304,8 @@ my_context_continue(struct my_context *c)
     return -1;
   }
 
+  if (!c->active)
+    my_context_stack_release(c);
   return c->active;
 }
 
@@ -91,11 +316,17 @@ my_context_spawn(struct my_context *c, void (*f)(void *), void *d)
   int err;
   union pass_void_ptr_as_2_int u;
 
+  if (my_context_stack_acquire(c))
+    return -1;
   err= getcontext(&c->spawned_context);
   if (err)
+  {
+    my_context_stack_release(c);
     return -1;
+  }
+  c->stack= c->pooled->bottom;
   c->spawned_context.uc_stack.ss_sp= c->stack;
-  c->spawned_context.uc_stack.ss_size= c->stack_size;
+  c->spawned_context.uc_stack.ss_size= c->pooled->size;
   c->spawned_context.uc_link= NULL;
   c->user_func= f;
   c->user_data= d;
@@ -130,26 +361,14 @@ my_context_init(struct my_context *c, size_t stack_size)
 #endif
 
   memset(c, 0, sizeof(*c));
-  if (!(c->stack= malloc(stack_size)))
-    return -1;                                  /* Out of memory */
   c->stack_size= stack_size;
-#ifdef HAVE_VALGRIND
-  c->valgrind_stack_id=
-    VALGRIND_STACK_REGISTER(c->stack, ((unsigned char *)(c->stack))+stack_size);
-#endif
   return 0;
 }
 
 void
 my_context_destroy(struct my_context *c)
 {
-  if (c->stack)
-  {
-#ifdef HAVE_VALGRIND
-    VALGRIND_STACK_DEREGISTER(c->valgrind_stack_id);
-#endif
-    free(c->stack);
-  }
+  my_context_stack_release(c);
 }
 
 #endif  /* MY_CONTEXT_USE_UCONTEXT */
@@ -189,6 +408,17 @@ my_context_spawn(struct my_context *c, void (*f)(void *), void *d)
 {
   int ret;
 
+  if (my_context_stack_acquire(c))
+    return -1;
+  /*
+    The ABI specifies 16-byte stack alignment.
+    Also put two zero words at the top of the stack.
+  */
+  c->stack_bot= c->pooled->bottom;
+  c->stack_top= (void *)
+    (( ((intptr)c->stack_bot + c->pooled->size) & ~(intptr)0xf) - 16);
+  memset(c->stack_top, 0, 16);
+
   /*
     There are 6 callee-save registers we need to save and restore when
     suspending and continuing, plus stack pointer %rsp and instruction pointer
@@ -250,6 +480,8 @@ my_context_spawn(struct my_context *c, void (*f)(void *), void *d)
      : "rcx", "rdx", "r8", "r9", "r10", "r11", "memory", "cc"
   );
 
+  if (!ret)
+    my_context_stack_release(c);
   return ret;
 }
 
@@ -315,6 +547,8 @@ my_context_continue(struct my_context *c)
      : "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11", "memory", "cc"
         );
 
+  if (!ret)
+    my_context_stack_release(c);
   return ret;
 }
 
@@ -363,34 +597,14 @@ int
 my_context_init(struct my_context *c, size_t stack_size)
 {
   memset(c, 0, sizeof(*c));
-
-  if (!(c->stack_bot= malloc(stack_size)))
-    return -1;                                  /* Out of memory */
-  /*
-    The x86_64 ABI specifies 16-byte stack alignment.
-    Also put two zero words at the top of the stack.
-  */
-  c->stack_top= (void *)
-    (( ((intptr)c->stack_bot + stack_size) & ~(intptr)0xf) - 16);
-  memset(c->stack_top, 0, 16);
-
-#ifdef HAVE_VALGRIND
-  c->valgrind_stack_id=
-    VALGRIND_STACK_REGISTER(c->stack_bot, c->stack_top);
-#endif
+  c->stack_size= stack_size;
   return 0;
 }
 
 void
 my_context_destroy(struct my_context *c)
 {
-  if (c->stack_bot)
-  {
-    free(c->stack_bot);
-#ifdef HAVE_VALGRIND
-    VALGRIND_STACK_DEREGISTER(c->valgrind_stack_id);
-#endif
-  }
+  my_context_stack_release(c);
 }
 
 #endif  /* MY_CONTEXT_USE_X86_64_GCC_ASM */
@@ -428,6 +642,17 @@ my_context_spawn(struct my_context *c, void (*f)(void *), void *d)
 {
   int ret;
 
+  if (my_context_stack_acquire(c))
+    return -1;
+  /*
+    The ABI specifies 16-byte stack alignment.
+    Also put two zero words at the top of the stack.
+  */
+  c->stack_bot= c->pooled->bottom;
+  c->stack_top= (void *)
+    (( ((intptr)c->stack_bot + c->pooled->size) & ~(intptr)0xf) - 16);
+  memset(c->stack_top, 0, 16);
+
   /*
     There are 4 callee-save registers we need to save and restore when
     suspending and continuing, plus stack pointer %esp and instruction pointer
@@ -488,6 +713,8 @@ my_context_spawn(struct my_context *c, void (*f)(void *), void *d)
      : "memory", "cc"
   );
 
+  if (!ret)
+    my_context_stack_release(c);
   return ret;
 }
 
@@ -549,6 +776,8 @@ my_context_continue(struct my_context *c)
      : "ecx", "edx", "memory", "cc"
         );
 
+  if (!ret)
+    my_context_stack_release(c);
   return ret;
 }
 
@@ -595,29 +824,14 @@ int
 my_context_init(struct my_context *c, size_t stack_size)
 {
   memset(c, 0, sizeof(*c));
-  if (!(c->stack_bot= malloc(stack_size)))
-    return -1;                                  /* Out of memory */
-  c->stack_top= (void *)
-    (( ((intptr)c->stack_bot + stack_size) & ~(intptr)0xf) - 16);
-  memset(c->stack_top, 0, 16);
-
-#ifdef HAVE_VALGRIND
-  c->valgrind_stack_id=
-    VALGRIND_STACK_REGISTER(c->stack_bot, c->stack_top);
-#endif
+  c->stack_size= stack_size;
   return 0;
 }
 
 void
 my_context_destroy(struct my_context *c)
 {
-  if (c->stack_bot)
-  {
-    free(c->stack_bot);
-#ifdef HAVE_VALGRIND
-    VALGRIND_STACK_DEREGISTER(c->valgrind_stack_id);
-#endif
-  }
+  my_context_stack_release(c);
 }
 
 #endif  /* MY_CONTEXT_USE_I386_GCC_ASM */
@@ -0,0 +1,321 @@
+/************************************************************************************
+  Copyright (C) 2018 MariaDB Corporation AB
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not see <http://www.gnu.org/licenses>
+  or write to the Free Software Foundation, Inc.,
+  51 Franklin St., Fifth Floor, Boston, MA 02110, USA
+
+ *************************************************************************************/
+
+/*
+  DNS resolution cache
+
+  Connections which set MARIADB_OPT_DNS_CACHE_TTL look up the addresses
+  of host and port here before calling getaddrinfo(), and store the
+  result of getaddrinfo() afterwards. The cache is shared by all
+  connections of the process, an entry is valid for the TTL of the
+  connection which looks it up. getaddrinfo() doesn't report the TTL of
+  the DNS records, so the TTL is the one of the option.
+
+  Failed lookups (unknown host) are cached as well, for at most
+  MA_DNS_CACHE_NEGATIVE_TTL seconds. Temporary failures (EAI_AGAIN) are
+  never cached.
+
+  Entries are kept in a hash (ma_hash) keyed by host and port only:
+  all lookups use the same hints (TCP, any address family). The cache
+  holds at most MA_DNS_CACHE_SIZE entries, the least recently used one
+  is evicted first. Lookups return a copy of the addresses, which must
+  be freed with ma_dns_cache_free().
+
+  All functions are thread safe. The cache is initialized by
+  mysql_server_init() and freed by mysql_server_end().
+*/
+
+#include <ma_global.h>
+#include <ma_sys.h>
+#include <ma_common.h>
+#include <ma_pthread.h>
+#include <ma_hash.h>
+#include <ma_list.h>
+#include <ma_pvio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#else
+#include <ws2tcpip.h>
+#endif
+
+#define MA_DNS_CACHE_NEGATIVE_TTL 5
+
+extern unsigned long long ma_stats_now(void);
+
+typedef struct st_ma_dns_address {
+  int family;
+  int socktype;
+  int protocol;
+  size_t length;
+  struct sockaddr_storage addr;
+} MA_DNS_ADDRESS;
+
+typedef struct st_ma_dns_entry {
+  LIST list;
+  unsigned long long resolved; /* ma_stats_now() of the lookup */
+  int gai_rc;                  /* error of a failed lookup */
+  unsigned int count;
+  MA_DNS_ADDRESS *addresses;   /* follow the entry */
+  size_t key_length;
+  char *key;                   /* host\0port, follows the addresses */
+} MA_DNS_ENTRY;
+
+static pthread_mutex_t LOCK_dns_cache;
+static my_bool ma_dns_cache_initialized= FALSE;
+static HASH ma_dns_cache_entries;
+static LIST *ma_dns_cache_newest= NULL, /* most recently used first */
+            *ma_dns_cache_oldest= NULL; /* next entry to evict */
+static MARIADB_DNS_STATS ma_dns_cache_counters;
+
+static uchar *ma_dns_cache_get_key(const uchar *record, uint *length,
+                                   my_bool not_used __attribute__((unused)))
+{
+  MA_DNS_ENTRY *entry= (MA_DNS_ENTRY *)record;
+  *length= (uint)entry->key_length;
+  return (uchar *)entry->key;
+}
+
+static size_t ma_dns_cache_key(char *key, const char *host, const char *port)
+{
+  size_t host_length= strlen(host),
+         port_length= strlen(port);
+
+  memcpy(key, host, host_length + 1);
+  memcpy(key + host_length + 1, port, port_length + 1);
+  return host_length + port_length + 2;
+}
+
+static void ma_dns_cache_unlink(MA_DNS_ENTRY *entry)
+{
+  if (ma_dns_cache_oldest == &entry->list)
+    ma_dns_cache_oldest= entry->list.prev;
+  ma_dns_cache_newest= list_delete(ma_dns_cache_newest, &entry->list);
+}
+
+static void ma_dns_cache_link_first(MA_DNS_ENTRY *entry)
+{
+  entry->list.data= entry;
+  ma_dns_cache_newest= list_add(ma_dns_cache_newest, &entry->list);
+  if (!ma_dns_cache_oldest)
+    ma_dns_cache_oldest= &entry->list;
+}
+
+/* removes the entry from the LRU list and the hash, which frees it */
+static void ma_dns_cache_delete(MA_DNS_ENTRY *entry)
+{
+  ma_dns_cache_unlink(entry);
+  hash_delete(&ma_dns_cache_entries, (uchar *)entry);
+  ma_dns_cache_counters.entries= ma_dns_cache_entries.records;
+}
+
+/* builds an addrinfo list of the cached addresses in one allocation */
+static struct addrinfo *ma_dns_cache_copy(const MA_DNS_ENTRY *entry)
+{
+  struct addrinfo *res;
+  struct sockaddr_storage *addr;
+  unsigned int i;
+
+  if (!(res= (struct addrinfo *)calloc(entry->count, sizeof(struct addrinfo) +
+                                                     sizeof(struct sockaddr_storage))))
+    return NULL;
+  addr= (struct sockaddr_storage *)(res + entry->count);
+  for (i=0; i < entry->count; i++)
+  {
+    res[i].ai_family= entry->addresses[i].family;
+    res[i].ai_socktype= entry->addresses[i].socktype;
+    res[i].ai_protocol= entry->addresses[i].protocol;
+    res[i].ai_addrlen= entry->addresses[i].length;
+    memcpy(&addr[i], &entry->addresses[i].addr, entry->addresses[i].length);
+    res[i].ai_addr= (struct sockaddr *)&addr[i];
+    res[i].ai_next= i + 1 < entry->count ? &res[i + 1] : NULL;
+  }
+  return res;
+}
+
+void ma_dns_cache_init(void)
+{
+  if (ma_dns_cache_initialized)
+    return;
+  if (_hash_init(&ma_dns_cache_entries, MA_DNS_CACHE_SIZE, 0, 0,
+                 ma_dns_cache_get_key, free, 0))
+    return;
+  pthread_mutex_init(&LOCK_dns_cache, NULL);
+  ma_dns_cache_initialized= TRUE;
+}
+
+void ma_dns_cache_end(void)
+{
+  if (!ma_dns_cache_initialized)
+    return;
+  hash_free(&ma_dns_cache_entries);
+  ma_dns_cache_newest= ma_dns_cache_oldest= NULL;
+  memset(&ma_dns_cache_counters, 0, sizeof(MARIADB_DNS_STATS));
+  pthread_mutex_destroy(&LOCK_dns_cache);
+  ma_dns_cache_initialized= FALSE;
+}
+
+/*
+  Looks up host and port in the cache, entries older than ttl seconds are
+  dropped. Returns 1 if nothing was found. Otherwise *gai_rc is the cached
+  result of getaddrinfo(): 0 with a copy of the addresses in *res, or the
+  error of a failed lookup.
+*/
+my_bool ma_dns_cache_get(const char *host, const char *port, unsigned int ttl,
+                         struct addrinfo **res, int *gai_rc)
+{
+  MA_DNS_ENTRY *entry;
+  char key[NI_MAXHOST + NI_MAXSERV + 2];
+  size_t key_length;
+  unsigned long long now;
+  my_bool rc= 1;
+
+  if (!ma_dns_cache_initialized || !ttl || !host || !port ||
+      strlen(host) >= NI_MAXHOST || strlen(port) >= NI_MAXSERV)
+    return 1;
+  key_length= ma_dns_cache_key(key, host, port);
+  now= ma_stats_now();
+
+  pthread_mutex_lock(&LOCK_dns_cache);
+  if ((entry= (MA_DNS_ENTRY *)hash_search(&ma_dns_cache_entries, (uchar *)key,
+                                          (uint)key_length)))
+  {
+    if (entry->gai_rc && ttl > MA_DNS_CACHE_NEGATIVE_TTL)
+      ttl= MA_DNS_CACHE_NEGATIVE_TTL;
+    if (now - entry->resolved >= (unsigned long long)ttl * 1000000000ULL)
+      ma_dns_cache_delete(entry);
+    else if (entry->gai_rc)
+    {
+      *res= NULL;
+      *gai_rc= entry->gai_rc;
+      ma_dns_cache_counters.negative_hits++;
+      rc= 0;
+    }
+    else if ((*res= ma_dns_cache_copy(entry)))
+    {
+      ma_dns_cache_unlink(entry);
+      ma_dns_cache_link_first(entry);
+      *gai_rc= 0;
+      ma_dns_cache_counters.hits++;
+      rc= 0;
+    }
+  }
+  if (rc)
+    ma_dns_cache_counters.misses++;
+  pthread_mutex_unlock(&LOCK_dns_cache);
+  return rc;
+}
+
+/* stores the result of getaddrinfo() for host and port */
+void ma_dns_cache_put(const char *host, const char *port,
+                      const struct addrinfo *res, int gai_rc)
+{
+  MA_DNS_ENTRY *entry, *old;
+  const struct addrinfo *ai;
+  char key[NI_MAXHOST + NI_MAXSERV + 2];
+  size_t key_length;
+  unsigned int count= 0;
+
+  /* temporary failures are not cached */
+  if (!ma_dns_cache_initialized || !host || !port ||
+      strlen(host) >= NI_MAXHOST || strlen(port) >= NI_MAXSERV ||
+      gai_rc == EAI_AGAIN || gai_rc == EAI_MEMORY ||
+#ifdef EAI_SYSTEM
+      gai_rc == EAI_SYSTEM ||
+#endif
+      (!gai_rc && !res))
+    return;
+
+  if (!gai_rc)
+    for (ai= res; ai; ai= ai->ai_next)
+      if (ai->ai_addrlen <= sizeof(struct sockaddr_storage))
+        count++;
+  key_length= ma_dns_cache_key(key, host, port);
+  if (!(entry= (MA_DNS_ENTRY *)malloc(sizeof(MA_DNS_ENTRY) +
+                                      count * sizeof(MA_DNS_ADDRESS) + key_length)))
+    return;
+  entry->addresses= (MA_DNS_ADDRESS *)(entry + 1);
+  entry->key= (char *)(entry->addresses + count);
+  memcpy(entry->key, key, key_length);
+  entry->key_length= key_length;
+  entry->resolved= ma_stats_now();
+  entry->gai_rc= gai_rc;
+  entry->count= 0;
+  for (ai= gai_rc ? NULL : res; ai; ai= ai->ai_next)
+  {
+    MA_DNS_ADDRESS *address= &entry->addresses[entry->count];
+
+    if (ai->ai_addrlen > sizeof(struct sockaddr_storage))
+      continue;
+    address->family= ai->ai_family;
+    address->socktype= ai->ai_socktype;
+    address->protocol= ai->ai_protocol;
+    address->length= ai->ai_addrlen;
+    memcpy(&address->addr, ai->ai_addr, ai->ai_addrlen);
+    entry->count++;
+  }
+  if (!gai_rc && !entry->count)
+  {
+    free(entry);
+    return;
+  }
+
+  pthread_mutex_lock(&LOCK_dns_cache);
+  /* a new lookup replaces the previous one */
+  if ((old= (MA_DNS_ENTRY *)hash_search(&ma_dns_cache_entries, (uchar *)key,
+                                        (uint)key_length)))
+    ma_dns_cache_delete(old);
+  if (hash_insert(&ma_dns_cache_entries, (uchar *)entry))
+  {
+    pthread_mutex_unlock(&LOCK_dns_cache);
+    free(entry);
+    return;
+  }
+  ma_dns_cache_link_first(entry);
+  ma_dns_cache_counters.stored++;
+
+  if (ma_dns_cache_entries.records > MA_DNS_CACHE_SIZE)
+  {
+    ma_dns_cache_delete((MA_DNS_ENTRY *)ma_dns_cache_oldest->data);
+    ma_dns_cache_counters.evicted++;
+  }
+  ma_dns_cache_counters.entries= ma_dns_cache_entries.records;
+  pthread_mutex_unlock(&LOCK_dns_cache);
+}
+
+/* frees addresses returned by ma_dns_cache_get() */
+void ma_dns_cache_free(struct addrinfo *res)
+{
+  free(res);
+}
+
+void ma_dns_cache_stats(MARIADB_DNS_STATS *stats)
+{
+  if (!ma_dns_cache_initialized)
+  {
+    memset(stats, 0, sizeof(MARIADB_DNS_STATS));
+    return;
+  }
+  pthread_mutex_lock(&LOCK_dns_cache);
+  *stats= ma_dns_cache_counters;
+  pthread_mutex_unlock(&LOCK_dns_cache);
+}
@@ -156,6 +156,9 @@ const char *mariadb_client_errors[] =
   /* 5003 */ "Server doesn't support function '%s'",
   /* 5004 */ "File '%s' not found (Errcode: %d)",
   /* 5005 */ "Error reading file '%s' (Errcode: %d)",
+  /* 5006 */ "Fetching column %u was aborted by the stream callback",
+  /* 5007 */ "Pipeline is full (%u commands, %lu bytes), pending results need to be read first",
+  /* 5008 */ "Bulk execution returned a result set after %u of %u rows",
   ""
 };
 
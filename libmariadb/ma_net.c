@@ -35,6 +35,7 @@
 #include <sys/types.h>
 #include <ma_pvio.h>
 #include <ma_common.h>
+#include <ma_compress.h>
 #ifndef _WIN32
 #include <poll.h>
 #endif
@@ -74,6 +75,9 @@ ulong net_buffer_length= 8192;	/* Default length. Enlarged if necessary */
  */
 
 static int ma_net_write_buff(NET *net,const char *packet, size_t len);
+static int ma_net_real_writev(NET *net, const char *packet, size_t len);
+extern void ma_stats_command(MA_STATS *stats, unsigned char command);
+extern void ma_stats_response(MA_STATS *stats, my_bool error);
 
 
 /* Init with packet info */
@@ -116,6 +120,17 @@ void ma_net_end(NET *net)
 {
   free(net->buff);
   net->buff=0;
+#ifdef HAVE_COMPRESS
+  if (net->extension)
+  {
+    ma_compression_end(net->extension->compression);
+    net->extension->compression= NULL;
+    free(net->extension->comp_buff);
+    net->extension->comp_buff= NULL;
+    net->extension->comp_buff_size= 0;
+  }
+  net->compress= 0;
+#endif
 }
 
 /* Realloc the packet buffer */
@@ -145,6 +160,25 @@ static my_bool net_realloc(NET *net, size_t length)
   return(0);
 }
 
+#ifdef HAVE_COMPRESS
+/* Returns the scratch buffer for compressed packets, which will be
+   reused for all further packets */
+static uchar *net_comp_buffer(NET *net, size_t length)
+{
+  if (length > net->extension->comp_buff_size)
+  {
+    uchar *buff;
+    size_t buff_size= (length + IO_SIZE - 1) & ~(IO_SIZE - 1);
+
+    if (!(buff= (uchar *)realloc(net->extension->comp_buff, buff_size)))
+      return NULL;
+    net->extension->comp_buff= buff;
+    net->extension->comp_buff_size= buff_size;
+  }
+  return net->extension->comp_buff;
+}
+#endif
+
 /* Remove unwanted characters from connection */
 void ma_net_clear(NET *net)
 {
@@ -189,6 +223,10 @@ int ma_net_flush(NET *net)
 int ma_net_write(NET *net, const uchar *packet, size_t len)
 {
   uchar buff[NET_HEADER_SIZE];
+  MA_STATS *stats;
+
+  if ((stats= MA_NET_STATS(net)))
+    stats->counters.packets_sent++;
   while (len >= MAX_PACKET_LENGTH)
   {
     const ulong max_len= MAX_PACKET_LENGTH;
@@ -217,7 +255,13 @@ int ma_net_write_command(NET *net, uchar command,
   size_t buff_size= NET_HEADER_SIZE + 1;
   size_t length= 1 + len; /* 1 extra byte for command */
   int rc;
+  MA_STATS *stats;
 
+  if ((stats= MA_NET_STATS(net)))
+  {
+    stats->counters.packets_sent++;
+    ma_stats_command(stats, command);
+  }
   buff[NET_HEADER_SIZE]= 0;
   buff[4]=command;
 
@@ -261,6 +305,10 @@ static int ma_net_write_buff(NET *net,const char *packet, size_t len)
 
   if (len > left_length)
   {
+    /* send pending data and packet with one gather write, so the packet
+       doesn't need to be copied into net->buff */
+    if (!net->compress)
+      return ma_net_real_writev(net, packet, len);
     if (net->write_pos != net->buff)
     {
       memcpy((char*) net->write_pos,packet,left_length);
@@ -311,18 +359,29 @@ int ma_net_real_write(NET *net, const char *packet, size_t len)
     size_t complen;
     uchar *b;
     uint header_length=NET_HEADER_SIZE+COMP_HEADER_SIZE;
-    if (!(b=(uchar*) malloc(len + NET_HEADER_SIZE + COMP_HEADER_SIZE + 1)))
+    MA_STATS *stats= MA_NET_STATS(net);
+    if (!(b= net_comp_buffer(net, len + header_length)))
     {
       net->last_errno=ER_OUT_OF_RESOURCES;
       net->error=2;
       net->reading_or_writing=0;
       return(1);
     }
-    memcpy(b+header_length,packet,len);
 
-    if (_mariadb_compress((unsigned char*) b+header_length,&len,&complen))
+    /* compress directly into the scratch buffer, if the packet can't be
+       compressed it will be sent uncompressed */
+    if (_mariadb_compress(net, b + header_length, &complen,
+                          (const uchar *)packet, len))
+    {
+      memcpy(b + header_length, packet, len);
+      complen= 0;
+    }
+    else
+      swap(size_t, len, complen);		/* len is now compressed length */
+    if (stats)
     {
-      complen=0;
+      stats->counters.uncompressed_bytes_sent+= complen ? complen : len;
+      stats->counters.compressed_bytes_sent+= len;
     }
     int3store(&b[NET_HEADER_SIZE],complen);
     int3store(b,len);
@@ -344,14 +403,59 @@ int ma_net_real_write(NET *net, const char *packet, size_t len)
     }
     pos+=length;
   }
-#ifdef HAVE_COMPRESS
-  if (net->compress)
-    free((char*) packet);
-#endif
   net->reading_or_writing=0;
   return(((int) (pos != end)));
 }
 
+/*
+  Writes the pending content of net->buff followed by packet. The packet
+  will be sent from its original location.
+*/
+static int ma_net_real_writev(NET *net, const char *packet, size_t len)
+{
+  MA_IOVEC iov[2], *io= iov;
+  int iovcnt= 0;
+  ssize_t length;
+
+  if (net->error == 2)
+    return(-1);				/* socket can't be used */
+
+  net->reading_or_writing=2;
+  if (net->write_pos != net->buff)
+  {
+    iov[iovcnt].iov_base= net->buff;
+    iov[iovcnt++].iov_len= (size_t)(net->write_pos - net->buff);
+  }
+  iov[iovcnt].iov_base= (void *)packet;
+  iov[iovcnt++].iov_len= len;
+
+  while (iovcnt)
+  {
+    if ((length= ma_pvio_writev(net->pvio, io, iovcnt)) <= 0)
+    {
+      net->error=2;				/* Close socket */
+      net->last_errno= ER_NET_ERROR_ON_WRITE;
+      net->reading_or_writing=0;
+      return(1);
+    }
+    /* skip buffers which were sent completely */
+    while (iovcnt && (size_t)length >= io->iov_len)
+    {
+      length-= io->iov_len;
+      io++;
+      iovcnt--;
+    }
+    if (iovcnt)
+    {
+      io->iov_base= (char *)io->iov_base + length;
+      io->iov_len-= length;
+    }
+  }
+  net->write_pos= net->buff;
+  net->reading_or_writing=0;
+  return(0);
+}
+
 /*****************************************************************************
  ** Read something from server/clinet
  *****************************************************************************/
@@ -410,6 +514,20 @@ static ulong ma_real_read(NET *net, size_t *complen)
         }
       }
       pos=net->buff + net->where_b;
+#ifdef HAVE_COMPRESS
+      /* compressed data will be read into the scratch buffer and
+         decompressed directly into net->buff by ma_net_read */
+      if (*complen)
+      {
+        if (!(pos= net_comp_buffer(net, len)))
+        {
+          net->error= 2;
+          net->last_errno= ER_OUT_OF_RESOURCES;
+          len= packet_error;
+          goto end;
+        }
+      }
+#endif
       remain = len;
     }
   }
@@ -419,7 +537,7 @@ end:
   return(len);
 }
 
-ulong ma_net_read(NET *net)
+static ulong ma_net_read_packet(NET *net, MA_STATS *stats)
 {
   size_t len,complen;
 
@@ -550,7 +668,11 @@ ulong ma_net_read(NET *net)
 
       if ((packet_length = ma_real_read(net,(size_t *)&complen)) == packet_error)
         return packet_error;
-      if (_mariadb_uncompress((unsigned char*) net->buff + net->where_b, &packet_length, &complen))
+      if (stats)
+        stats->counters.compressed_bytes_received+= packet_length;
+      if (_mariadb_uncompress(net, net->buff + net->where_b,
+                              net->extension->comp_buff,
+                              &packet_length, &complen))
       {
         len= packet_error;
         net->error=2;			/* caller will close socket */
@@ -558,6 +680,8 @@ ulong ma_net_read(NET *net)
         break;
         return packet_error;
       }
+      if (stats)
+        stats->counters.uncompressed_bytes_received+= complen;
       buffer_length+= complen;
     }
     /* set values */
@@ -574,6 +698,21 @@ ulong ma_net_read(NET *net)
   return (ulong)len;
 }
 
+ulong ma_net_read(NET *net)
+{
+  MA_STATS *stats= MA_NET_STATS(net);
+  ulong len= ma_net_read_packet(net, stats);
+
+  if (stats)
+  {
+    if (len != packet_error)
+      stats->counters.packets_received++;
+    if (stats->pending)
+      ma_stats_response(stats, len == packet_error);
+  }
+  return len;
+}
+
 int net_add_multi_command(NET *net, uchar command, const uchar *packet,
     size_t length)
 {
@@ -0,0 +1,413 @@
+/* Copyright (C) 2018 MariaDB Corporation AB
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA */
+
+/*
+  Read ahead of unbuffered result sets.
+
+  If MARIADB_OPT_RESULT_PREFETCH_ROWS is set, mysql_use_result() and the
+  unbuffered fetch of prepared statements start a reader thread, which
+  receives the row packets (including decompression and decryption) into
+  a ring of slots while the application processes the previous rows:
+
+    reader:   ma_net_read() -> copy into the next free slot -> ready++
+    consumer: mysql_fetch_row() / mysql_stmt_fetch() -> next ready slot
+
+  The reader waits if all slots are in use, the consumer if no row is
+  ready. A row stays valid until the next fetch, so the consumer holds
+  one slot and the ring has one slot more than rows are read ahead. To
+  keep the lock out of the per row path the consumer claims all ready
+  rows at once and returns used slots in batches.
+
+  The reader stops at the end of the result set, at an error packet or
+  if the connection failed. This last packet is left in the net buffer
+  and is checked by the consumer (ma_net_check_packet()) after the
+  thread was joined, so errors, progress reports and end_server() are
+  handled by the calling thread only. mysql_free_result() and flushing
+  a statement stop the reader and discard the rows which were read
+  ahead, the remaining rows are skipped as before.
+
+  While the reader runs, it owns NET and the PVIO of the connection,
+  including the read ahead cache. The application thread may fetch
+  rows of the result set, free it, call mariadb_get_infov() and
+  mariadb_reset_stats(). The statistics and the size of the read ahead
+  cache are passed by the reader under the lock. All other calls which
+  use the connection fail with CR_COMMANDS_OUT_OF_SYNC as for any
+  unbuffered result set, or stop the reader before they read or write.
+*/
+
+#include "ma_global.h"
+#include "ma_sys.h"
+#include "mysql.h"
+#include "ma_common.h"
+#include "ma_pvio.h"
+#include <string.h>
+
+ulong ma_net_check_packet(MYSQL *mysql, ulong len);
+void ma_stats_add(MARIADB_STATS *to, MARIADB_STATS *from);
+
+#ifndef _WIN32
+
+/* upper limit for MARIADB_OPT_RESULT_PREFETCH_ROWS */
+#define MA_PREFETCH_MAX_ROWS (1024 * 1024)
+
+typedef struct st_ma_prefetch_slot {
+  uchar *buffer;
+  size_t size;
+  ulong length;
+} MA_PREFETCH_SLOT;
+
+typedef struct st_ma_prefetch {
+  MYSQL *mysql;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t reader_cond;   /* slots were released */
+  pthread_cond_t consumer_cond; /* rows are ready or the reader finished */
+  MA_PREFETCH_SLOT *slots;
+  unsigned int size;
+  unsigned int release;         /* number of rows or slots passed at once */
+  /* protected by lock */
+  unsigned int ready;           /* rows read, not claimed by the consumer */
+  unsigned int free;            /* slots the reader may fill */
+  my_bool reader_waiting;
+  my_bool consumer_waiting;
+  my_bool abort;
+  my_bool done;
+  /* reader thread only, read by the consumer after the thread was joined */
+  MA_STATS stats;               /* added to the connection's stats under lock */
+  unsigned int tail;
+  my_bool pending;              /* the last packet is still in the net buffer */
+  ulong pending_length;
+  int pending_errno;
+  /* protected by lock, written by the reader */
+  size_t cache_capacity;        /* of the read ahead cache */
+  /* consumer only */
+  unsigned int head;
+  unsigned int claimed;         /* rows claimed, not returned yet */
+  unsigned int used;            /* returned rows, slots not released yet */
+  my_bool holding;              /* the last returned row is still in use */
+} MA_PREFETCH;
+
+/* the next packet can be read without waiting for the server */
+static my_bool ma_prefetch_buffered(NET *net)
+{
+  MARIADB_PVIO *pvio= net->pvio;
+
+  if (net->compress && net->remain_in_buf)
+    return 1;
+  return pvio->cache && pvio->cache_pos < pvio->cache + pvio->cache_size;
+}
+
+/* called by the reader with the lock held */
+static void ma_prefetch_publish(MA_PREFETCH *p, unsigned int rows)
+{
+  ma_stats_add(&p->mysql->extension->stats.counters, &p->stats.counters);
+  p->cache_capacity= p->mysql->net.pvio->cache_capacity;
+  p->ready+= rows;
+  if (p->consumer_waiting)
+    pthread_cond_signal(&p->consumer_cond);
+}
+
+static void *ma_prefetch_reader(void *arg)
+{
+  MA_PREFETCH *p= (MA_PREFETCH *)arg;
+  NET *net= &p->mysql->net;
+  MA_PREFETCH_SLOT *slot;
+  unsigned int free_slots= 0, unpublished= 0;
+  my_bool abort= 0;
+  ulong len;
+
+  while (!abort)
+  {
+    if (!free_slots)
+    {
+      pthread_mutex_lock(&p->lock);
+      ma_prefetch_publish(p, unpublished);
+      unpublished= 0;
+      while (!p->free && !p->abort)
+      {
+        p->reader_waiting= 1;
+        pthread_cond_wait(&p->reader_cond, &p->lock);
+        p->reader_waiting= 0;
+      }
+      free_slots= p->free;
+      p->free= 0;
+      abort= p->abort;
+      pthread_mutex_unlock(&p->lock);
+      if (abort)
+        break;
+    }
+
+    len= ma_net_read(net);
+    if (len == packet_error || len == 0 || net->read_pos[0] == 255 ||
+        (len <= 8 && net->read_pos[0] == 254))
+    {
+      /* end of result set or error: checked by the consumer */
+      p->pending= 1;
+      p->pending_length= len;
+      p->pending_errno= errno;
+      break;
+    }
+
+    slot= &p->slots[p->tail];
+    if (slot->size <= len)
+    {
+      /* text rows are terminated behind the last column */
+      uchar *buffer= (uchar *)realloc(slot->buffer, len + 1);
+      if (!buffer)
+      {
+        /* the consumer reads this and the remaining rows itself */
+        p->pending= 1;
+        p->pending_length= len;
+        break;
+      }
+      slot->buffer= buffer;
+      slot->size= len + 1;
+    }
+    memcpy(slot->buffer, net->read_pos, len);
+    slot->length= len;
+    if (++p->tail == p->size)
+      p->tail= 0;
+    free_slots--;
+
+    /* rows are passed in batches, unless the next read might block */
+    if (++unpublished >= p->release || !ma_prefetch_buffered(net))
+    {
+      pthread_mutex_lock(&p->lock);
+      ma_prefetch_publish(p, unpublished);
+      unpublished= 0;
+      abort= p->abort;
+      pthread_mutex_unlock(&p->lock);
+    }
+  }
+
+  pthread_mutex_lock(&p->lock);
+  p->done= 1;
+  ma_prefetch_publish(p, unpublished);
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+void ma_prefetch_start(MYSQL *mysql)
+{
+  MA_PREFETCH *p;
+  unsigned int rows= mysql->options.extension ?
+                     mysql->options.extension->result_prefetch_rows : 0;
+
+  /* the non-blocking API and connection handlers read on their own */
+  if (!rows || !mysql->net.pvio || mysql->extension->prefetch ||
+      mysql->extension->conn_hdlr || mysql->options.extension->async_context)
+    return;
+  rows= MIN(rows, MA_PREFETCH_MAX_ROWS);
+
+  /* if the reader can't be started, rows are read without it */
+  if (!(p= (MA_PREFETCH *)calloc(1, sizeof(MA_PREFETCH))))
+    return;
+  if (!(p->slots= (MA_PREFETCH_SLOT *)calloc(rows + 1, sizeof(MA_PREFETCH_SLOT))))
+  {
+    free(p);
+    return;
+  }
+  p->mysql= mysql;
+  p->size= rows + 1;
+  p->free= p->size;
+  p->release= MAX(1, p->size / 4);
+  p->cache_capacity= mysql->net.pvio->cache_capacity;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->reader_cond, NULL);
+  pthread_cond_init(&p->consumer_cond, NULL);
+  mysql->extension->io_stats= &p->stats;
+
+  if (pthread_create(&p->thread, NULL, ma_prefetch_reader, p))
+  {
+    mysql->extension->io_stats= NULL;
+    pthread_cond_destroy(&p->consumer_cond);
+    pthread_cond_destroy(&p->reader_cond);
+    pthread_mutex_destroy(&p->lock);
+    free(p->slots);
+    free(p);
+    return;
+  }
+  mysql->extension->prefetch= p;
+}
+
+/*
+  Stops the reader thread and releases the ring, rows which were not
+  fetched yet are discarded.
+  If the reader stopped at the end of the result set or at an error, this
+  packet is checked like ma_net_safe_read() does and its length is
+  returned. Otherwise 0 is returned and the remaining rows have to be read
+  from the connection.
+*/
+ulong ma_prefetch_end(MYSQL *mysql)
+{
+  MA_PREFETCH *p= mysql->extension->prefetch;
+  unsigned int i;
+  ulong len= 0;
+
+  pthread_mutex_lock(&p->lock);
+  p->abort= 1;
+  if (p->reader_waiting)
+    pthread_cond_signal(&p->reader_cond);
+  pthread_mutex_unlock(&p->lock);
+  pthread_join(p->thread, NULL);
+  mysql->extension->prefetch= NULL;
+  mysql->extension->io_stats= NULL;
+  ma_stats_add(&mysql->extension->stats.counters, &p->stats.counters);
+
+  if (p->pending)
+  {
+    errno= p->pending_errno;
+    len= ma_net_check_packet(mysql, p->pending_length);
+  }
+
+  for (i=0; i < p->size; i++)
+    free(p->slots[i].buffer);
+  free(p->slots);
+  pthread_cond_destroy(&p->consumer_cond);
+  pthread_cond_destroy(&p->reader_cond);
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+  return len;
+}
+
+static ulong ma_prefetch_read(MYSQL *mysql, uchar **packet)
+{
+  MA_PREFETCH *p= mysql->extension->prefetch;
+  MA_PREFETCH_SLOT *slot;
+  ulong len;
+
+  if (p->holding)
+  {
+    p->used++;
+    p->holding= 0;
+  }
+
+  if (!p->claimed || p->used >= p->release)
+  {
+    pthread_mutex_lock(&p->lock);
+    if (p->used)
+    {
+      p->free+= p->used;
+      p->used= 0;
+      if (p->reader_waiting)
+        pthread_cond_signal(&p->reader_cond);
+    }
+    if (!p->claimed)
+    {
+      while (!p->ready && !p->done)
+      {
+        p->consumer_waiting= 1;
+        pthread_cond_wait(&p->consumer_cond, &p->lock);
+        p->consumer_waiting= 0;
+      }
+      p->claimed= p->ready;
+      p->ready= 0;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (!p->claimed)
+    {
+      /* the reader stopped, continue with the packet it stopped at */
+      if (!(len= ma_prefetch_end(mysql)))
+        len= ma_net_safe_read(mysql);
+      *packet= mysql->net.read_pos;
+      return len;
+    }
+  }
+
+  slot= &p->slots[p->head];
+  if (++p->head == p->size)
+    p->head= 0;
+  p->claimed--;
+  p->holding= 1;
+  *packet= slot->buffer;
+  return slot->length;
+}
+
+/*
+  The reader adds its statistics to those of the connection while it
+  holds the lock, so the application thread reads or clears them under
+  the lock too.
+*/
+void ma_prefetch_lock(MYSQL *mysql)
+{
+  if (mysql->extension->prefetch)
+    pthread_mutex_lock(&mysql->extension->prefetch->lock);
+}
+
+void ma_prefetch_unlock(MYSQL *mysql)
+{
+  if (mysql->extension->prefetch)
+    pthread_mutex_unlock(&mysql->extension->prefetch->lock);
+}
+
+/* size of the read ahead cache, which the reader may resize */
+size_t ma_prefetch_cache_capacity(MYSQL *mysql)
+{
+  MA_PREFETCH *p= mysql->extension->prefetch;
+  size_t capacity;
+
+  if (!p)
+    return mysql->net.pvio->cache_capacity;
+  pthread_mutex_lock(&p->lock);
+  capacity= p->cache_capacity;
+  pthread_mutex_unlock(&p->lock);
+  return capacity;
+}
+
+#else
+
+void ma_prefetch_start(MYSQL *mysql __attribute__((unused)))
+{
+}
+
+ulong ma_prefetch_end(MYSQL *mysql __attribute__((unused)))
+{
+  return 0;
+}
+
+void ma_prefetch_lock(MYSQL *mysql __attribute__((unused)))
+{
+}
+
+void ma_prefetch_unlock(MYSQL *mysql __attribute__((unused)))
+{
+}
+
+size_t ma_prefetch_cache_capacity(MYSQL *mysql)
+{
+  return mysql->net.pvio->cache_capacity;
+}
+
+#endif /* _WIN32 */
+
+/*
+  Reads the next row packet of an unbuffered result set, either from the
+  reader thread or from the connection.
+*/
+ulong ma_read_row_packet(MYSQL *mysql, uchar **packet)
+{
+  ulong len;
+
+#ifndef _WIN32
+  if (mysql->extension->prefetch)
+    return ma_prefetch_read(mysql, packet);
+#endif
+  len= ma_net_safe_read(mysql);
+  *packet= mysql->net.read_pos;
+  return len;
+}
@@ -57,6 +57,10 @@
 /* callback functions for read/write */
 LIST *pvio_callback= NULL;
 
+extern unsigned long long ma_stats_now(void);
+extern void ma_stats_io(MA_STATS *stats, my_bool write, ssize_t r,
+                        unsigned long long start);
+
 #define IS_BLOCKING_ERROR()                   \
   IF_WIN(WSAGetLastError() != WSAEWOULDBLOCK, \
          (errno != EAGAIN && errno != EINTR))
@@ -123,7 +127,21 @@ MARIADB_PVIO *ma_pvio_init(MA_PVIO_CINFO *cinfo)
     pvio->methods->set_timeout(pvio, PVIO_WRITE_TIMEOUT, cinfo->mysql->options.connect_timeout);
   }
 
-  if (!(pvio->cache= calloc(1, PVIO_READ_AHEAD_CACHE_SIZE)))
+  pvio->cache_min_size= PVIO_READ_AHEAD_CACHE_MIN_SIZE;
+  pvio->cache_max_size= PVIO_READ_AHEAD_CACHE_MAX_SIZE;
+  if (cinfo->mysql->options.extension)
+  {
+    if (cinfo->mysql->options.extension->read_ahead_min_size)
+      pvio->cache_min_size= cinfo->mysql->options.extension->read_ahead_min_size;
+    if (cinfo->mysql->options.extension->read_ahead_max_size)
+      pvio->cache_max_size= cinfo->mysql->options.extension->read_ahead_max_size;
+  }
+  if (pvio->cache_max_size < pvio->cache_min_size)
+    pvio->cache_max_size= pvio->cache_min_size;
+  pvio->cache_capacity= MIN(MAX(PVIO_READ_AHEAD_CACHE_SIZE, pvio->cache_min_size),
+                            pvio->cache_max_size);
+
+  if (!(pvio->cache= calloc(1, pvio->cache_capacity)))
   {
     PVIO_SET_ERROR(cinfo->mysql, CR_OUT_OF_MEMORY, unknown_sqlstate, 0);
     free(pvio);
@@ -215,12 +233,30 @@ static size_t ma_pvio_read_async(MARIADB_PVIO *pvio, uchar *buffer, size_t lengt
 }
 /* }}} */
 
+/* {{{ ma_pvio_stats_start */
+static inline unsigned long long ma_pvio_stats_start(MARIADB_PVIO *pvio)
+{
+  return (pvio->mysql && MA_STATS_TIMING(pvio->mysql)) ? ma_stats_now() : 0;
+}
+/* }}} */
+
+/* {{{ ma_pvio_stats */
+static inline void ma_pvio_stats(MARIADB_PVIO *pvio, my_bool write, ssize_t r,
+                                 unsigned long long start)
+{
+  if (pvio->mysql && pvio->mysql->extension)
+    ma_stats_io(MA_IO_STATS(pvio->mysql), write, r, start);
+}
+/* }}} */
+
 /* {{{ size_t ma_pvio_read */
 ssize_t ma_pvio_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length)
 {
   ssize_t r= -1;
+  unsigned long long start;
   if (!pvio)
     return -1;
+  start= ma_pvio_stats_start(pvio);
   if (IS_PVIO_ASYNC_ACTIVE(pvio))
   {
     r= ma_pvio_read_async(pvio, buffer, length);
@@ -239,7 +275,8 @@ ssize_t ma_pvio_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length)
     }
   }
 
-  /* secure connection */
+  /* secure connection: reads always go through the TLS library, even with
+     kernel TLS, since alerts and TLS 1.3 tickets arrive as control records */
 #ifdef HAVE_TLS
   if (pvio->ctls)
   {
@@ -250,6 +287,7 @@ ssize_t ma_pvio_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length)
   if (pvio->methods->read)
     r= pvio->methods->read(pvio, buffer, length);
 end:
+  ma_pvio_stats(pvio, 0, r, start);
   if (pvio_callback)
   {
     void (*callback)(int mode, MYSQL *mysql, const uchar *buffer, size_t length);
@@ -265,6 +303,46 @@ end:
 }
 /* }}} */
 
+/* {{{ void ma_pvio_cache_resize */
+/*
+  Adjusts the size of the (empty) read ahead cache to the last read:
+  if the last read filled the whole cache more data is pending and the
+  cache grows, after several reads which used only a small part of the
+  cache it shrinks.
+*/
+static void ma_pvio_cache_resize(MARIADB_PVIO *pvio)
+{
+  size_t new_capacity= pvio->cache_capacity;
+  uchar *cache;
+
+  if (pvio->cache_last_read >= (ssize_t)pvio->cache_capacity)
+  {
+    pvio->cache_small_reads= 0;
+    new_capacity= MIN(pvio->cache_capacity * 2, pvio->cache_max_size);
+  }
+  else if (pvio->cache_last_read < (ssize_t)(pvio->cache_capacity / 4))
+  {
+    if (++pvio->cache_small_reads >= PVIO_READ_AHEAD_CACHE_SHRINK_READS)
+    {
+      pvio->cache_small_reads= 0;
+      new_capacity= MAX(pvio->cache_capacity / 2, pvio->cache_min_size);
+    }
+  }
+  else
+    pvio->cache_small_reads= 0;
+
+  if (new_capacity == pvio->cache_capacity)
+    return;
+
+  /* cache is empty, so we don't need to preserve the content */
+  if (!(cache= (uchar *)realloc(pvio->cache, new_capacity)))
+    return;
+  pvio->cache= pvio->cache_pos= cache;
+  pvio->cache_size= 0;
+  pvio->cache_capacity= new_capacity;
+}
+/* }}} */
+
 /* {{{  size_t ma_pvio_cache_read */
 ssize_t ma_pvio_cache_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length)
 {
@@ -283,14 +361,28 @@ ssize_t ma_pvio_cache_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length)
     r= MIN((ssize_t)length, remaining);
     memcpy(buffer, pvio->cache_pos, r);
     pvio->cache_pos+= r;
+    return r;
   }
-  else if (length >= PVIO_READ_AHEAD_CACHE_MIN_SIZE)
+
+  if (pvio->cache_last_read)
   {
-    r= ma_pvio_read(pvio, buffer, length); 
+    ma_pvio_cache_resize(pvio);
+    pvio->cache_last_read= 0;
+  }
+
+  if (length >= pvio->cache_capacity)
+  {
+    /* request doesn't fit into the cache, so we read directly into
+       buffer. Remember a full read, so the cache will grow for the
+       following packets */
+    r= ma_pvio_read(pvio, buffer, length);
+    if (r == (ssize_t)length)
+      pvio->cache_last_read= (ssize_t)pvio->cache_capacity;
   }
   else
   {
-    r= ma_pvio_read(pvio, pvio->cache, PVIO_READ_AHEAD_CACHE_SIZE);
+    r= ma_pvio_read(pvio, pvio->cache, pvio->cache_capacity);
+    pvio->cache_last_read= r > 0 ? r : 0;
     if (r > 0)
     {
       if (length < (size_t)r)
@@ -306,6 +398,114 @@ ssize_t ma_pvio_cache_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length)
 }
 /* }}} */
 
+/* {{{ int ma_pvio_cache_fill */
+/*
+  Reads without blocking until the read ahead cache holds at least length
+  unread bytes, the cache grows if necessary. Used by the stackless
+  non-blocking API, which needs complete packets in the cache before the
+  (blocking) protocol functions read them.
+
+  Returns 1 if enough data is cached, 0 if the read would block and -1
+  on error or if the peer closed the connection.
+*/
+int ma_pvio_cache_fill(MARIADB_PVIO *pvio, size_t length)
+{
+  size_t unread= pvio->cache + pvio->cache_size - pvio->cache_pos;
+  unsigned long long start;
+  ssize_t r;
+
+  while (unread < length)
+  {
+    if (pvio->cache_pos != pvio->cache)
+    {
+      memmove(pvio->cache, pvio->cache_pos, unread);
+      pvio->cache_pos= pvio->cache;
+      pvio->cache_size= unread;
+    }
+    if (length > pvio->cache_capacity)
+    {
+      uchar *cache;
+
+      if (!(cache= (uchar *)realloc(pvio->cache, length)))
+        return -1;
+      pvio->cache= pvio->cache_pos= cache;
+      pvio->cache_capacity= length;
+    }
+    start= ma_pvio_stats_start(pvio);
+    r= pvio->methods->async_read(pvio, pvio->cache + pvio->cache_size,
+                                 pvio->cache_capacity - pvio->cache_size);
+    ma_pvio_stats(pvio, 0, r, start);
+    if (pvio_callback)
+    {
+      void (*callback)(int mode, MYSQL *mysql, const uchar *buffer, size_t length);
+      LIST *p= pvio_callback;
+      while (p)
+      {
+        callback= p->data;
+        callback(0, pvio->mysql, pvio->cache + pvio->cache_size, r);
+        p= p->next;
+      }
+    }
+    if (r <= 0)
+      return (r < 0 && !IS_BLOCKING_ERROR()) ? 0 : -1;
+    pvio->cache_last_read= r;
+    pvio->cache_size+= r;
+    unread+= r;
+  }
+  return 1;
+}
+/* }}} */
+
+/* {{{ ma_pvio_write_reading */
+/*
+  Writes a buffer without blocking while input is pending: if the socket
+  buffer is full, data sent by the peer is read into the read ahead cache
+  before waiting for the socket to become writable again. Used while
+  commands are pipelined: a server which can't send its results doesn't
+  read further commands, so a client which doesn't read while it writes
+  would wait forever.
+*/
+static ssize_t ma_pvio_write_reading(MARIADB_PVIO *pvio, const uchar *buffer, size_t length)
+{
+  size_t written= 0;
+  int timeout= pvio->timeout[PVIO_WRITE_TIMEOUT], waited= 0;
+
+  while (written < length)
+  {
+    ssize_t r= pvio->methods->async_write(pvio, buffer + written, length - written);
+    int rc;
+
+    if (r > 0)
+    {
+      written+= r;
+      waited= 0;
+      continue;
+    }
+    if (r == 0 || IS_BLOCKING_ERROR())
+      return written ? (ssize_t)written : -1;
+
+    /* read everything which is available, the cache grows as needed */
+    do {
+      size_t unread= pvio->cache + pvio->cache_size - pvio->cache_pos;
+      rc= ma_pvio_cache_fill(pvio, unread + PVIO_READ_AHEAD_CACHE_SIZE);
+    } while (rc == 1);
+    if (rc < 0)
+      return written ? (ssize_t)written : -1;
+
+    /* wait in short slices, since new input might arrive before the
+       socket becomes writable */
+    if (timeout >= 0 && waited >= timeout)
+    {
+      errno= ETIMEDOUT;
+      return written ? (ssize_t)written : -1;
+    }
+    ma_pvio_wait_io_or_timeout(pvio, FALSE, PVIO_WRITE_READING_SLICE);
+    waited+= PVIO_WRITE_READING_SLICE;
+  }
+  return (ssize_t)written;
+}
+/* }}} */
+
 /* {{{ size_t ma_pvio_write_async */
 static ssize_t ma_pvio_write_async(MARIADB_PVIO *pvio, const uchar *buffer, size_t length)
 {
@@ -338,14 +538,16 @@ static ssize_t ma_pvio_write_async(MARIADB_PVIO *pvio, const uchar *buffer, size
 /* {{{ size_t ma_pvio_write */
 ssize_t ma_pvio_write(MARIADB_PVIO *pvio, const uchar *buffer, size_t length)
 {
-  ssize_t r;
+  ssize_t r= -1;
+  unsigned long long start;
 
   if (!pvio)
    return -1;
+  start= ma_pvio_stats_start(pvio);
 
-  /* secure connection */
+  /* secure connection, unless the kernel encrypts the records */
 #ifdef HAVE_TLS
-  if (pvio->ctls)
+  if (pvio->ctls && !pvio->ctls->ktls_send)
   {
     r= ma_pvio_tls_write(pvio->ctls, buffer, length);
     goto end;
@@ -357,6 +559,12 @@ ssize_t ma_pvio_write(MARIADB_PVIO *pvio, const uchar *buffer, size_t length)
     r= ma_pvio_write_async(pvio, buffer, length);
     goto end;
   }
+  else if (pvio->read_while_writing && pvio->methods->async_write &&
+           pvio->methods->async_read && pvio->cache)
+  {
+    r= ma_pvio_write_reading(pvio, buffer, length);
+    goto end;
+  }
   else
   {
     if (IS_PVIO_ASYNC(pvio))
@@ -373,6 +581,7 @@ ssize_t ma_pvio_write(MARIADB_PVIO *pvio, const uchar *buffer, size_t length)
   if (pvio->methods->write)
     r= pvio->methods->write(pvio, buffer, length);
 end:
+  ma_pvio_stats(pvio, 1, r, start);
   if (pvio_callback)
   {
     void (*callback)(int mode, MYSQL *mysql, const uchar *buffer, size_t length);
@@ -388,6 +597,71 @@ end:
 }
 /* }}} */
 
+/* {{{ size_t ma_pvio_writev */
+ssize_t ma_pvio_writev(MARIADB_PVIO *pvio, const MA_IOVEC *iov, int iovcnt)
+{
+  ssize_t r, total= 0;
+  unsigned long long start;
+  int i;
+
+  if (!pvio)
+   return -1;
+
+  /* TLS (without kernel offload) and non blocking connections don't
+     support gather writes, so we write the buffers one by one */
+  if (!pvio->methods->writev ||
+#ifdef HAVE_TLS
+      (pvio->ctls && !pvio->ctls->ktls_send) ||
+#endif
+      IS_PVIO_ASYNC_ACTIVE(pvio) || pvio->read_while_writing)
+  {
+    for (i=0; i < iovcnt; i++)
+    {
+      if ((r= ma_pvio_write(pvio, (const uchar *)iov[i].iov_base,
+                            iov[i].iov_len)) <= 0)
+        return total ? total : r;
+      total+= r;
+      if ((size_t)r < iov[i].iov_len)
+        break;
+    }
+    return total;
+  }
+
+  if (IS_PVIO_ASYNC(pvio))
+  {
+    /*
+      If switching from non-blocking to blocking API usage, set the socket
+      back to blocking mode.
+    */
+    my_bool old_mode;
+    ma_pvio_blocking(pvio, TRUE, &old_mode);
+  }
+
+  start= ma_pvio_stats_start(pvio);
+  r= pvio->methods->writev(pvio, iov, iovcnt);
+  ma_pvio_stats(pvio, 1, r, start);
+
+  if (pvio_callback)
+  {
+    void (*callback)(int mode, MYSQL *mysql, const uchar *buffer, size_t length);
+    LIST *p= pvio_callback;
+    while (p)
+    {
+      ssize_t remaining= r;
+      callback= p->data;
+      for (i=0; i < iovcnt && remaining > 0; i++)
+      {
+        size_t len= MIN((size_t)remaining, iov[i].iov_len);
+        callback(1, pvio->mysql, (const uchar *)iov[i].iov_base, len);
+        remaining-= len;
+      }
+      p= p->next;
+    }
+  }
+  return r;
+}
+/* }}} */
+
 /* {{{ void ma_pvio_close */
 void ma_pvio_close(MARIADB_PVIO *pvio)
 {
@@ -0,0 +1,221 @@
+/* Copyright (C) 2018 MariaDB Corporation AB
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA */
+
+/*
+  Per connection statistics.
+
+  The counters are updated by the I/O layer without locking:
+    ma_pvio_read/write/writev(): read_calls, write_calls, bytes, io_wait_ns
+    pvio_socket_read():          read_waits
+    ma_net_write(_command)():    packets_sent, commands
+    ma_net_read():               packets_received, round trips
+    ma_net_real_write(), ma_net_read(): compressed and uncompressed bytes
+
+  While a prefetch reader thread reads a result set, it counts into its
+  own MA_STATS (extension->io_stats), which is added to the statistics
+  of the connection under the lock of the reader (see ma_prefetch.c).
+
+  The clock is only read if MARIADB_OPT_STATS_TIMING is set, otherwise
+  io_wait_ns and the latency histograms stay empty.
+
+  A round trip starts when the first bytes of a command are written and
+  ends when the first packet of the response was read. While a command
+  waits for its response, further commands (pipelining) are not timed,
+  so round_trips counts the waits for the server, not the commands.
+  With TLS the bytes and calls are those of the TLS layer, i.e. the
+  decrypted payload.
+
+  The statistics are read with mariadb_get_infov() (MARIADB_CONNECTION_STATS,
+  MARIADB_CONNECTION_COMMAND_LATENCY) and cleared with mariadb_reset_stats().
+*/
+
+#include "ma_global.h"
+#include "ma_sys.h"
+#include "mysql.h"
+#include "ma_common.h"
+#include <string.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+extern void ma_prefetch_lock(MYSQL *mysql);
+extern void ma_prefetch_unlock(MYSQL *mysql);
+
+/* monotonic time in nanoseconds */
+unsigned long long ma_stats_now(void)
+{
+#ifdef _WIN32
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+
+  if (!frequency.QuadPart)
+    QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+         (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL /
+         frequency.QuadPart;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* histogram index of a command, -1 if it has no histogram */
+static int ma_stats_command_index(unsigned int command)
+{
+  if (command <= COM_RESET_CONNECTION)
+    return (int)command;
+  if (command == COM_MULTI)
+    return COM_RESET_CONNECTION + 1;
+  return -1;
+}
+
+/*
+  a read or write call which started at start returned r, start is 0
+  if the time isn't measured
+*/
+void ma_stats_io(MA_STATS *stats, my_bool write, ssize_t r,
+                 unsigned long long start)
+{
+  if (start)
+    stats->counters.io_wait_ns+= ma_stats_now() - start;
+  if (write)
+  {
+    stats->counters.write_calls++;
+    if (r > 0)
+      stats->counters.bytes_sent+= r;
+    /* the round trip of a command starts with its first write */
+    if (stats->pending && !stats->sent)
+    {
+      stats->sent= 1;
+      stats->command_start= start;
+    }
+  }
+  else
+  {
+    stats->counters.read_calls++;
+    if (r > 0)
+      stats->counters.bytes_received+= r;
+  }
+}
+
+/* a command was written to the net buffer */
+void ma_stats_command(MA_STATS *stats, unsigned char command)
+{
+  stats->counters.commands++;
+  if (stats->pending)
+    return;
+  switch (command) {
+  /* no response from the server */
+  case COM_QUIT:
+  case COM_STMT_CLOSE:
+  case COM_STMT_SEND_LONG_DATA:
+    return;
+  default:
+    stats->pending= 1;
+    stats->sent= 0;
+    stats->command= command;
+    stats->command_start= 0;
+  }
+}
+
+/* the first packet of the response to the pending command was read */
+void ma_stats_response(MA_STATS *stats, my_bool error)
+{
+  unsigned long long elapsed, us;
+  unsigned int bucket= 0;
+  int idx;
+
+  stats->pending= 0;
+  if (error || !stats->sent)
+    return;
+  stats->counters.round_trips++;
+
+  if (!stats->command_start ||
+      (idx= ma_stats_command_index(stats->command)) < 0)
+    return;
+  if (!stats->latency[idx] &&
+      !(stats->latency[idx]= (unsigned long long *)
+          calloc(MARIADB_LATENCY_BUCKETS, sizeof(unsigned long long))))
+    return;
+  elapsed= ma_stats_now() - stats->command_start;
+  for (us= elapsed / 1000; us && bucket < MARIADB_LATENCY_BUCKETS - 1; us>>= 1)
+    bucket++;
+  stats->latency[idx][bucket]++;
+}
+
+/*
+  Copies the latency histogram of command into buckets, which must have
+  room for MARIADB_LATENCY_BUCKETS values. Returns 1 if the command is
+  unknown.
+*/
+my_bool ma_stats_latency(MA_STATS *stats, unsigned int command,
+                         unsigned long long *buckets)
+{
+  int idx;
+
+  if ((idx= ma_stats_command_index(command)) < 0)
+    return 1;
+  if (stats->latency[idx])
+    memcpy(buckets, stats->latency[idx],
+           MARIADB_LATENCY_BUCKETS * sizeof(unsigned long long));
+  else
+    memset(buckets, 0, MARIADB_LATENCY_BUCKETS * sizeof(unsigned long long));
+  return 0;
+}
+
+/* adds the counters of from to to and clears them */
+void ma_stats_add(MARIADB_STATS *to, MARIADB_STATS *from)
+{
+  unsigned long long *dst= (unsigned long long *)to,
+                     *src= (unsigned long long *)from;
+  size_t i;
+
+  for (i=0; i < sizeof(MARIADB_STATS) / sizeof(unsigned long long); i++)
+    dst[i]+= src[i];
+  memset(from, 0, sizeof(MARIADB_STATS));
+}
+
+void ma_stats_free(MA_STATS *stats)
+{
+  int i;
+
+  for (i=0; i < MA_STATS_COMMANDS; i++)
+    free(stats->latency[i]);
+  memset(stats, 0, sizeof(MA_STATS));
+}
+
+/* {{{ mariadb_reset_stats */
+void STDCALL mariadb_reset_stats(MYSQL *mysql)
+{
+  MA_STATS *stats;
+  int i;
+
+  if (!mysql || !mysql->extension)
+    return;
+  stats= &mysql->extension->stats;
+  ma_prefetch_lock(mysql);
+  memset(&stats->counters, 0, sizeof(MARIADB_STATS));
+  ma_prefetch_unlock(mysql);
+  for (i=0; i < MA_STATS_COMMANDS; i++)
+    if (stats->latency[i])
+      memset(stats->latency[i], 0,
+             MARIADB_LATENCY_BUCKETS * sizeof(unsigned long long));
+}
+/* }}} */
@@ -0,0 +1,564 @@
+/* Copyright (C) 2018 MariaDB Corporation AB
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA */
+
+/*
+  Streaming fetch of unbuffered prepared statement results.
+
+  If STMT_ATTR_STREAM_RESULT is set, mysql_stmt_fetch() doesn't read a
+  row packet into net->buff before converting it. Rows which fit into
+  net->buff are read as before, larger rows are parsed column by column
+  while they are read from the connection:
+
+  - fixed size values and short strings are read into net->buff, which
+    serves as scratch buffer, and converted as usual,
+  - long string and blob values bound to a string or blob buffer are read
+    directly into the bound buffer, the part which doesn't fit is skipped
+    and reported as truncation,
+  - string and blob values of columns bound with a NULL buffer are passed
+    to the STMT_ATTR_STREAM_CALLBACK callback in pieces of at most the
+    size of net->buff.
+
+  So the memory used by the client doesn't depend on the size of the
+  values. mysql_stmt_fetch_column() is not available for rows which were
+  streamed, since they are not kept in memory.
+
+  Compressed connections, connections with a read ahead thread, a
+  connection handler or the non-blocking API read complete rows, the
+  values are passed to the bound buffers and to the callback in the same
+  way.
+*/
+
+#include "ma_global.h"
+#include <ma_sys.h>
+#include "mysql.h"
+#include "errmsg.h"
+#include <ma_pvio.h>
+#include <ma_common.h>
+#include <string.h>
+
+ulong ma_net_check_packet(MYSQL *mysql, ulong len);
+ulong ma_read_row_packet(MYSQL *mysql, uchar **packet);
+void stmt_set_error(MYSQL_STMT *stmt, unsigned int error_nr,
+                    const char *sqlstate, const char *format, ...);
+
+#define MAX_PACKET_LENGTH (256L*256L*256L-1)
+
+enum enum_ma_stream_error {
+  MA_STREAM_OK= 0,
+  MA_STREAM_IO_ERROR,
+  MA_STREAM_MALFORMED,
+  MA_STREAM_OOM
+};
+
+typedef struct st_ma_stream {
+  MYSQL *mysql;
+  my_bool from_socket;  /* row is read from the connection */
+  /* row in memory */
+  uchar *pos, *end;
+  /* row read from the connection */
+  size_t remain;        /* unread bytes of the current packet */
+  my_bool last;         /* current packet is the last one of the row */
+  uchar *scratch;       /* net->buff */
+  size_t scratch_size;
+  size_t used;
+  enum enum_ma_stream_error error;
+} MA_STREAM;
+
+static my_bool ma_stream_pvio_read(MA_STREAM *s, uchar *buffer, size_t length)
+{
+  ssize_t r;
+
+  while (length)
+  {
+    if ((r= ma_pvio_cache_read(s->mysql->net.pvio, buffer, length)) <= 0)
+    {
+      s->mysql->net.error= 2;
+      s->error= MA_STREAM_IO_ERROR;
+      return 1;
+    }
+    buffer+= r;
+    length-= r;
+  }
+  return 0;
+}
+
+/* reads the header of the next packet, see ma_real_read() */
+static my_bool ma_stream_read_header(MA_STREAM *s)
+{
+  NET *net= &s->mysql->net;
+  uchar header[NET_HEADER_SIZE];
+
+  if (ma_stream_pvio_read(s, header, NET_HEADER_SIZE))
+    return 1;
+  net->pkt_nr= header[3];
+  net->compress_pkt_nr= ++net->pkt_nr;
+  s->remain= uint3korr(header);
+  s->last= s->remain < MAX_PACKET_LENGTH;
+  return 0;
+}
+
+/*
+  Copies the next length bytes of the row into buffer, if buffer is NULL
+  the bytes are skipped.
+*/
+static my_bool ma_stream_copy(MA_STREAM *s, uchar *buffer, size_t length)
+{
+  size_t n;
+
+  if (s->error)
+    return 1;
+  if (!s->from_socket)
+  {
+    if ((size_t)(s->end - s->pos) < length)
+    {
+      s->error= MA_STREAM_MALFORMED;
+      return 1;
+    }
+    if (buffer)
+      memcpy(buffer, s->pos, length);
+    s->pos+= length;
+    return 0;
+  }
+  while (length)
+  {
+    if (!s->remain)
+    {
+      if (s->last)
+      {
+        s->error= MA_STREAM_MALFORMED;
+        return 1;
+      }
+      if (ma_stream_read_header(s))
+        return 1;
+      continue;
+    }
+    n= MIN(length, s->remain);
+    /* skipped bytes are read into the unused part of the scratch buffer */
+    if (!buffer && !(n= MIN(n, s->scratch_size - s->used)))
+    {
+      s->error= MA_STREAM_OOM;
+      return 1;
+    }
+    if (ma_stream_pvio_read(s, buffer ? buffer : s->scratch + s->used, n))
+      return 1;
+    if (buffer)
+      buffer+= n;
+    s->remain-= n;
+    length-= n;
+  }
+  return 0;
+}
+
+/* returns the next length bytes of the row in contiguous memory */
+static uchar *ma_stream_get(MA_STREAM *s, size_t length)
+{
+  uchar *p;
+
+  if (!s->from_socket)
+  {
+    p= s->pos;
+    return ma_stream_copy(s, NULL, length) ? NULL : p;
+  }
+  if (s->scratch_size - s->used < length)
+  {
+    s->error= MA_STREAM_MALFORMED;
+    return NULL;
+  }
+  p= s->scratch + s->used;
+  if (ma_stream_copy(s, p, length))
+    return NULL;
+  s->used+= length;
+  return p;
+}
+
+/*
+  Reads a length encoded value length. The length bytes remain available
+  in front of the value, so the conversion functions can be used.
+*/
+static uchar *ma_stream_get_length(MA_STREAM *s, ulong *length)
+{
+  uchar *p, *start;
+  size_t extra;
+
+  if (!(start= ma_stream_get(s, 1)))
+    return NULL;
+  switch (*start) {
+  case 252: extra= 2; break;
+  case 253: extra= 3; break;
+  case 254: extra= 8; break;
+  default:
+    if (*start >= 251)
+    {
+      s->error= MA_STREAM_MALFORMED;
+      return NULL;
+    }
+    *length= *start;
+    return start;
+  }
+  if (!(p= ma_stream_get(s, extra)))
+    return NULL;
+  *length= (ulong)(extra == 2 ? uint2korr(p) :
+                   extra == 3 ? uint3korr(p) : uint8korr(p));
+  return start;
+}
+
+/* skips the unread part of the row, so the connection stays usable */
+static void ma_stream_drain(MA_STREAM *s)
+{
+  enum enum_ma_stream_error error= s->error;
+
+  if (!s->from_socket || error == MA_STREAM_IO_ERROR)
+    return;
+  s->error= MA_STREAM_OK;
+  s->used= 0;
+  while ((s->remain || !s->last) && !s->error)
+  {
+    if (s->remain)
+      ma_stream_copy(s, NULL, s->remain);
+    else
+      ma_stream_read_header(s);
+  }
+  if (!s->error)
+    s->error= error;
+}
+
+static my_bool ma_stream_is_string_type(enum enum_field_types type)
+{
+  switch (type) {
+  case MYSQL_TYPE_VARCHAR:
+  case MYSQL_TYPE_VAR_STRING:
+  case MYSQL_TYPE_STRING:
+  case MYSQL_TYPE_TINY_BLOB:
+  case MYSQL_TYPE_MEDIUM_BLOB:
+  case MYSQL_TYPE_LONG_BLOB:
+  case MYSQL_TYPE_BLOB:
+  case MYSQL_TYPE_GEOMETRY:
+  case MYSQL_TYPE_JSON:
+  case MYSQL_TYPE_ENUM:
+  case MYSQL_TYPE_SET:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static my_bool ma_stream_is_blob_type(enum enum_field_types type)
+{
+  return type == MYSQL_TYPE_TINY_BLOB || type == MYSQL_TYPE_MEDIUM_BLOB ||
+         type == MYSQL_TYPE_LONG_BLOB || type == MYSQL_TYPE_BLOB;
+}
+
+/*
+  Reads a string value of length bytes into the bound buffer, like
+  ps_fetch_bin() and ps_fetch_string() copy it.
+*/
+static void ma_stream_fetch_string(MA_STREAM *s, MYSQL_BIND *bind,
+                                   MYSQL_FIELD *field, ulong length)
+{
+  size_t skip= MIN(bind->offset, length);
+  size_t copylen= length - skip;
+  size_t n= MIN(copylen, bind->buffer_length);
+
+  ma_stream_copy(s, NULL, skip);
+  ma_stream_copy(s, (uchar *)bind->buffer, n);
+  ma_stream_copy(s, NULL, copylen - n);
+  /* binary blobs are terminated for string buffers only */
+  if (copylen < bind->buffer_length &&
+      (field->charsetnr != 63 || !ma_stream_is_blob_type(field->type) ||
+       bind->buffer_type == MYSQL_TYPE_STRING ||
+       bind->buffer_type == MYSQL_TYPE_JSON))
+    ((char *)bind->buffer)[copylen]= 0;
+  *bind->error= copylen > bind->buffer_length;
+  *bind->length= length;
+}
+
+/* passes a value of length bytes to the stream callback */
+static int ma_stream_callback(MA_STREAM *s, MYSQL_STMT *stmt, unsigned int column,
+                              ulong length, mariadb_stmt_stream_callback callback,
+                              void *user_data)
+{
+  size_t base= s->used;
+  int rc;
+
+  if (!s->from_socket)
+  {
+    uchar *p= ma_stream_get(s, length);
+    return p ? callback(stmt, column, p, length, user_data) : 0;
+  }
+  do
+  {
+    size_t n= MIN(length, s->scratch_size - base);
+
+    s->used= base;
+    if (!ma_stream_get(s, n))
+      return 0;
+    rc= callback(stmt, column, s->scratch + base, n, user_data);
+    length-= n;
+  } while (length && !rc);
+  s->used= base;
+  /* skip the rest of an aborted value */
+  ma_stream_copy(s, NULL, length);
+  return rc;
+}
+
+/*
+  Converts the columns of the row into the bound buffers. If skip is
+  set, the row is discarded.
+*/
+static int ma_stream_row(MA_STREAM *s, MYSQL_STMT *stmt,
+                         mariadb_stmt_stream_callback callback,
+                         void *user_data, my_bool skip)
+{
+  size_t null_bytes= (stmt->field_count + 9) / 8;
+  size_t truncations= 0, base;
+  unsigned char *null_ptr, bit_offset= 4;
+  unsigned int i, aborted_column= 0;
+  my_bool aborted= 0;
+
+  if (!(null_ptr= ma_stream_get(s, 1 + null_bytes)))
+    return 1;
+  if (*null_ptr++)
+  {
+    s->error= MA_STREAM_MALFORMED;
+    return 1;
+  }
+  base= s->used;
+
+  for (i=0; i < stmt->field_count && !s->error; i++)
+  {
+    MYSQL_BIND *bind= &stmt->bind[i];
+    MYSQL_FIELD *field= &stmt->fields[i];
+    int pack_len= mysql_ps_fetch_functions[field->type].pack_len;
+    my_bool null_value= (*null_ptr & bit_offset) != 0;
+    uchar *start;
+    ulong length;
+
+    if (!((bit_offset <<=1) & 255)) {
+      bit_offset= 1; /* To next byte */
+      null_ptr++;
+    }
+    s->used= base;
+
+    if (skip || !stmt->bind_result_done || (bind->flags & MADB_BIND_DUMMY))
+    {
+      if (null_value)
+        continue;
+      if (pack_len >= 0)
+        ma_stream_copy(s, NULL, pack_len);
+      else if (ma_stream_get_length(s, &length))
+        ma_stream_copy(s, NULL, length);
+      if (!skip)
+        bind->u.row_ptr= NULL;
+      continue;
+    }
+    if (null_value)
+    {
+      *bind->is_null= 1;
+      bind->u.row_ptr= NULL;
+      continue;
+    }
+    if (!bind->length)
+      bind->length= &bind->length_value;
+    if (!bind->is_null)
+      bind->is_null= &bind->is_null_value;
+    *bind->is_null= 0;
+
+    if (pack_len >= 0)
+    {
+      if (!(start= ma_stream_get(s, pack_len)))
+        break;
+      bind->u.row_ptr= s->from_socket ? NULL : start;
+      mysql_ps_fetch_functions[field->type].func(bind, field, &start);
+    }
+    else
+    {
+      if (!(start= ma_stream_get_length(s, &length)))
+        break;
+      bind->u.row_ptr= s->from_socket ? NULL : start;
+      if (callback && !bind->buffer && ma_stream_is_string_type(field->type))
+      {
+        *bind->length= length;
+        *bind->error= 0;
+        if (aborted)
+          ma_stream_copy(s, NULL, length);
+        else if (ma_stream_callback(s, stmt, i, length, callback, user_data))
+        {
+          aborted= 1;
+          aborted_column= i;
+        }
+        continue;
+      }
+      if (!s->from_socket || length <= s->scratch_size - s->used)
+      {
+        if (!ma_stream_get(s, length))
+          break;
+        mysql_ps_fetch_functions[field->type].func(bind, field, &start);
+      }
+      else if (ma_stream_is_string_type(field->type) &&
+               ma_stream_is_string_type(bind->buffer_type))
+        ma_stream_fetch_string(s, bind, field, length);
+      else
+      {
+        /* conversion of a long value, e.g. to a number */
+        size_t prefix= s->scratch + s->used - start;
+        uchar *value= (uchar *)malloc(prefix + length), *p= value;
+
+        if (!value)
+        {
+          ma_stream_copy(s, NULL, length);
+          s->error= MA_STREAM_OOM;
+          break;
+        }
+        memcpy(value, start, prefix);
+        if (!ma_stream_copy(s, value + prefix, length))
+          mysql_ps_fetch_functions[field->type].func(bind, field, &p);
+        free(value);
+      }
+    }
+    if (stmt->mysql->options.report_data_truncation)
+      truncations+= *bind->error;
+  }
+
+  ma_stream_drain(s);
+  if (s->error)
+    return 1;
+  if (aborted)
+  {
+    stmt_set_error(stmt, CR_STMT_STREAM_ABORTED, SQLSTATE_UNKNOWN,
+                   CER(CR_STMT_STREAM_ABORTED), aborted_column);
+    return 1;
+  }
+  return truncations ? MYSQL_DATA_TRUNCATED : 0;
+}
+
+/* complete rows are read by other layers */
+static my_bool ma_stream_from_socket(MYSQL *mysql)
+{
+  return mysql->net.pvio && !mysql->net.compress &&
+         !mysql->extension->prefetch && !mysql->extension->conn_hdlr &&
+         !IS_MYSQL_ASYNC(mysql);
+}
+
+static void ma_stream_set_error(MA_STREAM *s, MYSQL_STMT *stmt)
+{
+  MYSQL *mysql= s->mysql;
+
+  switch (s->error) {
+  case MA_STREAM_IO_ERROR:
+    /* closes the connection and sets the error */
+    ma_net_check_packet(mysql, packet_error);
+    break;
+  case MA_STREAM_MALFORMED:
+    my_set_error(mysql, CR_MALFORMED_PACKET, SQLSTATE_UNKNOWN, 0);
+    break;
+  case MA_STREAM_OOM:
+    my_set_error(mysql, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+    break;
+  default:
+    return;
+  }
+  stmt_set_error(stmt, mysql->net.last_errno, mysql->net.sqlstate,
+                 "%s", mysql->net.last_error);
+}
+
+/*
+  Fetches the next row of an unbuffered result set into the bound buffers
+  (skip == 0) or discards it. Returns 0, MYSQL_DATA_TRUNCATED, MYSQL_NO_DATA
+  or 1 on error. done is set if the result set ended, streamed if the row
+  was not kept in memory.
+  If row is not NULL, a row which was read into memory isn't converted but
+  returned in row and row_length, so the caller can convert it later.
+*/
+int ma_stmt_stream_fetch(MYSQL_STMT *stmt, mariadb_stmt_stream_callback callback,
+                         void *user_data, my_bool skip,
+                         my_bool *done, my_bool *streamed,
+                         uchar **row, ulong *row_length)
+{
+  MYSQL *mysql= stmt->mysql;
+  NET *net= &mysql->net;
+  MA_STREAM s;
+  ulong len;
+  int rc;
+
+  memset(&s, 0, sizeof(MA_STREAM));
+  s.mysql= mysql;
+  *done= 1;
+  *streamed= 0;
+
+  if (!ma_stream_from_socket(mysql))
+  {
+    uchar *packet;
+
+    if ((len= ma_read_row_packet(mysql, &packet)) == packet_error)
+      return 1;
+    s.pos= packet;
+    s.end= packet + len;
+  }
+  else
+  {
+    MA_STATS *stats= &mysql->extension->stats;
+
+    s.scratch= net->buff;
+    s.scratch_size= net->max_packet;
+    if (ma_stream_read_header(&s))
+    {
+      ma_stream_set_error(&s, stmt);
+      return 1;
+    }
+    stats->counters.packets_received++;
+    if (s.last && s.remain < net->max_packet)
+    {
+      /* the row fits into net->buff */
+      len= (ulong)s.remain;
+      if (ma_stream_pvio_read(&s, net->buff, len))
+      {
+        ma_stream_set_error(&s, stmt);
+        return 1;
+      }
+      net->read_pos= net->buff;
+      net->read_pos[len]= 0;
+      if ((len= ma_net_check_packet(mysql, len)) == packet_error)
+        return 1;
+      s.pos= net->read_pos;
+      s.end= net->read_pos + len;
+    }
+    else
+    {
+      s.from_socket= 1;
+      *streamed= 1;
+    }
+  }
+
+  if (!s.from_socket && s.pos < s.end && s.pos[0] == 254)
+    return MYSQL_NO_DATA;
+
+  *done= 0;
+  if (!skip)
+    stmt->result.rows++;
+  if (row && !s.from_socket)
+  {
+    *row= s.pos;
+    *row_length= (ulong)(s.end - s.pos);
+    return 0;
+  }
+  if ((rc= ma_stream_row(&s, stmt, callback, user_data, skip)) == 1 && s.error)
+  {
+    *done= 1;
+    ma_stream_set_error(&s, stmt);
+  }
+  return rc;
+}
@@ -0,0 +1,259 @@
+/************************************************************************************
+  Copyright (C) 2018 MariaDB Corporation AB
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not see <http://www.gnu.org/licenses>
+  or write to the Free Software Foundation, Inc.,
+  51 Franklin St., Fifth Floor, Boston, MA 02110, USA
+
+ *************************************************************************************/
+
+/*
+  TLS session cache
+
+  Serialized sessions of the TLS libraries are cached per connection
+  target, so a reconnect can resume the previous session instead of
+  performing a full handshake. The key is a SHA1 digest of host, port,
+  socket, user, the TLS options which select the SSL context (see
+  ma_tls_options()) and the server certificate verification flag, so
+  sessions of different client identities or trust settings are never
+  mixed.
+
+  The cache is a hash (ma_hash) keyed by the digest and holds at most
+  MA_TLS_SESSION_CACHE_SIZE sessions, the least recently used one is
+  evicted first. TLS 1.3 tickets are single use: a ticket is removed
+  from the cache when it is handed out, the server sends new tickets
+  after every handshake.
+
+  All functions are thread safe. The cache is initialized and freed by
+  ma_tls_start() and ma_tls_end() of the TLS backend.
+*/
+
+#ifdef HAVE_TLS
+
+#include <ma_global.h>
+#include <ma_sys.h>
+#include <ma_common.h>
+#include <ma_pthread.h>
+#include <ma_hash.h>
+#include <ma_list.h>
+#include <ma_sha1.h>
+#include <string.h>
+#include <stddef.h>
+#include <ma_pvio.h>
+#include <ma_tls.h>
+
+typedef struct st_ma_tls_session {
+  unsigned char key[MA_TLS_SESSION_KEY_LEN];
+  my_bool single_use;
+  LIST list;
+  size_t length;
+  unsigned char data[1];
+} MA_TLS_SESSION;
+
+static pthread_mutex_t LOCK_tls_sessions;
+static my_bool ma_tls_sessions_initialized= FALSE;
+static HASH ma_tls_sessions;
+static LIST *ma_tls_session_newest= NULL, /* most recently used first */
+            *ma_tls_session_oldest= NULL; /* next session to evict */
+static MARIADB_TLS_SESSION_STATS ma_tls_session_counters;
+
+static void ma_tls_session_digest(_MA_SHA1_CTX *context, const char *str)
+{
+  /* a NULL value differs from an empty string */
+  unsigned char is_set= str ? 1 : 0;
+
+  ma_SHA1Update(context, &is_set, 1);
+  if (str)
+    ma_SHA1Update(context, (const unsigned char *)str, strlen(str) + 1);
+}
+
+void ma_tls_options(MYSQL *mysql, const char **options)
+{
+  struct st_mysql_options_extension *ext= mysql->options.extension;
+
+  options[0]= mysql->options.ssl_ca;
+  options[1]= mysql->options.ssl_capath;
+  options[2]= mysql->options.ssl_cert;
+  options[3]= mysql->options.ssl_key;
+  options[4]= mysql->options.ssl_cipher;
+  options[5]= ext ? ext->tls_version : NULL;
+  options[6]= ext ? ext->ssl_crl : NULL;
+  options[7]= ext ? ext->ssl_crlpath : NULL;
+  options[8]= ext ? ext->tls_pw : NULL;
+}
+
+void ma_tls_session_key(MYSQL *mysql, unsigned char *key)
+{
+  _MA_SHA1_CTX context;
+  const char *options[MA_TLS_OPTIONS];
+  char port[12];
+  unsigned char verify;
+  unsigned int i;
+
+  snprintf(port, sizeof(port), "%u", mysql->port);
+  ma_tls_options(mysql, options);
+  verify= (mysql->client_flag & CLIENT_SSL_VERIFY_SERVER_CERT) ? 1 : 0;
+  ma_SHA1Init(&context);
+  ma_tls_session_digest(&context, mysql->host);
+  ma_tls_session_digest(&context, port);
+  ma_tls_session_digest(&context, mysql->unix_socket);
+  ma_tls_session_digest(&context, mysql->user);
+  for (i= 0; i < MA_TLS_OPTIONS; i++)
+    ma_tls_session_digest(&context, options[i]);
+  ma_SHA1Update(&context, &verify, 1);
+  ma_SHA1Final(key, &context);
+}
+
+static void ma_tls_session_unlink(MA_TLS_SESSION *session)
+{
+  if (ma_tls_session_oldest == &session->list)
+    ma_tls_session_oldest= session->list.prev;
+  ma_tls_session_newest= list_delete(ma_tls_session_newest, &session->list);
+}
+
+static void ma_tls_session_link_first(MA_TLS_SESSION *session)
+{
+  session->list.data= session;
+  ma_tls_session_newest= list_add(ma_tls_session_newest, &session->list);
+  if (!ma_tls_session_oldest)
+    ma_tls_session_oldest= &session->list;
+}
+
+/* removes the session from the LRU list and the hash, which frees it */
+static void ma_tls_session_delete(MA_TLS_SESSION *session)
+{
+  ma_tls_session_unlink(session);
+  hash_delete(&ma_tls_sessions, (uchar *)session);
+  ma_tls_session_counters.entries= ma_tls_sessions.records;
+}
+
+void ma_tls_session_cache_init(void)
+{
+  if (ma_tls_sessions_initialized)
+    return;
+  if (_hash_init(&ma_tls_sessions, MA_TLS_SESSION_CACHE_SIZE,
+                 (uint)offsetof(MA_TLS_SESSION, key), MA_TLS_SESSION_KEY_LEN,
+                 NULL, free, 0))
+    return;
+  pthread_mutex_init(&LOCK_tls_sessions, NULL);
+  ma_tls_sessions_initialized= TRUE;
+}
+
+void ma_tls_session_cache_end(void)
+{
+  if (!ma_tls_sessions_initialized)
+    return;
+  hash_free(&ma_tls_sessions);
+  ma_tls_session_newest= ma_tls_session_oldest= NULL;
+  memset(&ma_tls_session_counters, 0, sizeof(MARIADB_TLS_SESSION_STATS));
+  pthread_mutex_destroy(&LOCK_tls_sessions);
+  ma_tls_sessions_initialized= FALSE;
+}
+
+/*
+  Looks up the session for key. On success a copy of the serialized
+  session is returned in data, which must be freed by the caller.
+  Returns 1 if no session was cached.
+*/
+my_bool ma_tls_session_get(const unsigned char *key, unsigned char **data,
+                           size_t *length)
+{
+  MA_TLS_SESSION *session;
+  my_bool rc= 1;
+
+  if (!ma_tls_sessions_initialized)
+    return 1;
+  pthread_mutex_lock(&LOCK_tls_sessions);
+  if ((session= (MA_TLS_SESSION *)hash_search(&ma_tls_sessions, key,
+                                              MA_TLS_SESSION_KEY_LEN)) &&
+      (*data= (unsigned char *)malloc(session->length)))
+  {
+    memcpy(*data, session->data, session->length);
+    *length= session->length;
+    if (session->single_use)
+      ma_tls_session_delete(session);
+    else
+    {
+      ma_tls_session_unlink(session);
+      ma_tls_session_link_first(session);
+    }
+    ma_tls_session_counters.hits++;
+    rc= 0;
+  }
+  else
+    ma_tls_session_counters.misses++;
+  pthread_mutex_unlock(&LOCK_tls_sessions);
+  return rc;
+}
+
+/* stores a copy of the serialized session data for key */
+void ma_tls_session_put(const unsigned char *key, const unsigned char *data,
+                        size_t length, my_bool single_use)
+{
+  MA_TLS_SESSION *session, *old;
+
+  if (!ma_tls_sessions_initialized || !length ||
+      !(session= (MA_TLS_SESSION *)malloc(sizeof(MA_TLS_SESSION) + length)))
+    return;
+  memcpy(session->key, key, MA_TLS_SESSION_KEY_LEN);
+  memcpy(session->data, data, length);
+  session->length= length;
+  session->single_use= single_use;
+
+  pthread_mutex_lock(&LOCK_tls_sessions);
+  /* a new session replaces the previous one */
+  if ((old= (MA_TLS_SESSION *)hash_search(&ma_tls_sessions, key,
+                                          MA_TLS_SESSION_KEY_LEN)))
+    ma_tls_session_delete(old);
+  if (hash_insert(&ma_tls_sessions, (uchar *)session))
+  {
+    pthread_mutex_unlock(&LOCK_tls_sessions);
+    free(session);
+    return;
+  }
+  ma_tls_session_link_first(session);
+  ma_tls_session_counters.stored++;
+
+  if (ma_tls_sessions.records > MA_TLS_SESSION_CACHE_SIZE)
+  {
+    ma_tls_session_delete((MA_TLS_SESSION *)ma_tls_session_oldest->data);
+    ma_tls_session_counters.evicted++;
+  }
+  ma_tls_session_counters.entries= ma_tls_sessions.records;
+  pthread_mutex_unlock(&LOCK_tls_sessions);
+}
+
+/* counts a handshake which resumed a cached session */
+void ma_tls_session_resumed(void)
+{
+  if (!ma_tls_sessions_initialized)
+    return;
+  pthread_mutex_lock(&LOCK_tls_sessions);
+  ma_tls_session_counters.resumed++;
+  pthread_mutex_unlock(&LOCK_tls_sessions);
+}
+
+void ma_tls_session_stats(MARIADB_TLS_SESSION_STATS *stats)
+{
+  if (!ma_tls_sessions_initialized)
+  {
+    memset(stats, 0, sizeof(MARIADB_TLS_SESSION_STATS));
+    return;
+  }
+  pthread_mutex_lock(&LOCK_tls_sessions);
+  *stats= ma_tls_session_counters;
+  pthread_mutex_unlock(&LOCK_tls_sessions);
+}
+
+#endif /* HAVE_TLS */
@@ -189,6 +189,235 @@ my_ssl_write_async(struct mysql_async_context *b, SSL *ssl,
 
 
 
+/*
+  Stackless non-blocking calls.
+
+  Sending a query, reading its result and fetching unbuffered rows don't
+  need a co-routine: the command is written into net->buff and sent with
+  non-blocking writes, the response is read with non-blocking reads into
+  the read ahead cache until all packets the protocol functions will read
+  are complete. Then the (blocking) protocol function runs without waiting
+  for the network. The progress of a suspended call is kept in the
+  mysql_async_context, so these calls neither need a stack nor a context
+  switch.
+
+  Connections with TLS, compression, a connection handler or an active
+  pipeline, and commands which don't fit into the net buffer still use
+  the co-routine. LOAD DATA LOCAL INFILE is completed in blocking mode.
+  If MYSQL_OPT_RECONNECT is set, mthd_my_send_cmd reconnects and resends
+  the command after a failed write, which needs the co-routine too. The
+  same applies to a connection which was already closed, so that the error
+  (or the reconnect) is the same as for blocking calls.
+*/
+
+#define MAX_PACKET_LENGTH (256L*256L*256L-1)
+
+enum enum_ma_async_sm_call {
+  MA_ASYNC_SM_NONE= 0,
+  MA_ASYNC_SM_REAL_QUERY,
+  MA_ASYNC_SM_SEND_QUERY,
+  MA_ASYNC_SM_READ_QUERY_RESULT,
+  MA_ASYNC_SM_FETCH_ROW
+};
+
+enum enum_ma_async_sm_state {
+  MA_ASYNC_SM_SEND,
+  MA_ASYNC_SM_READ
+};
+
+extern int ma_net_prepare_command(MYSQL *mysql, enum enum_server_command command,
+                                  const char *arg, size_t length);
+extern void ma_net_abort(MYSQL *mysql, unsigned int error);
+
+static my_bool ma_async_sm_supported(MYSQL *mysql)
+{
+  MARIADB_PVIO *pvio= mysql->net.pvio;
+
+  return pvio && !mysql->options.reconnect &&
+         pvio->cache && !pvio->ctls && !mysql->net.compress &&
+         pvio->methods->async_read && pvio->methods->async_write &&
+         !mysql->extension->conn_hdlr && !mysql->extension->pipeline &&
+         mysql->net.extension->multi_status == COM_MULTI_OFF;
+}
+
+static int ma_async_sm_wait(struct mysql_async_context *b, unsigned int event,
+                            int timeout)
+{
+  b->events_to_wait_for= event;
+  if (timeout >= 0)
+  {
+    b->events_to_wait_for|= MYSQL_WAIT_TIMEOUT;
+    b->timeout_value= timeout;
+  }
+  b->suspended= 1;
+  if (b->suspend_resume_hook)
+    (*b->suspend_resume_hook)(TRUE, b->suspend_resume_hook_user_data);
+  return b->events_to_wait_for;
+}
+
+/* all packets arrived, so the protocol function won't block */
+static int ma_async_sm_finish(MYSQL *mysql, struct mysql_async_context *b)
+{
+  switch (b->sm_call) {
+  case MA_ASYNC_SM_REAL_QUERY:
+    b->ret_result.r_int= mysql->methods->db_read_query_result(mysql);
+    break;
+  case MA_ASYNC_SM_SEND_QUERY:
+    b->ret_result.r_int= 0;
+    break;
+  case MA_ASYNC_SM_READ_QUERY_RESULT:
+    b->ret_result.r_my_bool= test(mysql->methods->db_read_query_result(mysql));
+    break;
+  case MA_ASYNC_SM_FETCH_ROW:
+    b->ret_result.r_ptr= mysql_fetch_row((MYSQL_RES *)b->sm_result);
+    break;
+  }
+  b->sm_call= MA_ASYNC_SM_NONE;
+  return 0;
+}
+
+/* the connection failed or timed out */
+static int ma_async_sm_abort(MYSQL *mysql, struct mysql_async_context *b)
+{
+  if (b->sm_state == MA_ASYNC_SM_SEND)
+  {
+    ma_net_abort(mysql, CR_SERVER_GONE_ERROR);
+    b->ret_result.r_int= -1;
+    b->sm_call= MA_ASYNC_SM_NONE;
+    return 0;
+  }
+  /* the protocol function reports the error */
+  ma_net_abort(mysql, CR_SERVER_LOST);
+  return ma_async_sm_finish(mysql, b);
+}
+
+static int ma_async_sm_run(MYSQL *mysql, struct mysql_async_context *b)
+{
+  NET *net= &mysql->net;
+  MARIADB_PVIO *pvio= net->pvio;
+
+  if (b->sm_state == MA_ASYNC_SM_SEND)
+  {
+    size_t length= net->write_pos - net->buff;
+
+    while (b->sm_sent < length)
+    {
+      ssize_t r= pvio->methods->async_write(pvio, net->buff + b->sm_sent,
+                                            length - b->sm_sent);
+      if (r < 0 && !IS_BLOCKING_ERROR())
+        return ma_async_sm_wait(b, MYSQL_WAIT_WRITE,
+                                pvio->timeout[PVIO_WRITE_TIMEOUT]);
+      if (r <= 0)
+        return ma_async_sm_abort(mysql, b);
+      b->sm_sent+= r;
+    }
+    net->write_pos= net->buff;
+    if (b->sm_call == MA_ASYNC_SM_SEND_QUERY)
+      return ma_async_sm_finish(mysql, b);
+    b->sm_state= MA_ASYNC_SM_READ;
+    b->sm_offset= 0;
+    b->sm_packets= 1;
+    b->sm_header= 1;
+  }
+
+  while (b->sm_packets)
+  {
+    size_t cached= pvio->cache + pvio->cache_size - pvio->cache_pos;
+    size_t needed= b->sm_offset + NET_HEADER_SIZE;
+    int rc;
+
+    if (cached >= needed)
+    {
+      uchar *pos= pvio->cache_pos + b->sm_offset;
+      ulong length= uint3korr(pos);
+
+      needed+= length;
+      if (cached >= needed)
+      {
+        b->sm_offset= needed;
+        pos+= NET_HEADER_SIZE;
+        /* packet is continued in the next packet */
+        if (length == MAX_PACKET_LENGTH)
+          continue;
+        /* progress reports are read by ma_net_safe_read */
+        if (length >= 3 && pos[0] == 255 && uint2korr(pos + 1) == 65535)
+          continue;
+        if (b->sm_header)
+        {
+          b->sm_header= 0;
+          /* result set: column definitions and eof packet follow */
+          if (pos[0] != 0 && pos[0] != 255 && pos[0] != 251)
+            b->sm_packets+= net_field_length(&pos) + 1;
+        }
+        b->sm_packets--;
+        continue;
+      }
+    }
+    if (!(rc= ma_pvio_cache_fill(pvio, needed)))
+      return ma_async_sm_wait(b, MYSQL_WAIT_READ,
+                              pvio->timeout[PVIO_READ_TIMEOUT]);
+    if (rc < 0)
+      return ma_async_sm_abort(mysql, b);
+  }
+  return ma_async_sm_finish(mysql, b);
+}
+
+/*
+  Starts a stackless call: arg is the query for calls which send a
+  command, result the result set for mysql_fetch_row. Returns -1 if the
+  co-routine has to be used, otherwise like foo_start().
+*/
+static int ma_async_sm_start(MYSQL *mysql, unsigned int call,
+                             const char *arg, size_t length, MYSQL_RES *result)
+{
+  struct mysql_async_context *b= mysql->options.extension->async_context;
+
+  if (!ma_async_sm_supported(mysql))
+    return -1;
+  if (call == MA_ASYNC_SM_FETCH_ROW &&
+      (result->data || result->eof || mysql->status != MYSQL_STATUS_USE_RESULT))
+    return -1;
+  b->sm_call= call;
+  b->sm_result= result;
+  if (arg)
+  {
+    if (length + NET_HEADER_SIZE + 1 > (size_t)(mysql->net.buff_end - mysql->net.buff) ||
+        (call == MA_ASYNC_SM_REAL_QUERY && OPT_EXT_VAL(mysql, multi_command)))
+    {
+      b->sm_call= MA_ASYNC_SM_NONE;
+      return -1;
+    }
+    if (ma_net_prepare_command(mysql, COM_QUERY, arg, length))
+    {
+      b->ret_result.r_int= -1;
+      b->sm_call= MA_ASYNC_SM_NONE;
+      return 0;
+    }
+    b->sm_state= MA_ASYNC_SM_SEND;
+    b->sm_sent= 0;
+  }
+  else
+  {
+    b->sm_state= MA_ASYNC_SM_READ;
+    b->sm_offset= 0;
+    b->sm_packets= 1;
+    b->sm_header= (call != MA_ASYNC_SM_FETCH_ROW);
+  }
+  return ma_async_sm_run(mysql, b);
+}
+
+static int ma_async_sm_continue(MYSQL *mysql, struct mysql_async_context *b,
+                                int ready_status)
+{
+  b->events_occured= ready_status;
+  b->suspended= 0;
+  if (b->suspend_resume_hook)
+    (*b->suspend_resume_hook)(FALSE, b->suspend_resume_hook_user_data);
+  if (ready_status & MYSQL_WAIT_TIMEOUT)
+    return ma_async_sm_abort(mysql, b);
+  return ma_async_sm_run(mysql, b);
+}
+
 /*
   Now create non-blocking definitions for all the calls that may block.
 
@@ -240,7 +469,7 @@ my_ssl_write_async(struct mysql_async_context *b, SSL *ssl,
   int res;                                                                    \
   struct mysql_async_context *b=                                              \
     (mysql_val)->options.extension->async_context;                            \
-  if (!b->suspended)                                                          \
+  if (!b->suspended || b->sm_call)                                            \
   {                                                                           \
     set_mariadb_error((mysql_val), CR_COMMANDS_OUT_OF_SYNC, unknown_sqlstate);  \
     *ret= err_val;                                                            \
@@ -297,7 +526,7 @@ my_ssl_write_async(struct mysql_async_context *b, SSL *ssl,
   int res;                                                                    \
   struct mysql_async_context *b=                                              \
     (mysql_val)->options.extension->async_context;                            \
-  if (!b->suspended)                                                          \
+  if (!b->suspended || b->sm_call)                                            \
   {                                                                           \
     set_mariadb_error((mysql_val), CR_COMMANDS_OUT_OF_SYNC, unknown_sqlstate);  \
     return 0;                                                                 \
@@ -315,6 +544,55 @@ my_ssl_write_async(struct mysql_async_context *b, SSL *ssl,
   return 0;
 
 
+/*
+  Stackless variants (see ma_async_sm_start()): MK_ASYNC_SM_START is used
+  as extra1 of MK_ASYNC_START_BODY and returns if the call doesn't need
+  the co-routine, MK_ASYNC_SM_CONT_BODY continues either kind of call.
+*/
+#define MK_ASYNC_SM_START(mysql_val, call, arg, length, result, ok_val)      \
+  b= (mysql_val)->options.extension->async_context;                           \
+  if ((res= ma_async_sm_start((mysql_val), (call), (arg), (length),           \
+                              (result))) >= 0)                                \
+  {                                                                           \
+    if (!res)                                                                 \
+      *ret= b->ret_result. ok_val;                                            \
+    return res;                                                               \
+  }
+
+#define MK_ASYNC_SM_CONT_BODY(mysql_val, call, err_val, ok_val)              \
+  int res;                                                                    \
+  struct mysql_async_context *b=                                              \
+    (mysql_val)->options.extension->async_context;                            \
+  if (!b->suspended || (b->sm_call && b->sm_call != (call)))                  \
+  {                                                                           \
+    set_mariadb_error((mysql_val), CR_COMMANDS_OUT_OF_SYNC, unknown_sqlstate);  \
+    *ret= err_val;                                                            \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
+  if (b->sm_call)                                                             \
+  {                                                                           \
+    if ((res= ma_async_sm_continue((mysql_val), b, ready_status)))            \
+      return res;                                                             \
+    *ret= b->ret_result. ok_val;                                              \
+    return 0;                                                                 \
+  }                                                                           \
+  b->active= 1;                                                               \
+  b->events_occured= ready_status;                                            \
+  res= my_context_continue(&b->async_context);                                \
+  b->active= 0;                                                               \
+  if (res > 0)                                                                \
+    return b->events_to_wait_for;               /* (Still) suspended */       \
+  b->suspended= 0;                                                            \
+  if (res < 0)                                                                \
+  {                                                                           \
+    set_mariadb_error((mysql_val), CR_OUT_OF_MEMORY, unknown_sqlstate);         \
+    *ret= err_val;                                                            \
+  }                                                                           \
+  else                                                                        \
+    *ret= b->ret_result. ok_val;                /* Finished. */               \
+  return 0;
+
 /* Structure used to pass parameters from mysql_real_connect_start(). */
 struct mysql_real_connect_params {
   MYSQL *mysql;
@@ -399,6 +677,9 @@ mysql_real_query_start(int *ret, MYSQL *mysql, const char *stmt_str, size_t leng
     parms.stmt_str= stmt_str;
     parms.length= length;
   }
+  MK_ASYNC_SM_START(mysql, MA_ASYNC_SM_REAL_QUERY, stmt_str,
+                    length == (size_t)-1 ? strlen(stmt_str) : length, NULL,
+                    r_int)
 
   b->active= 1;
   res= my_context_spawn(&b->async_context, mysql_real_query_start_internal, &parms);
@@ -422,8 +703,9 @@ mysql_real_query_start(int *ret, MYSQL *mysql, const char *stmt_str, size_t leng
 int STDCALL
 mysql_real_query_cont(int *ret, MYSQL *mysql, int ready_status)
 {
-MK_ASYNC_CONT_BODY(
+MK_ASYNC_SM_CONT_BODY(
   mysql,
+  MA_ASYNC_SM_REAL_QUERY,
   1,
   r_int)
 }
@@ -464,13 +746,16 @@ MK_ASYNC_START_BODY(
   {
     *ret= mysql_fetch_row(result);
     return 0;
-  })
+  }
+  MK_ASYNC_SM_START(result->handle, MA_ASYNC_SM_FETCH_ROW, NULL, 0, result,
+                    r_ptr))
 }
 int STDCALL
 mysql_fetch_row_cont(MYSQL_ROW *ret, MYSQL_RES *result, int ready_status)
 {
-MK_ASYNC_CONT_BODY(
+MK_ASYNC_SM_CONT_BODY(
   result->handle,
+  MA_ASYNC_SM_FETCH_ROW,
   NULL,
   r_ptr)
 }
@@ -583,13 +868,14 @@ MK_ASYNC_START_BODY(
   },
   1,
   r_int,
-  /* Nothing */)
+  MK_ASYNC_SM_START(mysql, MA_ASYNC_SM_SEND_QUERY, q, length, NULL, r_int))
 }
 int STDCALL
 mysql_send_query_cont(int *ret, MYSQL *mysql, int ready_status)
 {
-MK_ASYNC_CONT_BODY(
+MK_ASYNC_SM_CONT_BODY(
   mysql,
+  MA_ASYNC_SM_SEND_QUERY,
   1,
   r_int)
 }
@@ -813,13 +1099,14 @@ MK_ASYNC_START_BODY(
   },
   1,
   r_int,
-  /* Nothing */)
+  MK_ASYNC_SM_START(mysql, MA_ASYNC_SM_REAL_QUERY, q, strlen(q), NULL, r_int))
 }
 int STDCALL
 mysql_query_cont(int *ret, MYSQL *mysql, int ready_status)
 {
-MK_ASYNC_CONT_BODY(
+MK_ASYNC_SM_CONT_BODY(
   mysql,
+  MA_ASYNC_SM_REAL_QUERY,
   1,
   r_int)
 }
@@ -1312,13 +1599,15 @@ MK_ASYNC_START_BODY(
   },
   TRUE,
   r_my_bool,
-  /* Nothing */)
+  MK_ASYNC_SM_START(mysql, MA_ASYNC_SM_READ_QUERY_RESULT, NULL, 0, NULL,
+                    r_my_bool))
 }
 int STDCALL
 mysql_read_query_result_cont(my_bool *ret, MYSQL *mysql, int ready_status)
 {
-MK_ASYNC_CONT_BODY(
+MK_ASYNC_SM_CONT_BODY(
   mysql,
+  MA_ASYNC_SM_READ_QUERY_RESULT,
   TRUE,
   r_my_bool)
 }
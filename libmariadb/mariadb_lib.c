@@ -27,6 +27,7 @@
 #include <ma_string.h>
 #include <mariadb_ctype.h>
 #include <ma_common.h>
+#include <ma_compress.h>
 #include "ma_context.h"
 #include "mysql.h"
 #include "mariadb_version.h"
@@ -104,6 +105,16 @@ extern void mthd_stmt_flush_unbuffered(MYSQL_STMT *stmt);
 extern my_bool _mariadb_read_options(MYSQL *mysql, const char *config_file,
                                      char *group);
 extern unsigned char *mysql_net_store_length(unsigned char *packet, size_t length);
+extern size_t ma_net_length_size(size_t length);
+extern void ma_prefetch_start(MYSQL *mysql);
+extern ulong ma_prefetch_end(MYSQL *mysql);
+extern void ma_prefetch_lock(MYSQL *mysql);
+extern void ma_prefetch_unlock(MYSQL *mysql);
+extern size_t ma_prefetch_cache_capacity(MYSQL *mysql);
+extern ulong ma_read_row_packet(MYSQL *mysql, uchar **packet);
+extern my_bool ma_stats_latency(MA_STATS *stats, unsigned int command,
+                                unsigned long long *buckets);
+extern void ma_stats_free(MA_STATS *stats);
 
 extern void
 my_context_install_suspend_resume_hook(struct mysql_async_context *b,
@@ -133,9 +144,17 @@ struct st_mariadb_methods MARIADB_DEFAULT_METHODS;
   (((mysql)->extension->conn_hdlr))
 
 static void end_server(MYSQL *mysql);
+ulong ma_net_check_packet(MYSQL *mysql, ulong len);
 static void mysql_close_memory(MYSQL *mysql);
 void read_user_name(char *name);
 my_bool STDCALL mariadb_reconnect(MYSQL *mysql);
+void ma_stmt_cache_clear(MYSQL *mysql);
+static void free_old_query(MYSQL *mysql);
+static void ma_pipeline_free(MYSQL *mysql);
+static int ma_pipeline_write(MYSQL *mysql, enum enum_server_command command,
+                             const char *arg, size_t length);
+static int ma_pipeline_read_result(MYSQL *mysql);
+int stmt_read_execute_response(MYSQL_STMT *stmt);
 static int cli_report_progress(MYSQL *mysql, uchar *packet, uint length);
 
 extern int mysql_client_plugin_init();
@@ -183,10 +202,22 @@ ma_net_safe_read(MYSQL *mysql)
   NET *net= &mysql->net;
   ulong len=0;
 
-restart:
   if (net->pvio != 0)
     len=ma_net_read(net);
+  return ma_net_check_packet(mysql, len);
+}
+
+/*
+  Checks a packet of length len which was read by ma_net_read(): sets the
+  error for a lost connection or an error packet and skips progress
+  reports.
+*/
+ulong
+ma_net_check_packet(MYSQL *mysql, ulong len)
+{
+  NET *net= &mysql->net;
 
+restart:
   if (len == packet_error || len == 0)
   {
     end_server(mysql);
@@ -215,6 +246,7 @@ restart:
           my_set_error(mysql, CR_MALFORMED_PACKET, SQLSTATE_UNKNOWN, 0);
           return (packet_error);
         }
+        len= net->pvio ? ma_net_read(net) : 0;
         goto restart;
       }
       net->last_errno= last_errno;
@@ -339,15 +371,356 @@ net_field_length_ll(uchar **packet)
 }
 
 
+/* Frees the row index directory, must be called before the rows are freed */
+void ma_data_free_index(MYSQL_DATA *data)
+{
+  struct st_mariadb_data_extension *data_ext=
+    (struct st_mariadb_data_extension *)data->extension;
+
+  if (data_ext)
+    free(data_ext->row_index);
+  data->extension= NULL;
+}
+
 void free_rows(MYSQL_DATA *cur)
 {
   if (cur)
   {
+    ma_data_free_index(cur);
     ma_free_root(&cur->alloc,MYF(0));
     free(cur);
   }
 }
 
+/*
+  Allocate an extension for a buffered result set. The extension is
+  allocated from the result's memory root, so it will be released
+  together with the rows. The chunk directory of the row index is
+  allocated separately and must be released with ma_data_free_index()
+  before the memory root is freed.
+*/
+struct st_mariadb_data_extension *ma_data_init_extension(MYSQL_DATA *data)
+{
+  struct st_mariadb_data_extension *data_ext;
+
+  if (!(data_ext= (struct st_mariadb_data_extension *)
+          ma_alloc_root(&data->alloc, sizeof(struct st_mariadb_data_extension))))
+    return NULL;
+  memset(data_ext, 0, sizeof(struct st_mariadb_data_extension));
+  data->extension= data_ext;
+  return data_ext;
+}
+
+/*
+  Append a row to the row index of a buffered result set. The index
+  consists of fixed size chunks of row pointers, so neither the chunks
+  nor the rows need to be moved when the index grows. Only the directory
+  of chunk pointers is reallocated, it lives outside of the memory root
+  so a grown directory doesn't leave the old copy behind.
+  The row will be stored at position data->rows, so this function
+  must be called before the row counter gets incremented.
+*/
+my_bool ma_data_add_row(MYSQL_DATA *data, MYSQL_ROWS *row)
+{
+  struct st_mariadb_data_extension *data_ext=
+    (struct st_mariadb_data_extension *)data->extension;
+  size_t chunk= (size_t)(data->rows >> MA_ROW_INDEX_CHUNK_BITS);
+  size_t offset= (size_t)(data->rows & (MA_ROW_INDEX_CHUNK_SIZE - 1));
+
+  if (!data_ext)
+    return 1;
+
+  if (chunk >= data_ext->row_index_chunks)
+  {
+    size_t new_size= data_ext->row_index_chunks ? data_ext->row_index_chunks * 2 : 16;
+    MYSQL_ROWS ***new_index;
+
+    if (!(new_index= (MYSQL_ROWS ***)realloc(data_ext->row_index,
+                                             new_size * sizeof(MYSQL_ROWS **))))
+      return 1;
+    data_ext->row_index= new_index;
+    data_ext->row_index_chunks= new_size;
+  }
+  if (!offset &&
+      !(data_ext->row_index[chunk]= (MYSQL_ROWS **)ma_alloc_root(&data->alloc,
+                                      MA_ROW_INDEX_CHUNK_SIZE * sizeof(MYSQL_ROWS *))))
+    return 1;
+  data_ext->row_index[chunk][offset]= row;
+  return 0;
+}
+
+/* Returns the row at position row_nr of a buffered result set */
+MYSQL_ROWS *ma_data_get_row(MYSQL_DATA *data, unsigned long long row_nr)
+{
+  struct st_mariadb_data_extension *data_ext=
+    (struct st_mariadb_data_extension *)data->extension;
+  MYSQL_ROWS *row;
+
+  if (!data->data || row_nr >= data->rows)
+    return NULL;
+
+  if (data_ext && data_ext->row_index)
+    return data_ext->row_index[row_nr >> MA_ROW_INDEX_CHUNK_BITS]
+                              [row_nr & (MA_ROW_INDEX_CHUNK_SIZE - 1)];
+
+  /* no index available: walk the list */
+  for (row= data->data; row_nr-- && row; row= row->next);
+  return row;
+}
+
+/*
+  Pipelining: between mariadb_pipeline_begin() and mariadb_pipeline_end()
+  mysql_send_query() and mysql_stmt_execute() only append their command to
+  the net buffer and remember which result they expect. Results are read
+  in the same order by mysql_read_query_result(), which sends the buffered
+  commands first. Commands can be queued whenever no result set is being
+  read, so a connection with a high round trip time can keep the server
+  busy.
+
+  The server doesn't read further commands while it can't send its
+  results, so while commands are written the connection reads pending
+  results into the read ahead cache (see ma_pvio_write_reading). TLS
+  connections can't do this, for them the size of the commands whose
+  results were not read yet is limited to what fits into the socket
+  buffers. If MA_PIPELINE_MAX_COMMANDS or the size limit is reached,
+  further commands fail with CR_PIPELINE_FULL until results were read.
+*/
+typedef struct st_ma_pipeline_slot {
+  my_bool is_stmt;
+  MYSQL_STMT *stmt; /* NULL if the statement was closed before its result was read */
+  size_t length;    /* size of the command */
+} MA_PIPELINE_SLOT;
+
+typedef struct st_ma_pipeline {
+  MA_PIPELINE_SLOT *slots;
+  unsigned int size;
+  unsigned int first;
+  unsigned int count;
+  size_t bytes;     /* size of the commands whose results were not read */
+} MA_PIPELINE;
+
+#define MA_PIPELINE_INIT_SLOTS 16
+#define MA_PIPELINE_MAX_COMMANDS 4096
+#define MA_PIPELINE_MAX_BYTES (16 * 1024 * 1024)
+#define MA_PIPELINE_MAX_TLS_BYTES (64 * 1024)
+
+static void ma_pipeline_free(MYSQL *mysql)
+{
+  if (!mysql->extension || !mysql->extension->pipeline)
+    return;
+  free(mysql->extension->pipeline->slots);
+  free(mysql->extension->pipeline);
+  mysql->extension->pipeline= NULL;
+  if (mysql->net.pvio)
+    mysql->net.pvio->read_while_writing= 0;
+}
+
+/* writes a command without flushing the net buffer */
+static int ma_pipeline_write(MYSQL *mysql, enum enum_server_command command,
+                             const char *arg, size_t length)
+{
+  NET *net= &mysql->net;
+
+  if (!net->pvio)
+  {
+    SET_CLIENT_ERROR(mysql, CR_SERVER_GONE_ERROR, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  CLEAR_CLIENT_ERROR(mysql);
+  /* the net buffer might be overwritten */
+  mysql->info= 0;
+  net->pkt_nr= net->compress_pkt_nr= 0;
+  if (ma_net_write_command(net, (uchar)command, arg, length, 1))
+  {
+    my_set_error(mysql, net->last_errno == ER_NET_PACKET_TOO_LARGE ?
+                 CR_NET_PACKET_TOO_LARGE : CR_SERVER_LOST,
+                 SQLSTATE_UNKNOWN, 0);
+    end_server(mysql);
+    return 1;
+  }
+  return 0;
+}
+
+int ma_pipeline_send(MYSQL *mysql, enum enum_server_command command,
+                     const char *arg, size_t length, MYSQL_STMT *stmt)
+{
+  MA_PIPELINE *pipeline= mysql->extension->pipeline;
+  MA_PIPELINE_SLOT *slot;
+  size_t max_bytes;
+
+  if (mysql->status != MYSQL_STATUS_READY ||
+      mysql->server_status & SERVER_MORE_RESULTS_EXIST)
+  {
+    SET_CLIENT_ERROR(mysql, CR_COMMANDS_OUT_OF_SYNC, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  max_bytes= (mysql->net.pvio && mysql->net.pvio->read_while_writing) ?
+             MA_PIPELINE_MAX_BYTES : MA_PIPELINE_MAX_TLS_BYTES;
+  if (pipeline->count >= MA_PIPELINE_MAX_COMMANDS ||
+      (pipeline->count && pipeline->bytes + length > max_bytes))
+  {
+    /* let the server work on the queued commands until the application
+       reads their results */
+    if (ma_net_flush(&mysql->net))
+    {
+      my_set_error(mysql, CR_SERVER_LOST, SQLSTATE_UNKNOWN, 0);
+      end_server(mysql);
+      return 1;
+    }
+    my_set_error(mysql, CR_PIPELINE_FULL, SQLSTATE_UNKNOWN,
+                 CER(CR_PIPELINE_FULL), pipeline->count,
+                 (unsigned long)pipeline->bytes);
+    return 1;
+  }
+  if (pipeline->count == pipeline->size)
+  {
+    unsigned int i, size= pipeline->size * 2;
+    MA_PIPELINE_SLOT *slots;
+
+    if (!(slots= (MA_PIPELINE_SLOT *)malloc(size * sizeof(MA_PIPELINE_SLOT))))
+    {
+      SET_CLIENT_ERROR(mysql, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+      return 1;
+    }
+    for (i=0; i < pipeline->count; i++)
+      slots[i]= pipeline->slots[(pipeline->first + i) % pipeline->size];
+    free(pipeline->slots);
+    pipeline->slots= slots;
+    pipeline->size= size;
+    pipeline->first= 0;
+  }
+  if (ma_pipeline_write(mysql, command, arg, length))
+    return 1;
+  /* end_server might have released the pipeline */
+  if (!(pipeline= mysql->extension->pipeline))
+    return 1;
+  slot= &pipeline->slots[(pipeline->first + pipeline->count++) % pipeline->size];
+  slot->is_stmt= (command == COM_STMT_EXECUTE);
+  slot->stmt= stmt;
+  slot->length= length;
+  pipeline->bytes+= length;
+  return 0;
+}
+
+/* results of a closed statement are read and discarded */
+static int ma_pipeline_skip_result(MYSQL *mysql)
+{
+  do {
+    if (mysql->methods->db_read_query_result(mysql))
+      return 1;
+    if (mysql->field_count)
+    {
+      ulong pkt_len;
+
+      do {
+        if ((pkt_len= ma_net_safe_read(mysql)) == packet_error)
+          return 1;
+      } while (pkt_len > 8 || mysql->net.read_pos[0] != 254);
+      mysql->server_status= uint2korr(mysql->net.read_pos + 3);
+      mysql->status= MYSQL_STATUS_READY;
+      free_old_query(mysql);
+      mysql->field_count= 0;
+    }
+  } while (mysql->server_status & SERVER_MORE_RESULTS_EXIST);
+  return 0;
+}
+
+static int ma_pipeline_read_result(MYSQL *mysql)
+{
+  MA_PIPELINE *pipeline= mysql->extension->pipeline;
+  MA_PIPELINE_SLOT slot;
+
+  if (mysql->status != MYSQL_STATUS_READY ||
+      mysql->server_status & SERVER_MORE_RESULTS_EXIST)
+  {
+    SET_CLIENT_ERROR(mysql, CR_COMMANDS_OUT_OF_SYNC, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  if (ma_net_flush(&mysql->net))
+  {
+    my_set_error(mysql, CR_SERVER_LOST, SQLSTATE_UNKNOWN, 0);
+    end_server(mysql);
+    return 1;
+  }
+  slot= pipeline->slots[pipeline->first];
+  pipeline->first= (pipeline->first + 1) % pipeline->size;
+  pipeline->count--;
+  pipeline->bytes-= slot.length;
+
+  if (!slot.is_stmt)
+    return mysql->methods->db_read_query_result(mysql);
+  if (slot.stmt)
+    return stmt_read_execute_response(slot.stmt);
+  return ma_pipeline_skip_result(mysql);
+}
+
+void ma_pipeline_stmt_close(MYSQL *mysql, MYSQL_STMT *stmt)
+{
+  MA_PIPELINE *pipeline= mysql->extension->pipeline;
+  unsigned int i;
+
+  if (!pipeline)
+    return;
+  for (i=0; i < pipeline->count; i++)
+  {
+    MA_PIPELINE_SLOT *slot= &pipeline->slots[(pipeline->first + i) % pipeline->size];
+    if (slot->stmt == stmt)
+      slot->stmt= NULL;
+  }
+}
+
+int STDCALL mariadb_pipeline_begin(MYSQL *mysql)
+{
+  MA_PIPELINE *pipeline;
+
+  if (!mysql->net.pvio)
+  {
+    SET_CLIENT_ERROR(mysql, CR_SERVER_GONE_ERROR, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  if (mysql->extension->pipeline ||
+      mysql->status != MYSQL_STATUS_READY ||
+      mysql->server_status & SERVER_MORE_RESULTS_EXIST ||
+      mysql->net.extension->multi_status != COM_MULTI_OFF)
+  {
+    SET_CLIENT_ERROR(mysql, CR_COMMANDS_OUT_OF_SYNC, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  /* connection handlers need to see every command */
+  if (IS_CONNHDLR_ACTIVE(mysql))
+  {
+    SET_CLIENT_ERROR(mysql, CR_NOT_IMPLEMENTED, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  if (!(pipeline= (MA_PIPELINE *)calloc(1, sizeof(MA_PIPELINE))) ||
+      !(pipeline->slots= (MA_PIPELINE_SLOT *)malloc(MA_PIPELINE_INIT_SLOTS *
+                                                     sizeof(MA_PIPELINE_SLOT))))
+  {
+    free(pipeline);
+    SET_CLIENT_ERROR(mysql, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  pipeline->size= MA_PIPELINE_INIT_SLOTS;
+  ma_net_clear(&mysql->net);
+  /* TLS records can't be read without blocking */
+  mysql->net.pvio->read_while_writing= !mysql->net.pvio->ctls;
+  mysql->extension->pipeline= pipeline;
+  return 0;
+}
+
+int STDCALL mariadb_pipeline_end(MYSQL *mysql)
+{
+  if (!mysql->extension->pipeline)
+    return 0;
+  if (mysql->extension->pipeline->count)
+  {
+    SET_CLIENT_ERROR(mysql, CR_COMMANDS_OUT_OF_SYNC, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  ma_pipeline_free(mysql);
+  return 0;
+}
+
 int
 mthd_my_send_cmd(MYSQL *mysql,enum enum_server_command command, const char *arg,
 	       size_t length, my_bool skipp_check, void *opt_arg)
@@ -367,6 +740,17 @@ mthd_my_send_cmd(MYSQL *mysql,enum enum_server_command command, const char *arg,
     goto end;
   }
 
+  if (mysql->extension->pipeline && mysql->extension->pipeline->count)
+  {
+    /* commands without response can be queued behind pipelined commands,
+       all others have to wait until pending results were read */
+    if (command == COM_STMT_CLOSE || command == COM_STMT_SEND_LONG_DATA ||
+        command == COM_QUIT)
+      return ma_pipeline_write(mysql, command, arg ? arg : "", length);
+    SET_CLIENT_ERROR(mysql, CR_COMMANDS_OUT_OF_SYNC, SQLSTATE_UNKNOWN, 0);
+    goto end;
+  }
+
   if (IS_CONNHDLR_ACTIVE(mysql))
   {
     result= mysql->extension->conn_hdlr->plugin->set_connection(mysql, command, arg, length, skipp_check, opt_arg);
@@ -426,6 +810,41 @@ ma_simple_command(MYSQL *mysql,enum enum_server_command command, const char *arg
   return mysql->methods->db_command(mysql, command, arg, length, skipp_check, opt_arg);
 }
 
+/*
+  Writes a command into the net buffer without sending it: the stackless
+  non-blocking API (mariadb_async.c) sends the buffer itself. The caller
+  has to make sure that the packet fits into the buffer.
+*/
+int ma_net_prepare_command(MYSQL *mysql, enum enum_server_command command,
+                           const char *arg, size_t length)
+{
+  NET *net= &mysql->net;
+
+  if (mysql->status != MYSQL_STATUS_READY ||
+      mysql->server_status & SERVER_MORE_RESULTS_EXIST)
+  {
+    SET_CLIENT_ERROR(mysql, CR_COMMANDS_OUT_OF_SYNC, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  CLEAR_CLIENT_ERROR(mysql);
+  mysql->info= 0;
+  mysql->affected_rows= ~(unsigned long long) 0;
+  ma_net_clear(net);
+  if (ma_net_write_command(net, (uchar)command, arg, length, 1))
+  {
+    my_set_error(mysql, CR_SERVER_GONE_ERROR, SQLSTATE_UNKNOWN, 0);
+    return 1;
+  }
+  return 0;
+}
+
+/* closes the connection after an I/O error in a stackless non-blocking call */
+void ma_net_abort(MYSQL *mysql, unsigned int error)
+{
+  end_server(mysql);
+  my_set_error(mysql, error, SQLSTATE_UNKNOWN, 0);
+}
+
 int ma_multi_command(MYSQL *mysql, enum enum_multi_status status)
 {
   NET *net= &mysql->net;
@@ -543,6 +962,10 @@ end_server(MYSQL *mysql)
     ma_pvio_close(mysql->net.pvio);
     mysql->net.pvio= 0;    /* Marker */
   }
+  /* server side statements were released together with the connection */
+  ma_stmt_cache_clear(mysql);
+  /* results of pipelined commands are lost */
+  ma_pipeline_free(mysql);
   ma_net_end(&mysql->net);
   free_old_query(mysql);
   return;
@@ -550,13 +973,15 @@ end_server(MYSQL *mysql)
 
 void mthd_my_skip_result(MYSQL *mysql)
 {
-  ulong pkt_len;
+  ulong pkt_len= 0;
 
-  do {
+  /* rows which were read ahead are discarded */
+  if (mysql->extension->prefetch)
+    pkt_len= ma_prefetch_end(mysql);
+
+  while (pkt_len != packet_error &&
+         (!pkt_len || pkt_len > 8 || mysql->net.read_pos[0] != 254))
     pkt_len= ma_net_safe_read(mysql);
-    if (pkt_len == packet_error)
-      break;
-  } while (pkt_len > 8 || mysql->net.read_pos[0] != 254);
   return;
 }
 
@@ -641,6 +1066,15 @@ struct st_default_options mariadb_defaults[] =
   {MARIADB_OPT_SSL_FP_LIST, MARIADB_OPTION_STR, "ssl-fplist"},
   {MARIADB_OPT_TLS_PASSPHRASE, MARIADB_OPTION_STR, "ssl_passphrase"},
   {MYSQL_OPT_BIND, MARIADB_OPTION_STR, "bind-address"},
+  {MARIADB_OPT_COMPRESSION_ALGORITHMS, MARIADB_OPTION_STR, "compression-algorithms"},
+  {MARIADB_OPT_COMPRESSION_LEVEL, MARIADB_OPTION_INT, "compression-level"},
+  {MARIADB_OPT_READ_AHEAD_MIN_SIZE, MARIADB_OPTION_SIZET, "read-ahead-min-size"},
+  {MARIADB_OPT_READ_AHEAD_MAX_SIZE, MARIADB_OPTION_SIZET, "read-ahead-max-size"},
+  {MARIADB_OPT_STMT_CACHE_SIZE, MARIADB_OPTION_INT, "stmt-cache-size"},
+  {MARIADB_OPT_RESULT_PREFETCH_ROWS, MARIADB_OPTION_INT, "result-prefetch-rows"},
+  {MARIADB_OPT_TLS_KTLS, MARIADB_OPTION_BOOL, "tls-ktls"},
+  {MARIADB_OPT_DNS_CACHE_TTL, MARIADB_OPTION_INT, "dns-cache-ttl"},
+  {MARIADB_OPT_STATS_TIMING, MARIADB_OPTION_BOOL, "stats-timing"},
   {0, 0, NULL}
 };
 
@@ -815,6 +1249,77 @@ unpack_fields(MYSQL_DATA *data,MA_MEM_ROOT *alloc,uint fields,
 }
 
 
+/*
+  Store one result set row in packed format: the received packet is copied
+  as a whole into the row buffer and field pointers are set up in place.
+  The length byte(s) of the following field are overwritten by the
+  terminating zero of the previous field.
+  Length prefixes are kept in their shortest encoding (the server always
+  sends them that way, other encodings are compacted in place), so
+  mysql_fetch_lengths() can derive the lengths from the field pointers.
+*/
+static MYSQL_ROWS *ma_store_packed_row(MYSQL *mysql, MYSQL_DATA *data,
+                                       MYSQL_FIELD *mysql_fields,
+                                       uint fields, ulong pkt_len)
+{
+  uint field;
+  ulong len;
+  size_t prefix;
+  uchar *pos, *to, *start, *prev_pos= 0, *end_pos;
+  MYSQL_ROWS *cur;
+
+  if (!(cur= (MYSQL_ROWS *)ma_alloc_root(&data->alloc,
+                                         sizeof(MYSQL_ROWS) +
+                                         (fields + 1) * sizeof(char *) +
+                                         pkt_len + 1)))
+  {
+    SET_CLIENT_ERROR(mysql, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+    return NULL;
+  }
+  cur->data= (MYSQL_ROW)(cur + 1);
+  pos= to= (uchar *)(cur->data + fields + 1);
+  memcpy(pos, mysql->net.read_pos, pkt_len);
+  end_pos= pos + pkt_len;
+  cur->length= pkt_len;
+
+  for (field=0; field < fields; field++)
+  {
+    start= pos;
+    if ((len= (ulong)net_field_length(&pos)) == NULL_LENGTH)
+    {
+      cur->data[field]= 0;
+      *to++= 251;
+    }
+    else
+    {
+      if (len > (ulong)(end_pos - pos))
+      {
+        SET_CLIENT_ERROR(mysql, CR_UNKNOWN_ERROR, SQLSTATE_UNKNOWN, 0);
+        return NULL;
+      }
+      prefix= ma_net_length_size(len);
+      if (to != start || (size_t)(pos - start) != prefix)
+      {
+        mysql_net_store_length(to, len);
+        memmove(to + prefix, pos, len);
+      }
+      to+= prefix;
+      cur->data[field]= (char *)to;
+      pos+= len;
+      to+= len;
+      if (mysql_fields[field].max_length < len)
+        mysql_fields[field].max_length= len;
+    }
+    if (prev_pos)
+      *prev_pos= 0;                     /* Terminate prev field */
+    prev_pos= to;
+  }
+  if (prev_pos)
+    *prev_pos= 0;                       /* Terminate last field */
+  cur->data[field]= (char *)to + 1;     /* End of last field */
+  return cur;
+}
+
 /* Read all rows (fields or data) from server */
 
 MYSQL_DATA *mthd_my_read_rows(MYSQL *mysql,MYSQL_FIELD *mysql_fields,
@@ -828,6 +1333,7 @@ MYSQL_DATA *mthd_my_read_rows(MYSQL *mysql,MYSQL_FIELD *mysql_fields,
   MYSQL_DATA *result;
   MYSQL_ROWS **prev_ptr,*cur;
   NET *net = &mysql->net;
+  struct st_mariadb_data_extension *data_ext= NULL;
 
   if ((pkt_len= ma_net_safe_read(mysql)) == packet_error)
     return(0);
@@ -842,8 +1348,44 @@ MYSQL_DATA *mthd_my_read_rows(MYSQL *mysql,MYSQL_FIELD *mysql_fields,
   result->rows=0;
   result->fields=fields;
 
+  /* Result set rows (but not metadata, which is processed by
+     unpack_fields) are stored in packed format */
+  if (mysql_fields)
+  {
+    if (!(data_ext= ma_data_init_extension(result)))
+    {
+      free_rows(result);
+      SET_CLIENT_ERROR(mysql, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+      return(0);
+    }
+    data_ext->packed_rows= 1;
+  }
+
   while (*(cp=net->read_pos) != 254 || pkt_len >= 8)
   {
+    if (data_ext)
+    {
+      if (!(cur= ma_store_packed_row(mysql, result, mysql_fields, fields, pkt_len)))
+      {
+        free_rows(result);
+        return(0);
+      }
+      if (ma_data_add_row(result, cur))
+      {
+        free_rows(result);
+        SET_CLIENT_ERROR(mysql, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+        return(0);
+      }
+      result->rows++;
+      *prev_ptr=cur;
+      prev_ptr= &cur->next;
+      if ((pkt_len=ma_net_safe_read(mysql)) == packet_error)
+      {
+        free_rows(result);
+        return(0);
+      }
+      continue;
+    }
     result->rows++;
     if (!(cur= (MYSQL_ROWS*) ma_alloc_root(&result->alloc,
 					    sizeof(MYSQL_ROWS))) ||
@@ -877,11 +1419,6 @@ MYSQL_DATA *mthd_my_read_rows(MYSQL *mysql,MYSQL_FIELD *mysql_fields,
         memcpy(to,(char*) cp,len); to[len]=0;
         to+=len+1;
         cp+=len;
-        if (mysql_fields)
-        {
-          if (mysql_fields[field].max_length < len)
-            mysql_fields[field].max_length=len;
-         }
       }
     }
     cur->data[field]=to;			/* End of last field */
@@ -916,17 +1453,16 @@ int mthd_my_read_one_row(MYSQL *mysql,uint fields,MYSQL_ROW row, ulong *lengths)
   ulong pkt_len,len;
   uchar *pos,*prev_pos, *end_pos;
 
-  if ((pkt_len=(uint) ma_net_safe_read(mysql)) == packet_error)
+  if ((pkt_len=(uint) ma_read_row_packet(mysql, &pos)) == packet_error)
     return -1;
 
-  if (pkt_len <= 8 && mysql->net.read_pos[0] == 254)
+  if (pkt_len <= 8 && pos[0] == 254)
   {
-    mysql->warning_count= uint2korr(mysql->net.read_pos + 1);
-    mysql->server_status= uint2korr(mysql->net.read_pos + 3);
+    mysql->warning_count= uint2korr(pos + 1);
+    mysql->server_status= uint2korr(pos + 3);
     return 1;				/* End of data */
   }
   prev_pos= 0;				/* allowed to write at packet[-1] */
-  pos=mysql->net.read_pos;
   end_pos=pos+pkt_len;
   for (field=0 ; field < fields ; field++)
   {
@@ -1479,8 +2015,19 @@ MYSQL *mthd_my_real_connect(MYSQL *mysql, const char *host, const char *user,
                              scramble_plugin, db))
     goto error;
 
-  if (mysql->client_flag & CLIENT_COMPRESS)
+  if (mysql->client_flag & (CLIENT_COMPRESS | CLIENT_ZSTD_COMPRESSION_ALGORITHM))
+  {
+    if (!(net->extension->compression=
+          ma_compression_init((mysql->client_flag & CLIENT_ZSTD_COMPRESSION_ALGORITHM) ?
+                              MA_COMPRESSION_ZSTD : MA_COMPRESSION_ZLIB,
+                              mysql->options.extension ?
+                              mysql->options.extension->compression_level : 0)))
+    {
+      SET_CLIENT_ERROR(mysql, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+      goto error;
+    }
     net->compress= 1;
+  }
 
   /* last part: select default db */
   if (db && !mysql->db)
@@ -1595,6 +2142,7 @@ my_bool STDCALL mariadb_reconnect(MYSQL *mysql)
   tmp_mysql.options.my_cnf_group= tmp_mysql.options.my_cnf_file= NULL;
   if (IS_MYSQL_ASYNC_ACTIVE(mysql))
   {
+    ctxt= mysql->options.extension->async_context;
     hook_data.orig_mysql= mysql;
     hook_data.new_mysql= &tmp_mysql;
     hook_data.orig_pvio= mysql->net.pvio;
@@ -1628,6 +2176,9 @@ my_bool STDCALL mariadb_reconnect(MYSQL *mysql)
     }
   }
 
+  if (ctxt)
+    my_context_install_suspend_resume_hook(ctxt, NULL, NULL);
+
   tmp_mysql.free_me= mysql->free_me;
   tmp_mysql.stmts= mysql->stmts;
   mysql->stmts= NULL;
@@ -1646,6 +2197,9 @@ my_bool STDCALL mariadb_reconnect(MYSQL *mysql)
 
 void ma_invalidate_stmts(MYSQL *mysql, const char *function_name)
 {
+  /* cached statement ids are no longer valid */
+  ma_stmt_cache_clear(mysql);
+
   if (mysql->stmts)
   {
     LIST *li_stmt= mysql->stmts;
@@ -1816,6 +2370,7 @@ static void mysql_close_options(MYSQL *mysql)
     free(mysql->options.extension->tls_version);
     free(mysql->options.extension->url);
     free(mysql->options.extension->connection_handler);
+    free(mysql->options.extension->compression_algorithms);
     if(hash_inited(&mysql->options.extension->connect_attrs))
       hash_free(&mysql->options.extension->connect_attrs);
     if (hash_inited(&mysql->options.extension->userdata))
@@ -1897,6 +2452,10 @@ mysql_close(MYSQL *mysql)
       free(p);
     }
 
+    /* stop reading ahead rows of an unbuffered result set */
+    if (mysql->extension && mysql->extension->prefetch)
+      ma_prefetch_end(mysql);
+
     if (mysql->methods)
       mysql->methods->db_close(mysql);
 
@@ -1916,7 +2475,11 @@ mysql_close(MYSQL *mysql)
     memset((char*) &mysql->options, 0, sizeof(mysql->options));
 
     if (mysql->extension)
+    {
+      ma_pipeline_free(mysql);
+      ma_stats_free(&mysql->extension->stats);
       free(mysql->extension);
+    }
 
     mysql->net.pvio= 0;
     if (mysql->free_me)
@@ -1946,6 +2509,8 @@ mysql_query(MYSQL *mysql, const char *query)
 int STDCALL
 mysql_send_query(MYSQL* mysql, const char* query, size_t length)
 {
+  if (mysql->extension->pipeline)
+    return ma_pipeline_send(mysql, COM_QUERY, query, length, NULL);
   return ma_simple_command(mysql, COM_QUERY, query, length, 1,0);
 }
 
@@ -2137,6 +2702,8 @@ int STDCALL mysql_session_track_get_first(MYSQL *mysql, enum enum_session_state_
 my_bool STDCALL
 mysql_read_query_result(MYSQL *mysql)
 {
+  if (mysql->extension->pipeline && mysql->extension->pipeline->count)
+    return test(ma_pipeline_read_result(mysql));
   return test(mysql->methods->db_read_query_result(mysql)) ? 1 : 0;
 }
 
@@ -2240,6 +2807,7 @@ mysql_use_result(MYSQL *mysql)
   result->current_row=	0;
   mysql->fields=0;			/* fields is now in result */
   mysql->status=MYSQL_STATUS_USE_RESULT;
+  ma_prefetch_start(mysql);
   return(result);			/* Data is read to be fetched */
 }
 
@@ -2311,6 +2879,29 @@ mysql_fetch_lengths(MYSQL_RES *res)
     return 0;					/* Something is wrong */
   if (res->data)
   {
+    struct st_mariadb_data_extension *data_ext=
+      (struct st_mariadb_data_extension *)res->data->extension;
+
+    /* packed rows: walk backwards from the end of the last field, each
+       field is preceded by its length prefix, a NULL field takes one byte */
+    if (data_ext && data_ext->packed_rows)
+    {
+      uint i= res->field_count;
+
+      start= column[i] - 1;
+      while (i--)
+      {
+        if (!column[i])
+        {
+          res->lengths[i]= 0;
+          start--;
+          continue;
+        }
+        res->lengths[i]= (ulong)(start - column[i]);
+        start= column[i] - ma_net_length_size(res->lengths[i]);
+      }
+      return res->lengths;
+    }
     start=0;
     prev_length=0;				/* Keep gcc happy */
     lengths=res->lengths;
@@ -2339,7 +2930,7 @@ mysql_data_seek(MYSQL_RES *result, unsigned long long row)
 {
   MYSQL_ROWS	*tmp=0;
   if (result->data)
-    for (tmp=result->data->data; row-- && tmp ; tmp = tmp->next) ;
+    tmp= ma_data_get_row(result->data, row);
   result->current_row=0;
   result->data_cursor = tmp;
 }
@@ -2949,6 +3540,49 @@ mysql_optionsv(MYSQL *mysql,enum mysql_option option, ...)
   case MARIADB_OPT_CONNECTION_READ_ONLY:
     OPT_SET_EXTENDED_VALUE_INT(&mysql->options, read_only, *(my_bool *)arg1);
     break;
+  case MARIADB_OPT_COMPRESSION_ALGORITHMS:
+    OPT_SET_EXTENDED_VALUE_STR(&mysql->options, compression_algorithms, (char *)arg1);
+    mysql->options.compress= 1;			/* Remember for connect */
+    mysql->options.client_flag|= CLIENT_COMPRESS;
+    break;
+  case MARIADB_OPT_COMPRESSION_LEVEL:
+    if (ma_compression_check_level(mysql->options.extension ?
+                                   mysql->options.extension->compression_algorithms : NULL,
+                                   *((unsigned int *)arg1)))
+    {
+      SET_CLIENT_ERROR(mysql, CR_INVALID_PARAMETER_NO, SQLSTATE_UNKNOWN, 0);
+      goto end;
+    }
+    OPT_SET_EXTENDED_VALUE_INT(&mysql->options, compression_level, *((unsigned int *)arg1));
+    break;
+  case MARIADB_OPT_READ_AHEAD_MIN_SIZE:
+    OPT_SET_EXTENDED_VALUE_INT(&mysql->options, read_ahead_min_size, *((size_t *)arg1));
+    break;
+  case MARIADB_OPT_READ_AHEAD_MAX_SIZE:
+    OPT_SET_EXTENDED_VALUE_INT(&mysql->options, read_ahead_max_size, *((size_t *)arg1));
+    break;
+  case MARIADB_OPT_STMT_CACHE_SIZE:
+    OPT_SET_EXTENDED_VALUE_INT(&mysql->options, stmt_cache_size, *((unsigned int *)arg1));
+    break;
+  case MARIADB_OPT_ASYNC_STACK_GUARD:
+    /* process-wide, mysql is ignored */
+    my_context_stack_guard= test(*(my_bool *)arg1);
+    break;
+  case MARIADB_OPT_ASYNC_STACK_WATERMARK:
+    my_context_stack_watermark= test(*(my_bool *)arg1);
+    break;
+  case MARIADB_OPT_RESULT_PREFETCH_ROWS:
+    OPT_SET_EXTENDED_VALUE_INT(&mysql->options, result_prefetch_rows, *((unsigned int *)arg1));
+    break;
+  case MARIADB_OPT_TLS_KTLS:
+    OPT_SET_EXTENDED_VALUE_INT(&mysql->options, tls_ktls, *(my_bool *)arg1);
+    break;
+  case MARIADB_OPT_DNS_CACHE_TTL:
+    OPT_SET_EXTENDED_VALUE_INT(&mysql->options, dns_cache_ttl, *(unsigned int *)arg1);
+    break;
+  case MARIADB_OPT_STATS_TIMING:
+    OPT_SET_EXTENDED_VALUE_INT(&mysql->options, stats_timing, *(my_bool *)arg1);
+    break;
   default:
     va_end(ap);
     return(-1);
@@ -3135,6 +3769,41 @@ mysql_get_optionv(MYSQL *mysql, enum mysql_option option, void *arg, ...)
   case MARIADB_OPT_CONNECTION_READ_ONLY:
     *((my_bool *)arg)= mysql->options.extension ? mysql->options.extension->read_only : 0;
     break;
+  case MARIADB_OPT_COMPRESSION_ALGORITHMS:
+    *((char **)arg)= mysql->options.extension ? mysql->options.extension->compression_algorithms : NULL;
+    break;
+  case MARIADB_OPT_COMPRESSION_LEVEL:
+    *((unsigned int *)arg)= mysql->options.extension ? mysql->options.extension->compression_level : 0;
+    break;
+  case MARIADB_OPT_READ_AHEAD_MIN_SIZE:
+    *((size_t *)arg)= (mysql->options.extension && mysql->options.extension->read_ahead_min_size) ?
+                      mysql->options.extension->read_ahead_min_size : PVIO_READ_AHEAD_CACHE_MIN_SIZE;
+    break;
+  case MARIADB_OPT_READ_AHEAD_MAX_SIZE:
+    *((size_t *)arg)= (mysql->options.extension && mysql->options.extension->read_ahead_max_size) ?
+                      mysql->options.extension->read_ahead_max_size : PVIO_READ_AHEAD_CACHE_MAX_SIZE;
+    break;
+  case MARIADB_OPT_STMT_CACHE_SIZE:
+    *((unsigned int *)arg)= mysql->options.extension ? mysql->options.extension->stmt_cache_size : 0;
+    break;
+  case MARIADB_OPT_ASYNC_STACK_GUARD:
+    *((my_bool *)arg)= my_context_stack_guard;
+    break;
+  case MARIADB_OPT_ASYNC_STACK_WATERMARK:
+    *((my_bool *)arg)= my_context_stack_watermark;
+    break;
+  case MARIADB_OPT_RESULT_PREFETCH_ROWS:
+    *((unsigned int *)arg)= mysql->options.extension ? mysql->options.extension->result_prefetch_rows : 0;
+    break;
+  case MARIADB_OPT_TLS_KTLS:
+    *((my_bool *)arg)= mysql->options.extension ? mysql->options.extension->tls_ktls : 0;
+    break;
+  case MARIADB_OPT_DNS_CACHE_TTL:
+    *((unsigned int *)arg)= mysql->options.extension ? mysql->options.extension->dns_cache_ttl : 0;
+    break;
+  case MARIADB_OPT_STATS_TIMING:
+    *((my_bool *)arg)= MA_STATS_TIMING(mysql);
+    break;
   case MARIADB_OPT_USERDATA:
     /* nysql_get_optionv(mysql, MARIADB_OPT_USERDATA, key, value) */
     {
@@ -3454,6 +4123,7 @@ static void mysql_once_init()
   }
   if (!mysql_ps_subsystem_initialized)
     mysql_init_ps_subsystem();
+  ma_dns_cache_init();
   ignore_sigpipe();
   mysql_client_init = 1;
 #ifdef _WIN32
@@ -3494,6 +4164,8 @@ void STDCALL mysql_server_end(void)
   mysql_client_plugin_deinit();
 
   list_free(pvio_callback, 0);
+  my_context_pool_end();
+  ma_dns_cache_end();
   if (ma_init_done)
     ma_end(0);
 #ifdef HAVE_TLS
@@ -3811,6 +4483,74 @@ my_bool STDCALL mariadb_get_infov(MYSQL *mysql, enum mariadb_value value, void *
       *((unsigned long *)arg)= mysql->client_flag;
     else
       goto error;
+    break;
+  case MARIADB_ASYNC_STACKS_IN_USE:
+  case MARIADB_ASYNC_STACKS_POOLED:
+  case MARIADB_ASYNC_STACK_MAX_USED:
+    {
+      unsigned int in_use, pooled;
+      size_t max_used;
+
+      my_context_pool_stats(&in_use, &pooled, &max_used);
+      if (value == MARIADB_ASYNC_STACK_MAX_USED)
+        *((size_t *)arg)= max_used;
+      else
+        *((unsigned int *)arg)= value == MARIADB_ASYNC_STACKS_IN_USE ? in_use : pooled;
+    }
+    break;
+  case MARIADB_CONNECTION_STATS:
+    if (!mysql || !mysql->extension)
+      goto error;
+    ma_prefetch_lock(mysql);
+    *((MARIADB_STATS *)arg)= mysql->extension->stats.counters;
+    ma_prefetch_unlock(mysql);
+    break;
+  case MARIADB_CONNECTION_COMMAND_LATENCY:
+    {
+      unsigned int command= va_arg(ap, unsigned int);
+
+      if (!mysql || !mysql->extension ||
+          ma_stats_latency(&mysql->extension->stats, command,
+                           (unsigned long long *)arg))
+        goto error;
+    }
+    break;
+  case MARIADB_CONNECTION_TLS_KTLS:
+    if (!mysql)
+      goto error;
+    *((unsigned int *)arg)= 0;
+#ifdef HAVE_TLS
+    if (mysql->net.pvio && mysql->net.pvio->ctls)
+    {
+      if (mysql->net.pvio->ctls->ktls_send)
+        *((unsigned int *)arg)|= MARIADB_KTLS_SEND;
+      if (mysql->net.pvio->ctls->ktls_recv)
+        *((unsigned int *)arg)|= MARIADB_KTLS_RECV;
+    }
+#endif
+    break;
+  case MARIADB_TLS_SESSION_CACHE_STATS:
+#ifdef HAVE_TLS
+    ma_tls_session_stats((MARIADB_TLS_SESSION_STATS *)arg);
+#else
+    memset(arg, 0, sizeof(MARIADB_TLS_SESSION_STATS));
+#endif
+    break;
+  case MARIADB_DNS_CACHE_STATS:
+    ma_dns_cache_stats((MARIADB_DNS_STATS *)arg);
+    break;
+  case MARIADB_TLS_CTX_CACHE_STATS:
+#ifdef HAVE_OPENSSL
+    ma_tls_ctx_stats((MARIADB_TLS_CTX_STATS *)arg);
+#else
+    memset(arg, 0, sizeof(MARIADB_TLS_CTX_STATS));
+#endif
+    break;
+  case MARIADB_CONNECTION_READ_AHEAD_SIZE:
+    if (!mysql || !mysql->net.pvio)
+      goto error;
+    *((size_t *)arg)= ma_prefetch_cache_capacity(mysql);
+    break;
   default:
     va_end(ap);
     return(-1);
@@ -4037,7 +4777,11 @@ struct st_mariadb_api MARIADB_API=
   mysql_stmt_next_result,
   mysql_stmt_more_results,
   mariadb_stmt_execute_direct,
-  mysql_reset_connection
+  mysql_reset_connection,
+  mariadb_stmt_fetch_batch,
+  mariadb_pipeline_begin,
+  mariadb_pipeline_end,
+  mariadb_reset_stats
 };
 
 /*
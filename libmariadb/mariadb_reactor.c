@@ -0,0 +1,477 @@
+/* Copyright (C) 2018 MariaDB Corporation AB
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA */
+
+/*
+  Event loop for the non-blocking API.
+
+  Instead of polling mysql_get_socket() and calling foo_cont() itself, an
+  application registers the status returned by foo_start() together with
+  a callback:
+
+    status= mysql_real_query_start(&err, mysql, query, length);
+    mariadb_reactor_add(reactor, mysql, status, query_cont, ctx);
+    ...
+    while (mariadb_reactor_run(reactor, -1) > 0);
+
+  Once the socket is ready or the timeout expired, the reactor invokes the
+  callback with the events that occured. The callback calls foo_cont()
+  (or starts the next call) and returns the new status: the reactor waits
+  again for non zero values, 0 finishes the handle.
+
+  Sockets are watched with epoll (poll() if epoll isn't available),
+  timeouts (MYSQL_WAIT_TIMEOUT, mysql_get_timeout_value_ms()) are kept in
+  a hashed timer wheel, so adding, rearming and expiring a timeout doesn't
+  depend on the number of connections. A reactor must only be used by one
+  thread at a time.
+*/
+
+#include "ma_global.h"
+#include "ma_sys.h"
+#include "mysql.h"
+#include <string.h>
+
+#ifndef _WIN32
+#include <time.h>
+#include <errno.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+/* 256 slots of 10 milliseconds */
+#define MA_REACTOR_TICK 10
+#define MA_REACTOR_WHEEL_BITS 8
+#define MA_REACTOR_WHEEL_SIZE (1 << MA_REACTOR_WHEEL_BITS)
+#define MA_REACTOR_WHEEL_MASK (MA_REACTOR_WHEEL_SIZE - 1)
+#define MA_REACTOR_MAX_EVENTS 256
+
+typedef struct st_ma_reactor_handle {
+  MYSQL *mysql;
+  my_socket fd;
+  int status;
+  mariadb_reactor_callback callback;
+  void *arg;
+  /* timer wheel: the handle expires after rounds full turns */
+  struct st_ma_reactor_handle *timer_next, **timer_prev;
+  unsigned int rounds;
+  struct st_ma_reactor_handle *next, **prev;
+} MA_REACTOR_HANDLE;
+
+struct st_mariadb_reactor {
+  MA_REACTOR_HANDLE *handles;
+#ifdef HAVE_SYS_EPOLL_H
+  int epoll_fd;
+#else
+  struct pollfd *fds;
+  MA_REACTOR_HANDLE **fd_handles;
+  unsigned int fds_size;
+#endif
+  unsigned int count;
+  unsigned int timer_count;
+  /* start of the current tick, in milliseconds */
+  unsigned long long wheel_time;
+  unsigned int wheel_pos;
+  MA_REACTOR_HANDLE *wheel[MA_REACTOR_WHEEL_SIZE];
+};
+
+static unsigned long long ma_reactor_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void ma_reactor_timer_remove(MARIADB_REACTOR *reactor, MA_REACTOR_HANDLE *h)
+{
+  if (!h->timer_prev)
+    return;
+  if ((*h->timer_prev= h->timer_next))
+    h->timer_next->timer_prev= h->timer_prev;
+  h->timer_prev= NULL;
+  reactor->timer_count--;
+}
+
+static void ma_reactor_timer_insert(MARIADB_REACTOR *reactor, MA_REACTOR_HANDLE *h,
+                                    unsigned int slot)
+{
+  MA_REACTOR_HANDLE **head= &reactor->wheel[slot];
+
+  if ((h->timer_next= *head))
+    h->timer_next->timer_prev= &h->timer_next;
+  h->timer_prev= head;
+  *head= h;
+  reactor->timer_count++;
+}
+
+static void ma_reactor_timer_add(MARIADB_REACTOR *reactor, MA_REACTOR_HANDLE *h,
+                                 unsigned long long now, unsigned int timeout)
+{
+  unsigned long long ticks;
+
+  if (!reactor->timer_count)
+  {
+    /* the wheel didn't move while it was empty */
+    reactor->wheel_time= now;
+  }
+  ticks= (now + timeout - reactor->wheel_time + MA_REACTOR_TICK - 1) / MA_REACTOR_TICK;
+  if (!ticks)
+    ticks= 1;
+  h->rounds= (unsigned int)((ticks - 1) >> MA_REACTOR_WHEEL_BITS);
+  ma_reactor_timer_insert(reactor, h,
+                          (unsigned int)(reactor->wheel_pos + ticks) & MA_REACTOR_WHEEL_MASK);
+}
+
+/* milliseconds until the next occupied slot of the wheel, -1 if there is none */
+static int ma_reactor_next_timeout(MARIADB_REACTOR *reactor, unsigned long long now)
+{
+  unsigned int i;
+
+  if (!reactor->timer_count)
+    return -1;
+  for (i= 1; i <= MA_REACTOR_WHEEL_SIZE; i++)
+  {
+    if (reactor->wheel[(reactor->wheel_pos + i) & MA_REACTOR_WHEEL_MASK])
+    {
+      unsigned long long expire= reactor->wheel_time + i * MA_REACTOR_TICK;
+      return expire > now ? (int)(expire - now) : 0;
+    }
+  }
+  return -1;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static int ma_reactor_watch(MARIADB_REACTOR *reactor, MA_REACTOR_HANDLE *h,
+                            my_socket fd, int status)
+{
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.data.ptr= h;
+  if (status & MYSQL_WAIT_READ)
+    ev.events|= EPOLLIN;
+  if (status & MYSQL_WAIT_WRITE)
+    ev.events|= EPOLLOUT;
+  if (status & MYSQL_WAIT_EXCEPT)
+    ev.events|= EPOLLPRI;
+  if (h->fd != INVALID_SOCKET && h->fd != fd)
+  {
+    /* connection was reestablished, the old socket might be closed */
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, h->fd, &ev);
+    h->fd= INVALID_SOCKET;
+  }
+  if (h->fd == INVALID_SOCKET)
+  {
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev))
+      return 1;
+    h->fd= fd;
+  }
+  else if ((h->status ^ status) & (MYSQL_WAIT_READ | MYSQL_WAIT_WRITE | MYSQL_WAIT_EXCEPT))
+  {
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, fd, &ev))
+      return 1;
+  }
+  return 0;
+}
+
+static void ma_reactor_unwatch(MARIADB_REACTOR *reactor, MA_REACTOR_HANDLE *h)
+{
+  struct epoll_event ev;
+
+  /* fails if the callback already closed the connection */
+  if (h->fd != INVALID_SOCKET)
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, h->fd, &ev);
+  h->fd= INVALID_SOCKET;
+}
+#else
+static int ma_reactor_watch(MARIADB_REACTOR *reactor __attribute__((unused)),
+                            MA_REACTOR_HANDLE *h,
+                            my_socket fd, int status __attribute__((unused)))
+{
+  h->fd= fd;
+  return 0;
+}
+
+static void ma_reactor_unwatch(MARIADB_REACTOR *reactor __attribute__((unused)),
+                               MA_REACTOR_HANDLE *h)
+{
+  h->fd= INVALID_SOCKET;
+}
+#endif
+
+static void ma_reactor_remove(MARIADB_REACTOR *reactor, MA_REACTOR_HANDLE *h)
+{
+  ma_reactor_timer_remove(reactor, h);
+  ma_reactor_unwatch(reactor, h);
+  if ((*h->prev= h->next))
+    h->next->prev= h->prev;
+  reactor->count--;
+  free(h);
+}
+
+/* waits for the new status, or finishes the handle if status is 0 */
+static int ma_reactor_arm(MARIADB_REACTOR *reactor, MA_REACTOR_HANDLE *h,
+                          int status, unsigned long long now)
+{
+  ma_reactor_timer_remove(reactor, h);
+  if (!status)
+  {
+    ma_reactor_remove(reactor, h);
+    return 0;
+  }
+  if (status & (MYSQL_WAIT_READ | MYSQL_WAIT_WRITE | MYSQL_WAIT_EXCEPT))
+  {
+    my_socket fd= mysql_get_socket(h->mysql);
+
+    if (fd == INVALID_SOCKET || ma_reactor_watch(reactor, h, fd, status))
+      return 1;
+  }
+  else
+    ma_reactor_unwatch(reactor, h);
+  h->status= status;
+  if (status & MYSQL_WAIT_TIMEOUT)
+    ma_reactor_timer_add(reactor, h, now, mysql_get_timeout_value_ms(h->mysql));
+  return 0;
+}
+
+static void ma_reactor_dispatch(MARIADB_REACTOR *reactor, MA_REACTOR_HANDLE *h,
+                                int events)
+{
+  int status= h->callback(h->mysql, events, h->arg);
+
+  if (ma_reactor_arm(reactor, h, status, ma_reactor_now()))
+  {
+    /* can't wait for the socket: report a timeout, so the call fails */
+    status= h->callback(h->mysql, MYSQL_WAIT_TIMEOUT, h->arg);
+    if (status)
+      ma_reactor_timer_add(reactor, h, ma_reactor_now(), 0);
+    else
+      ma_reactor_remove(reactor, h);
+  }
+}
+
+/* expires the timeouts of all ticks which passed */
+static void ma_reactor_expire(MARIADB_REACTOR *reactor, unsigned long long now)
+{
+  while (reactor->timer_count && reactor->wheel_time + MA_REACTOR_TICK <= now)
+  {
+    MA_REACTOR_HANDLE *h, *next;
+
+    reactor->wheel_time+= MA_REACTOR_TICK;
+    reactor->wheel_pos= (reactor->wheel_pos + 1) & MA_REACTOR_WHEEL_MASK;
+    h= reactor->wheel[reactor->wheel_pos];
+    reactor->wheel[reactor->wheel_pos]= NULL;
+    for (; h; h= next)
+    {
+      next= h->timer_next;
+      h->timer_prev= NULL;
+      reactor->timer_count--;
+      if (h->rounds)
+      {
+        h->rounds--;
+        ma_reactor_timer_insert(reactor, h, reactor->wheel_pos);
+        continue;
+      }
+      ma_reactor_dispatch(reactor, h, MYSQL_WAIT_TIMEOUT);
+    }
+  }
+}
+
+MARIADB_REACTOR * STDCALL mariadb_reactor_init(void)
+{
+  MARIADB_REACTOR *reactor;
+
+  if (!(reactor= (MARIADB_REACTOR *)calloc(1, sizeof(MARIADB_REACTOR))))
+    return NULL;
+#ifdef HAVE_SYS_EPOLL_H
+  if ((reactor->epoll_fd= epoll_create(MA_REACTOR_MAX_EVENTS)) < 0)
+  {
+    free(reactor);
+    return NULL;
+  }
+#endif
+  reactor->wheel_time= ma_reactor_now();
+  return reactor;
+}
+
+int STDCALL mariadb_reactor_add(MARIADB_REACTOR *reactor, MYSQL *mysql, int status,
+                                mariadb_reactor_callback callback, void *arg)
+{
+  MA_REACTOR_HANDLE *h;
+
+  if (!status)
+    return 0;
+  if (!(h= (MA_REACTOR_HANDLE *)calloc(1, sizeof(MA_REACTOR_HANDLE))))
+    return 1;
+  h->mysql= mysql;
+  h->fd= INVALID_SOCKET;
+  h->callback= callback;
+  h->arg= arg;
+  if ((h->next= reactor->handles))
+    h->next->prev= &h->next;
+  h->prev= &reactor->handles;
+  reactor->handles= h;
+  reactor->count++;
+  if (ma_reactor_arm(reactor, h, status, ma_reactor_now()))
+  {
+    ma_reactor_remove(reactor, h);
+    return 1;
+  }
+  return 0;
+}
+
+int STDCALL mariadb_reactor_run(MARIADB_REACTOR *reactor, int timeout)
+{
+  unsigned long long now= ma_reactor_now();
+  int next, n, i;
+
+  if (!reactor->count)
+    return 0;
+  next= ma_reactor_next_timeout(reactor, now);
+  if (next >= 0 && (timeout < 0 || next < timeout))
+    timeout= next;
+#ifdef HAVE_SYS_EPOLL_H
+  {
+    struct epoll_event events[MA_REACTOR_MAX_EVENTS];
+
+    if ((n= epoll_wait(reactor->epoll_fd, events, MA_REACTOR_MAX_EVENTS, timeout)) < 0 &&
+        errno != EINTR)
+      return -1;
+    for (i= 0; i < n; i++)
+    {
+      MA_REACTOR_HANDLE *h= (MA_REACTOR_HANDLE *)events[i].data.ptr;
+      int ready= 0;
+
+      if (events[i].events & EPOLLIN)
+        ready|= MYSQL_WAIT_READ;
+      if (events[i].events & EPOLLOUT)
+        ready|= MYSQL_WAIT_WRITE;
+      if (events[i].events & EPOLLPRI)
+        ready|= MYSQL_WAIT_EXCEPT;
+      /* errors are reported by the next read or write */
+      if (events[i].events & (EPOLLERR | EPOLLHUP))
+        ready|= h->status & (MYSQL_WAIT_READ | MYSQL_WAIT_WRITE);
+      ma_reactor_dispatch(reactor, h, ready);
+    }
+  }
+#else
+  {
+    MA_REACTOR_HANDLE *h;
+    unsigned int cnt= 0;
+
+    if (reactor->fds_size < reactor->count)
+    {
+      struct pollfd *fds;
+      MA_REACTOR_HANDLE **fd_handles;
+
+      if (!(fds= (struct pollfd *)realloc(reactor->fds, reactor->count * sizeof(struct pollfd))))
+        return -1;
+      reactor->fds= fds;
+      if (!(fd_handles= (MA_REACTOR_HANDLE **)realloc(reactor->fd_handles,
+                                              reactor->count * sizeof(MA_REACTOR_HANDLE *))))
+        return -1;
+      reactor->fd_handles= fd_handles;
+      reactor->fds_size= reactor->count;
+    }
+    for (h= reactor->handles; h; h= h->next)
+    {
+      /* negative descriptors are ignored by poll() */
+      reactor->fds[cnt].fd= h->fd;
+      reactor->fds[cnt].events= 0;
+      reactor->fds[cnt].revents= 0;
+      if (h->status & MYSQL_WAIT_READ)
+        reactor->fds[cnt].events|= POLLIN;
+      if (h->status & MYSQL_WAIT_WRITE)
+        reactor->fds[cnt].events|= POLLOUT;
+      if (h->status & MYSQL_WAIT_EXCEPT)
+        reactor->fds[cnt].events|= POLLPRI;
+      reactor->fd_handles[cnt++]= h;
+    }
+    if ((n= poll(reactor->fds, cnt, timeout)) < 0 && errno != EINTR)
+      return -1;
+    for (i= 0; n > 0 && i < (int)cnt; i++)
+    {
+      int ready= 0;
+      short revents= reactor->fds[i].revents;
+
+      if (!revents)
+        continue;
+      n--;
+      h= reactor->fd_handles[i];
+      if (revents & POLLIN)
+        ready|= MYSQL_WAIT_READ;
+      if (revents & POLLOUT)
+        ready|= MYSQL_WAIT_WRITE;
+      if (revents & POLLPRI)
+        ready|= MYSQL_WAIT_EXCEPT;
+      if (revents & (POLLERR | POLLHUP | POLLNVAL))
+        ready|= h->status & (MYSQL_WAIT_READ | MYSQL_WAIT_WRITE);
+      ma_reactor_dispatch(reactor, h, ready);
+    }
+  }
+#endif
+  ma_reactor_expire(reactor, ma_reactor_now());
+  return (int)reactor->count;
+}
+
+void STDCALL mariadb_reactor_end(MARIADB_REACTOR *reactor)
+{
+  if (!reactor)
+    return;
+  /* handles which are still registered are dropped */
+  while (reactor->handles)
+  {
+    MA_REACTOR_HANDLE *h= reactor->handles;
+    reactor->handles= h->next;
+    free(h);
+  }
+#ifdef HAVE_SYS_EPOLL_H
+  close(reactor->epoll_fd);
+#else
+  free(reactor->fds);
+  free(reactor->fd_handles);
+#endif
+  free(reactor);
+}
+#else
+
+/* not available on Windows yet */
+MARIADB_REACTOR * STDCALL mariadb_reactor_init(void)
+{
+  return NULL;
+}
+
+int STDCALL mariadb_reactor_add(MARIADB_REACTOR *reactor __attribute__((unused)),
+                                MYSQL *mysql __attribute__((unused)),
+                                int status __attribute__((unused)),
+                                mariadb_reactor_callback callback __attribute__((unused)),
+                                void *arg __attribute__((unused)))
+{
+  return 1;
+}
+
+int STDCALL mariadb_reactor_run(MARIADB_REACTOR *reactor __attribute__((unused)),
+                                int timeout __attribute__((unused)))
+{
+  return -1;
+}
+
+void STDCALL mariadb_reactor_end(MARIADB_REACTOR *reactor __attribute__((unused)))
+{
+}
+#endif
@@ -67,16 +67,129 @@
 #define MAX_DATE_STR_LEN 5
 #define MAX_DATETIME_STR_LEN 12
 
+/* request buffers up to this size are kept for the next execution */
+#define MADB_STMT_REQUEST_KEEP (1024 * 1024)
+/* size of the packets a bulk execution is split into */
+#define MADB_STMT_BULK_PACKET MADB_STMT_REQUEST_KEEP
+/*
+  number of bulk packets which are sent before the first response is read
+  inside a transaction
+*/
+#define MADB_STMT_BULK_PENDING 2
+
+extern void ma_prefetch_start(MYSQL *mysql);
+extern ulong ma_prefetch_end(MYSQL *mysql);
+extern ulong ma_read_row_packet(MYSQL *mysql, uchar **packet);
+
+typedef uchar *(*madb_param_encoder)(uchar *to, const void *value, size_t length);
+
+enum enum_madb_param_kind {
+  MADB_PARAM_FIXED= 0, MADB_PARAM_TIME, MADB_PARAM_DATETIME,
+  MADB_PARAM_STRING, MADB_PARAM_NULL, MADB_PARAM_UNSUPPORTED
+};
+
+/* how the values of a bound parameter are encoded, see
+   ma_stmt_build_param_plan() */
+typedef struct
+{
+  madb_param_encoder encode;
+  enum enum_madb_param_kind kind;
+  int fixed_length;              /* encoded length of fixed width values */
+  char *value;                   /* value of the first row */
+  size_t value_stride;           /* distance between the values of two rows */
+  my_bool value_indirect;        /* value is an array of pointers */
+  char *length;                  /* length of the first row */
+  size_t length_stride;
+  char *indicator;               /* indicator of the first row */
+  size_t indicator_stride;
+  my_bool has_indicator;         /* an indicator byte is sent */
+  my_bool is_null;               /* set for each execution */
+  my_bool long_data;
+} MADB_PARAM_PLAN;
+
+/* parameter of the row which is currently stored in the execute request */
+typedef struct
+{
+  void *value;
+  size_t length;                 /* length of string values, encoded length
+                                    of temporal values */
+  char indicator;                /* indicator value to send */
+  my_bool send_indicator;
+  my_bool has_data;              /* a value is sent */
+  my_bool is_null;
+} MADB_PARAM_INFO;
+
 typedef struct
 {
   MA_MEM_ROOT fields_ma_alloc_root;
+  unsigned int fetch_array_size; /* rows per mariadb_stmt_fetch_batch call */
+  size_t fetch_row_size;         /* 0 for column wise binding */
+  unsigned char **fetch_rows;    /* row positions for batch fetch */
+  unsigned char **fetch_nulls;   /* null bitmaps for batch fetch */
+  unsigned int fetch_rows_size;  /* number of allocated row positions */
+  unsigned char *fetch_buffer;   /* copies of unbuffered rows of a batch */
+  size_t fetch_buffer_size;
+  ulong row_length;              /* packet length of the last fetched row */
+  char *query;                   /* statement text, only stored if the */
+  size_t query_length;           /* statement cache is enabled */
+  unsigned char *request;        /* reusable COM_STMT_EXECUTE packet */
+  size_t request_size;
+  MADB_PARAM_PLAN *param_plan;   /* encoder plan of the bound parameters */
+  MADB_PARAM_INFO *param_info;
+  unsigned int param_plan_count;
+  size_t fixed_row_length;       /* row length if all values are fixed width */
+  my_bool stream_result;         /* see ma_stmt_stream.c */
+  mariadb_stmt_stream_callback stream_callback;
+  void *stream_user_data;
+  my_bool row_streamed;          /* current row is not kept in memory */
 } MADB_STMT_EXTENSION;
 
+/*
+  Client side cache of server side prepared statements.
+
+  If MARIADB_OPT_STMT_CACHE_SIZE was set, closing or re-preparing a
+  statement handle doesn't close the statement on the server but keeps
+  its id and metadata in a per connection cache, keyed by the statement
+  text. A following mysql_stmt_prepare() of the same text takes the entry
+  out of the cache instead of sending COM_STMT_PREPARE. The cache only
+  holds statements which are not in use: a statement taken out by a
+  prepare enters the cache again as the newest entry when its handle is
+  closed. If the cache is full, the oldest entry (the statement which
+  was idle for the longest time) will be closed on the server.
+*/
+typedef struct st_ma_stmt_cache_entry {
+  char *query;
+  size_t length;
+  unsigned long stmt_id;
+  unsigned int param_count;
+  unsigned int field_count;
+  MYSQL_FIELD *fields;
+  MA_MEM_ROOT mem_root;
+  LIST list;
+} MA_STMT_CACHE_ENTRY;
+
+typedef struct st_ma_stmt_cache {
+  HASH entries;
+  LIST *newest;    /* most recently cached entry first */
+  LIST *oldest;    /* next entry to evict */
+} MA_STMT_CACHE;
+
 MYSQL_DATA *read_rows(MYSQL *mysql,MYSQL_FIELD *mysql_fields, uint fields);
 void free_rows(MYSQL_DATA *cur);
+struct st_mariadb_data_extension *ma_data_init_extension(MYSQL_DATA *data);
+my_bool ma_data_add_row(MYSQL_DATA *data, MYSQL_ROWS *row);
+void ma_data_free_index(MYSQL_DATA *data);
+MYSQL_ROWS *ma_data_get_row(MYSQL_DATA *data, unsigned long long row_nr);
 int ma_multi_command(MYSQL *mysql, enum enum_multi_status status);
+int ma_pipeline_send(MYSQL *mysql, enum enum_server_command command,
+                     const char *arg, size_t length, MYSQL_STMT *stmt);
+void ma_pipeline_stmt_close(MYSQL *mysql, MYSQL_STMT *stmt);
 MYSQL_FIELD * unpack_fields(MYSQL_DATA *data,MA_MEM_ROOT *alloc,uint fields, my_bool default_value, my_bool long_flag_protocol);
-static my_bool net_stmt_close(MYSQL_STMT *stmt, my_bool remove);
+static my_bool net_stmt_close(MYSQL_STMT *stmt, my_bool remove, my_bool cache);
+int ma_stmt_stream_fetch(MYSQL_STMT *stmt, mariadb_stmt_stream_callback callback,
+                         void *user_data, my_bool skip,
+                         my_bool *done, my_bool *streamed,
+                         uchar **row, ulong *row_length);
 
 static my_bool is_not_null= 0;
 static my_bool is_null= 1;
@@ -145,8 +258,9 @@ static int stmt_unbuffered_eof(MYSQL_STMT *stmt __attribute__((unused)),
 static int stmt_unbuffered_fetch(MYSQL_STMT *stmt, uchar **row)
 {
   ulong pkt_len;
+  uchar *packet;
 
-  pkt_len= ma_net_safe_read(stmt->mysql);
+  pkt_len= ma_read_row_packet(stmt->mysql, &packet);
 
   if (pkt_len == packet_error)
   {
@@ -154,14 +268,15 @@ static int stmt_unbuffered_fetch(MYSQL_STMT *stmt, uchar **row)
     return(1);
   }
 
-  if (stmt->mysql->net.read_pos[0] == 254)
+  if (packet[0] == 254)
   {
     *row = NULL;
     stmt->fetch_row_func= stmt_unbuffered_eof;
     return(MYSQL_NO_DATA);
   }
   else
-    *row = stmt->mysql->net.read_pos;
+    *row = packet;
+  ((MADB_STMT_EXTENSION *)stmt->extension)->row_length= pkt_len;
   stmt->result.rows++;
   return(0);
 }
@@ -176,6 +291,7 @@ static int stmt_buffered_fetch(MYSQL_STMT *stmt, uchar **row)
   }
   stmt->state= MYSQL_STMT_USER_FETCHING;
   *row= (uchar *)stmt->result_cursor->data;
+  ((MADB_STMT_EXTENSION *)stmt->extension)->row_length= stmt->result_cursor->length;
 
   stmt->result_cursor= stmt->result_cursor->next;
   return 0;
@@ -189,18 +305,23 @@ int mthd_stmt_read_all_rows(MYSQL_STMT *stmt)
   unsigned char *p;
 
   pprevious= &result->data;
+  /* rows might still contain the number of rows of a previous unbuffered
+     fetch, the row index needs to start at position 0 */
+  result->rows= 0;
+
+  ma_data_free_index(result);
+  if (!ma_data_init_extension(result))
+    goto oom;
 
   while ((packet_len = ma_net_safe_read(stmt->mysql)) != packet_error)
   {
     p= stmt->mysql->net.read_pos;
     if (packet_len > 7 || p[0] != 254)
     {
-      /* allocate space for rows */
-      if (!(current= (MYSQL_ROWS *)ma_alloc_root(&result->alloc, sizeof(MYSQL_ROWS) + packet_len)))
-      {
-        SET_CLIENT_STMT_ERROR(stmt, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
-        return(1);
-      }
+      /* allocate space for rows, the row is linked after it was indexed */
+      if (!(current= (MYSQL_ROWS *)ma_alloc_root(&result->alloc, sizeof(MYSQL_ROWS) + packet_len)) ||
+          ma_data_add_row(result, current))
+        goto oom;
       current->data= (MYSQL_ROW)(current + 1);
       *pprevious= current;
       pprevious= &current->next;
@@ -268,9 +389,18 @@ int mthd_stmt_read_all_rows(MYSQL_STMT *stmt)
       return(0);
     }
   }
-  stmt->result_cursor= 0;
   SET_CLIENT_STMT_ERROR(stmt, stmt->mysql->net.last_errno, stmt->mysql->net.sqlstate,
       stmt->mysql->net.last_error);
+  goto error;
+oom:
+  SET_CLIENT_STMT_ERROR(stmt, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+error:
+  /* don't leave a partially linked row list or index behind */
+  ma_data_free_index(result);
+  ma_free_root(&result->alloc, MYF(MY_KEEP_PREALLOC));
+  result->data= NULL;
+  result->rows= 0;
+  stmt->result_cursor= 0;
   return(1);
 }
 
@@ -299,6 +429,7 @@ static int stmt_cursor_fetch(MYSQL_STMT *stmt, uchar **row)
       return(1);
 
     /* free previously allocated buffer */
+    ma_data_free_index(result);
     ma_free_root(&result->alloc, MYF(MY_KEEP_PREALLOC));
     result->data= 0;
     result->rows= 0;
@@ -315,7 +446,25 @@ static int stmt_cursor_fetch(MYSQL_STMT *stmt, uchar **row)
 
 void mthd_stmt_flush_unbuffered(MYSQL_STMT *stmt)
 {
-  ulong packet_len;
+  ulong packet_len= 0;
+
+  /* rows which were read ahead are discarded */
+  if (stmt->mysql->extension->prefetch &&
+      (packet_len= ma_prefetch_end(stmt->mysql)) != 0)
+  {
+    if (packet_len == packet_error ||
+        (packet_len < 8 && stmt->mysql->net.read_pos[0] == 254))
+      return;
+  }
+  if (((MADB_STMT_EXTENSION *)stmt->extension)->stream_result)
+  {
+    my_bool done= 0, streamed;
+
+    /* large rows are skipped without reading them into net->buff */
+    while (!done)
+      ma_stmt_stream_fetch(stmt, NULL, NULL, 1, &done, &streamed, NULL, NULL);
+    return;
+  }
   while ((packet_len = ma_net_safe_read(stmt->mysql)) != packet_error)
     if (packet_len < 8 && stmt->mysql->net.read_pos[0] == 254)
       return;
@@ -375,6 +524,174 @@ int mthd_stmt_fetch_to_bind(MYSQL_STMT *stmt, unsigned char *row)
   return((truncations) ? MYSQL_DATA_TRUNCATED : 0);
 }
 
+/*
+  Returns the size of an array element of a result buffer which was bound
+  column wise.
+*/
+static size_t ma_get_result_buffer_size(MYSQL_BIND *bind)
+{
+  switch (bind->buffer_type) {
+  case MYSQL_TYPE_NULL:
+  case MYSQL_TYPE_TINY:
+  case MYSQL_TYPE_SHORT:
+  case MYSQL_TYPE_YEAR:
+  case MYSQL_TYPE_INT24:
+  case MYSQL_TYPE_LONG:
+  case MYSQL_TYPE_FLOAT:
+  case MYSQL_TYPE_LONGLONG:
+  case MYSQL_TYPE_DOUBLE:
+  case MYSQL_TYPE_TIME:
+  case MYSQL_TYPE_DATE:
+  case MYSQL_TYPE_DATETIME:
+  case MYSQL_TYPE_TIMESTAMP:
+    return bind->length_value; /* set in mysql_stmt_bind_result */
+  default:
+    return bind->buffer_length;
+  }
+}
+
+/*
+  Returns the distance between the array elements of the bound result
+  buffers of a column for batch fetches.
+*/
+static void stmt_get_bind_strides(MYSQL_STMT *stmt, MYSQL_BIND *bind,
+                                  size_t *buffer_stride, size_t *length_stride,
+                                  size_t *null_stride, size_t *error_stride)
+{
+  MADB_STMT_EXTENSION *stmt_ext= (MADB_STMT_EXTENSION *)stmt->extension;
+
+  if (stmt_ext->fetch_row_size)
+    *buffer_stride= *length_stride= *null_stride= *error_stride= stmt_ext->fetch_row_size;
+  else
+  {
+    *buffer_stride= ma_get_result_buffer_size(bind);
+    *length_stride= sizeof(unsigned long);
+    *null_stride= *error_stride= sizeof(my_bool);
+  }
+  /* length, is_null and error might point to internal single values,
+     which were set by mysql_stmt_bind_result */
+  if (bind->length == &bind->length_value)
+    *length_stride= 0;
+  if (bind->is_null == &bind->is_null_value)
+    *null_stride= 0;
+  if (bind->error == &bind->error_value)
+    *error_stride= 0;
+}
+
+/*
+  Moves the bound result buffers to array position row_nr (forward != 0)
+  or back to position 0, so a row which can't be converted together with
+  the other rows of a batch is converted into its array position.
+*/
+static void stmt_move_bind(MYSQL_STMT *stmt, unsigned int row_nr, my_bool forward)
+{
+  unsigned int i;
+
+  if (!stmt->bind_result_done || !row_nr)
+    return;
+  for (i=0; i < stmt->field_count; i++)
+  {
+    MYSQL_BIND *bind= &stmt->bind[i];
+    size_t buffer_stride, length_stride, null_stride, error_stride;
+
+    stmt_get_bind_strides(stmt, bind, &buffer_stride, &length_stride,
+                          &null_stride, &error_stride);
+    if (!forward)
+    {
+      buffer_stride= 0 - buffer_stride;
+      length_stride= 0 - length_stride;
+      null_stride= 0 - null_stride;
+      error_stride= 0 - error_stride;
+    }
+    if (bind->buffer)
+      bind->buffer= (char *)bind->buffer + buffer_stride * row_nr;
+    bind->length= (unsigned long *)((char *)bind->length + length_stride * row_nr);
+    bind->is_null= (my_bool *)((char *)bind->is_null + null_stride * row_nr);
+    bind->error= (my_bool *)((char *)bind->error + error_stride * row_nr);
+  }
+}
+
+/*
+  Converts row_count binary rows into the bound result arrays, starting
+  at array position first_row. Rows are processed column by column, so
+  type conversion for a column is done in a single loop. The row
+  pointers in rows will be advanced while processing the columns, nulls
+  receives the position of the null bitmap of each row. Rows with a NULL
+  row pointer were already converted and will be skipped.
+*/
+static int stmt_fetch_rows_to_bind(MYSQL_STMT *stmt, unsigned char **rows,
+                                   unsigned char **nulls,
+                                   unsigned int row_count, unsigned int first_row)
+{
+  size_t null_bytes= (stmt->field_count + 9) / 8;
+  size_t truncations= 0;
+  unsigned int i, r;
+
+  if (!stmt->bind_result_done)  /* nothing to do */
+    return(0);
+
+  /* skip status byte and null bitmap */
+  for (r=0; r < row_count; r++)
+  {
+    if (!rows[r])
+      continue;
+    nulls[r]= rows[r] + 1;
+    rows[r]+= 1 + null_bytes;
+  }
+
+  for (i=0; i < stmt->field_count; i++)
+  {
+    MYSQL_BIND *bind= &stmt->bind[i];
+    MYSQL_FIELD *field= &stmt->fields[i];
+    MYSQL_BIND column;
+    ps_field_fetch_func fetch_func= mysql_ps_fetch_functions[field->type].func;
+    int pack_len= mysql_ps_fetch_functions[field->type].pack_len;
+    size_t null_pos= (i + 2) / 8;
+    unsigned char null_bit= (unsigned char)(1 << ((i + 2) & 7));
+    size_t buffer_stride, length_stride, null_stride, error_stride;
+
+    stmt_get_bind_strides(stmt, bind, &buffer_stride, &length_stride,
+                          &null_stride, &error_stride);
+
+    column= *bind;
+    for (r=0; r < row_count; r++)
+    {
+      unsigned int row_nr= first_row + r;
+
+      if (!rows[r])
+        continue;
+      column.is_null= (my_bool *)((char *)bind->is_null + null_stride * row_nr);
+      if (nulls[r][null_pos] & null_bit)
+      {
+        *column.is_null= 1;
+        bind->u.row_ptr= NULL;
+        continue;
+      }
+      bind->u.row_ptr= rows[r];
+      if (bind->flags & MADB_BIND_DUMMY)
+      {
+        unsigned long length;
+
+        if (pack_len >= 0)
+          length= pack_len;
+        else
+          length= net_field_length(&rows[r]);
+        rows[r]+= length;
+        continue;
+      }
+      column.buffer= bind->buffer ? (char *)bind->buffer + buffer_stride * row_nr : NULL;
+      column.length= (unsigned long *)((char *)bind->length + length_stride * row_nr);
+      column.error= (my_bool *)((char *)bind->error + error_stride * row_nr);
+      column.buffer_length= bind->buffer_length;
+      *column.is_null= 0;
+      fetch_func(&column, field, &rows[r]);
+      if (stmt->mysql->options.report_data_truncation)
+        truncations+= *column.error;
+    }
+  }
+  return((truncations) ? MYSQL_DATA_TRUNCATED : 0);
+}
+
 MYSQL_RES *_mysql_stmt_use_result(MYSQL_STMT *stmt)
 {
   MYSQL *mysql= stmt->mysql;
@@ -392,7 +709,10 @@ MYSQL_RES *_mysql_stmt_use_result(MYSQL_STMT *stmt)
 
   stmt->state = MYSQL_STMT_USE_OR_STORE_CALLED;
   if (!stmt->cursor_exists)
+  {
     stmt->fetch_row_func= stmt_unbuffered_fetch; //mysql_stmt_fetch_unbuffered_row;
+    ma_prefetch_start(mysql);
+  }
   else
     stmt->fetch_row_func= stmt_cursor_fetch;
 
@@ -422,193 +742,406 @@ unsigned char *mysql_net_store_length(unsigned char *packet, size_t length)
   return packet + 8;
 }
 
-static long ma_get_length(MYSQL_STMT *stmt, unsigned int param_nr, unsigned long row_nr)
+/* number of bytes of a length encoded integer */
+size_t ma_net_length_size(size_t length)
 {
-  if (!stmt->params[param_nr].length)
-    return 0;
-  if (stmt->row_size)
-    return *(long *)((char *)stmt->params[param_nr].length + row_nr * stmt->row_size);
-  else
-    return stmt->params[param_nr].length[row_nr];
+  if (length < (unsigned long long) L64(251))
+    return 1;
+  if (length < (unsigned long long) L64(65536))
+    return 3;
+  if (length < (unsigned long long) L64(16777216))
+    return 4;
+  return 9;
 }
 
-static char ma_get_indicator(MYSQL_STMT *stmt, unsigned int param_nr, unsigned long row_nr)
+/* length of a binary encoded time value, including the length byte */
+static uint ma_time_length(MYSQL_TIME *t)
 {
-  if (!MARIADB_STMT_BULK_SUPPORTED(stmt) ||
-      !stmt->array_size ||
-      !stmt->params[param_nr].u.indicator)
-    return 0;
-  if (stmt->row_size)
-    return *((char *)stmt->params[param_nr].u.indicator + (row_nr * stmt->row_size));
-  return stmt->params[param_nr].u.indicator[row_nr];
+  if (t->second_part)
+    return 13;
+  if (t->day || t->hour || t->minute || t->second)
+    return 9;
+  return 1;
 }
 
-static void *ma_get_buffer_offset(MYSQL_STMT *stmt, enum enum_field_types type,
-                                  void *buffer, unsigned long row_nr)
+/* length of a binary encoded date/datetime value, including the length byte */
+static uint ma_datetime_length(MYSQL_TIME *t)
 {
-  if (stmt->array_size)
+  if (t->second_part)
+    return 12;
+  if (t->hour || t->minute || t->second)
+    return 8;
+  if (t->year || t->month || t->day)
+    return 5;
+  return 1;
+}
+
+/*
+  Parameter encoders: store a value in the execute request and return the
+  position after it. For strings length is the length of the value, for
+  temporal types the encoded length which was determined while sizing the
+  request.
+*/
+static uchar *ma_encode_int1(uchar *to, const void *value, size_t length __attribute__((unused)))
+{
+  int1store(to, *(uchar *)value);
+  return to + 1;
+}
+
+static uchar *ma_encode_int2(uchar *to, const void *value, size_t length __attribute__((unused)))
+{
+  int2store(to, *(short *)value);
+  return to + 2;
+}
+
+static uchar *ma_encode_int4(uchar *to, const void *value, size_t length __attribute__((unused)))
+{
+  int4store(to, *(int32 *)value);
+  return to + 4;
+}
+
+static uchar *ma_encode_int8(uchar *to, const void *value, size_t length __attribute__((unused)))
+{
+  int8store(to, *(ulonglong *)value);
+  return to + 8;
+}
+
+static uchar *ma_encode_float(uchar *to, const void *value, size_t length __attribute__((unused)))
+{
+  float4store(to, *(float *)value);
+  return to + 4;
+}
+
+static uchar *ma_encode_double(uchar *to, const void *value, size_t length __attribute__((unused)))
+{
+  float8store(to, *(double *)value);
+  return to + 8;
+}
+
+static uchar *ma_encode_time(uchar *to, const void *value, size_t length)
+{
+  /* binary encoding:
+     Offset     Length  Field
+     0          1       Length
+     1          1       negative
+     2-5        4       day
+     6          1       hour
+     7          1       ninute
+     8          1       second;
+     9-13       4       second_part
+     */
+  MYSQL_TIME *t= (MYSQL_TIME *)value;
+
+  to[0]= (uchar)(length - 1);
+  if (length > 1)
   {
-    int len;
-    if (stmt->row_size)
-      return (void *)((char *)buffer + stmt->row_size * row_nr);
-    len= mysql_ps_fetch_functions[type].pack_len;
-    if (len > 0)
-      return (void *)((char *)buffer + len * row_nr);
-    return ((void **)buffer)[row_nr];
+    to[1]= t->neg ? 1 : 0;
+    int4store(to + 2, t->day);
+    to[6]= (uchar) t->hour;
+    to[7]= (uchar) t->minute;
+    to[8]= (uchar) t->second;
+    if (length > 9)
+      int4store(to + 9, t->second_part);
   }
-  return buffer;
+  return to + length;
 }
 
-int store_param(MYSQL_STMT *stmt, int column, unsigned char **p, unsigned long row_nr)
+static uchar *ma_encode_datetime(uchar *to, const void *value, size_t length)
 {
-  void *buf= ma_get_buffer_offset(stmt, stmt->params[column].buffer_type,
-                                  stmt->params[column].buffer, row_nr);
-  char indicator= ma_get_indicator(stmt, column, row_nr);
+  /* binary format for date, timestamp and datetime
+     Offset     Length  Field
+     0          1       Length
+     1-2        2       Year
+     3          1       Month
+     4          1       Day
+     5          1       Hour
+     6          1       minute
+     7          1       second
+     8-11       4       secondpart
+     */
+  MYSQL_TIME *t= (MYSQL_TIME *)value;
 
-  switch (stmt->params[column].buffer_type) {
-  case MYSQL_TYPE_TINY:
-    int1store(*p, (*(uchar *)buf));
-    (*p) += 1;
-    break;
-  case MYSQL_TYPE_SHORT:
-  case MYSQL_TYPE_YEAR:
-    int2store(*p, (*(short *)buf));
-    (*p) += 2;
-    break;
-  case MYSQL_TYPE_FLOAT:
-    float4store(*p, (*(float *)buf));
-    (*p) += 4;
-    break;
-  case MYSQL_TYPE_DOUBLE:
-    float8store(*p, (*(double *)buf));
-    (*p) += 8;
-    break;
-  case MYSQL_TYPE_LONGLONG:
-    int8store(*p, (*(ulonglong *)buf));
-    (*p) += 8;
-    break;
-  case MYSQL_TYPE_LONG:
-  case MYSQL_TYPE_INT24:
-    int4store(*p, (*(int32 *)buf));
-    (*p)+= 4;
-    break;
-  case MYSQL_TYPE_TIME:
+  to[0]= (uchar)(length - 1);
+  if (length > 1)
   {
-    /* binary encoding:
-       Offset     Length  Field
-       0          1       Length
-       1          1       negative
-       2-5        4       day
-       6          1       hour
-       7          1       ninute
-       8          1       second;
-       9-13       4       second_part
-       */
-    MYSQL_TIME *t= (MYSQL_TIME *)ma_get_buffer_offset(stmt, stmt->params[column].buffer_type,
-                                                      stmt->params[column].buffer, row_nr);
-    char t_buffer[MAX_TIME_STR_LEN];
-    uint len= 0;
-
-    t_buffer[1]= t->neg ? 1 : 0;
-    int4store(t_buffer + 2, t->day);
-    t_buffer[6]= (uchar) t->hour;
-    t_buffer[7]= (uchar) t->minute;
-    t_buffer[8]= (uchar) t->second;
-    if (t->second_part)
-    {
-      int4store(t_buffer + 9, t->second_part);
-      len= 12;
-    }
-    else if (t->day || t->hour || t->minute || t->second)
-      len= 8;
-    t_buffer[0]= len++;
-    memcpy(*p, t_buffer, len);
-    (*p)+= len;
-    break;
+    int2store(to + 1, t->year);
+    to[3]= (uchar) t->month;
+    to[4]= (uchar) t->day;
   }
-  case MYSQL_TYPE_DATE:
-  case MYSQL_TYPE_TIMESTAMP:
-  case MYSQL_TYPE_DATETIME:
+  if (length > 5)
   {
-    /* binary format for date, timestamp and datetime
-       Offset     Length  Field
-       0          1       Length
-       1-2        2       Year
-       3          1       Month
-       4          1       Day
-       5          1       Hour
-       6          1       minute
-       7          1       second
-       8-11       4       secondpart
-       */
-    MYSQL_TIME *t= (MYSQL_TIME *)ma_get_buffer_offset(stmt, stmt->params[column].buffer_type,
-                                                      stmt->params[column].buffer, row_nr);
-    char t_buffer[MAX_DATETIME_STR_LEN];
-    uint len= 0;
-
-    int2store(t_buffer + 1, t->year);
-    t_buffer[3]= (char) t->month;
-    t_buffer[4]= (char) t->day;
-    t_buffer[5]= (char) t->hour;
-    t_buffer[6]= (char) t->minute;
-    t_buffer[7]= (char) t->second;
-    if (t->second_part)
+    to[5]= (uchar) t->hour;
+    to[6]= (uchar) t->minute;
+    to[7]= (uchar) t->second;
+  }
+  if (length > 8)
+    int4store(to + 8, t->second_part);
+  return to + length;
+}
+
+static uchar *ma_encode_string(uchar *to, const void *value, size_t length)
+{
+  to= mysql_net_store_length(to, length);
+  if (length)
+    memcpy(to, value, length);
+  return to + length;
+}
+
+/*
+  Builds the encoder plan for the bound parameters: the encoder of each
+  column and where the values, lengths and indicators of a row are
+  located, so executing doesn't need to check the parameter type and the
+  binding layout for every value.
+  Has to be called again if the array size or the row size changes.
+*/
+static my_bool ma_stmt_build_param_plan(MYSQL_STMT *stmt)
+{
+  MADB_STMT_EXTENSION *stmt_ext= (MADB_STMT_EXTENSION *)stmt->extension;
+  my_bool bulk= stmt->mysql && MARIADB_STMT_BULK_SUPPORTED(stmt);
+  uint i;
+
+  if (stmt->param_count > stmt_ext->param_plan_count)
+  {
+    MADB_PARAM_PLAN *plan;
+    MADB_PARAM_INFO *info;
+
+    if (!(plan= (MADB_PARAM_PLAN *)realloc(stmt_ext->param_plan,
+                                           stmt->param_count * sizeof(MADB_PARAM_PLAN))))
+      goto error;
+    stmt_ext->param_plan= plan;
+    if (!(info= (MADB_PARAM_INFO *)realloc(stmt_ext->param_info,
+                                           stmt->param_count * sizeof(MADB_PARAM_INFO))))
+      goto error;
+    stmt_ext->param_info= info;
+    stmt_ext->param_plan_count= stmt->param_count;
+  }
+
+  stmt_ext->fixed_row_length= 0;
+  for (i=0; i < stmt->param_count; i++)
+  {
+    MYSQL_BIND *param= &stmt->params[i];
+    MADB_PARAM_PLAN *plan= &stmt_ext->param_plan[i];
+    int pack_len= mysql_ps_fetch_functions[param->buffer_type].pack_len;
+
+    memset(plan, 0, sizeof(MADB_PARAM_PLAN));
+    switch (param->buffer_type) {
+    case MYSQL_TYPE_TINY:
+      plan->encode= ma_encode_int1;
+      break;
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_YEAR:
+      plan->encode= ma_encode_int2;
+      break;
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_INT24:
+      plan->encode= ma_encode_int4;
+      break;
+    case MYSQL_TYPE_LONGLONG:
+      plan->encode= ma_encode_int8;
+      break;
+    case MYSQL_TYPE_FLOAT:
+      plan->encode= ma_encode_float;
+      break;
+    case MYSQL_TYPE_DOUBLE:
+      plan->encode= ma_encode_double;
+      break;
+    case MYSQL_TYPE_TIME:
+      plan->kind= MADB_PARAM_TIME;
+      plan->encode= ma_encode_time;
+      break;
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_TIMESTAMP:
+    case MYSQL_TYPE_DATETIME:
+      plan->kind= MADB_PARAM_DATETIME;
+      plan->encode= ma_encode_datetime;
+      break;
+    case MYSQL_TYPE_TINY_BLOB:
+    case MYSQL_TYPE_MEDIUM_BLOB:
+    case MYSQL_TYPE_LONG_BLOB:
+    case MYSQL_TYPE_BLOB:
+    case MYSQL_TYPE_VARCHAR:
+    case MYSQL_TYPE_VAR_STRING:
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_JSON:
+    case MYSQL_TYPE_DECIMAL:
+    case MYSQL_TYPE_NEWDECIMAL:
+      plan->kind= MADB_PARAM_STRING;
+      plan->encode= ma_encode_string;
+      break;
+    case MYSQL_TYPE_NULL:
+      plan->kind= MADB_PARAM_NULL;
+      break;
+    default:
+      plan->kind= MADB_PARAM_UNSUPPORTED;
+      break;
+    }
+    if (plan->kind == MADB_PARAM_FIXED)
     {
-      int4store(t_buffer + 8, t->second_part);
-      len= 11;
+      plan->fixed_length= pack_len;
+      stmt_ext->fixed_row_length+= pack_len;
     }
-    else if (t->hour || t->minute || t->second)
-      len= 7;
-    else if (t->year || t->month || t->day)
-      len= 4;
-    else
-      len=0;
-    t_buffer[0]= len++;
-    memcpy(*p, t_buffer, len);
-    (*p)+= len;
-    break;
+
+    plan->value= (char *)param->buffer;
+    plan->length= (char *)param->length;
+    if (stmt->array_size)
+    {
+      if (stmt->row_size)
+        plan->value_stride= stmt->row_size;
+      else if (pack_len > 0)
+        plan->value_stride= pack_len;
+      else
+        plan->value_indirect= 1;
+      plan->length_stride= stmt->row_size ? stmt->row_size : sizeof(unsigned long);
+      if (bulk && param->u.indicator)
+      {
+        plan->indicator= param->u.indicator;
+        plan->indicator_stride= stmt->row_size ? stmt->row_size : 1;
+      }
+    }
+    plan->has_indicator= bulk && (param->u.indicator || param->buffer_type == MYSQL_TYPE_NULL);
   }
-  case MYSQL_TYPE_TINY_BLOB:
-  case MYSQL_TYPE_MEDIUM_BLOB:
-  case MYSQL_TYPE_LONG_BLOB:
-  case MYSQL_TYPE_BLOB:
-  case MYSQL_TYPE_VARCHAR:
-  case MYSQL_TYPE_VAR_STRING:
-  case MYSQL_TYPE_STRING:
-  case MYSQL_TYPE_JSON:
-  case MYSQL_TYPE_DECIMAL:
-  case MYSQL_TYPE_NEWDECIMAL:
-  {
-    ulong len;
-    /* to is after p. The latter hasn't been moved */
-    uchar *to;
+  return 0;
+error:
+  SET_CLIENT_STMT_ERROR(stmt, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+  return 1;
+}
 
-    if (indicator == STMT_INDICATOR_NTS)
-      len= -1;
-    else
-      len= ma_get_length(stmt, column, row_nr);
+/*
+  Determines for one row of parameters which indicator has to be sent and
+  if and with which length a value has to be sent. Returns the number of
+  bytes the row needs in the execute packet, or (size_t)-1 on error.
+*/
+static size_t ma_get_row_params(MYSQL_STMT *stmt, MADB_PARAM_INFO *info,
+                                unsigned long row_nr)
+{
+  MADB_PARAM_PLAN *plan= ((MADB_STMT_EXTENSION *)stmt->extension)->param_plan;
+  uint i;
+  size_t size= 0;
 
-    if (len == (ulong)-1)
-      len= (ulong)strlen((char *)buf);
+  for (i=0; i < stmt->param_count; i++, plan++)
+  {
+    char indicator= 0;
+    my_bool has_data= TRUE;
 
-    to = mysql_net_store_length(*p, len);
+    if (plan->has_indicator)
+    {
+      if (plan->kind == MADB_PARAM_NULL)
+        indicator= STMT_INDICATOR_NULL;
+      else if (plan->indicator)
+        indicator= plan->indicator[row_nr * plan->indicator_stride];
+      /* check if we need to send data */
+      if (indicator > 0)
+        has_data= FALSE;
+    }
+    /* long data was sent for the first row only */
+    if (plan->long_data && !row_nr)
+      has_data= FALSE;
+    if (has_data && plan->kind == MADB_PARAM_NULL)
+    {
+      if (plan->has_indicator)
+        indicator= STMT_INDICATOR_NULL;
+      has_data= FALSE;
+    }
+    info[i].is_null= 0;
+    if (plan->is_null &&
+        indicator != STMT_INDICATOR_DEFAULT && indicator != STMT_INDICATOR_IGNORE)
+    {
+      has_data= FALSE;
+      if (stmt->array_size)
+        indicator= STMT_INDICATOR_NULL;
+      info[i].is_null= 1;
+    }
 
-    if (len)
-      memcpy(to, buf, len);
-    (*p) = to + len;
-    break;
+    info[i].send_indicator= plan->has_indicator || indicator;
+    info[i].indicator= indicator > 0 ? indicator : 0;
+    info[i].has_data= has_data;
+    if (info[i].send_indicator)
+      size++;
+    if (!has_data)
+      continue;
+
+    info[i].value= plan->value_indirect ? ((char **)plan->value)[row_nr] :
+                                          plan->value + row_nr * plan->value_stride;
+    switch (plan->kind) {
+    case MADB_PARAM_FIXED:
+      size+= plan->fixed_length;
+      break;
+    case MADB_PARAM_TIME:
+      info[i].length= ma_time_length((MYSQL_TIME *)info[i].value);
+      size+= info[i].length;
+      break;
+    case MADB_PARAM_DATETIME:
+      info[i].length= ma_datetime_length((MYSQL_TIME *)info[i].value);
+      size+= info[i].length;
+      break;
+    case MADB_PARAM_STRING:
+    {
+      ulong len= plan->length ?
+                 *(ulong *)(plan->length + row_nr * plan->length_stride) : 0;
+
+      if (indicator == STMT_INDICATOR_NTS || len == (ulong)-1)
+        len= (ulong)strlen((char *)info[i].value);
+      info[i].length= len;
+      size+= ma_net_length_size(len) + len;
+      break;
+    }
+    default:
+      /* unsupported parameter type */
+      SET_CLIENT_STMT_ERROR(stmt, CR_UNSUPPORTED_PARAM_TYPE, SQLSTATE_UNKNOWN, 0);
+      return (size_t)-1;
+    }
   }
+  return size;
+}
 
-  default:
-    /* unsupported parameter type */
-    SET_CLIENT_STMT_ERROR(stmt, CR_UNSUPPORTED_PARAM_TYPE, SQLSTATE_UNKNOWN, 0);
+/* makes sure that the request buffer of the statement has at least size
+   bytes, bulk requests grow up to max_length */
+static my_bool ma_stmt_request_reserve(MYSQL_STMT *stmt, size_t size,
+                                       size_t max_length)
+{
+  MADB_STMT_EXTENSION *stmt_ext= (MADB_STMT_EXTENSION *)stmt->extension;
+  uchar *buf;
+
+  if (size <= stmt_ext->request_size)
+    return 0;
+  /* bulk requests grow row by row */
+  if (stmt->array_size)
+    size= MAX(size, MIN(2 * stmt_ext->request_size, max_length));
+  if (!(buf= (uchar *)realloc(stmt_ext->request, size)))
+  {
+    SET_CLIENT_STMT_ERROR(stmt, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
     return 1;
   }
+  stmt_ext->request= buf;
+  stmt_ext->request_size= size;
   return 0;
 }
 
-/* {{{ mysqlnd_stmt_execute_generate_request */
-unsigned char* mysql_stmt_execute_generate_request(MYSQL_STMT *stmt, size_t *request_len)
+/* releases the request buffer after an unusually large request */
+static void ma_stmt_request_release(MYSQL_STMT *stmt)
+{
+  MADB_STMT_EXTENSION *stmt_ext= (MADB_STMT_EXTENSION *)stmt->extension;
+
+  if (stmt_ext->request_size > MADB_STMT_REQUEST_KEEP)
+  {
+    free(stmt_ext->request);
+    stmt_ext->request= NULL;
+    stmt_ext->request_size= 0;
+  }
+}
+
+/*
+  Generates the COM_STMT_EXECUTE packet for the rows starting at first_row
+  in the request buffer of the statement. Rows are added as long as the
+  packet doesn't exceed max_length (but at least one row), the number of
+  rows is returned in rows. The buffer is reused by subsequent executions,
+  so the caller must not free the returned packet.
+*/
+static unsigned char* ma_stmt_generate_request(MYSQL_STMT *stmt,
+                                               unsigned int first_row,
+                                               size_t max_length,
+                                               unsigned int *rows,
+                                               size_t *request_len)
 {
   /* execute packet has the following format:
      Offset   Length      Description
@@ -636,13 +1169,17 @@ unsigned char* mysql_stmt_execute_generate_request(MYSQL_STMT *stmt, size_t *req
 
      */
 
-  size_t length= 1024;
-  size_t free_bytes= 0;
+  MADB_STMT_EXTENSION *stmt_ext= (MADB_STMT_EXTENSION *)stmt->extension;
+  MADB_PARAM_INFO *info;
+  MADB_PARAM_PLAN *plan;
+  size_t length, offset, null_count= 0;
   size_t null_byte_offset= 0;
-  uint i, j, num_rows= 1;
-
-  uchar *start= NULL, *p;
+  uint i, j, num_rows= 1, last_row;
+  my_bool fixed= 1;
+  uchar *p;
 
+  *request_len= 0;
+  *rows= 0;
   if (!MARIADB_STMT_BULK_SUPPORTED(stmt) && stmt->array_size > 0)
   {
     stmt_set_error(stmt, CR_FUNCTION_NOT_SUPPORTED, SQLSTATE_UNKNOWN,
@@ -650,186 +1187,153 @@ unsigned char* mysql_stmt_execute_generate_request(MYSQL_STMT *stmt, size_t *req
     return NULL;
   }
 
+  if (!stmt->param_count && stmt->prebind_params)
+    stmt->param_count= stmt->prebind_params;
+  if (MARIADB_STMT_BULK_SUPPORTED(stmt) && stmt->array_size)
+    num_rows= stmt->array_size;
+  last_row= num_rows;
+
+  /* the plan is built by mysql_stmt_bind_param */
+  if (stmt->param_count > stmt_ext->param_plan_count &&
+      ma_stmt_build_param_plan(stmt))
+    return NULL;
+  info= stmt_ext->param_info;
+  plan= stmt_ext->param_plan;
+  for (i=0; i < stmt->param_count; i++)
+  {
+    MYSQL_BIND *param= &stmt->params[i];
+
+    plan[i].is_null= (param->is_null && *param->is_null) ||
+                     param->buffer_type == MYSQL_TYPE_NULL || !param->buffer;
+    plan[i].long_data= param->long_data_used;
+    param->long_data_used= 0;
+    if (plan[i].kind != MADB_PARAM_FIXED || plan[i].has_indicator ||
+        plan[i].is_null || plan[i].long_data)
+      fixed= 0;
+  }
+
+  length= STMT_ID_LENGTH + 1 + 4;
+  if (stmt->param_count)
+  {
+    if (!stmt->array_size)
+      null_count= (stmt->param_count + 7) / 8;
+    length+= null_count + 1;
+    if (stmt->send_types_to_server)
+      length+= stmt->param_count * 2;
+  }
 
-  /* preallocate length bytes */
-  /* check: gr */
-  if (!(start= p= (uchar *)malloc(length)))
-    goto mem_error;
+  /* Rows of fixed width values without indicators and NULL values all
+     have the same length. Otherwise a single row is sized completely
+     before anything is stored, bulk requests are sized row by row, so the
+     lengths of the values have to be determined only once */
+  if (fixed)
+  {
+    if (stmt_ext->fixed_row_length && max_length != (size_t)-1)
+    {
+      size_t max_rows= max_length > length ?
+                       (max_length - length) / stmt_ext->fixed_row_length : 0;
+      last_row= first_row + (uint)MIN(MAX(max_rows, 1), num_rows - first_row);
+    }
+    length+= (size_t)(last_row - first_row) * stmt_ext->fixed_row_length;
+  }
+  else if (stmt->param_count)
+  {
+    size_t row_length= ma_get_row_params(stmt, info, first_row);
+    if (row_length == (size_t)-1)
+      return NULL;
+    length+= row_length;
+  }
+  if (ma_stmt_request_reserve(stmt, length, max_length))
+    return NULL;
 
+  p= stmt_ext->request;
   int4store(p, stmt->stmt_id);
   p += STMT_ID_LENGTH;
 
   /* flags is 4 bytes, we store just 1 */
   int1store(p, (unsigned char) stmt->flags);
   p++;
-  if (MARIADB_STMT_BULK_SUPPORTED(stmt) && stmt->array_size)
-    num_rows= stmt->array_size;
-  int4store(p, num_rows);
+  /* iteration count is stored when the rows were added */
   p+= 4;
 
-  if (!stmt->param_count && stmt->prebind_params)
-    stmt->param_count= stmt->prebind_params;
-
   if (stmt->param_count)
   {
-    if (!stmt->array_size)
-    {
-      size_t null_count= (stmt->param_count + 7) / 8;
-
-      free_bytes= length - (p - start);
-      if (null_count + 20 > free_bytes)
-      {
-        size_t offset= p - start;
-        length+= offset + null_count + 20;
-        if (!(start= (uchar *)realloc(start, length)))
-          goto mem_error;
-        p= start + offset;
-      }
-
-      null_byte_offset= p - start;
-      memset(p, 0, null_count);
-      p += null_count;
-    }
+    null_byte_offset= p - stmt_ext->request;
+    memset(p, 0, null_count);
+    p += null_count;
     int1store(p, stmt->send_types_to_server);
     p++;
 
-    free_bytes= length - (p - start);
-
     /* Store type information:
        2 bytes per type
        */
     if (stmt->send_types_to_server)
     {
-      if (free_bytes < stmt->param_count * 2 + 20)
-      {
-        size_t offset= p - start;
-        length= offset + stmt->param_count * 2 + 20;
-        if (!(start= (uchar *)realloc(start, length)))
-          goto mem_error;
-        p= start + offset;
-      }
       for (i = 0; i < stmt->param_count; i++)
       {
         /* this differs from mysqlnd, c api supports unsinged !! */
         uint buffer_type= stmt->params[i].buffer_type | (stmt->params[i].is_unsigned ? 32768 : 0);
         /* check if parameter requires indicator variable */
-        if (MARIADB_STMT_BULK_SUPPORTED(stmt) &&
-            (stmt->params[i].u.indicator || stmt->params[i].buffer_type == MYSQL_TYPE_NULL))
+        if (plan[i].has_indicator)
           buffer_type|= 16384;
         int2store(p, buffer_type);
         p+= 2;
       }
     }
-
-    /* calculate data size */
-    for (j=0; j < num_rows; j++)
+
+    if (fixed)
+    {
+      for (j=first_row; j < last_row; j++)
+        for (i=0; i < stmt->param_count; i++)
+          p= plan[i].encode(p, plan[i].value + j * plan[i].value_stride, 0);
+    }
+    else for (j=first_row; j < last_row; j++)
     {
-      for (i=0; i < stmt->param_count; i++)
+      if (j > first_row)
       {
-        size_t size= 0;
-        my_bool has_data= TRUE;
-        char indicator= 0;
-
-        if (MARIADB_STMT_BULK_SUPPORTED(stmt) &&
-           (stmt->params[i].u.indicator || stmt->params[i].buffer_type == MYSQL_TYPE_NULL))
-        {
-          if (stmt->params[i].buffer_type == MYSQL_TYPE_NULL)
-          {
-            indicator= STMT_INDICATOR_NULL;
-          }
-          else
-            indicator= ma_get_indicator(stmt, i, j);
-          /* check if we need to send data */
-          if (indicator > 0)
-            has_data= FALSE;
-          size= 1;
-        }
-
-        if (stmt->params[i].long_data_used)
-        {
-          has_data= FALSE;
-          stmt->params[i].long_data_used= 0;
-        }
-        if (has_data)
-        {
-          switch (stmt->params[i].buffer_type) {
-          case MYSQL_TYPE_NULL:
-            if (MARIADB_STMT_BULK_SUPPORTED(stmt))
-              indicator= STMT_INDICATOR_NULL;
-            has_data= FALSE;
-            break;
-          case MYSQL_TYPE_TINY_BLOB:
-          case MYSQL_TYPE_MEDIUM_BLOB:
-          case MYSQL_TYPE_LONG_BLOB:
-          case MYSQL_TYPE_BLOB:
-          case MYSQL_TYPE_VARCHAR:
-          case MYSQL_TYPE_VAR_STRING:
-          case MYSQL_TYPE_STRING:
-          case MYSQL_TYPE_JSON:
-          case MYSQL_TYPE_DECIMAL:
-          case MYSQL_TYPE_NEWDECIMAL:
-          case MYSQL_TYPE_GEOMETRY:
-          case MYSQL_TYPE_NEWDATE:
-          case MYSQL_TYPE_ENUM:
-          case MYSQL_TYPE_BIT:
-          case MYSQL_TYPE_SET:
-            size+= 5; /* max 8 bytes for size */
-            if (indicator == STMT_INDICATOR_NTS || 
-              (!stmt->row_size && ma_get_length(stmt,i,j) == -1))
-                size+= strlen(ma_get_buffer_offset(stmt, 
-                                                   stmt->params[i].buffer_type,
-                                                   stmt->params[i].buffer,j));
-            else
-              size+= (size_t)ma_get_length(stmt, i, j);
-            break;
-          default:
-            size+= mysql_ps_fetch_functions[stmt->params[i].buffer_type].pack_len;
-            break;
-          }
-        }
-        free_bytes= length - (p - start);
-        if (free_bytes < size + 20)
-        {
-          size_t offset= p - start;
-          length= MAX(2 * length, offset + size + 20);
-          if (!(start= (uchar *)realloc(start, length)))
-            goto mem_error;
-          p= start + offset;
-        }
-
-        if ((indicator != STMT_INDICATOR_DEFAULT && indicator != STMT_INDICATOR_IGNORE) &&
-            ((stmt->params[i].is_null && *stmt->params[i].is_null) ||
-             stmt->params[i].buffer_type == MYSQL_TYPE_NULL ||
-             !stmt->params[i].buffer))
+        size_t row_length= ma_get_row_params(stmt, info, j);
+        if (row_length == (size_t)-1)
+          return NULL;
+        offset= p - stmt_ext->request;
+        /* the row is sent with the next packet */
+        if (offset + row_length > max_length)
         {
-          has_data= FALSE;
-          if (!stmt->array_size)
-            (start + null_byte_offset)[i/8] |= (unsigned char) (1 << (i & 7));
-          else
-            indicator= STMT_INDICATOR_NULL;
+          last_row= j;
+          break;
         }
-        if (MARIADB_STMT_BULK_SUPPORTED(stmt) &&
-            (indicator || stmt->params[i].u.indicator))
+        if (ma_stmt_request_reserve(stmt, offset + row_length, max_length))
+          return NULL;
+        p= stmt_ext->request + offset;
+      }
+      for (i=0; i < stmt->param_count; i++)
+      {
+        if (info[i].is_null && !stmt->array_size)
+          (stmt_ext->request + null_byte_offset)[i/8] |= (unsigned char) (1 << (i & 7));
+        if (info[i].send_indicator)
         {
-          int1store(p, indicator > 0 ? indicator : 0);
+          int1store(p, info[i].indicator);
           p++;
         }
-        if (has_data)
-        {
-          store_param(stmt, i, &p, j);
-        }
+        if (info[i].has_data)
+          p= plan[i].encode(p, info[i].value, info[i].length);
       }
     }
-
   }
+  else
+    last_row= num_rows;
+  int4store(stmt_ext->request + STMT_ID_LENGTH + 1, last_row - first_row);
   stmt->send_types_to_server= 0;
-  *request_len = (size_t)(p - start);
-  return start;
-mem_error:
-  SET_CLIENT_STMT_ERROR(stmt, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
-  free(start);
-  *request_len= 0;
-  return NULL;
+  *rows= last_row - first_row;
+  *request_len = (size_t)(p - stmt_ext->request);
+  return stmt_ext->request;
+}
+
+/* {{{ mysqlnd_stmt_execute_generate_request */
+unsigned char* mysql_stmt_execute_generate_request(MYSQL_STMT *stmt, size_t *request_len)
+{
+  unsigned int rows;
+
+  return ma_stmt_generate_request(stmt, 0, (size_t)-1, &rows, request_len);
 }
 /* }}} */
 
@@ -869,6 +1373,21 @@ my_bool STDCALL mysql_stmt_attr_get(MYSQL_STMT *stmt, enum enum_stmt_attr_type a
     case STMT_ATTR_ROW_SIZE:
       *(size_t *)value= stmt->row_size;
       break;
+    case STMT_ATTR_FETCH_ARRAY_SIZE:
+      *(unsigned int *)value= ((MADB_STMT_EXTENSION *)stmt->extension)->fetch_array_size;
+      break;
+    case STMT_ATTR_FETCH_ROW_SIZE:
+      *(size_t *)value= ((MADB_STMT_EXTENSION *)stmt->extension)->fetch_row_size;
+      break;
+    case STMT_ATTR_STREAM_RESULT:
+      *(my_bool *)value= ((MADB_STMT_EXTENSION *)stmt->extension)->stream_result;
+      break;
+    case STMT_ATTR_STREAM_CALLBACK:
+      *(mariadb_stmt_stream_callback *)value= ((MADB_STMT_EXTENSION *)stmt->extension)->stream_callback;
+      break;
+    case STMT_ATTR_STREAM_USER_DATA:
+      *(void **)value= ((MADB_STMT_EXTENSION *)stmt->extension)->stream_user_data;
+      break;
     default:
       return(1);
   }
@@ -899,7 +1418,7 @@ my_bool STDCALL mysql_stmt_attr_set(MYSQL_STMT *stmt, enum enum_stmt_attr_type a
     if (stmt->state > MYSQL_STMT_INITTED)
     {
       mysql_stmt_internal_reset(stmt, 1);
-      net_stmt_close(stmt, 0);
+      net_stmt_close(stmt, 0, 0);
       stmt->state= MYSQL_STMT_INITTED;
       stmt->params= 0;
     }
@@ -907,9 +1426,29 @@ my_bool STDCALL mysql_stmt_attr_set(MYSQL_STMT *stmt, enum enum_stmt_attr_type a
     break;
   case STMT_ATTR_ARRAY_SIZE:
     stmt->array_size= *(unsigned int *)value;
+    if (stmt->bind_param_done && stmt->param_count)
+      return ma_stmt_build_param_plan(stmt);
     break;
   case STMT_ATTR_ROW_SIZE:
     stmt->row_size= *(size_t *)value;
+    if (stmt->bind_param_done && stmt->param_count)
+      return ma_stmt_build_param_plan(stmt);
+    break;
+  case STMT_ATTR_FETCH_ARRAY_SIZE:
+    ((MADB_STMT_EXTENSION *)stmt->extension)->fetch_array_size= *(unsigned int *)value;
+    break;
+  case STMT_ATTR_FETCH_ROW_SIZE:
+    ((MADB_STMT_EXTENSION *)stmt->extension)->fetch_row_size= *(size_t *)value;
+    break;
+  case STMT_ATTR_STREAM_RESULT:
+    ((MADB_STMT_EXTENSION *)stmt->extension)->stream_result= *(my_bool *)value;
+    break;
+  case STMT_ATTR_STREAM_CALLBACK:
+    /* the callback is passed as value, like a pointer to data */
+    ((MADB_STMT_EXTENSION *)stmt->extension)->stream_callback= (mariadb_stmt_stream_callback)value;
+    break;
+  case STMT_ATTR_STREAM_USER_DATA:
+    ((MADB_STMT_EXTENSION *)stmt->extension)->stream_user_data= (void *)value;
     break;
   default:
     SET_CLIENT_STMT_ERROR(stmt, CR_NOT_IMPLEMENTED, SQLSTATE_UNKNOWN, 0);
@@ -1019,6 +1558,8 @@ my_bool STDCALL mysql_stmt_bind_param(MYSQL_STMT *stmt, MYSQL_BIND *bind)
         break;
       }
     }
+    if (ma_stmt_build_param_plan(stmt))
+      return(1);
   }
   stmt->bind_param_done= stmt->send_types_to_server= 1;
 
@@ -1115,12 +1656,198 @@ my_bool STDCALL mysql_stmt_bind_result(MYSQL_STMT *stmt, MYSQL_BIND *bind)
   return(0);
 }
 
-static my_bool net_stmt_close(MYSQL_STMT *stmt, my_bool remove)
+static uchar *ma_stmt_cache_get_key(const uchar *record, uint *length,
+                                    my_bool not_used __attribute__((unused)))
+{
+  MA_STMT_CACHE_ENTRY *entry= (MA_STMT_CACHE_ENTRY *)record;
+  *length= (uint)entry->length;
+  return (uchar *)entry->query;
+}
+
+static void ma_stmt_cache_free_entry(void *record)
+{
+  MA_STMT_CACHE_ENTRY *entry= (MA_STMT_CACHE_ENTRY *)record;
+  ma_free_root(&entry->mem_root, MYF(0));
+  free(entry);
+}
+
+/* removes and frees an entry */
+static void ma_stmt_cache_remove(MA_STMT_CACHE *cache, MA_STMT_CACHE_ENTRY *entry)
+{
+  if (cache->oldest == &entry->list)
+    cache->oldest= entry->list.prev;
+  cache->newest= list_delete(cache->newest, &entry->list);
+  hash_delete(&cache->entries, (uchar *)entry);
+}
+
+void ma_stmt_cache_clear(MYSQL *mysql)
+{
+  MA_STMT_CACHE *cache;
+
+  if (!mysql->extension || !(cache= mysql->extension->stmt_cache))
+    return;
+  hash_free(&cache->entries);
+  free(cache);
+  mysql->extension->stmt_cache= NULL;
+}
+
+static my_bool ma_stmt_cache_enabled(MYSQL *mysql)
+{
+  return mysql->options.extension && mysql->options.extension->stmt_cache_size &&
+         mysql->net.extension->multi_status == COM_MULTI_OFF;
+}
+
+/* copies metadata, max_length will be recalculated by the next
+   mysql_stmt_store_result call */
+static MYSQL_FIELD *ma_stmt_copy_fields(MA_MEM_ROOT *root, MYSQL_FIELD *src,
+                                        unsigned int field_count)
+{
+  MYSQL_FIELD *fields;
+  unsigned int i;
+
+  if (!(fields= (MYSQL_FIELD *)ma_alloc_root(root, sizeof(MYSQL_FIELD) * field_count)))
+    return NULL;
+  memcpy(fields, src, sizeof(MYSQL_FIELD) * field_count);
+  for (i=0; i < field_count; i++)
+  {
+    if ((src[i].db && !(fields[i].db= ma_strdup_root(root, src[i].db))) ||
+        (src[i].table && !(fields[i].table= ma_strdup_root(root, src[i].table))) ||
+        (src[i].org_table && !(fields[i].org_table= ma_strdup_root(root, src[i].org_table))) ||
+        (src[i].name && !(fields[i].name= ma_strdup_root(root, src[i].name))) ||
+        (src[i].org_name && !(fields[i].org_name= ma_strdup_root(root, src[i].org_name))) ||
+        (src[i].catalog && !(fields[i].catalog= ma_strdup_root(root, src[i].catalog))) ||
+        (src[i].def && !(fields[i].def= ma_strdup_root(root, src[i].def))))
+      return NULL;
+    fields[i].max_length= 0;
+    fields[i].extension= NULL;
+  }
+  return fields;
+}
+
+/*
+  A statement can only be cached if the server doesn't hold any state
+  for it which could affect the next execution: an open cursor or long
+  data which wasn't sent with an execute yet. Must be checked before the
+  statement gets reset.
+*/
+static my_bool ma_stmt_cacheable(MYSQL_STMT *stmt)
+{
+  unsigned int i;
+
+  if (!stmt->mysql || !stmt->mysql->net.pvio || stmt->state <= MYSQL_STMT_INITTED ||
+      !((MADB_STMT_EXTENSION *)stmt->extension)->query ||
+      stmt->cursor_exists || !ma_stmt_cache_enabled(stmt->mysql))
+    return 0;
+  if (stmt->params)
+    for (i=0; i < stmt->param_count; i++)
+      if (stmt->params[i].long_data_used)
+        return 0;
+  return 1;
+}
+
+/*
+  Moves the server side statement into the cache. Returns 0 if the
+  statement was cached, otherwise the caller has to close it.
+*/
+static my_bool ma_stmt_cache_put(MYSQL_STMT *stmt)
+{
+  MYSQL *mysql= stmt->mysql;
+  MADB_STMT_EXTENSION *stmt_ext= (MADB_STMT_EXTENSION *)stmt->extension;
+  MA_STMT_CACHE *cache;
+  MA_STMT_CACHE_ENTRY *entry;
+
+  if (mysql->status != MYSQL_STATUS_READY)
+    return 1;
+
+  if (!(cache= mysql->extension->stmt_cache))
+  {
+    if (!(cache= (MA_STMT_CACHE *)calloc(1, sizeof(MA_STMT_CACHE))))
+      return 1;
+    if (_hash_init(&cache->entries, 0, 0, 0, ma_stmt_cache_get_key,
+                   ma_stmt_cache_free_entry, 0))
+    {
+      free(cache);
+      return 1;
+    }
+    mysql->extension->stmt_cache= cache;
+  }
+
+  /* the same statement text might be cached already by another handle */
+  if (hash_search(&cache->entries, (uchar *)stmt_ext->query, (uint)stmt_ext->query_length))
+    return 1;
+
+  while (cache->entries.records >= mysql->options.extension->stmt_cache_size &&
+         cache->oldest)
+  {
+    MA_STMT_CACHE_ENTRY *last= (MA_STMT_CACHE_ENTRY *)cache->oldest->data;
+    char stmt_id[STMT_ID_LENGTH];
+
+    int4store(stmt_id, last->stmt_id);
+    ma_stmt_cache_remove(cache, last);
+    if (mysql->methods->db_command(mysql, COM_STMT_CLOSE, stmt_id,
+                                   sizeof(stmt_id), 1, stmt))
+      return 1;
+  }
+
+  if (!(entry= (MA_STMT_CACHE_ENTRY *)calloc(1, sizeof(MA_STMT_CACHE_ENTRY))))
+    return 1;
+  ma_init_alloc_root(&entry->mem_root, 1024, 0);
+  /* the key (query and length) must be set before the entry is hashed */
+  entry->length= stmt_ext->query_length;
+  entry->stmt_id= stmt->stmt_id;
+  entry->param_count= stmt->param_count;
+  entry->field_count= stmt->field_count;
+  if (!(entry->query= ma_memdup_root(&entry->mem_root, stmt_ext->query,
+                                     stmt_ext->query_length)) ||
+      (stmt->field_count &&
+       !(entry->fields= ma_stmt_copy_fields(&entry->mem_root, stmt->fields,
+                                            stmt->field_count))) ||
+      hash_insert(&cache->entries, (uchar *)entry))
+  {
+    ma_stmt_cache_free_entry(entry);
+    return 1;
+  }
+  entry->list.data= entry;
+  cache->newest= list_add(cache->newest, &entry->list);
+  if (!cache->oldest)
+    cache->oldest= &entry->list;
+  return 0;
+}
+
+/*
+  Takes a statement with the given text out of the cache. Returns 0 if
+  the statement was found, otherwise it needs to be prepared on the server.
+*/
+static my_bool ma_stmt_cache_get(MYSQL_STMT *stmt, const char *query, size_t length)
+{
+  MA_STMT_CACHE *cache= stmt->mysql->extension->stmt_cache;
+  MA_STMT_CACHE_ENTRY *entry;
+  MA_MEM_ROOT *fields_ma_alloc_root= &((MADB_STMT_EXTENSION *)stmt->extension)->fields_ma_alloc_root;
+
+  if (!cache ||
+      !(entry= (MA_STMT_CACHE_ENTRY *)hash_search(&cache->entries, (uchar *)query, (uint)length)))
+    return 1;
+
+  if (entry->field_count &&
+      !(stmt->fields= ma_stmt_copy_fields(fields_ma_alloc_root, entry->fields,
+                                          entry->field_count)))
+    return 1;
+  stmt->stmt_id= entry->stmt_id;
+  stmt->param_count= entry->param_count;
+  stmt->field_count= entry->field_count;
+  stmt->mysql->warning_count= stmt->upsert_status.warning_count= 0;
+  ma_stmt_cache_remove(cache, entry);
+  return 0;
+}
+
+static my_bool net_stmt_close(MYSQL_STMT *stmt, my_bool remove, my_bool cache)
 {
   char stmt_id[STMT_ID_LENGTH];
   MA_MEM_ROOT *fields_ma_alloc_root= &((MADB_STMT_EXTENSION *)stmt->extension)->fields_ma_alloc_root;
+  my_bool cached= cache && !ma_stmt_cache_put(stmt);
 
   /* clear memory */
+  ma_data_free_index(&stmt->result);
   ma_free_root(&stmt->result.alloc, MYF(0)); /* allocated in mysql_stmt_store_result */
   ma_free_root(&stmt->mem_root,MYF(0));
   ma_free_root(fields_ma_alloc_root, MYF(0));
@@ -1133,13 +1860,16 @@ static my_bool net_stmt_close(MYSQL_STMT *stmt, my_bool remove)
     if (remove)
       stmt->mysql->stmts= list_delete(stmt->mysql->stmts, &stmt->list);
 
+    /* pending pipelined results of this statement will be skipped */
+    ma_pipeline_stmt_close(stmt->mysql, stmt);
+
     /* check if all data are fetched */
     if (stmt->mysql->status != MYSQL_STATUS_READY)
     {
       stmt->mysql->methods->db_stmt_flush_unbuffered(stmt);
       stmt->mysql->status= MYSQL_STATUS_READY;
     }
-    if (stmt->state > MYSQL_STMT_INITTED)
+    if (stmt->state > MYSQL_STMT_INITTED && !cached)
     {
       int4store(stmt_id, stmt->stmt_id);
       if (stmt->mysql->methods->db_command(stmt->mysql,COM_STMT_CLOSE, stmt_id,
@@ -1155,12 +1885,20 @@ static my_bool net_stmt_close(MYSQL_STMT *stmt, my_bool remove)
 
 my_bool STDCALL mysql_stmt_close(MYSQL_STMT *stmt)
 {
-  my_bool rc;
+  my_bool rc, cacheable= 0;
   if (stmt && stmt->mysql && stmt->mysql->net.pvio)
+  {
+    cacheable= ma_stmt_cacheable(stmt);
     mysql_stmt_internal_reset(stmt, 1);
+  }
 
-  rc= net_stmt_close(stmt, 1);
+  rc= net_stmt_close(stmt, 1, cacheable);
 
+  free(((MADB_STMT_EXTENSION *)stmt->extension)->fetch_rows);
+  free(((MADB_STMT_EXTENSION *)stmt->extension)->fetch_buffer);
+  free(((MADB_STMT_EXTENSION *)stmt->extension)->request);
+  free(((MADB_STMT_EXTENSION *)stmt->extension)->param_plan);
+  free(((MADB_STMT_EXTENSION *)stmt->extension)->param_info);
   free(stmt->extension);
   free(stmt);
 
@@ -1169,13 +1907,7 @@ my_bool STDCALL mysql_stmt_close(MYSQL_STMT *stmt)
 
 void STDCALL mysql_stmt_data_seek(MYSQL_STMT *stmt, unsigned long long offset)
 {
-  unsigned long long i= offset;
-  MYSQL_ROWS *ptr= stmt->result.data;
-
-  while(i-- && ptr)
-    ptr= ptr->next;
-
-  stmt->result_cursor= ptr;
+  stmt->result_cursor= ma_data_get_row(&stmt->result, offset);
   stmt->state= MYSQL_STMT_USER_FETCHING;
 
   return;
@@ -1198,6 +1930,7 @@ int mthd_stmt_fetch_row(MYSQL_STMT *stmt, unsigned char **row)
 
 int STDCALL mysql_stmt_fetch(MYSQL_STMT *stmt)
 {
+  MADB_STMT_EXTENSION *stmt_ext= (MADB_STMT_EXTENSION *)stmt->extension;
   unsigned char *row;
   int rc;
 
@@ -1219,6 +1952,29 @@ int STDCALL mysql_stmt_fetch(MYSQL_STMT *stmt)
   if (stmt->state == MYSQL_STMT_FETCH_DONE)
     return(MYSQL_NO_DATA);
 
+  if (stmt_ext->stream_result && stmt->fetch_row_func == stmt_unbuffered_fetch)
+  {
+    my_bool done;
+
+    rc= ma_stmt_stream_fetch(stmt, stmt_ext->stream_callback,
+                             stmt_ext->stream_user_data, 0,
+                             &done, &stmt_ext->row_streamed, NULL, NULL);
+    if (done)
+    {
+      stmt->fetch_row_func= stmt_unbuffered_eof;
+      stmt->state= MYSQL_STMT_FETCH_DONE;
+      stmt->mysql->status= MYSQL_STATUS_READY;
+      return(rc);
+    }
+    stmt->state= MYSQL_STMT_USER_FETCHING;
+    if (rc)
+      return(rc);
+    CLEAR_CLIENT_ERROR(stmt->mysql);
+    CLEAR_CLIENT_STMT_ERROR(stmt);
+    return(0);
+  }
+  stmt_ext->row_streamed= 0;
+
   if ((rc= stmt->mysql->methods->db_stmt_fetch(stmt, &row)))
   {
     stmt->state= MYSQL_STMT_FETCH_DONE;
@@ -1238,10 +1994,190 @@ int STDCALL mysql_stmt_fetch(MYSQL_STMT *stmt)
   return(0);
 }
 
+/*
+  Makes room for size bytes in the batch row buffer. The row positions
+  of the first row_count rows will be moved with the buffer.
+*/
+static my_bool stmt_fetch_buffer_reserve(MADB_STMT_EXTENSION *stmt_ext,
+                                         unsigned int row_count, size_t size)
+{
+  unsigned char *buffer;
+  size_t new_size= MAX(size, 2 * stmt_ext->fetch_buffer_size);
+  unsigned int r;
+
+  if (size <= stmt_ext->fetch_buffer_size)
+    return 0;
+  /* fetch_nulls isn't used before the rows are converted */
+  for (r=0; r < row_count; r++)
+    if (stmt_ext->fetch_rows[r])
+      stmt_ext->fetch_nulls[r]= (unsigned char *)(size_t)(stmt_ext->fetch_rows[r] -
+                                                          stmt_ext->fetch_buffer);
+  if (!(buffer= (unsigned char *)realloc(stmt_ext->fetch_buffer, new_size)))
+    return 1;
+  for (r=0; r < row_count; r++)
+    if (stmt_ext->fetch_rows[r])
+      stmt_ext->fetch_rows[r]= buffer + (size_t)stmt_ext->fetch_nulls[r];
+  stmt_ext->fetch_buffer= buffer;
+  stmt_ext->fetch_buffer_size= new_size;
+  return 0;
+}
+
+/*
+  Fetches up to STMT_ATTR_FETCH_ARRAY_SIZE rows into the bound result
+  arrays. If STMT_ATTR_FETCH_ROW_SIZE is zero, buffers are bound column
+  wise, otherwise row wise with the specified row size.
+  The number of fetched rows is returned in rows_fetched.
+*/
+int STDCALL mariadb_stmt_fetch_batch(MYSQL_STMT *stmt, unsigned int *rows_fetched)
+{
+  MADB_STMT_EXTENSION *stmt_ext= (MADB_STMT_EXTENSION *)stmt->extension;
+  unsigned int array_size= stmt_ext->fetch_array_size ? stmt_ext->fetch_array_size : 1;
+  unsigned int row_count= 0;
+  unsigned char *row;
+  my_bool buffered, stream;
+  size_t used= 0;
+  int rc= 0, fetch_rc= 0;
+
+  if (rows_fetched)
+    *rows_fetched= 0;
+
+  if (stmt->state <= MYSQL_STMT_EXECUTED)
+  {
+    SET_CLIENT_STMT_ERROR(stmt, CR_COMMANDS_OUT_OF_SYNC, SQLSTATE_UNKNOWN, 0);
+    return(1);
+  }
+
+  if (stmt->state < MYSQL_STMT_WAITING_USE_OR_STORE || !stmt->field_count)
+  {
+    SET_CLIENT_STMT_ERROR(stmt, CR_COMMANDS_OUT_OF_SYNC, SQLSTATE_UNKNOWN, 0);
+    return(1);
+  } else if (stmt->state== MYSQL_STMT_WAITING_USE_OR_STORE)
+  {
+    stmt->default_rset_handler(stmt);
+  }
+
+  if (stmt->state == MYSQL_STMT_FETCH_DONE)
+    return(MYSQL_NO_DATA);
+
+  if (stmt_ext->fetch_rows_size < array_size)
+  {
+    unsigned char **rows;
+
+    if (!(rows= (unsigned char **)realloc(stmt_ext->fetch_rows,
+                                          2 * array_size * sizeof(unsigned char *))))
+    {
+      SET_CLIENT_STMT_ERROR(stmt, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+      return(1);
+    }
+    stmt_ext->fetch_rows= rows;
+    stmt_ext->fetch_nulls= rows + array_size;
+    stmt_ext->fetch_rows_size= array_size;
+  }
+
+  /* Rows are collected first and converted column by column. Rows of a
+     buffered result set stay valid until the result set will be freed,
+     unbuffered rows will be overwritten by the next read and cursor rows
+     by the next COM_STMT_FETCH, so they are copied into fetch_buffer.
+     Streamed rows which don't fit into net->buff are converted while they
+     are read (see ma_stmt_stream.c) */
+  buffered= (stmt->fetch_row_func == stmt_buffered_fetch);
+  stream= stmt_ext->stream_result && stmt->fetch_row_func == stmt_unbuffered_fetch;
+  stmt_ext->row_streamed= 0;
+
+  while (row_count < array_size)
+  {
+    ulong length;
+
+    if (stream)
+    {
+      my_bool done;
+
+      row= NULL;
+      stmt_move_bind(stmt, row_count, 1);
+      /* the callback needs to be called while the row is converted */
+      fetch_rc= ma_stmt_stream_fetch(stmt, stmt_ext->stream_callback,
+                                     stmt_ext->stream_user_data, 0,
+                                     &done, &stmt_ext->row_streamed,
+                                     stmt_ext->stream_callback ? NULL : &row,
+                                     &length);
+      stmt_move_bind(stmt, row_count, 0);
+      if (done)
+      {
+        stmt->fetch_row_func= stmt_unbuffered_eof;
+        break;
+      }
+      if (!row)
+      {
+        stmt_ext->fetch_rows[row_count++]= NULL;
+        if (fetch_rc == 1)
+        {
+          /* stream was aborted by the callback, the remaining rows can
+             be fetched by the next call */
+          rc= 1;
+          fetch_rc= 0;
+          break;
+        }
+        if (fetch_rc)
+          rc= fetch_rc;
+        fetch_rc= 0;
+        continue;
+      }
+    }
+    else if ((fetch_rc= stmt->mysql->methods->db_stmt_fetch(stmt, &row)))
+      break;
+    else
+      length= stmt_ext->row_length;
+
+    if (!buffered)
+    {
+      if (stmt_fetch_buffer_reserve(stmt_ext, row_count, used + length))
+      {
+        SET_CLIENT_STMT_ERROR(stmt, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+        fetch_rc= 1;
+        break;
+      }
+      memcpy(stmt_ext->fetch_buffer + used, row, length);
+      row= stmt_ext->fetch_buffer + used;
+      used+= length;
+    }
+    stmt_ext->fetch_rows[row_count++]= row;
+  }
+  if (row_count)
+  {
+    int conv_rc= stmt_fetch_rows_to_bind(stmt, stmt_ext->fetch_rows,
+                                         stmt_ext->fetch_nulls, row_count, 0);
+    if (rc != 1 && conv_rc)
+      rc= conv_rc;
+  }
+
+  if (rows_fetched)
+    *rows_fetched= row_count;
+
+  if (fetch_rc)
+  {
+    stmt->state= MYSQL_STMT_FETCH_DONE;
+    stmt->mysql->status= MYSQL_STATUS_READY;
+    /* to fetch data again, stmt must be executed again */
+    if (fetch_rc != MYSQL_NO_DATA || !row_count)
+      return(fetch_rc);
+  }
+  else
+    stmt->state= MYSQL_STMT_USER_FETCHING;
+
+  if (rc)
+    return(rc);
+
+  CLEAR_CLIENT_ERROR(stmt->mysql);
+  CLEAR_CLIENT_STMT_ERROR(stmt);
+  return(0);
+}
+
 int STDCALL mysql_stmt_fetch_column(MYSQL_STMT *stmt, MYSQL_BIND *bind, unsigned int column, unsigned long offset)
 {
+  /* streamed rows are not kept in memory */
   if (stmt->state < MYSQL_STMT_USER_FETCHING || column >= stmt->field_count ||
-      stmt->state == MYSQL_STMT_FETCH_DONE)  {
+      stmt->state == MYSQL_STMT_FETCH_DONE ||
+      ((MADB_STMT_EXTENSION *)stmt->extension)->row_streamed)  {
     SET_CLIENT_STMT_ERROR(stmt, CR_NO_DATA, SQLSTATE_UNKNOWN, 0);
     return(1);
   }
@@ -1384,8 +2320,10 @@ int STDCALL mysql_stmt_warning_count(MYSQL_STMT *stmt)
 int STDCALL mysql_stmt_prepare(MYSQL_STMT *stmt, const char *query, size_t length)
 {
   MYSQL *mysql= stmt->mysql;
+  MADB_STMT_EXTENSION *stmt_ext= (MADB_STMT_EXTENSION *)stmt->extension;
   int rc= 1;
   my_bool is_multi= 0;
+  my_bool use_cache;
 
   if (!stmt->mysql)
   {
@@ -1396,6 +2334,8 @@ int STDCALL mysql_stmt_prepare(MYSQL_STMT *stmt, const char *query, size_t lengt
   if (length == (size_t) -1)
     length= strlen(query);
 
+  use_cache= ma_stmt_cache_enabled(mysql);
+
   /* clear flags */
   CLEAR_CLIENT_STMT_ERROR(stmt);
   CLEAR_CLIENT_ERROR(stmt->mysql);
@@ -1405,29 +2345,40 @@ int STDCALL mysql_stmt_prepare(MYSQL_STMT *stmt, const char *query, size_t lengt
   if (stmt->state > MYSQL_STMT_INITTED)
   {
     char stmt_id[STMT_ID_LENGTH];
+    my_bool cached= 0, cacheable= ma_stmt_cacheable(stmt);
     is_multi= (mysql->net.extension->multi_status > COM_MULTI_OFF);
     /* We need to semi-close the prepared statement:
        reset stmt and free all buffers and close the statement
        on server side. Statment handle will get a new stmt_id */
 
-    if (!is_multi)
+    if (!is_multi && !use_cache)
       ma_multi_command(mysql, COM_MULTI_ENABLED);
 
     if (mysql_stmt_internal_reset(stmt, 1))
       goto fail;
 
+    if (cacheable)
+      cached= !ma_stmt_cache_put(stmt);
+
     ma_free_root(&stmt->mem_root, MYF(MY_KEEP_PREALLOC));
     ma_free_root(&((MADB_STMT_EXTENSION *)stmt->extension)->fields_ma_alloc_root, MYF(0));
 
     stmt->param_count= 0;
     stmt->field_count= 0;
     stmt->params= 0;
+    stmt_ext->query= NULL;
 
     int4store(stmt_id, stmt->stmt_id);
-    if (mysql->methods->db_command(mysql, COM_STMT_CLOSE, stmt_id,
+    if (!cached &&
+        mysql->methods->db_command(mysql, COM_STMT_CLOSE, stmt_id,
                                          sizeof(stmt_id), 1, stmt))
       goto fail;
   }
+
+  /* if the statement was prepared before, we can skip the round trip */
+  if (use_cache && !ma_stmt_cache_get(stmt, query, length))
+    goto prepared;
+
   if (mysql->methods->db_command(mysql, COM_STMT_PREPARE, query, length, 1, stmt))
     goto fail;
 
@@ -1455,6 +2406,8 @@ int STDCALL mysql_stmt_prepare(MYSQL_STMT *stmt, const char *query, size_t lengt
   {
     goto fail;
   }
+
+prepared:
   if (stmt->param_count)
   {
     if (stmt->prebind_params)
@@ -1483,6 +2436,16 @@ int STDCALL mysql_stmt_prepare(MYSQL_STMT *stmt, const char *query, size_t lengt
       goto fail;
     }
   }
+  /* remember the statement text for the cache */
+  if (use_cache)
+  {
+    if (!(stmt_ext->query= ma_memdup_root(&stmt->mem_root, query, length)))
+    {
+      SET_CLIENT_STMT_ERROR(stmt, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+      goto fail;
+    }
+    stmt_ext->query_length= length;
+  }
   stmt->state = MYSQL_STMT_PREPARED;
   return(0);
 
@@ -1541,6 +2504,7 @@ int STDCALL mysql_stmt_store_result(MYSQL_STMT *stmt)
   if (stmt->mysql->methods->db_stmt_read_all_rows(stmt))
   {
     /* error during read - reset stmt->data */
+    ma_data_free_index(&stmt->result);
     ma_free_root(&stmt->result.alloc, 0);
     stmt->result.data= NULL;
     stmt->result.rows= 0;
@@ -1749,6 +2713,121 @@ int stmt_read_execute_response(MYSQL_STMT *stmt)
   return(0);
 }
 
+/*
+  Bulk execution: the rows are sent in packets of at most
+  MADB_STMT_BULK_PACKET bytes (or the client's max_allowed_packet), so
+  memory usage doesn't depend on the array size. Affected rows and
+  warnings of all packets are summed up and the first error is returned.
+  Inside a transaction (or with autocommit disabled) the next packet is
+  sent before the response to the previous one was read: if a packet
+  fails, the server still executes the packet which is already on its
+  way, and the application has to roll back. Otherwise each response is
+  read before the next packet is sent, so no rows after a failed packet
+  are executed.
+*/
+static int ma_stmt_execute_bulk(MYSQL_STMT *stmt)
+{
+  MYSQL *mysql= stmt->mysql;
+  /* 1 byte for the command */
+  size_t max_length= MIN(mysql->net.max_packet_size, MADB_STMT_BULK_PACKET) - 1;
+  unsigned int max_pending= 1;
+  unsigned int row= 0, rows, pending= 0, warnings= 0;
+  unsigned long long affected_rows= 0, insert_id= 0;
+  unsigned int error= 0;
+  char sqlstate[SQLSTATE_LENGTH + 1];
+  char error_msg[MYSQL_ERRMSG_SIZE];
+
+  if ((mysql->server_status & SERVER_STATUS_IN_TRANS) ||
+      !(mysql->server_status & SERVER_STATUS_AUTOCOMMIT))
+    max_pending= MADB_STMT_BULK_PENDING;
+
+  while ((!error && row < stmt->array_size) || pending)
+  {
+    if (!error && row < stmt->array_size)
+    {
+      size_t request_len;
+      char *request= (char *)ma_stmt_generate_request(stmt, row, max_length,
+                                                       &rows, &request_len);
+      if (request)
+      {
+        if (mysql->methods->db_command(mysql, COM_STMT_EXECUTE, request,
+                                       request_len, 1, stmt))
+        {
+          /* the connection is gone, pending responses can't be read */
+          SET_CLIENT_STMT_ERROR(stmt, mysql->net.last_errno, mysql->net.sqlstate,
+                                mysql->net.last_error);
+          ma_stmt_request_release(stmt);
+          return(1);
+        }
+        row+= rows;
+        if (++pending < max_pending && row < stmt->array_size)
+          continue;
+      }
+      else
+      {
+        error= stmt->last_errno;
+        strcpy(sqlstate, stmt->sqlstate);
+        strcpy(error_msg, stmt->last_error);
+        if (!pending)
+          break;
+      }
+    }
+
+    pending--;
+    if (stmt_read_execute_response(stmt))
+    {
+      if (!stmt->mysql || !mysql->net.pvio)
+      {
+        ma_stmt_request_release(stmt);
+        return(1);
+      }
+      if (!error)
+      {
+        error= stmt->last_errno;
+        strcpy(sqlstate, stmt->sqlstate);
+        strcpy(error_msg, stmt->last_error);
+      }
+      continue;
+    }
+    if (stmt->field_count)
+    {
+      /* the result set of the last packet is read by the caller */
+      if (!pending && row >= stmt->array_size)
+        break;
+      /* other responses follow, so it can't be returned */
+      if (stmt->state == MYSQL_STMT_WAITING_USE_OR_STORE && !stmt->cursor_exists)
+        mysql->methods->db_stmt_flush_unbuffered(stmt);
+      mysql->status= MYSQL_STATUS_READY;
+      if (!error)
+      {
+        error= CR_BULK_RESULT_SET;
+        strcpy(sqlstate, SQLSTATE_UNKNOWN);
+        snprintf(error_msg, MYSQL_ERRMSG_SIZE, CER(CR_BULK_RESULT_SET),
+                 row, stmt->array_size);
+      }
+      continue;
+    }
+    affected_rows+= stmt->upsert_status.affected_rows;
+    if (!insert_id)
+      insert_id= stmt->upsert_status.last_insert_id;
+    warnings+= stmt->upsert_status.warning_count;
+  }
+  ma_stmt_request_release(stmt);
+
+  if (error)
+  {
+    my_set_error(mysql, error, sqlstate, "%s", error_msg);
+    SET_CLIENT_STMT_ERROR(stmt, mysql->net.last_errno, mysql->net.sqlstate,
+                          mysql->net.last_error);
+    stmt->state= MYSQL_STMT_PREPARED;
+    return(1);
+  }
+  stmt->upsert_status.affected_rows= mysql->affected_rows= affected_rows;
+  stmt->upsert_status.last_insert_id= mysql->insert_id= insert_id;
+  stmt->upsert_status.warning_count= mysql->warning_count= warnings;
+  return(0);
+}
+
 int STDCALL mysql_stmt_execute(MYSQL_STMT *stmt)
 {
   MYSQL *mysql= stmt->mysql;
@@ -1790,19 +2869,40 @@ int STDCALL mysql_stmt_execute(MYSQL_STMT *stmt)
   /* clear data, in case mysql_stmt_store_result was called */
   if (stmt->result.data)
   {
+    ma_data_free_index(&stmt->result);
     ma_free_root(&stmt->result.alloc, MYF(MY_KEEP_PREALLOC));
     stmt->result_cursor= stmt->result.data= 0;
     stmt->result.rows= 0;
   }
+  if (stmt->array_size && !stmt->field_count &&
+      MARIADB_STMT_BULK_SUPPORTED(stmt) &&
+      !mysql->extension->pipeline && !mysql->extension->conn_hdlr &&
+      mysql->net.extension->multi_status == COM_MULTI_OFF)
+    return ma_stmt_execute_bulk(stmt);
+
   request= (char *)mysql_stmt_execute_generate_request(stmt, &request_len);
 
   if (!request)
     return 1;
 
+  /* in pipeline mode the response is read by mysql_read_query_result */
+  if (mysql->extension->pipeline)
+  {
+    ret= ma_pipeline_send(mysql, COM_STMT_EXECUTE, request, request_len, stmt);
+    ma_stmt_request_release(stmt);
+    if (ret)
+    {
+      SET_CLIENT_STMT_ERROR(stmt, mysql->net.last_errno, mysql->net.sqlstate,
+                            mysql->net.last_error);
+      return(1);
+    }
+    stmt->state= MYSQL_STMT_PREPARED;
+    return(0);
+  }
+
   ret= stmt->mysql->methods->db_command(mysql, COM_STMT_EXECUTE, request,
                                              request_len, 1, stmt);
-  if (request)
-    free(request);
+  ma_stmt_request_release(stmt);
 
   if (ret)
   {
@@ -1843,6 +2943,7 @@ static my_bool madb_reset_stmt(MYSQL_STMT *stmt, unsigned int flags)
     if (flags & MADB_RESET_STORED &&
         stmt->result_cursor)
     {
+      ma_data_free_index(&stmt->result);
       ma_free_root(&stmt->result.alloc, MYF(MY_KEEP_PREALLOC));
       stmt->result.data= NULL;
       stmt->result.rows= 0;
@@ -969,6 +969,7 @@ int ma_tls_start(char *errmsg, size_t errmsg_len)
     ma_tls_get_error(errmsg, errmsg_len, rc);
     goto end;
   }
+  ma_tls_session_cache_init();
   ma_tls_initialized= TRUE;
 end:
   pthread_mutex_unlock(&LOCK_gnutls_config);
@@ -992,6 +993,7 @@ void ma_tls_end()
   if (ma_tls_initialized)
   {
     pthread_mutex_lock(&LOCK_gnutls_config);
+    ma_tls_session_cache_end();
     if (mariadb_deinitialize_ssl)
       gnutls_global_deinit();
     ma_tls_initialized= FALSE;
@@ -1149,6 +1151,49 @@ error:
   return ssl_error;
 }
 
+/* stores the session data of ssl in the shared session cache */
+static void ma_tls_store_session(gnutls_session_t ssl, my_bool single_use)
+{
+  struct st_gnutls_data *data= (struct st_gnutls_data *)gnutls_session_get_ptr(ssl);
+  unsigned char key[MA_TLS_SESSION_KEY_LEN];
+  gnutls_datum_t session;
+
+  if (!data || !data->mysql ||
+      gnutls_session_get_data2(ssl, &session) != GNUTLS_E_SUCCESS)
+    return;
+  ma_tls_session_key(data->mysql, key);
+  ma_tls_session_put(key, session.data, session.size, single_use);
+  gnutls_free(session.data);
+}
+
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+/* TLS 1.3: the server sends session tickets after the handshake */
+static int ma_tls_ticket_hook(gnutls_session_t ssl,
+                              unsigned int htype __attribute__((unused)),
+                              unsigned int when __attribute__((unused)),
+                              unsigned int incoming __attribute__((unused)),
+                              const gnutls_datum_t *msg __attribute__((unused)))
+{
+  if (gnutls_protocol_get_version(ssl) == GNUTLS_TLS1_3)
+    ma_tls_store_session(ssl, 1);
+  return 0;
+}
+#endif
+
+/* offers the cached session of the connection target to the server */
+static void ma_tls_set_session(MYSQL *mysql, gnutls_session_t ssl)
+{
+  unsigned char key[MA_TLS_SESSION_KEY_LEN];
+  unsigned char *data;
+  size_t length;
+
+  ma_tls_session_key(mysql, key);
+  if (ma_tls_session_get(key, &data, &length))
+    return;
+  gnutls_session_set_data(ssl, data, length);
+  free(data);
+}
+
 void *ma_tls_init(MYSQL *mysql)
 {
   gnutls_session_t ssl= NULL;
@@ -1183,6 +1228,12 @@ void *ma_tls_init(MYSQL *mysql)
      a client certificate we will send it via callback function */
   if ((ssl_error= gnutls_credentials_set(ssl, GNUTLS_CRD_CERTIFICATE, ctx)) < 0)
     goto error;
+
+  ma_tls_set_session(mysql, ssl);
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+  gnutls_handshake_set_hook_function(ssl, GNUTLS_HANDSHAKE_NEW_SESSION_TICKET,
+                                     GNUTLS_HOOK_POST, ma_tls_ticket_hook);
+#endif
   
   pthread_mutex_unlock(&LOCK_gnutls_config);
   return (void *)ssl;
@@ -1235,7 +1286,11 @@ my_bool ma_tls_connect(MARIADB_TLS *ctls)
   if (!(blocking= pvio->methods->is_blocking(pvio)))
     pvio->methods->blocking(pvio, TRUE, 0);
 
-  /* we don't use GnuTLS read/write functions */
+  /*
+    All I/O goes through PVIO, so timeouts, statistics and non blocking
+    connections work as without TLS. GnuTLS can only enable kernel TLS
+    on a socket it owns, so MARIADB_OPT_TLS_KTLS is ignored.
+  */
   gnutls_transport_set_ptr(ssl, pvio);
   gnutls_transport_set_push_function(ssl, ma_tls_push);
   gnutls_transport_set_pull_function(ssl, ma_tls_pull);
@@ -1257,6 +1312,12 @@ my_bool ma_tls_connect(MARIADB_TLS *ctls)
       pvio->methods->blocking(pvio, FALSE, 0);
     return 1;
   }
+  if (gnutls_session_is_resumed(ssl))
+    ma_tls_session_resumed();
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+  if (gnutls_protocol_get_version(ssl) != GNUTLS_TLS1_3)
+#endif
+    ma_tls_store_session(ssl, 0);
   ctls->ssl= (void *)ssl;
   return 0;
 }
@@ -28,11 +28,9 @@
 #include <openssl/ssl.h> /* SSL and SSL_CTX */
 #include <openssl/err.h> /* error reporting */
 #include <openssl/conf.h>
-#include <openssl/md4.h>
+#include <openssl/sha.h>
+#include <sys/stat.h>
 
-#ifdef HAVE_TLS_SESSION_CACHE
-#undef HAVE_TLS_SESSION_CACHE
-#endif
 #if OPENSSL_USE_BIOMETHOD
 #undef OPENSSL_USE_BIOMETHOD
 #endif
@@ -53,6 +51,9 @@ extern unsigned int mariadb_deinitialize_ssl;
 #define MAX_SSL_ERR_LEN 100
 
 static pthread_mutex_t LOCK_openssl_config;
+static rw_lock_t LOCK_tls_ctx_cache;
+static pthread_mutex_t LOCK_tls_ctx_stats;
+static void ma_tls_ctx_cache_free(void);
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 static pthread_mutex_t *LOCK_crypto= NULL;
 #endif
@@ -106,46 +107,6 @@ static void my_cb_threadid(CRYPTO_THREADID *id)
 #endif
 #endif
 
-#ifdef HAVE_TLS_SESSION_CACHE
-typedef struct st_ma_tls_session {
-  char md4_hash[17];
-  SSL_SESSION *session;
-} MA_SSL_SESSION;
-
-MA_SSL_SESSION *ma_tls_sessions= NULL;
-int ma_tls_session_cache_size= 128;
-
-static char *ma_md4_hash(const char *host, const char *user, unsigned int port, char *md4)
-{
-  char buffer[195]; /* MAX_USERNAME_LEN + MAX_HOST_NAME_LEN + 2 + 5 */
-  snprintf(buffer, 194, "%s@%s:%d", user ? user : "", host, port);
-  buffer[194]= 0;
-  MD4((unsigned char *)buffer, strlen(buffer), (unsigned char *)md4);
-  return md4;
-}
-
-MA_SSL_SESSION *ma_tls_get_session(MYSQL *mysql)
-{
-  char md4[17];
-  int i;
-
-  if (!ma_tls_sessions)
-    return NULL;
-
-  memset(md4, 0, 16);
-  ma_md4_hash(mysql->host, mysql->user, mysql->port, md4);
-  for (i=0; i < ma_tls_session_cache_size; i++)
-  {
-    if (ma_tls_sessions[i].session &&
-        !strncmp(ma_tls_sessions[i].md4_hash, md4, 16))
-    {
-      return &ma_tls_sessions[i];
-    }
-  }
-  return NULL;
-}
-
-
 #if OPENSSL_USE_BIOMETHOD
 static int ma_bio_read(BIO *bio, char *buf, int size)
 {
@@ -167,47 +128,58 @@ static int ma_bio_write(BIO *bio, const char *buf, int size)
 }
 #endif
 
+/*
+  Called for every new session and every TLS 1.3 ticket the server sent:
+  stores the serialized session in the shared session cache.
+*/
 static int ma_tls_session_cb(SSL *ssl, SSL_SESSION *session)
 {
-  MYSQL *mysql;
-  MA_SSL_SESSION *stored_session;
-  int i;
-
-  mysql= (MYSQL *)SSL_get_app_data(ssl);
-
-  /* check if we already stored session key */
-  if ((stored_session= ma_tls_get_session(mysql)))
-  {
-    SSL_SESSION_free(stored_session->session);
-    stored_session->session= session;
-    return 1;
-  }
-
-  for (i=0; i < ma_tls_session_cache_size; i++)
+  MYSQL *mysql= (MYSQL *)SSL_get_app_data(ssl);
+  unsigned char key[MA_TLS_SESSION_KEY_LEN];
+  unsigned char *data, *p;
+  my_bool single_use= 0;
+  int length;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  if (!SSL_SESSION_is_resumable(session))
+    return 0;
+#endif
+#ifdef TLS1_3_VERSION
+  single_use= SSL_SESSION_get_protocol_version(session) >= TLS1_3_VERSION;
+#endif
+  if (!mysql || (length= i2d_SSL_SESSION(session, NULL)) <= 0 ||
+      !(p= data= (unsigned char *)malloc(length)))
+    return 0;
+  if (i2d_SSL_SESSION(session, &p) == length)
   {
-    if (!ma_tls_sessions[i].session)
-    {
-      ma_md4_hash(mysql->host, mysql->user, mysql->port, ma_tls_sessions[i].md4_hash);
-      ma_tls_sessions[i].session= session;
-    }
-    return 1;
+    ma_tls_session_key(mysql, key);
+    ma_tls_session_put(key, data, length, single_use);
   }
+  free(data);
+  /* we didn't keep a reference to session */
   return 0;
 }
 
-static void ma_tls_remove_session_cb(SSL_CTX* ctx __attribute__((unused)), 
-                                     SSL_SESSION* session)
+/* offers the cached session of the connection target to the server */
+static void ma_tls_set_session(MYSQL *mysql, SSL *ssl)
 {
-  int i;
-  for (i=0; i < ma_tls_session_cache_size; i++)
-    if (session == ma_tls_sessions[i].session)
-    {
-      ma_tls_sessions[i].md4_hash[0]= 0;
-      SSL_SESSION_free(ma_tls_sessions[i].session);
-      ma_tls_sessions[i].session= NULL;
-    }
+  unsigned char key[MA_TLS_SESSION_KEY_LEN];
+  unsigned char *data;
+  const unsigned char *p;
+  size_t length;
+  SSL_SESSION *session;
+
+  ma_tls_session_key(mysql, key);
+  if (ma_tls_session_get(key, &data, &length))
+    return;
+  p= data;
+  if ((session= d2i_SSL_SESSION(NULL, &p, (long)length)))
+  {
+    SSL_set_session(ssl, session);
+    SSL_SESSION_free(session);
+  }
+  free(data);
 }
-#endif
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 static void my_cb_locking(int mode, int n, 
@@ -287,6 +259,9 @@ int ma_tls_start(char *errmsg __attribute__((unused)), size_t errmsg_len __attri
   /* lock mutex to prevent multiple initialization */
   pthread_mutex_init(&LOCK_openssl_config, NULL);
   pthread_mutex_lock(&LOCK_openssl_config);
+  my_rwlock_init(&LOCK_tls_ctx_cache, NULL);
+  pthread_mutex_init(&LOCK_tls_ctx_stats, NULL);
+  ma_tls_session_cache_init();
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
   if (!OPENSSL_init_ssl(OPENSSL_INIT_LOAD_CONFIG, NULL))
     goto end;
@@ -337,6 +312,10 @@ void ma_tls_end()
   if (ma_tls_initialized)
   {
     pthread_mutex_lock(&LOCK_openssl_config);
+    ma_tls_ctx_cache_free();
+    rwlock_destroy(&LOCK_tls_ctx_cache);
+    pthread_mutex_destroy(&LOCK_tls_ctx_stats);
+    ma_tls_session_cache_end();
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
     CRYPTO_set_locking_callback(NULL);
     CRYPTO_set_id_callback(NULL);
@@ -377,21 +356,43 @@ int ma_tls_get_password(char *buf, int size,
 }
 
 
-static int ma_tls_set_certs(MYSQL *mysql, SSL *ssl)
+static int ma_tls_set_certs(MYSQL *mysql, SSL_CTX *ctx)
 {
   char *certfile= mysql->options.ssl_cert,
        *keyfile= mysql->options.ssl_key;
   char *pw= (mysql->options.extension) ?
             mysql->options.extension->tls_pw : NULL;
-  SSL_CTX *ctx= SSL_get_SSL_CTX(ssl);
+  char *tls_version= (mysql->options.extension) ?
+                     mysql->options.extension->tls_version : NULL;
 
-  
   /* add cipher */
   if ((mysql->options.ssl_cipher && 
         mysql->options.ssl_cipher[0] != 0) &&
-      SSL_set_cipher_list(ssl, mysql->options.ssl_cipher) == 0)
+      SSL_CTX_set_cipher_list(ctx, mysql->options.ssl_cipher) == 0)
     goto error;
 
+  /* restrict protocol versions to those listed in tls_version */
+  if (tls_version && tls_version[0])
+  {
+    long options= 0;
+
+    if (!strstr(tls_version, "TLSv1.0"))
+      options|= SSL_OP_NO_TLSv1;
+#ifdef SSL_OP_NO_TLSv1_1
+    if (!strstr(tls_version, "TLSv1.1"))
+      options|= SSL_OP_NO_TLSv1_1;
+#endif
+#ifdef SSL_OP_NO_TLSv1_2
+    if (!strstr(tls_version, "TLSv1.2"))
+      options|= SSL_OP_NO_TLSv1_2;
+#endif
+#ifdef SSL_OP_NO_TLSv1_3
+    if (!strstr(tls_version, "TLSv1.3"))
+      options|= SSL_OP_NO_TLSv1_3;
+#endif
+    SSL_CTX_set_options(ctx, options);
+  }
+
   /* ca_file and ca_path */
   SSL_CTX_set_verify(ctx, (mysql->options.ssl_ca || mysql->options.ssl_capath)?
                      SSL_VERIFY_NONE : SSL_VERIFY_NONE, NULL);
@@ -413,8 +414,7 @@ static int ma_tls_set_certs(MYSQL *mysql, SSL *ssl)
   /* set cert */
   if (certfile  && certfile[0] != 0)
   {
-    if (SSL_CTX_use_certificate_chain_file(ctx, certfile) != 1 ||
-        SSL_use_certificate_file(ssl, certfile, SSL_FILETYPE_PEM) != 1)
+    if (SSL_CTX_use_certificate_chain_file(ctx, certfile) != 1)
       goto error; 
   }
   if (keyfile && keyfile[0])
@@ -425,7 +425,7 @@ static int ma_tls_set_certs(MYSQL *mysql, SSL *ssl)
       EVP_PKEY *key= EVP_PKEY_new();
       PEM_read_PrivateKey(fp, &key, NULL, pw);
       fclose(fp);
-      if (SSL_use_PrivateKey(ssl, key) != 1)
+      if (SSL_CTX_use_PrivateKey(ctx, key) != 1)
       {
         unsigned long err= ERR_peek_error();
         EVP_PKEY_free(key);
@@ -441,7 +441,7 @@ static int ma_tls_set_certs(MYSQL *mysql, SSL *ssl)
     }
   }
   /* verify key */
-  if (certfile && !SSL_check_private_key(ssl))
+  if (certfile && !SSL_CTX_check_private_key(ctx))
     goto error;
   
   if (mysql->options.extension &&
@@ -465,51 +465,283 @@ error:
   return 1;
 }
 
-void *ma_tls_init(MYSQL *mysql)
+/*
+  SSL_CTX cache
+
+  Loading the CA, certificate, key and CRL files into a context is
+  expensive, so all connections with the same TLS options share one
+  context. Entries are identified by a SHA-256 digest of the options
+  and store the modification time of the files they were loaded from:
+  if a file changed, the next connection creates a new context which
+  replaces the old entry.
+
+  The cache and every SSL object hold a reference to the context, so
+  a replaced or evicted context is freed when its last connection was
+  closed. Lookups only take a read lock, the files are parsed without
+  holding any lock. The statistics (MARIADB_TLS_CTX_CACHE_STATS) have
+  their own mutex, since hits are counted under the read lock.
+*/
+#define MA_TLS_CTX_CACHE_SIZE 32
+#define MA_TLS_CTX_FILES 6
+
+typedef struct st_ma_tls_file_sig {
+  time_t mtime;
+  unsigned long long size;
+  unsigned long long inode;
+} MA_TLS_FILE_SIG;
+
+typedef struct st_ma_tls_ctx {
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  MA_TLS_FILE_SIG files[MA_TLS_CTX_FILES];
+  SSL_CTX *ctx;
+  struct st_ma_tls_ctx *next;
+} MA_TLS_CTX;
+
+static MA_TLS_CTX *ma_tls_ctx_cache= NULL;
+static unsigned int ma_tls_ctx_cache_count= 0;
+static MARIADB_TLS_CTX_STATS ma_tls_ctx_counters;
+
+static void ma_tls_ctx_count(unsigned long long *counter)
 {
-  SSL *ssl= NULL;
-  SSL_CTX *ctx= NULL;
-#ifdef HAVE_TLS_SESSION_CACHE
-  MA_SSL_SESSION *session= ma_tls_get_session(mysql);
-#endif
-  pthread_mutex_lock(&LOCK_openssl_config);
+  pthread_mutex_lock(&LOCK_tls_ctx_stats);
+  (*counter)++;
+  pthread_mutex_unlock(&LOCK_tls_ctx_stats);
+}
+
+static void ma_tls_file_sig(const char *path, MA_TLS_FILE_SIG *sig)
+{
+  struct stat st;
+
+  memset(sig, 0, sizeof(MA_TLS_FILE_SIG));
+  if (path && path[0] && !stat(path, &st))
+  {
+    sig->mtime= st.st_mtime;
+    sig->size= (unsigned long long)st.st_size;
+    sig->inode= (unsigned long long)st.st_ino;
+  }
+}
+
+static void ma_tls_digest_option(EVP_MD_CTX *md, const char *option)
+{
+  /* a NULL option differs from an empty one */
+  unsigned char is_set= option ? 1 : 0;
+
+  EVP_DigestUpdate(md, &is_set, 1);
+  if (option)
+    EVP_DigestUpdate(md, option, strlen(option) + 1);
+}
+
+/* computes the cache key of the TLS options of mysql */
+static my_bool ma_tls_ctx_key(MYSQL *mysql, MA_TLS_CTX *key)
+{
+  const char *options[MA_TLS_OPTIONS];
+  EVP_MD_CTX *md;
+  my_bool rc;
+  unsigned int i;
+
+  if (!(md= EVP_MD_CTX_create()))
+    return 1;
+  if (EVP_DigestInit_ex(md, EVP_sha256(), NULL) != 1)
+  {
+    EVP_MD_CTX_destroy(md);
+    return 1;
+  }
+  ma_tls_options(mysql, options);
+  for (i= 0; i < MA_TLS_OPTIONS; i++)
+    ma_tls_digest_option(md, options[i]);
+  rc= EVP_DigestFinal_ex(md, key->digest, NULL) != 1;
+  EVP_MD_CTX_destroy(md);
+  if (rc)
+    return 1;
+
+  /* CA, CA path, certificate, key, CRL and CRL path */
+  ma_tls_file_sig(options[0], &key->files[0]);
+  ma_tls_file_sig(options[1], &key->files[1]);
+  ma_tls_file_sig(options[2], &key->files[2]);
+  ma_tls_file_sig(options[3], &key->files[3]);
+  ma_tls_file_sig(options[6], &key->files[4]);
+  ma_tls_file_sig(options[7], &key->files[5]);
+  return 0;
+}
+/* returns the cached context for key, NULL if it is not cached or outdated */
+static SSL_CTX *ma_tls_ctx_find(const MA_TLS_CTX *key, MA_TLS_CTX **prev)
+{
+  MA_TLS_CTX *entry;
 
-  #if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  *prev= NULL;
+  for (entry= ma_tls_ctx_cache; entry; *prev= entry, entry= entry->next)
+  {
+    if (!memcmp(entry->digest, key->digest, SHA256_DIGEST_LENGTH))
+    {
+      if (memcmp(entry->files, key->files, sizeof(key->files)))
+        return NULL;
+      return entry->ctx;
+    }
+  }
+  return NULL;
+}
+
+static SSL_CTX *ma_tls_ctx_create(MYSQL *mysql)
+{
+  SSL_CTX *ctx;
+
+  /* don't report errors left over from a previous connection */
+  ERR_clear_error();
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
   if (!(ctx= SSL_CTX_new(TLS_client_method())))
 #else
   if (!(ctx= SSL_CTX_new(SSLv23_client_method())))
 #endif
-    goto error;
+  {
+    ma_tls_set_error(mysql);
+    return NULL;
+  }
   SSL_CTX_set_options(ctx, SSL_OP_ALL);
-#ifdef HAVE_TLS_SESSION_CACHE
-  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
-  ma_tls_sessions= (MA_SSL_SESSION *)calloc(1, sizeof(struct st_ma_tls_session) * ma_tls_session_cache_size);
+  /* sessions are kept in the shared cache, not in the context */
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+                                      SSL_SESS_CACHE_NO_INTERNAL_STORE);
   SSL_CTX_sess_set_new_cb(ctx, ma_tls_session_cb);
-  SSL_CTX_sess_set_remove_cb(ctx, ma_tls_remove_session_cb);
-#endif
+  if (ma_tls_set_certs(mysql, ctx))
+  {
+    SSL_CTX_free(ctx);
+    return NULL;
+  }
+  return ctx;
+}
 
-  if (!(ssl= SSL_new(ctx)))
-    goto error;
+/*
+  Adds the new context ctx for key to the cache and returns a new SSL
+  object for it. If another thread cached a context for key in the
+  meantime, that one is used and ctx is released.
+*/
+static SSL *ma_tls_ctx_add(const MA_TLS_CTX *key, SSL_CTX *ctx)
+{
+  MA_TLS_CTX *entry, *prev;
+  SSL_CTX *cached;
+  SSL *ssl;
 
-  if (ma_tls_set_certs(mysql, ssl))
+  rw_wrlock(&LOCK_tls_ctx_cache);
+  if ((cached= ma_tls_ctx_find(key, &prev)))
   {
-    goto error;
+    ma_tls_ctx_count(&ma_tls_ctx_counters.hits);
+    SSL_CTX_free(ctx);
+    ssl= SSL_new(cached);
+    rw_unlock(&LOCK_tls_ctx_cache);
+    return ssl;
+  }
+  /* drop the outdated entry */
+  entry= prev ? prev->next : ma_tls_ctx_cache;
+  if (entry && !memcmp(entry->digest, key->digest, SHA256_DIGEST_LENGTH))
+  {
+    if (prev)
+      prev->next= entry->next;
+    else
+      ma_tls_ctx_cache= entry->next;
+    SSL_CTX_free(entry->ctx);
+    free(entry);
+    ma_tls_ctx_cache_count--;
+    ma_tls_ctx_count(&ma_tls_ctx_counters.reloaded);
+  }
+  ma_tls_ctx_count(&ma_tls_ctx_counters.created);
+  if (!(entry= (MA_TLS_CTX *)malloc(sizeof(MA_TLS_CTX))))
+  {
+    /* use the context uncached, the SSL object keeps it alive */
+    rw_unlock(&LOCK_tls_ctx_cache);
+    ssl= SSL_new(ctx);
+    SSL_CTX_free(ctx);
+    return ssl;
   }
+  memcpy(entry, key, sizeof(MA_TLS_CTX));
+  entry->ctx= ctx;
+  entry->next= ma_tls_ctx_cache;
+  ma_tls_ctx_cache= entry;
+
+  /* evict the oldest entry */
+  if (++ma_tls_ctx_cache_count > MA_TLS_CTX_CACHE_SIZE)
+  {
+    for (prev= entry; prev->next->next; prev= prev->next);
+    SSL_CTX_free(prev->next->ctx);
+    free(prev->next);
+    prev->next= NULL;
+    ma_tls_ctx_cache_count--;
+    ma_tls_ctx_count(&ma_tls_ctx_counters.evicted);
+  }
+  ssl= SSL_new(ctx);
+  rw_unlock(&LOCK_tls_ctx_cache);
+  return ssl;
+}
+
+static void ma_tls_ctx_cache_free(void)
+{
+  MA_TLS_CTX *entry;
+
+  while ((entry= ma_tls_ctx_cache))
+  {
+    ma_tls_ctx_cache= entry->next;
+    SSL_CTX_free(entry->ctx);
+    free(entry);
+  }
+  ma_tls_ctx_cache_count= 0;
+  memset(&ma_tls_ctx_counters, 0, sizeof(MARIADB_TLS_CTX_STATS));
+}
+
+void ma_tls_ctx_stats(MARIADB_TLS_CTX_STATS *stats)
+{
+  if (!ma_tls_initialized)
+  {
+    memset(stats, 0, sizeof(MARIADB_TLS_CTX_STATS));
+    return;
+  }
+  rw_rdlock(&LOCK_tls_ctx_cache);
+  pthread_mutex_lock(&LOCK_tls_ctx_stats);
+  *stats= ma_tls_ctx_counters;
+  stats->entries= ma_tls_ctx_cache_count;
+  pthread_mutex_unlock(&LOCK_tls_ctx_stats);
+  rw_unlock(&LOCK_tls_ctx_cache);
+}
+
+void *ma_tls_init(MYSQL *mysql)
+{
+  SSL *ssl= NULL;
+  SSL_CTX *ctx;
+  MA_TLS_CTX key, *prev;
+
+  if (ma_tls_ctx_key(mysql, &key))
+  {
+    my_set_error(mysql, CR_OUT_OF_MEMORY, SQLSTATE_UNKNOWN, 0);
+    return NULL;
+  }
+
+  rw_rdlock(&LOCK_tls_ctx_cache);
+  if ((ctx= ma_tls_ctx_find(&key, &prev)))
+  {
+    ma_tls_ctx_count(&ma_tls_ctx_counters.hits);
+    ssl= SSL_new(ctx);
+  }
+  rw_unlock(&LOCK_tls_ctx_cache);
+
+  if (!ctx)
+  {
+    if (!(ctx= ma_tls_ctx_create(mysql)))
+      return NULL;
+    ssl= ma_tls_ctx_add(&key, ctx);
+  }
+  if (!ssl)
+    goto error;
 
   if (!SSL_set_app_data(ssl, mysql))
     goto error;
 
-#ifdef HAVE_TLS_SESSION_CACHE
-  if (session)
-    SSL_set_session(ssl, session->session);
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+  /* OpenSSL falls back to user space encryption if the kernel or the
+     negotiated cipher doesn't support it */
+  if (mysql->options.extension && mysql->options.extension->tls_ktls)
+    SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
 #endif
-
-  pthread_mutex_unlock(&LOCK_openssl_config);
+  ma_tls_set_session(mysql, ssl);
   return (void *)ssl;
 error:
-  pthread_mutex_unlock(&LOCK_openssl_config);
-  if (ctx)
-    SSL_CTX_free(ctx);
+  ma_tls_set_error(mysql);
   if (ssl)
     SSL_free(ssl);
   return NULL;
@@ -582,6 +814,12 @@ my_bool ma_tls_connect(MARIADB_TLS *ctls)
       return 1;
     }
   }
+  if (SSL_session_reused(ssl))
+    ma_tls_session_resumed();
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS) && !OPENSSL_USE_BIOMETHOD
+  ctls->ktls_send= BIO_get_ktls_send(SSL_get_wbio(ssl));
+  ctls->ktls_recv= BIO_get_ktls_recv(SSL_get_rbio(ssl));
+#endif
   pvio->ctls->ssl= ctls->ssl= (void *)ssl;
 
   return 0;
@@ -601,14 +839,10 @@ my_bool ma_tls_close(MARIADB_TLS *ctls)
 {
   int i, rc;
   SSL *ssl;
-  SSL_CTX *ctx= NULL;
 
   if (!ctls || !ctls->ssl)
     return 1;
   ssl= (SSL *)ctls->ssl;
-  ctx= SSL_get_SSL_CTX(ssl);
-  if (ctx)
-    SSL_CTX_free(ctx);
 
   SSL_set_quiet_shutdown(ssl, 1); 
   /* 2 x pending + 2 * data = 4 */ 
@@ -3,6 +3,7 @@
 #include <errmsg.h>
 #include <string.h>
 #include <ma_common.h>
+#include <ma_compress.h>
 #include <mysql/client_plugin.h>
 
 typedef struct st_mysql_client_plugin_AUTHENTICATION auth_plugin_t;
@@ -163,7 +164,7 @@ static int send_client_reply_packet(MCPVIO_EXT *mpvio,
                          mysql->options.extension->connect_attrs_len : 0;
 
   /* see end= buff+32 below, fixed size of the packet is 32 bytes */
-  buff= malloc(33 + USERNAME_LENGTH + data_len + NAME_LEN + NAME_LEN + conn_attr_len + 9);
+  buff= malloc(33 + USERNAME_LENGTH + data_len + NAME_LEN + NAME_LEN + conn_attr_len + 10);
   end= buff;
   
   mysql->client_flag|= mysql->options.client_flag;
@@ -200,13 +201,23 @@ static int send_client_reply_packet(MCPVIO_EXT *mpvio,
   }
 
 
+#ifdef HAVE_COMPRESS
+  /* select compression algorithm */
+  if (mysql->client_flag & (CLIENT_COMPRESS | CLIENT_ZSTD_COMPRESSION_ALGORITHM))
+  {
+    mysql->client_flag&= ~(CLIENT_COMPRESS | CLIENT_ZSTD_COMPRESSION_ALGORITHM);
+    mysql->client_flag|= ma_compression_negotiate(mysql);
+  }
+#endif
+
   /* Remove options that server doesn't support */
   mysql->client_flag= mysql->client_flag &
-                       (~(CLIENT_COMPRESS | CLIENT_SSL | CLIENT_PROTOCOL_41) 
+                       (~(CLIENT_COMPRESS | CLIENT_ZSTD_COMPRESSION_ALGORITHM |
+                          CLIENT_SSL | CLIENT_PROTOCOL_41)
                        | mysql->server_capabilities);
 
 #ifndef HAVE_COMPRESS
-  mysql->client_flag&= ~CLIENT_COMPRESS;
+  mysql->client_flag&= ~(CLIENT_COMPRESS | CLIENT_ZSTD_COMPRESSION_ALGORITHM);
 #endif
 
   if (mysql->client_flag & CLIENT_PROTOCOL_41)
@@ -300,6 +311,15 @@ static int send_client_reply_packet(MCPVIO_EXT *mpvio,
 
   end= ma_send_connect_attr(mysql, (unsigned char *)end);
 
+  if (mysql->client_flag & CLIENT_ZSTD_COMPRESSION_ALGORITHM)
+  {
+    unsigned int level= (mysql->options.extension &&
+                         mysql->options.extension->compression_level) ?
+                         mysql->options.extension->compression_level :
+                         MA_ZSTD_DEFAULT_LEVEL;
+    *end++= (char)level;
+  }
+
   /* Write authentication package */
   if (ma_net_write(net, (unsigned char *)buff, (size_t) (end-buff)) || ma_net_flush(net))
   {
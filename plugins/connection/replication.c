@@ -184,6 +184,7 @@ MYSQL *repl_connect(MYSQL *mysql, const char *host, const char *user, const char
 {
   REPL_DATA *data= NULL;
   MA_CONNECTION_HANDLER *hdlr= mysql->extension->conn_hdlr;
+  unsigned int dns_cache_ttl= 0;
 
   if (!mariadb_api)
     mariadb_api= mysql->methods->api;
@@ -218,7 +219,14 @@ MYSQL *repl_connect(MYSQL *mysql, const char *host, const char *user, const char
    * connecting to slave(s) in background */
 
   /* if slave connection will fail, we will not return error but use master instead */
-  if (!(data->slave_mysql= mariadb_api->mysql_init(NULL)) ||
+  if ((data->slave_mysql= mariadb_api->mysql_init(NULL)))
+  {
+    /* resolve the slave through the DNS cache of the master connection */
+    mariadb_api->mysql_get_optionv(mysql, MARIADB_OPT_DNS_CACHE_TTL, &dns_cache_ttl);
+    if (dns_cache_ttl)
+      mariadb_api->mysql_optionsv(data->slave_mysql, MARIADB_OPT_DNS_CACHE_TTL, &dns_cache_ttl);
+  }
+  if (!data->slave_mysql ||
       !(mysql->methods->db_connect(data->slave_mysql, data->host[MARIADB_SLAVE], user, passwd, db, 
                                    data->port[MARIADB_SLAVE] ? data->port[MARIADB_SLAVE] : port, unix_socket, clientflag)))
   {
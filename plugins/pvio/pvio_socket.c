@@ -61,6 +61,8 @@
 #endif
 
 #define DNS_TIMEOUT 30
+/* delay between staggered connection attempts in ms (RFC 8305) */
+#define CONNECT_ATTEMPT_DELAY 250
 
 
 /* Function prototypes */
@@ -70,6 +72,7 @@ ssize_t pvio_socket_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length);
 ssize_t pvio_socket_async_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length);
 ssize_t pvio_socket_async_write(MARIADB_PVIO *pvio, const uchar *buffer, size_t length);
 ssize_t pvio_socket_write(MARIADB_PVIO *pvio, const uchar *buffer, size_t length);
+ssize_t pvio_socket_writev(MARIADB_PVIO *pvio, const MA_IOVEC *iov, int iovcnt);
 int pvio_socket_wait_io_or_timeout(MARIADB_PVIO *pvio, my_bool is_read, int timeout);
 my_bool pvio_socket_blocking(MARIADB_PVIO *pvio, my_bool value, my_bool *old_value);
 my_bool pvio_socket_connect(MARIADB_PVIO *pvio, MA_PVIO_CINFO *cinfo);
@@ -105,7 +108,8 @@ struct st_ma_pvio_methods pvio_socket_methods= {
   pvio_socket_is_blocking,
   pvio_socket_is_alive,
   pvio_socket_has_data,
-  pvio_socket_shutdown
+  pvio_socket_shutdown,
+  pvio_socket_writev
 };
 
 #ifndef HAVE_SOCKET_DYNAMIC
@@ -253,7 +257,8 @@ int pvio_socket_get_timeout(MARIADB_PVIO *pvio, enum enum_pvio_timeout type)
      length          buffer length
 
    DESCRIPTION
-     reads up to length bytes into specified buffer. In the event of an
+     reads up to length bytes into specified buffer. The socket is only
+     polled if no data is available yet. In the event of an
      error erno is set to indicate it.
 
    RETURNS
@@ -266,7 +271,7 @@ ssize_t pvio_socket_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length)
 {
   ssize_t r= -1;
 #ifndef _WIN32
-  int read_flags= 0;
+  int read_flags= MSG_DONTWAIT;
 #endif
   struct st_pvio_socket *csock= NULL;
 
@@ -276,11 +281,25 @@ ssize_t pvio_socket_read(MARIADB_PVIO *pvio, uchar *buffer, size_t length)
   csock= (struct st_pvio_socket *)pvio->data;
 
 #ifndef _WIN32
-  if (pvio_socket_wait_io_or_timeout(pvio, TRUE, pvio->timeout[PVIO_READ_TIMEOUT]) < 1)
-    return -1;
+  /* Try to read without waiting first, which saves the poll() call if
+     the data already arrived. Whether data is pending can't be derived
+     from the size of the previous read, since the read ahead cache
+     usually asks for more than the server sent so far */
   do {
     r= recv(csock->socket, (void *)buffer, length, read_flags);
   } while (r == -1 && errno == EINTR);
+
+  while (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+         pvio->timeout[PVIO_READ_TIMEOUT] != 0)
+  {
+    if (pvio->mysql && pvio->mysql->extension)
+      MA_IO_STATS(pvio->mysql)->counters.read_waits++;
+    if (pvio_socket_wait_io_or_timeout(pvio, TRUE, pvio->timeout[PVIO_READ_TIMEOUT]) < 1)
+      return -1;
+    do {
+      r= recv(csock->socket, (void *)buffer, length, read_flags);
+    } while (r == -1 && errno == EINTR);
+  }
 #else
   {
     WSABUF wsaData;
@@ -485,6 +504,100 @@ ssize_t pvio_socket_write(MARIADB_PVIO *pvio, const uchar *buffer, size_t length
 }
 /* }}} */
 
+#ifndef _WIN32
+static ssize_t ma_sendv(int socket, const MA_IOVEC *iov, int iovcnt, int flags)
+{
+  ssize_t r;
+  struct msghdr msg;
+#if !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE)
+  struct sigaction act, oldact;
+  act.sa_handler= SIG_IGN;
+  sigaction(SIGPIPE, &act, &oldact);
+#endif
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov= (struct iovec *)iov;
+  msg.msg_iovlen= iovcnt;
+  r= sendmsg(socket, &msg, flags);
+#if !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE)
+  sigaction(SIGPIPE, &oldact, NULL);
+#endif
+  return r;
+}
+#endif
+
+/* {{{ pvio_socket_writev */
+/*
+   gather write to socket
+
+   SYNOPSIS
+   pvio_socket_writev()
+     pvio            PVIO
+     iov             array of buffers
+     iovcnt          number of buffers (max. PVIO_IOV_MAX)
+
+   DESCRIPTION
+     writes the buffers in order with a single system call. Like
+     pvio_socket_write it may write less bytes than requested, in the
+     event of an error errno is set to indicate it.
+
+   RETURNS
+      1..n           number of bytes written
+      0              peer has performed shutdown
+     -1              on error
+*/
+ssize_t pvio_socket_writev(MARIADB_PVIO *pvio, const MA_IOVEC *iov, int iovcnt)
+{
+  ssize_t r= -1;
+  struct st_pvio_socket *csock= NULL;
+#ifndef _WIN32
+  int send_flags= MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+  send_flags|= MSG_NOSIGNAL;
+#endif
+#endif
+  if (!pvio || !pvio->data || iovcnt > PVIO_IOV_MAX)
+    return -1;
+
+  csock= (struct st_pvio_socket *)pvio->data;
+
+#ifndef _WIN32
+  do {
+    r= ma_sendv(csock->socket, iov, iovcnt, send_flags);
+  } while (r == -1 && errno == EINTR);
+
+  while (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+         pvio->timeout[PVIO_WRITE_TIMEOUT] != 0)
+  {
+    if (pvio_socket_wait_io_or_timeout(pvio, FALSE, pvio->timeout[PVIO_WRITE_TIMEOUT]) < 1)
+      return -1;
+    do {
+      r= ma_sendv(csock->socket, iov, iovcnt, send_flags);
+    } while (r == -1 && errno == EINTR);
+  }
+#else
+  {
+    WSABUF wsaData[PVIO_IOV_MAX];
+    DWORD dwBytes= 0;
+    int i;
+
+    for (i=0; i < iovcnt; i++)
+    {
+      wsaData[i].len= (u_long)iov[i].iov_len;
+      wsaData[i].buf= (char *)iov[i].iov_base;
+    }
+
+    r = WSASend(csock->socket, wsaData, iovcnt, &dwBytes, 0, NULL, NULL);
+    if (r == SOCKET_ERROR) {
+      errno= WSAGetLastError();
+      return -1;
+    }
+    r= dwBytes;
+  }
+#endif
+  return r;
+}
+/* }}} */
+
 int pvio_socket_wait_io_or_timeout(MARIADB_PVIO *pvio, my_bool is_read, int timeout)
 {
   int rc;
@@ -509,7 +622,7 @@ int pvio_socket_wait_io_or_timeout(MARIADB_PVIO *pvio, my_bool is_read, int time
 
     do {
       rc= poll(&p_fd, 1, timeout);
-    } while (rc == -1 || errno == EINTR);
+    } while (rc == -1 && errno == EINTR);
 
     if (rc == 0)
       errno= ETIMEDOUT;
@@ -718,6 +831,228 @@ int pvio_socket_fast_send(MARIADB_PVIO *pvio)
   return r;
 }
 
+#ifndef _WIN32
+/* {{{ parallel connect ("happy eyeballs", RFC 8305) */
+static unsigned long long pvio_socket_now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+  Creates a non blocking socket for addr and starts connecting it.
+  Returns the socket or -1 on error (errno is set), *connected is set
+  if the connection was established immediately.
+*/
+static int pvio_socket_start_connect(struct addrinfo *addr,
+                                     struct addrinfo *bind_res,
+                                     my_bool *connected, int *attempts)
+{
+  struct addrinfo *bres;
+  int sd, rc= 0, error;
+
+  *connected= 0;
+  if ((sd= socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) == -1)
+    return -1;
+  if (bind_res)
+  {
+    for (bres= bind_res; bres; bres= bres->ai_next)
+    {
+      if (!(rc= bind(sd, bres->ai_addr, (int)bres->ai_addrlen)))
+        break;
+    }
+    if (rc)
+      goto error;
+  }
+  if (fcntl(sd, F_SETFL, O_NONBLOCK) == -1)
+    goto error;
+#ifdef __APPLE__
+  {
+    int val= 1;
+    setsockopt(sd, SOL_SOCKET, SO_NOSIGPIPE, (void *)&val, sizeof(int));
+  }
+#endif
+  (*attempts)++;
+  do {
+    rc= connect(sd, addr->ai_addr, (int)addr->ai_addrlen);
+  } while (rc == -1 && errno == EINTR);
+  if (!rc)
+    *connected= 1;
+  else if (errno != EINPROGRESS && errno != EAGAIN)
+    goto error;
+  return sd;
+error:
+  error= errno;
+  closesocket(sd);
+  errno= error;
+  return -1;
+}
+
+/*
+  Connects to the first address of res which accepts the connection.
+  Connection attempts are started CONNECT_ATTEMPT_DELAY ms apart, or as
+  soon as the previous attempt failed, alternating between IPv6 and IPv4
+  addresses. The first established connection wins, the others are
+  closed. Every attempt times out after the connect timeout.
+
+  Returns 0 on success with csock->socket set to the non blocking
+  socket, otherwise 1 and errno is set to the last error.
+*/
+static int pvio_socket_connect_parallel(MARIADB_PVIO *pvio,
+                                        struct addrinfo *res,
+                                        struct addrinfo *bind_res,
+                                        int *attempts)
+{
+  struct st_pvio_socket *csock= (struct st_pvio_socket *)pvio->data;
+  int timeout= pvio->timeout[PVIO_CONNECT_TIMEOUT];
+  struct addrinfo *ai, **addrs;
+  struct pollfd *fds;
+  unsigned long long *expires, now, next_attempt;
+  int count= 0, next= 0, pending= 0, i;
+  int winner= -1, error= ETIMEDOUT;
+
+  for (ai= res; ai; ai= ai->ai_next)
+    count++;
+  if (!(addrs= (struct addrinfo **)malloc(count * (sizeof(struct addrinfo *) +
+                                                  sizeof(struct pollfd) +
+                                                  sizeof(unsigned long long)))))
+  {
+    errno= ENOMEM;
+    return 1;
+  }
+  expires= (unsigned long long *)(addrs + count);
+  fds= (struct pollfd *)(expires + count);
+
+  /* alternate address families, starting with the family of the first
+     address (RFC 8305, 4.) */
+  {
+    struct addrinfo *a= res, *b= res;
+
+    for (i= 0; i < count; i++)
+    {
+      while (a && a->ai_family != res->ai_family)
+        a= a->ai_next;
+      while (b && b->ai_family == res->ai_family)
+        b= b->ai_next;
+      if ((i % 2 == 0 && a) || !b)
+      {
+        addrs[i]= a;
+        a= a->ai_next;
+      }
+      else
+      {
+        addrs[i]= b;
+        b= b->ai_next;
+      }
+    }
+  }
+
+  now= next_attempt= pvio_socket_now_ms();
+  while (winner == -1 && (next < count || pending))
+  {
+    int wait= -1, rc;
+    my_bool failed= 0;
+
+    /* start the next attempt */
+    if (next < count && now >= next_attempt)
+    {
+      my_bool connected;
+      int sd= pvio_socket_start_connect(addrs[next++], bind_res, &connected,
+                                        attempts);
+      if (sd == -1)
+      {
+        error= errno;
+        continue;
+      }
+      if (connected)
+      {
+        winner= sd;
+        break;
+      }
+      fds[pending].fd= sd;
+      fds[pending].events= POLLOUT;
+      fds[pending].revents= 0;
+      expires[pending++]= now + (timeout > 0 ? timeout : 0);
+      next_attempt= now + CONNECT_ATTEMPT_DELAY;
+      continue;
+    }
+
+    if (next < count)
+      wait= (int)(next_attempt - now);
+    if (timeout > 0)
+    {
+      for (i= 0; i < pending; i++)
+      {
+        int left= expires[i] > now ? (int)(expires[i] - now) : 0;
+        if (wait == -1 || left < wait)
+          wait= left;
+      }
+    }
+    do {
+      rc= poll(fds, pending, wait);
+    } while (rc == -1 && errno == EINTR);
+    if (rc == -1)
+    {
+      error= errno;
+      break;
+    }
+    now= pvio_socket_now_ms();
+
+    for (i= pending - 1; i >= 0; i--)
+    {
+      int sock_error= 0;
+      socklen_t len= sizeof(sock_error);
+
+      if (fds[i].revents)
+      {
+        if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (char *)&sock_error, &len) < 0)
+          sock_error= errno;
+        if (!sock_error && winner == -1)
+        {
+          winner= fds[i].fd;
+          fds[i].fd= -1;
+          continue;
+        }
+      }
+      else if (timeout > 0 && now >= expires[i])
+        sock_error= ETIMEDOUT;
+      else
+        continue;
+      if (sock_error)
+      {
+        error= sock_error;
+        failed= 1;
+      }
+      /* remove the failed attempt */
+      closesocket(fds[i].fd);
+      fds[i]= fds[--pending];
+      expires[i]= expires[pending];
+    }
+    /* a failed attempt starts the next one immediately */
+    if (failed)
+      next_attempt= now;
+  }
+
+  /* cancel the remaining attempts */
+  for (i= 0; i < pending; i++)
+    if (fds[i].fd != -1)
+      closesocket(fds[i].fd);
+  free(addrs);
+
+  if (winner == -1)
+  {
+    errno= error;
+    return 1;
+  }
+  csock->socket= winner;
+  csock->fcntl_mode= O_NONBLOCK;
+  return 0;
+}
+/* }}} */
+#endif
+
 static int
 pvio_socket_connect_sync_or_async(MARIADB_PVIO *pvio,
                           const struct sockaddr *name, uint namelen)
@@ -736,6 +1071,51 @@ pvio_socket_connect_sync_or_async(MARIADB_PVIO *pvio,
   return pvio_socket_internal_connect(pvio, name, namelen);
 }
 
+/* {{{ pvio_socket_getaddrinfo
+   Resolves host and port, temporary failures are retried until the
+   connect timeout elapsed. If the connection has a DNS cache TTL, the
+   result is taken from or added to the DNS cache: if *cached is set,
+   *res must be freed with ma_dns_cache_free() instead of freeaddrinfo().
+*/
+static int pvio_socket_getaddrinfo(MYSQL *mysql, const char *host,
+                                   const char *port, struct addrinfo *hints,
+                                   time_t start_t, struct addrinfo **res,
+                                   my_bool *cached)
+{
+  unsigned int ttl= mysql->options.extension ?
+                    mysql->options.extension->dns_cache_ttl : 0;
+  int gai_rc;
+#ifdef _WIN32
+  DWORD wait_gai= 1;
+#else
+  unsigned int wait_gai= 1;
+#endif
+
+  *cached= 0;
+  if (ttl && !ma_dns_cache_get(host, port ? port : "", ttl, res, &gai_rc))
+  {
+    *cached= 1;
+    return gai_rc;
+  }
+  while ((gai_rc= getaddrinfo(host, port, hints, res)) == EAI_AGAIN)
+  {
+    unsigned int timeout= mysql->options.connect_timeout ?
+                          mysql->options.connect_timeout : DNS_TIMEOUT;
+    if (time(NULL) - start_t > timeout)
+      break;
+#ifndef _WIN32
+    usleep(wait_gai);
+#else
+    Sleep(wait_gai);
+#endif
+    wait_gai*= 2;
+  }
+  if (ttl)
+    ma_dns_cache_put(host, port ? port : "", gai_rc ? NULL : *res, gai_rc);
+  return gai_rc;
+}
+/* }}} */
+
 my_bool pvio_socket_connect(MARIADB_PVIO *pvio, MA_PVIO_CINFO *cinfo)
 {
   struct st_pvio_socket *csock= NULL;
@@ -787,13 +1167,9 @@ my_bool pvio_socket_connect(MARIADB_PVIO *pvio, MA_PVIO_CINFO *cinfo)
     struct addrinfo hints, *save_res= 0, *bind_res= 0, *res= 0, *bres= 0;
     char server_port[NI_MAXSERV];
     int gai_rc;
-    int rc= 0;
+    int rc= 0, attempts= 0;
+    my_bool res_cached= 0, bind_res_cached= 0;
     time_t start_t= time(NULL);
-#ifdef _WIN32
-    DWORD wait_gai;
-#else
-    unsigned int wait_gai;
-#endif
 
     memset(&server_port, 0, NI_MAXSERV);
     snprintf(server_port, NI_MAXSERV, "%d", cinfo->port);
@@ -808,21 +1184,8 @@ my_bool pvio_socket_connect(MARIADB_PVIO *pvio, MA_PVIO_CINFO *cinfo)
      * bind_address */
     if (cinfo->mysql->options.bind_address)
     {
-      wait_gai= 1;
-      while ((gai_rc= getaddrinfo(cinfo->mysql->options.bind_address, 0,
-                          &hints, &bind_res)) == EAI_AGAIN)
-      {
-        unsigned int timeout= mysql->options.connect_timeout ?
-                              mysql->options.connect_timeout : DNS_TIMEOUT;
-        if (time(NULL) - start_t > timeout)
-          break;
-#ifndef _WIN32
-        usleep(wait_gai);
-#else
-        Sleep(wait_gai);
-#endif
-        wait_gai*= 2;
-      }
+      gai_rc= pvio_socket_getaddrinfo(mysql, cinfo->mysql->options.bind_address, 0,
+                                      &hints, start_t, &bind_res, &bind_res_cached);
       if (gai_rc != 0 || !bind_res)
       {
         PVIO_SET_ERROR(cinfo->mysql, CR_BIND_ADDR_FAILED, SQLSTATE_UNKNOWN, 
@@ -831,30 +1194,26 @@ my_bool pvio_socket_connect(MARIADB_PVIO *pvio, MA_PVIO_CINFO *cinfo)
       }
     }
     /* Get the address information for the server using getaddrinfo() */
-    wait_gai= 1;
-    while ((gai_rc= getaddrinfo(cinfo->host, server_port,
-                                &hints, &res) == EAI_AGAIN))
-    {
-      unsigned int timeout= mysql->options.connect_timeout ?
-                            mysql->options.connect_timeout : DNS_TIMEOUT;
-      if (time(NULL) - start_t > timeout)
-        break;
-#ifndef _WIN32
-      usleep(wait_gai);
-#else
-      Sleep(wait_gai);
-#endif
-      wait_gai*= 2;
-    }
+    gai_rc= pvio_socket_getaddrinfo(mysql, cinfo->host, server_port,
+                                    &hints, start_t, &res, &res_cached);
     if (gai_rc != 0 || !res)
     {
       PVIO_SET_ERROR(cinfo->mysql, CR_UNKNOWN_HOST, SQLSTATE_UNKNOWN, 
                    ER(CR_UNKNOWN_HOST), cinfo->host, gai_rc);
-      if (bind_res)
+      if (bind_res_cached)
+        ma_dns_cache_free(bind_res);
+      else if (bind_res)
         freeaddrinfo(bind_res);
       goto error;
     }
 
+#ifndef _WIN32
+    /* several addresses: connect in parallel, unless the connection is
+       non blocking */
+    if (res->ai_next && !IS_PVIO_ASYNC_ACTIVE(pvio))
+      rc= pvio_socket_connect_parallel(pvio, res, bind_res, &attempts);
+    else
+#endif
     /* res is a linked list of addresses for the given hostname. We loop until
        we are able to connect to one address or all connect attempts failed */
     for (save_res= res; save_res; save_res= save_res->ai_next)
@@ -879,6 +1238,7 @@ my_bool pvio_socket_connect(MARIADB_PVIO *pvio, MA_PVIO_CINFO *cinfo)
         }
       }
 
+      attempts++;
       rc= pvio_socket_connect_sync_or_async(pvio, save_res->ai_addr, (uint)save_res->ai_addrlen);
       if (!rc)
       {
@@ -895,11 +1255,16 @@ my_bool pvio_socket_connect(MARIADB_PVIO *pvio, MA_PVIO_CINFO *cinfo)
       }
     }
  
-    freeaddrinfo(res);
-    if (bind_res)
+    if (res_cached)
+      ma_dns_cache_free(res);
+    else
+      freeaddrinfo(res);
+    if (bind_res_cached)
+      ma_dns_cache_free(bind_res);
+    else if (bind_res)
       freeaddrinfo(bind_res);
 
-    if (csock->socket == SOCKET_ERROR)
+    if (csock->socket == SOCKET_ERROR && !attempts)
     {
       PVIO_SET_ERROR(cinfo->mysql, CR_IPSOCK_ERROR, SQLSTATE_UNKNOWN, ER(CR_IPSOCK_ERROR),
                          socket_errno);
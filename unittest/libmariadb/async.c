@@ -211,6 +211,321 @@ static int async1(MYSQL *unused __attribute__((unused)))
   return OK;
 }
 
+/*
+  Plain queries and unbuffered fetches don't need a co-routine (see
+  mariadb_async.c), mix them with calls which still use one.
+*/
+static int test_async_stackless(MYSQL *unused __attribute__((unused)))
+{
+  int err= 0, rc;
+  my_bool berr= 0;
+  MYSQL mysql, *ret;
+  MYSQL_RES *res;
+  MYSQL_ROW row;
+  int status;
+  unsigned int rows= 0;
+
+  if (skip_async)
+    return SKIP;
+
+  mysql_init(&mysql);
+  rc= mysql_options(&mysql, MYSQL_OPT_NONBLOCK, 0);
+  check_mysql_rc(rc, (MYSQL *)&mysql);
+
+  status= mysql_real_connect_start(&ret, &mysql, hostname, username, password,
+                                   schema, port, socketname, 0);
+  while (status)
+  {
+    status= wait_for_mysql(&mysql, status);
+    status= mysql_real_connect_cont(&ret, &mysql, status);
+  }
+  FAIL_IF(!ret, "Failed to mysql_real_connect()");
+
+  status= mysql_query_start(&err, &mysql, "SELECT * FROM nonexisting_table");
+  while (status)
+  {
+    status= wait_for_mysql(&mysql, status);
+    status= mysql_query_cont(&err, &mysql, status);
+  }
+  FAIL_IF(!err, "Error expected");
+  FAIL_IF(mysql_errno(&mysql) != 1146, "Expected error 1146");
+
+  status= mysql_send_query_start(&err, &mysql, SL("SELECT SEQ FROM seq_1_to_1000"));
+  while (status)
+  {
+    status= wait_for_mysql(&mysql, status);
+    status= mysql_send_query_cont(&err, &mysql, status);
+  }
+  FAIL_IF(err, "mysql_send_query() returns error");
+
+  status= mysql_read_query_result_start(&berr, &mysql);
+  while (status)
+  {
+    status= wait_for_mysql(&mysql, status);
+    status= mysql_read_query_result_cont(&berr, &mysql, status);
+  }
+  if (berr && mysql_errno(&mysql) == 1146)
+  {
+    diag("Sequence engine not available");
+    mysql_close(&mysql);
+    return SKIP;
+  }
+  FAIL_IF(berr, "mysql_read_query_result() returns error");
+
+  res= mysql_use_result(&mysql);
+  FAIL_IF(!res, "mysql_use_result() returns error");
+  for (;;)
+  {
+    status= mysql_fetch_row_start(&row, res);
+    while (status)
+    {
+      status= wait_for_mysql(&mysql, status);
+      status= mysql_fetch_row_cont(&row, res, status);
+    }
+    if (!row)
+      break;
+    rows++;
+  }
+  FAIL_IF(mysql_errno(&mysql), "Got error while retrieving rows");
+  FAIL_IF(rows != 1000, "Expected 1000 rows");
+  mysql_free_result(res);
+
+  status= mysql_select_db_start(&err, &mysql, schema);
+  while (status)
+  {
+    status= wait_for_mysql(&mysql, status);
+    status= mysql_select_db_cont(&err, &mysql, status);
+  }
+  FAIL_IF(err, "mysql_select_db() returns error");
+
+  status= mysql_close_start(&mysql);
+  while (status)
+  {
+    status= wait_for_mysql(&mysql, status);
+    status= mysql_close_cont(&mysql, status);
+  }
+  return OK;
+}
+
+/*
+  With MYSQL_OPT_RECONNECT a non-blocking query on a killed connection
+  reconnects like a blocking one.
+*/
+static int test_async_reconnect(MYSQL *my)
+{
+  int err= 0, rc, i;
+  my_bool reconnect= 1;
+  MYSQL mysql, *ret;
+  MYSQL_RES *res;
+  int status;
+  unsigned long thread_id;
+
+  if (skip_async)
+    return SKIP;
+
+  mysql_init(&mysql);
+  rc= mysql_options(&mysql, MYSQL_OPT_NONBLOCK, 0);
+  check_mysql_rc(rc, (MYSQL *)&mysql);
+  rc= mysql_options(&mysql, MYSQL_OPT_RECONNECT, &reconnect);
+  check_mysql_rc(rc, (MYSQL *)&mysql);
+
+  status= mysql_real_connect_start(&ret, &mysql, hostname, username, password,
+                                   schema, port, socketname, 0);
+  while (status)
+  {
+    status= wait_for_mysql(&mysql, status);
+    status= mysql_real_connect_cont(&ret, &mysql, status);
+  }
+  FAIL_IF(!ret, "Failed to mysql_real_connect()");
+
+  thread_id= mysql_thread_id(&mysql);
+  rc= mysql_kill(my, thread_id);
+  check_mysql_rc(rc, my);
+
+  /* the first query may still be written to the killed connection and
+     fail while reading the response, the next one has to reconnect */
+  for (i= 0; i < 3; i++)
+  {
+    status= mysql_query_start(&err, &mysql, "SELECT 1");
+    while (status)
+    {
+      status= wait_for_mysql(&mysql, status);
+      status= mysql_query_cont(&err, &mysql, status);
+    }
+    if (!err)
+      break;
+    diag("error %d: %s", mysql_errno(&mysql), mysql_error(&mysql));
+  }
+  FAIL_IF(err, "Non-blocking query didn't reconnect");
+  FAIL_IF(mysql_thread_id(&mysql) == thread_id, "Expected a new connection");
+  res= mysql_store_result(&mysql);
+  FAIL_IF(!res, "mysql_store_result() returns error");
+  mysql_free_result(res);
+
+  mysql_close(&mysql);
+  return OK;
+}
+
+/* Stacks are only held while a call is in flight */
+static int test_async_stack_pool(MYSQL *unused __attribute__((unused)))
+{
+  int err= 0, rc;
+  MYSQL mysql, *ret;
+  int status;
+  my_bool watermark= 1;
+  unsigned int in_use;
+  size_t max_used;
+
+  if (skip_async)
+    return SKIP;
+
+  rc= mysql_optionsv(NULL, MARIADB_OPT_ASYNC_STACK_WATERMARK, &watermark);
+  FAIL_IF(rc, "Setting MARIADB_OPT_ASYNC_STACK_WATERMARK failed");
+
+  mysql_init(&mysql);
+  rc= mysql_options(&mysql, MYSQL_OPT_NONBLOCK, 0);
+  check_mysql_rc(rc, (MYSQL *)&mysql);
+  mariadb_get_infov(NULL, MARIADB_ASYNC_STACKS_IN_USE, &in_use);
+  FAIL_IF(in_use, "No stack expected before a call was started");
+
+  status= mysql_real_connect_start(&ret, &mysql, hostname, username, password,
+                                   schema, port, socketname, 0);
+  while (status)
+  {
+    status= wait_for_mysql(&mysql, status);
+    status= mysql_real_connect_cont(&ret, &mysql, status);
+  }
+  FAIL_IF(!ret, "Failed to mysql_real_connect()");
+
+  status= mysql_select_db_start(&err, &mysql, schema);
+  while (status)
+  {
+    status= wait_for_mysql(&mysql, status);
+    status= mysql_select_db_cont(&err, &mysql, status);
+  }
+  FAIL_IF(err, "mysql_select_db() returns error");
+
+  mariadb_get_infov(NULL, MARIADB_ASYNC_STACKS_IN_USE, &in_use);
+  FAIL_IF(in_use, "Stack wasn't returned to the pool");
+  mariadb_get_infov(NULL, MARIADB_ASYNC_STACK_MAX_USED, &max_used);
+  diag("max. stack usage: %lu", (unsigned long)max_used);
+  FAIL_IF(!max_used, "Expected stack usage");
+
+  mysql_close(&mysql);
+  watermark= 0;
+  mysql_optionsv(NULL, MARIADB_OPT_ASYNC_STACK_WATERMARK, &watermark);
+  return OK;
+}
+
+struct reactor_conn {
+  MYSQL mysql;
+  int state;
+  int err;
+  MYSQL_RES *res;
+  unsigned int rows;
+};
+
+static int reactor_callback(MYSQL *mysql, int ready_status, void *arg)
+{
+  struct reactor_conn *conn= (struct reactor_conn *)arg;
+  MYSQL *ret= NULL;
+  MYSQL_ROW row= NULL;
+  int status= 0;
+
+  switch (conn->state) {
+  case 0:
+    status= mysql_real_connect_cont(&ret, mysql, ready_status);
+    break;
+  case 1:
+    status= mysql_query_cont(&conn->err, mysql, ready_status);
+    break;
+  case 2:
+    status= mysql_fetch_row_cont(&row, conn->res, ready_status);
+    break;
+  }
+  /* start the next calls until one has to wait */
+  while (!status)
+  {
+    switch (conn->state) {
+    case 0:
+      if (!ret)
+        return 0;
+      conn->state= 1;
+      status= mysql_query_start(&conn->err, mysql, "SELECT SEQ FROM seq_1_to_100");
+      break;
+    case 1:
+      if (conn->err || !(conn->res= mysql_use_result(mysql)))
+        return 0;
+      conn->state= 2;
+      status= mysql_fetch_row_start(&row, conn->res);
+      break;
+    case 2:
+      if (!row)
+      {
+        conn->state= 3;
+        return 0;
+      }
+      conn->rows++;
+      status= mysql_fetch_row_start(&row, conn->res);
+      break;
+    }
+  }
+  return status;
+}
+
+#define REACTOR_CONNECTIONS 16
+
+static int test_async_reactor(MYSQL *unused __attribute__((unused)))
+{
+  struct reactor_conn conn[REACTOR_CONNECTIONS];
+  MARIADB_REACTOR *reactor;
+  MYSQL *ret;
+  int i, rc, status;
+
+  if (skip_async)
+    return SKIP;
+
+  reactor= mariadb_reactor_init();
+  FAIL_IF(!reactor, "mariadb_reactor_init() failed");
+
+  for (i= 0; i < REACTOR_CONNECTIONS; i++)
+  {
+    memset(&conn[i], 0, sizeof(conn[i]));
+    mysql_init(&conn[i].mysql);
+    rc= mysql_options(&conn[i].mysql, MYSQL_OPT_NONBLOCK, 0);
+    check_mysql_rc(rc, &conn[i].mysql);
+    status= mysql_real_connect_start(&ret, &conn[i].mysql, hostname, username,
+                                     password, schema, port, socketname, 0);
+    FAIL_IF(!status, "Expected mysql_real_connect_start() to suspend");
+    rc= mariadb_reactor_add(reactor, &conn[i].mysql, status, reactor_callback,
+                            &conn[i]);
+    FAIL_IF(rc, "mariadb_reactor_add() failed");
+  }
+
+  while ((rc= mariadb_reactor_run(reactor, -1)) > 0);
+  FAIL_IF(rc < 0, "mariadb_reactor_run() failed");
+
+  for (i= 0; i < REACTOR_CONNECTIONS; i++)
+  {
+    if (conn[i].err && mysql_errno(&conn[i].mysql) == 1146)
+    {
+      diag("Sequence engine not available");
+      rc= SKIP;
+    }
+    else if (conn[i].state != 3 || conn[i].rows != 100)
+    {
+      diag("connection %d: state %d rows %u: %s", i, conn[i].state,
+           conn[i].rows, mysql_error(&conn[i].mysql));
+      rc= FAIL;
+    }
+    if (conn[i].res)
+      mysql_free_result(conn[i].res);
+    mysql_close(&conn[i].mysql);
+  }
+  mariadb_reactor_end(reactor);
+  return rc ? rc : OK;
+}
+
 static int test_conc131(MYSQL *unused __attribute__((unused)))
 {
   int rc;
@@ -243,6 +558,10 @@ static int test_conc129(MYSQL *unused __attribute__((unused)))
 struct my_tests_st my_tests[] = {
   {"test_async", test_async, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"async1", async1, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
+  {"test_async_stackless", test_async_stackless, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
+  {"test_async_reconnect", test_async_reconnect, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
+  {"test_async_stack_pool", test_async_stack_pool, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
+  {"test_async_reactor", test_async_reactor, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
   {"test_conc131", test_conc131, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
   {"test_conc129", test_conc129, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
   {NULL, NULL, 0, 0, NULL, NULL}
@@ -776,6 +776,114 @@ static int test_compressed(MYSQL *unused __attribute__((unused)))
   return OK;
 }
 
+static int test_compression_algorithms(MYSQL *unused __attribute__((unused)))
+{
+  int rc;
+  MYSQL *mysql= mysql_init(NULL);
+  MYSQL_RES *res;
+  unsigned int level= 5;
+  char *algorithms;
+
+  /* zstd will be used if supported by client and server, otherwise
+     we fall back to zlib */
+  rc= mysql_optionsv(mysql, MARIADB_OPT_COMPRESSION_ALGORITHMS, "zstd,zlib");
+  FAIL_IF(rc, "mysql_optionsv failed");
+  rc= mysql_optionsv(mysql, MARIADB_OPT_COMPRESSION_LEVEL, &level);
+  FAIL_IF(rc, "mysql_optionsv failed");
+  mysql_get_optionv(mysql, MARIADB_OPT_COMPRESSION_ALGORITHMS, &algorithms);
+  FAIL_IF(strcmp(algorithms, "zstd,zlib"), "wrong compression algorithms");
+
+  FAIL_IF(!my_test_connect(mysql, hostname, username, password, schema,
+                              port, socketname, 0), mysql_error(mysql));
+  FAIL_IF(!mysql->net.compress, "compression not enabled");
+
+  rc= mysql_query(mysql, "SELECT REPEAT('A', 100000)");
+  check_mysql_rc(rc, mysql);
+
+  if ((res= mysql_store_result(mysql)))
+    mysql_free_result(res);
+
+  mysql_close(mysql);
+
+  /* disable compression */
+  mysql= mysql_init(NULL);
+  rc= mysql_optionsv(mysql, MARIADB_OPT_COMPRESSION_ALGORITHMS, "uncompressed");
+  FAIL_IF(rc, "mysql_optionsv failed");
+  FAIL_IF(!my_test_connect(mysql, hostname, username, password, schema,
+                              port, socketname, 0), mysql_error(mysql));
+  FAIL_IF(mysql->net.compress, "compression enabled");
+  mysql_close(mysql);
+
+  /* levels are checked against the range of each algorithm */
+  mysql= mysql_init(NULL);
+  level= 10;
+  FAIL_IF(!mysql_optionsv(mysql, MARIADB_OPT_COMPRESSION_LEVEL, &level),
+          "zlib level 10 was accepted");
+  rc= mysql_optionsv(mysql, MARIADB_OPT_COMPRESSION_ALGORITHMS, "zstd");
+  FAIL_IF(rc, "mysql_optionsv failed");
+  level= 300;
+  FAIL_IF(!mysql_optionsv(mysql, MARIADB_OPT_COMPRESSION_LEVEL, &level),
+          "level 300 was accepted");
+  level= 0;
+  rc= mysql_optionsv(mysql, MARIADB_OPT_COMPRESSION_LEVEL, &level);
+  FAIL_IF(rc, "default level was rejected");
+  mysql_close(mysql);
+
+  return OK;
+}
+
+static int test_read_ahead_size(MYSQL *unused __attribute__((unused)))
+{
+  int rc, i;
+  MYSQL *mysql= mysql_init(NULL);
+  MYSQL_RES *res;
+  size_t min_size= 4096, max_size= 65536, size, grown_size;
+
+  rc= mysql_optionsv(mysql, MARIADB_OPT_READ_AHEAD_MIN_SIZE, &min_size);
+  FAIL_IF(rc, "mysql_optionsv failed");
+  rc= mysql_optionsv(mysql, MARIADB_OPT_READ_AHEAD_MAX_SIZE, &max_size);
+  FAIL_IF(rc, "mysql_optionsv failed");
+  mysql_get_optionv(mysql, MARIADB_OPT_READ_AHEAD_MIN_SIZE, &size);
+  FAIL_IF(size != min_size, "wrong read ahead min size");
+  mysql_get_optionv(mysql, MARIADB_OPT_READ_AHEAD_MAX_SIZE, &size);
+  FAIL_IF(size != max_size, "wrong read ahead max size");
+
+  FAIL_IF(!my_test_connect(mysql, hostname, username, password, schema,
+                              port, socketname, 0), mysql_error(mysql));
+
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_READ_AHEAD_SIZE, &size);
+  FAIL_IF(rc, "mariadb_get_infov failed");
+  FAIL_IF(size < min_size || size > max_size, "initial read ahead size out of range");
+
+  /* large results let the cache grow, small ones shrink it again */
+  for (i=0; i < 2; i++)
+  {
+    rc= mysql_query(mysql, "SELECT REPEAT('A', 500000)");
+    check_mysql_rc(rc, mysql);
+    FAIL_IF(!(res= mysql_store_result(mysql)), mysql_error(mysql));
+    mysql_free_result(res);
+  }
+  mariadb_get_infov(mysql, MARIADB_CONNECTION_READ_AHEAD_SIZE, &grown_size);
+  diag("read ahead size: %lu -> %lu", (unsigned long)size, (unsigned long)grown_size);
+  FAIL_IF(grown_size <= size, "read ahead cache didn't grow");
+  FAIL_IF(grown_size > max_size, "read ahead cache exceeds max size");
+
+  for (i=0; i < 20; i++)
+  {
+    rc= mysql_query(mysql, "SELECT 1");
+    check_mysql_rc(rc, mysql);
+    FAIL_IF(!(res= mysql_store_result(mysql)), mysql_error(mysql));
+    mysql_free_result(res);
+  }
+  mariadb_get_infov(mysql, MARIADB_CONNECTION_READ_AHEAD_SIZE, &size);
+  diag("read ahead size after small results: %lu", (unsigned long)size);
+  FAIL_IF(size >= grown_size, "read ahead cache didn't shrink");
+  FAIL_IF(size < min_size, "read ahead cache below min size");
+  mysql_close(mysql);
+
+  return OK;
+}
+
 struct my_tests_st my_tests[] = {
   {"test_conc75", test_conc75, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"test_conc74", test_conc74, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
@@ -783,6 +891,8 @@ struct my_tests_st my_tests[] = {
   {"test_conc70", test_conc70, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"test_conc68", test_conc68, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"test_compressed", test_compressed, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
+  {"test_compression_algorithms", test_compression_algorithms, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
+  {"test_read_ahead_size", test_read_ahead_size, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
   {"test_reconnect_maxpackage", test_reconnect_maxpackage, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
   {"basic_connect", basic_connect, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
   {"use_utf8", use_utf8, TEST_CONNECTION_NEW, 0,  opt_utf8,  NULL},
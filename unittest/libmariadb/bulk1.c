@@ -498,6 +498,167 @@ static int bulk6(MYSQL *mysql)
   return OK;
 }
 
+#define BULK_CHUNKED_ROWS 100000
+
+/* A bulk request larger than a single packet is sent in several chunks */
+static int bulk_chunked(MYSQL *mysql)
+{
+  MYSQL_STMT *stmt;
+  MYSQL_BIND bind[2];
+  MYSQL_RES *res;
+  MYSQL_ROW row;
+  unsigned int i, array_size= BULK_CHUNKED_ROWS;
+  int *id;
+  char **name;
+  unsigned long *length;
+  int rc;
+  const char *str= "0123456789012345678901234567890123456789";
+
+  if (!bulk_enabled)
+    return SKIP;
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS bulk_chunked");
+  check_mysql_rc(rc, mysql);
+
+  rc= mysql_query(mysql, "CREATE TABLE bulk_chunked (a int, b varchar(40))");
+  check_mysql_rc(rc, mysql);
+
+  id= (int *)malloc(BULK_CHUNKED_ROWS * sizeof(int));
+  name= (char **)malloc(BULK_CHUNKED_ROWS * sizeof(char *));
+  length= (unsigned long *)malloc(BULK_CHUNKED_ROWS * sizeof(unsigned long));
+  FAIL_IF(!id || !name || !length, "Not enough memory");
+
+  for (i=0; i < BULK_CHUNKED_ROWS; i++)
+  {
+    id[i]= i;
+    name[i]= (char *)str;
+    length[i]= 10 + i % 31;
+  }
+
+  stmt= mysql_stmt_init(mysql);
+  rc= mysql_stmt_prepare(stmt, "INSERT INTO bulk_chunked VALUES (?,?)", -1);
+  check_stmt_rc(rc, stmt);
+
+  memset(bind, 0, sizeof(MYSQL_BIND) * 2);
+  bind[0].buffer_type= MYSQL_TYPE_LONG;
+  bind[0].buffer= id;
+  bind[1].buffer_type= MYSQL_TYPE_STRING;
+  bind[1].buffer= name;
+  bind[1].length= length;
+
+  rc= mysql_stmt_attr_set(stmt, STMT_ATTR_ARRAY_SIZE, &array_size);
+  check_stmt_rc(rc, stmt);
+
+  rc= mysql_stmt_bind_param(stmt, bind);
+  check_stmt_rc(rc, stmt);
+
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+
+  FAIL_IF(mysql_stmt_affected_rows(stmt) != BULK_CHUNKED_ROWS,
+          "wrong number of affected rows");
+
+  mysql_stmt_close(stmt);
+  free(id);
+  free(name);
+  free(length);
+
+  rc= mysql_query(mysql, "SELECT COUNT(*), SUM(LENGTH(b)) FROM bulk_chunked");
+  check_mysql_rc(rc, mysql);
+
+  res= mysql_store_result(mysql);
+  row= mysql_fetch_row(res);
+  FAIL_IF(atol(row[0]) != BULK_CHUNKED_ROWS, "wrong number of rows");
+  FAIL_IF(atol(row[1]) != 2499925, "wrong total length");
+  mysql_free_result(res);
+
+  rc= mysql_query(mysql, "DROP TABLE bulk_chunked");
+  check_mysql_rc(rc, mysql);
+
+  return OK;
+}
+
+/*
+  A failed chunk stops the bulk execution: outside a transaction the next
+  chunk isn't sent before the response to the previous one was read
+*/
+static int bulk_chunk_error(MYSQL *mysql)
+{
+  MYSQL_STMT *stmt;
+  MYSQL_BIND bind[2];
+  MYSQL_RES *res;
+  MYSQL_ROW row;
+  unsigned int i, array_size= BULK_CHUNKED_ROWS;
+  int *id;
+  char **name;
+  unsigned long *length;
+  int rc;
+  const char *str= "0123456789012345678901234567890123456789";
+
+  if (!bulk_enabled)
+    return SKIP;
+
+  rc= mysql_autocommit(mysql, 1);
+  check_mysql_rc(rc, mysql);
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS bulk_chunk_error");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "CREATE TABLE bulk_chunk_error (a int primary key, b varchar(40))");
+  check_mysql_rc(rc, mysql);
+
+  id= (int *)malloc(BULK_CHUNKED_ROWS * sizeof(int));
+  name= (char **)malloc(BULK_CHUNKED_ROWS * sizeof(char *));
+  length= (unsigned long *)malloc(BULK_CHUNKED_ROWS * sizeof(unsigned long));
+  FAIL_IF(!id || !name || !length, "Not enough memory");
+
+  for (i=0; i < BULK_CHUNKED_ROWS; i++)
+  {
+    id[i]= i;
+    name[i]= (char *)str;
+    length[i]= 10 + i % 31;
+  }
+  /* duplicate key in the first chunk */
+  id[1]= 0;
+
+  stmt= mysql_stmt_init(mysql);
+  rc= mysql_stmt_prepare(stmt, "INSERT INTO bulk_chunk_error VALUES (?,?)", -1);
+  check_stmt_rc(rc, stmt);
+
+  memset(bind, 0, sizeof(MYSQL_BIND) * 2);
+  bind[0].buffer_type= MYSQL_TYPE_LONG;
+  bind[0].buffer= id;
+  bind[1].buffer_type= MYSQL_TYPE_STRING;
+  bind[1].buffer= name;
+  bind[1].length= length;
+
+  rc= mysql_stmt_attr_set(stmt, STMT_ATTR_ARRAY_SIZE, &array_size);
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_bind_param(stmt, bind);
+  check_stmt_rc(rc, stmt);
+
+  rc= mysql_stmt_execute(stmt);
+  FAIL_IF(!rc, "Error expected");
+  FAIL_IF(mysql_stmt_errno(stmt) != 1062, "Expected duplicate key error");
+
+  mysql_stmt_close(stmt);
+  free(id);
+  free(name);
+  free(length);
+
+  /* a chunk holds less than half of the rows */
+  rc= mysql_query(mysql, "SELECT COUNT(*) FROM bulk_chunk_error WHERE a >= 50000");
+  check_mysql_rc(rc, mysql);
+  res= mysql_store_result(mysql);
+  row= mysql_fetch_row(res);
+  FAIL_IF(atol(row[0]) != 0, "rows after the failed chunk were inserted");
+  mysql_free_result(res);
+
+  rc= mysql_query(mysql, "DROP TABLE bulk_chunk_error");
+  check_mysql_rc(rc, mysql);
+
+  return OK;
+}
+
 struct my_tests_st my_tests[] = {
   {"check_bulk", check_bulk, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"bulk5", bulk5, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
@@ -507,6 +668,8 @@ struct my_tests_st my_tests[] = {
   {"bulk3", bulk3, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"bulk4", bulk4, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"bulk_null", bulk_null, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
+  {"bulk_chunked", bulk_chunked, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
+  {"bulk_chunk_error", bulk_chunk_error, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {NULL, NULL, 0, 0, NULL, NULL}
 };
 
@@ -26,6 +26,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "my_test.h"
+#ifndef _WIN32
+#include "ma_pvio.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#endif
 
 static int test_conc66(MYSQL *my)
 {
@@ -1055,7 +1063,370 @@ static int test_reset(MYSQL *mysql)
   return OK;
 }
 
+static int test_connection_stats(MYSQL *unused __attribute__((unused)))
+{
+  MYSQL *mysql;
+  MYSQL_RES *res;
+  MARIADB_STATS stats, before;
+  unsigned long long latency[MARIADB_LATENCY_BUCKETS];
+  unsigned long long total= 0;
+  my_bool timing= 1;
+  int rc, i;
+
+  mysql= mysql_init(NULL);
+  FAIL_IF(!mysql, "not enough memory");
+  mysql_options(mysql, MYSQL_OPT_COMPRESS, NULL);
+  mysql_optionsv(mysql, MARIADB_OPT_STATS_TIMING, &timing);
+  if (!(my_test_connect(mysql, hostname, username,
+                           password, schema, port,
+                           socketname, 0)))
+  {
+    diag("connection failed");
+    mysql_close(mysql);
+    return FAIL;
+  }
+
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_STATS, &before);
+  FAIL_IF(rc, "MARIADB_CONNECTION_STATS failed");
+  FAIL_IF(!before.bytes_sent || !before.bytes_received, "handshake not counted");
+
+  rc= mysql_query(mysql, "SELECT REPEAT('a', 1000)");
+  check_mysql_rc(rc, mysql);
+  res= mysql_store_result(mysql);
+  FAIL_IF(!res, "expected result");
+  mysql_free_result(res);
+
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_STATS, &stats);
+  FAIL_IF(rc, "MARIADB_CONNECTION_STATS failed");
+  FAIL_IF(stats.commands != before.commands + 1, "expected one command");
+  FAIL_IF(stats.round_trips != before.round_trips + 1, "expected one round trip");
+  FAIL_IF(stats.packets_received - before.packets_received < 5, "expected a result set");
+  FAIL_IF(stats.bytes_received - before.bytes_received < 1000, "expected more bytes");
+  FAIL_IF(!stats.read_calls || !stats.write_calls, "expected system calls");
+  FAIL_IF(stats.uncompressed_bytes_received <= stats.compressed_bytes_received,
+          "expected compressed result");
+
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_COMMAND_LATENCY, latency, COM_QUERY);
+  FAIL_IF(rc, "MARIADB_CONNECTION_COMMAND_LATENCY failed");
+  for (i=0; i < MARIADB_LATENCY_BUCKETS; i++)
+    total+= latency[i];
+  FAIL_IF(total != 1, "expected one COM_QUERY round trip");
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_COMMAND_LATENCY, latency, 100);
+  FAIL_IF(!rc, "error expected for unknown command");
+
+  mariadb_reset_stats(mysql);
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_STATS, &stats);
+  FAIL_IF(rc, "MARIADB_CONNECTION_STATS failed");
+  FAIL_IF(stats.bytes_sent || stats.packets_received || stats.round_trips ||
+          stats.io_wait_ns, "expected zero after reset");
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_COMMAND_LATENCY, latency, COM_QUERY);
+  FAIL_IF(rc, "MARIADB_CONNECTION_COMMAND_LATENCY failed");
+  for (i=0; i < MARIADB_LATENCY_BUCKETS; i++)
+    FAIL_IF(latency[i], "expected empty histogram after reset");
+
+  /* without timing the counters are still updated */
+  timing= 0;
+  mysql_optionsv(mysql, MARIADB_OPT_STATS_TIMING, &timing);
+  rc= mysql_query(mysql, "SELECT 1");
+  check_mysql_rc(rc, mysql);
+  res= mysql_store_result(mysql);
+  mysql_free_result(res);
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_STATS, &stats);
+  FAIL_IF(rc, "MARIADB_CONNECTION_STATS failed");
+  FAIL_IF(stats.round_trips != 1, "expected one round trip");
+  FAIL_IF(stats.io_wait_ns, "expected no timing");
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_COMMAND_LATENCY, latency, COM_QUERY);
+  FAIL_IF(rc, "MARIADB_CONNECTION_COMMAND_LATENCY failed");
+  for (i=0; i < MARIADB_LATENCY_BUCKETS; i++)
+    FAIL_IF(latency[i], "expected no latency without timing");
+
+  mysql_close(mysql);
+  return OK;
+}
+
+/*
+  "localhost" usually resolves to ::1 and 127.0.0.1, so a TCP connection
+  tries both address families in parallel. The server might listen on
+  one of them only.
+*/
+static int test_connect_multiple_addresses(MYSQL *unused __attribute__((unused)))
+{
+  MYSQL *mysql;
+  unsigned int protocol= MYSQL_PROTOCOL_TCP, timeout= 5;
+  int rc;
+
+  if (hostname && strcmp(hostname, "localhost") && strcmp(hostname, "127.0.0.1"))
+  {
+    diag("test requires a local server");
+    return SKIP;
+  }
+
+  mysql= mysql_init(NULL);
+  FAIL_IF(!mysql, "not enough memory");
+  mysql_options(mysql, MYSQL_OPT_PROTOCOL, &protocol);
+  mysql_options(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+  if (!(my_test_connect(mysql, "localhost", username,
+                           password, schema, port,
+                           NULL, 0)))
+  {
+    diag("error: %s", mysql_error(mysql));
+    mysql_close(mysql);
+    return FAIL;
+  }
+  rc= mysql_query(mysql, "SELECT 1");
+  check_mysql_rc(rc, mysql);
+  mysql_free_result(mysql_store_result(mysql));
+  mysql_close(mysql);
+  return OK;
+}
+
+#ifndef _WIN32
+/*
+  A host name whose first address doesn't answer must not delay the
+  connection by the connect timeout. The addresses of the host are
+  stored in the DNS cache: a closed port or a blackholed one, followed
+  by the server. A listener whose accept queue is full drops the SYN
+  packets, so connecting to it blocks like a blackholed address.
+*/
+static int test_connect_unreachable_first_address(MYSQL *unused __attribute__((unused)))
+{
+  MYSQL *mysql;
+  struct addrinfo ai[2];
+  struct sockaddr_in addr[2];
+  socklen_t addrlen= sizeof(struct sockaddr_in);
+  unsigned int protocol= MYSQL_PROTOCOL_TCP, timeout= 10, ttl= 60, server_port;
+  char port_str[12];
+  const char *host= "unreachable-first.test";
+  time_t start;
+  int i, j, s, fill[3];
+
+  if (hostname && strcmp(hostname, "localhost") && strcmp(hostname, "127.0.0.1"))
+  {
+    diag("test requires a local server");
+    return SKIP;
+  }
+
+  /* the port the server listens on */
+  mysql= mysql_init(NULL);
+  FAIL_IF(!mysql, "not enough memory");
+  mysql_options(mysql, MYSQL_OPT_PROTOCOL, &protocol);
+  if (!my_test_connect(mysql, "127.0.0.1", username, password, schema,
+                       port, NULL, 0))
+  {
+    diag("error: %s", mysql_error(mysql));
+    mysql_close(mysql);
+    return FAIL;
+  }
+  mariadb_get_infov(mysql, MARIADB_CONNECTION_PORT, &server_port);
+  mysql_close(mysql);
+  snprintf(port_str, sizeof(port_str), "%u", server_port);
+
+  memset(ai, 0, sizeof(ai));
+  memset(addr, 0, sizeof(addr));
+  for (i=0; i < 2; i++)
+  {
+    addr[i].sin_family= AF_INET;
+    ai[i].ai_family= AF_INET;
+    ai[i].ai_socktype= SOCK_STREAM;
+    ai[i].ai_protocol= IPPROTO_TCP;
+    ai[i].ai_addrlen= sizeof(struct sockaddr_in);
+    ai[i].ai_addr= (struct sockaddr *)&addr[i];
+  }
+  ai[0].ai_next= &ai[1];
+  addr[1].sin_addr.s_addr= inet_addr("127.0.0.1");
+  addr[1].sin_port= htons((unsigned short)server_port);
+
+  for (i=0; i < 2; i++)
+  {
+    FAIL_IF((s= socket(AF_INET, SOCK_STREAM, 0)) < 0, "socket() failed");
+    addr[0].sin_addr.s_addr= inet_addr("127.0.0.1");
+    addr[0].sin_port= 0;
+    FAIL_IF(bind(s, (struct sockaddr *)&addr[0], addrlen) ||
+            getsockname(s, (struct sockaddr *)&addr[0], &addrlen), "bind() failed");
+    if (i == 0)
+      /* nobody listens on the port: the attempt is refused */
+      close(s);
+    else
+    {
+      /* fill the accept queue, further attempts get no answer */
+      FAIL_IF(listen(s, 0), "listen() failed");
+      for (j=0; j < 3; j++)
+      {
+        FAIL_IF((fill[j]= socket(AF_INET, SOCK_STREAM, 0)) < 0, "socket() failed");
+        fcntl(fill[j], F_SETFL, O_NONBLOCK);
+        connect(fill[j], (struct sockaddr *)&addr[0], addrlen);
+      }
+    }
+
+    mysql= mysql_init(NULL);
+    FAIL_IF(!mysql, "not enough memory");
+    ma_dns_cache_put(host, port_str, ai, 0);
+    mysql_options(mysql, MYSQL_OPT_PROTOCOL, &protocol);
+    mysql_options(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    mysql_optionsv(mysql, MARIADB_OPT_DNS_CACHE_TTL, &ttl);
+    start= time(NULL);
+    if (!my_test_connect(mysql, host, username, password, schema,
+                         server_port, NULL, 0))
+    {
+      diag("error: %s", mysql_error(mysql));
+      mysql_close(mysql);
+      return FAIL;
+    }
+    diag("%s first address: connected after %ld seconds",
+         i ? "blackholed" : "closed", (long)(time(NULL) - start));
+    FAIL_IF(time(NULL) - start >= (time_t)timeout / 2,
+            "Connect waited for the unreachable address");
+    mysql_close(mysql);
+    if (i)
+    {
+      for (j=0; j < 3; j++)
+        close(fill[j]);
+      close(s);
+    }
+  }
+  return OK;
+}
+#endif
+
+static int test_dns_cache(MYSQL *unused __attribute__((unused)))
+{
+  MYSQL *mysql;
+  MARIADB_DNS_STATS before, after;
+  unsigned int protocol= MYSQL_PROTOCOL_TCP, ttl= 60;
+  int i;
+
+  if (hostname && strcmp(hostname, "localhost") && strcmp(hostname, "127.0.0.1"))
+  {
+    diag("test requires a local server");
+    return SKIP;
+  }
+
+  mariadb_get_infov(NULL, MARIADB_DNS_CACHE_STATS, &before);
+  for (i=0; i < 2; i++)
+  {
+    mysql= mysql_init(NULL);
+    FAIL_IF(!mysql, "not enough memory");
+    mysql_options(mysql, MYSQL_OPT_PROTOCOL, &protocol);
+    mysql_optionsv(mysql, MARIADB_OPT_DNS_CACHE_TTL, &ttl);
+    if (!(my_test_connect(mysql, "localhost", username,
+                             password, schema, port,
+                             NULL, 0)))
+    {
+      diag("error: %s", mysql_error(mysql));
+      mysql_close(mysql);
+      return FAIL;
+    }
+    mysql_close(mysql);
+  }
+  mariadb_get_infov(NULL, MARIADB_DNS_CACHE_STATS, &after);
+  FAIL_IF(after.hits <= before.hits, "second connect didn't use the DNS cache");
+
+  /* failed lookups are cached too */
+  for (i=0; i < 2; i++)
+  {
+    mysql= mysql_init(NULL);
+    FAIL_IF(!mysql, "not enough memory");
+    mysql_options(mysql, MYSQL_OPT_PROTOCOL, &protocol);
+    mysql_optionsv(mysql, MARIADB_OPT_DNS_CACHE_TTL, &ttl);
+    FAIL_IF(mysql_real_connect(mysql, "unknown-host.invalid", username,
+                               password, schema, port, NULL, 0),
+            "connect to unknown host succeeded");
+    FAIL_IF(mysql_errno(mysql) != CR_UNKNOWN_HOST, "expected CR_UNKNOWN_HOST");
+    mysql_close(mysql);
+  }
+  mariadb_get_infov(NULL, MARIADB_DNS_CACHE_STATS, &before);
+  FAIL_IF(before.negative_hits <= after.negative_hits, "failed lookup wasn't cached");
+  return OK;
+}
+
+#ifndef _WIN32
+/* stores host<i>.test with the single address 10.0.<i / 256>.<i % 256> + offset */
+static void dns_put(unsigned int i, unsigned int offset)
+{
+  struct addrinfo ai;
+  struct sockaddr_in addr;
+  char host[32];
+
+  memset(&ai, 0, sizeof(ai));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family= AF_INET;
+  addr.sin_addr.s_addr= htonl(0x0a000000 + i + offset);
+  ai.ai_family= AF_INET;
+  ai.ai_socktype= SOCK_STREAM;
+  ai.ai_addrlen= sizeof(addr);
+  ai.ai_addr= (struct sockaddr *)&addr;
+  sprintf(host, "host%u.test", i);
+  ma_dns_cache_put(host, "3306", &ai, 0);
+}
+
+/* returns 0 if host<i>.test is cached with the address of dns_put() */
+static int dns_check(unsigned int i, unsigned int offset)
+{
+  struct addrinfo *res;
+  char host[32];
+  int gai_rc, rc;
+
+  sprintf(host, "host%u.test", i);
+  if (ma_dns_cache_get(host, "3306", 60, &res, &gai_rc))
+    return 1;
+  rc= gai_rc || !res || res->ai_next ||
+      ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr != htonl(0x0a000000 + i + offset);
+  ma_dns_cache_free(res);
+  return rc;
+}
+
+/*
+  Replacing and evicting entries must not lose other entries of the
+  cache, the cache is tested directly with made up addresses.
+*/
+static int test_dns_cache_entries(MYSQL *unused __attribute__((unused)))
+{
+  MARIADB_DNS_STATS before, after;
+  unsigned int i, found, count= MA_DNS_CACHE_SIZE + 20;
+
+  mariadb_get_infov(NULL, MARIADB_DNS_CACHE_STATS, &before);
+  for (i=0; i < 3; i++)
+    dns_put(i, 0);
+  /* a second lookup of the same host, e.g. by a concurrent connect,
+     replaces the first one */
+  dns_put(1, 1000);
+  FAIL_IF(dns_check(0, 0), "host0 lost after replace");
+  FAIL_IF(dns_check(1, 1000), "host1 wasn't replaced");
+  FAIL_IF(dns_check(2, 0), "host2 lost after replace");
+
+  /* fill the cache beyond its size, every 3rd time an older entry is
+     stored again, which sits in the middle of the hash and LRU list */
+  for (i=3; i < count; i++)
+  {
+    dns_put(i, 0);
+    if (i % 3 == 0 && i >= 50)
+      dns_put(i - 50, 0);
+  }
+  mariadb_get_infov(NULL, MARIADB_DNS_CACHE_STATS, &after);
+  diag("entries: %llu evicted: %llu", after.entries, after.evicted - before.evicted);
+  FAIL_IF(after.entries != MA_DNS_CACHE_SIZE, "wrong number of cached entries");
+  FAIL_IF(after.evicted <= before.evicted, "no entry was evicted");
+
+  /* every counted entry can be found */
+  for (i=0, found=0; i < count; i++)
+    if (!dns_check(i, 0))
+      found++;
+  FAIL_IF(found != MA_DNS_CACHE_SIZE, "cached entries can't be found");
+  FAIL_IF(dns_check(count - 1, 0), "newest entry not found");
+  return OK;
+}
+#endif
+
 struct my_tests_st my_tests[] = {
+  {"test_dns_cache", test_dns_cache, TEST_CONNECTION_NONE, 0, NULL,  NULL},
+#ifndef _WIN32
+  {"test_dns_cache_entries", test_dns_cache_entries, TEST_CONNECTION_NONE, 0, NULL,  NULL},
+#endif
+  {"test_connect_multiple_addresses", test_connect_multiple_addresses, TEST_CONNECTION_NONE, 0, NULL,  NULL},
+#ifndef _WIN32
+  {"test_connect_unreachable_first_address", test_connect_unreachable_first_address, TEST_CONNECTION_NONE, 0, NULL,  NULL},
+#endif
+  {"test_connection_stats", test_connection_stats, TEST_CONNECTION_NONE, 0, NULL,  NULL},
   {"test_reset", test_reset, TEST_CONNECTION_DEFAULT, 0, NULL,  NULL},
   {"test_unix_socket_close", test_unix_socket_close, TEST_CONNECTION_NONE, 0, NULL,  NULL},
   {"test_sess_track_db", test_sess_track_db, TEST_CONNECTION_DEFAULT, 0, NULL,  NULL},
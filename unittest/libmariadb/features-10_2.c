@@ -186,6 +186,133 @@ static int conc_218(MYSQL *mysql)
   return OK;
 }
 
+static int test_pipeline(MYSQL *mysql)
+{
+  MYSQL_STMT *stmt;
+  MYSQL_BIND bind;
+  MYSQL_RES *res;
+  int rc, i, val;
+  const char *query= "SELECT a FROM t_pipeline";
+  const char *bad_query= "SELECT a FROM t_pipeline_not_exists";
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS t_pipeline");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "CREATE TABLE t_pipeline (a int)");
+  check_mysql_rc(rc, mysql);
+
+  stmt= mysql_stmt_init(mysql);
+  rc= mysql_stmt_prepare(stmt, "INSERT INTO t_pipeline VALUES (?)", -1);
+  check_stmt_rc(rc, stmt);
+
+  memset(&bind, 0, sizeof(MYSQL_BIND));
+  bind.buffer_type= MYSQL_TYPE_LONG;
+  bind.buffer= &val;
+  rc= mysql_stmt_bind_param(stmt, &bind);
+  check_stmt_rc(rc, stmt);
+
+  rc= mariadb_pipeline_begin(mysql);
+  check_mysql_rc(rc, mysql);
+
+  for (i=0; i < 10; i++)
+  {
+    val= i;
+    rc= mysql_stmt_execute(stmt);
+    check_stmt_rc(rc, stmt);
+  }
+  rc= mysql_send_query(mysql, query, strlen(query));
+  check_mysql_rc(rc, mysql);
+  rc= mysql_send_query(mysql, bad_query, strlen(bad_query));
+  check_mysql_rc(rc, mysql);
+  rc= mysql_send_query(mysql, query, strlen(query));
+  check_mysql_rc(rc, mysql);
+
+  /* commands which read their response immediately have to wait */
+  rc= mysql_query(mysql, "SELECT 1");
+  FAIL_IF(!rc, "Error expected");
+  FAIL_IF(!mariadb_pipeline_end(mysql), "Error expected");
+
+  /* results are read in the order of the commands */
+  for (i=0; i < 10; i++)
+  {
+    rc= mysql_read_query_result(mysql);
+    check_stmt_rc(rc, stmt);
+    FAIL_IF(mysql_stmt_affected_rows(stmt) != 1, "Expected 1 affected row");
+  }
+  rc= mysql_read_query_result(mysql);
+  check_mysql_rc(rc, mysql);
+  FAIL_IF(!(res= mysql_store_result(mysql)), mysql_error(mysql));
+  FAIL_IF(mysql_num_rows(res) != 10, "Expected 10 rows");
+  mysql_free_result(res);
+
+  /* an error only affects its own result */
+  rc= mysql_read_query_result(mysql);
+  FAIL_IF(!rc, "Error expected");
+  diag("expected error: %s", mysql_error(mysql));
+
+  rc= mysql_read_query_result(mysql);
+  check_mysql_rc(rc, mysql);
+  FAIL_IF(!(res= mysql_store_result(mysql)), mysql_error(mysql));
+  FAIL_IF(mysql_num_rows(res) != 10, "Expected 10 rows");
+  mysql_free_result(res);
+
+  rc= mariadb_pipeline_end(mysql);
+  check_mysql_rc(rc, mysql);
+  mysql_stmt_close(stmt);
+
+  rc= mysql_query(mysql, "DROP TABLE t_pipeline");
+  check_mysql_rc(rc, mysql);
+  return OK;
+}
+
+/*
+  Pipelines more command and result data than both socket buffers can
+  hold: the server stops reading commands while it can't send results,
+  so the client has to read results while it writes.
+*/
+static int test_pipeline_full_buffers(MYSQL *mysql)
+{
+  char query[10240];
+  size_t length;
+  int rc, sent= 0, read= 0;
+  const int commands= 1000;
+  MYSQL_RES *res;
+  MYSQL_ROW row;
+
+  length= (size_t)sprintf(query, "SELECT REPEAT('a', 65536) /* ");
+  memset(query + length, 'x', sizeof(query) - length - 4);
+  strcpy(query + sizeof(query) - 4, " */");
+  length= strlen(query);
+
+  rc= mariadb_pipeline_begin(mysql);
+  check_mysql_rc(rc, mysql);
+
+  while (read < commands)
+  {
+    if (sent < commands)
+    {
+      if (!mysql_send_query(mysql, query, length))
+      {
+        sent++;
+        continue;
+      }
+      /* the pipeline might be limited, e.g. on TLS connections */
+      FAIL_IF(mysql_errno(mysql) != CR_PIPELINE_FULL, mysql_error(mysql));
+      FAIL_IF(sent == read, "Pipeline full without pending results");
+    }
+    rc= mysql_read_query_result(mysql);
+    check_mysql_rc(rc, mysql);
+    FAIL_IF(!(res= mysql_store_result(mysql)), mysql_error(mysql));
+    FAIL_IF(!(row= mysql_fetch_row(res)), "Expected a row");
+    FAIL_IF(strlen(row[0]) != 65536, "Wrong length");
+    mysql_free_result(res);
+    read++;
+  }
+  diag("%d commands, %d bytes per command", commands, (int)length);
+
+  rc= mariadb_pipeline_end(mysql);
+  check_mysql_rc(rc, mysql);
+  return OK;
+}
 
 struct my_tests_st my_tests[] = {
   {"conc_218", conc_218, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
@@ -193,6 +320,8 @@ struct my_tests_st my_tests[] = {
   {"conc_213", conc_213, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"execute_direct", execute_direct, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"execute_direct_example", execute_direct_example, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
+  {"test_pipeline", test_pipeline, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
+  {"test_pipeline_full_buffers", test_pipeline_full_buffers, TEST_CONNECTION_NEW, 0,  NULL,  NULL},
   {NULL, NULL, 0, 0, NULL, NULL}
 };
 
@@ -905,6 +905,235 @@ static int test_fetch_double(MYSQL *mysql)
   return bind_fetch(mysql, 3);
 }
 
+/* Test fetching of multiple rows into column and row wise bound arrays */
+
+#define TEST_FETCH_BATCH_ROWS 100
+
+static int test_fetch_batch(MYSQL *mysql)
+{
+  MYSQL_STMT *stmt;
+  MYSQL_BIND my_bind[2];
+  int rc, total= 0;
+  unsigned int i, rows, array_size= 8;
+  size_t row_size= 0;
+  int ids[8];
+  char names[8][20];
+  unsigned long lengths[8];
+  my_bool is_null[8];
+  struct st_row {
+    int id;
+    char name[20];
+    unsigned long length;
+    my_bool is_null;
+  } row_buffer[8];
+  const char *query= "SELECT id, name FROM t_fetch_batch ORDER BY id";
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS t_fetch_batch");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "CREATE TABLE t_fetch_batch (id int, name varchar(20))");
+  check_mysql_rc(rc, mysql);
+  for (i=0; i < TEST_FETCH_BATCH_ROWS; i++)
+  {
+    char insert[64];
+    if (i % 5)
+      sprintf(insert, "INSERT INTO t_fetch_batch VALUES (%u, 'row %u')", i, i);
+    else
+      sprintf(insert, "INSERT INTO t_fetch_batch VALUES (%u, NULL)", i);
+    rc= mysql_query(mysql, insert);
+    check_mysql_rc(rc, mysql);
+  }
+
+  stmt= mysql_stmt_init(mysql);
+  FAIL_IF(!stmt, mysql_error(mysql));
+  rc= mysql_stmt_prepare(stmt, query, (unsigned long)strlen(query));
+  check_stmt_rc(rc, stmt);
+
+  /* column wise binding */
+  rc= mysql_stmt_attr_set(stmt, STMT_ATTR_FETCH_ARRAY_SIZE, &array_size);
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_attr_set(stmt, STMT_ATTR_FETCH_ROW_SIZE, &row_size);
+  check_stmt_rc(rc, stmt);
+
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+
+  memset(my_bind, 0, sizeof(my_bind));
+  my_bind[0].buffer_type= MYSQL_TYPE_LONG;
+  my_bind[0].buffer= ids;
+  my_bind[1].buffer_type= MYSQL_TYPE_STRING;
+  my_bind[1].buffer= names;
+  my_bind[1].buffer_length= 20;
+  my_bind[1].length= lengths;
+  my_bind[1].is_null= is_null;
+  rc= mysql_stmt_bind_result(stmt, my_bind);
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_store_result(stmt);
+  check_stmt_rc(rc, stmt);
+
+  while (!(rc= mariadb_stmt_fetch_batch(stmt, &rows)))
+  {
+    FAIL_IF(rows == 0 || rows > array_size, "wrong number of rows");
+    for (i=0; i < rows; i++)
+    {
+      FAIL_IF(ids[i] != total, "wrong id");
+      FAIL_IF(is_null[i] != !(total % 5), "wrong null indicator");
+      if (!is_null[i])
+      {
+        char expected[20];
+        sprintf(expected, "row %d", total);
+        FAIL_IF(lengths[i] != strlen(expected), "wrong length");
+        FAIL_IF(strncmp(names[i], expected, lengths[i]), "wrong value");
+      }
+      total++;
+    }
+  }
+  FAIL_IF(rc != MYSQL_NO_DATA, "expected MYSQL_NO_DATA");
+  FAIL_IF(total != TEST_FETCH_BATCH_ROWS, "wrong number of total rows");
+
+  /* row wise binding, unbuffered */
+  row_size= sizeof(struct st_row);
+  rc= mysql_stmt_attr_set(stmt, STMT_ATTR_FETCH_ROW_SIZE, &row_size);
+  check_stmt_rc(rc, stmt);
+
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+
+  memset(my_bind, 0, sizeof(my_bind));
+  my_bind[0].buffer_type= MYSQL_TYPE_LONG;
+  my_bind[0].buffer= &row_buffer[0].id;
+  my_bind[1].buffer_type= MYSQL_TYPE_STRING;
+  my_bind[1].buffer= row_buffer[0].name;
+  my_bind[1].buffer_length= 20;
+  my_bind[1].length= &row_buffer[0].length;
+  my_bind[1].is_null= &row_buffer[0].is_null;
+  rc= mysql_stmt_bind_result(stmt, my_bind);
+  check_stmt_rc(rc, stmt);
+
+  total= 0;
+  while (!(rc= mariadb_stmt_fetch_batch(stmt, &rows)))
+  {
+    for (i=0; i < rows; i++)
+    {
+      FAIL_IF(row_buffer[i].id != total, "wrong id");
+      FAIL_IF(row_buffer[i].is_null != !(total % 5), "wrong null indicator");
+      total++;
+    }
+  }
+  FAIL_IF(rc != MYSQL_NO_DATA, "expected MYSQL_NO_DATA");
+  FAIL_IF(total != TEST_FETCH_BATCH_ROWS, "wrong number of total rows");
+
+  mysql_stmt_close(stmt);
+  rc= mysql_query(mysql, "DROP TABLE t_fetch_batch");
+  check_mysql_rc(rc, mysql);
+  return OK;
+}
+
+/* Test streaming of long values into bound buffers and a callback */
+
+static unsigned long long stream_bytes;
+static unsigned int stream_errors;
+
+static int stream_callback(MYSQL_STMT *stmt __attribute__((unused)),
+                           unsigned int column,
+                           const unsigned char *data, size_t length,
+                           void *user_data)
+{
+  size_t i;
+
+  if (column != 1 || user_data != (void *)&stream_bytes)
+    stream_errors++;
+  for (i=0; i < length; i++)
+    if (data[i] != 'a' + (stream_bytes + i) % 26)
+      stream_errors++;
+  stream_bytes+= length;
+  return 0;
+}
+
+static int test_fetch_stream(MYSQL *mysql)
+{
+  MYSQL_STMT *stmt;
+  MYSQL_BIND my_bind[3];
+  int rc, id, i;
+  char buffer[100], tail[10];
+  unsigned long length, tail_length;
+  my_bool stream= 1;
+  const char *query= "SELECT id, b, 'tail' FROM t_fetch_stream ORDER BY id";
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS t_fetch_stream");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "CREATE TABLE t_fetch_stream (id int, b longblob)");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "INSERT INTO t_fetch_stream VALUES (1, REPEAT('abcdefghijklmnopqrstuvwxyz', 38462)), (2, 'abc'), (3, NULL)");
+  check_mysql_rc(rc, mysql);
+
+  stmt= mysql_stmt_init(mysql);
+  FAIL_IF(!stmt, mysql_error(mysql));
+  rc= mysql_stmt_prepare(stmt, query, (unsigned long)strlen(query));
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_attr_set(stmt, STMT_ATTR_STREAM_RESULT, &stream);
+  check_stmt_rc(rc, stmt);
+
+  /* long values are read into the bound buffer and truncated */
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+  memset(my_bind, 0, sizeof(my_bind));
+  my_bind[0].buffer_type= MYSQL_TYPE_LONG;
+  my_bind[0].buffer= &id;
+  my_bind[1].buffer_type= MYSQL_TYPE_BLOB;
+  my_bind[1].buffer= buffer;
+  my_bind[1].buffer_length= sizeof(buffer);
+  my_bind[1].length= &length;
+  my_bind[2].buffer_type= MYSQL_TYPE_STRING;
+  my_bind[2].buffer= tail;
+  my_bind[2].buffer_length= sizeof(tail);
+  my_bind[2].length= &tail_length;
+  rc= mysql_stmt_bind_result(stmt, my_bind);
+  check_stmt_rc(rc, stmt);
+
+  rc= mysql_stmt_fetch(stmt);
+  FAIL_IF(rc != MYSQL_DATA_TRUNCATED, "expected MYSQL_DATA_TRUNCATED");
+  FAIL_IF(id != 1, "wrong id");
+  FAIL_IF(length != 38462 * 26, "wrong length");
+  FAIL_IF(memcmp(buffer, "abcdefghijklmnopqrstuvwxyzabcd", 30), "wrong value");
+  FAIL_IF(tail_length != 4 || strcmp(tail, "tail"), "wrong value behind streamed column");
+  rc= mysql_stmt_fetch(stmt);
+  check_stmt_rc(rc, stmt);
+  FAIL_IF(id != 2 || length != 3 || memcmp(buffer, "abc", 3), "wrong value");
+  rc= mysql_stmt_fetch(stmt);
+  check_stmt_rc(rc, stmt);
+  FAIL_IF(id != 3 || !my_bind[1].is_null_value, "expected NULL");
+  rc= mysql_stmt_fetch(stmt);
+  FAIL_IF(rc != MYSQL_NO_DATA, "expected MYSQL_NO_DATA");
+
+  /* columns bound without buffer are passed to the callback */
+  rc= mysql_stmt_attr_set(stmt, STMT_ATTR_STREAM_CALLBACK, (void *)stream_callback);
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_attr_set(stmt, STMT_ATTR_STREAM_USER_DATA, &stream_bytes);
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+  my_bind[1].buffer= NULL;
+  my_bind[1].buffer_length= 0;
+  rc= mysql_stmt_bind_result(stmt, my_bind);
+  check_stmt_rc(rc, stmt);
+  for (i=0; i < 2; i++)
+  {
+    stream_bytes= 0;
+    rc= mysql_stmt_fetch(stmt);
+    check_stmt_rc(rc, stmt);
+    FAIL_IF(stream_bytes != length, "callback didn't receive the value");
+    FAIL_IF(stream_errors, "callback received wrong data");
+  }
+  /* remaining rows are skipped */
+  rc= mysql_stmt_free_result(stmt);
+  check_stmt_rc(rc, stmt);
+
+  mysql_stmt_close(stmt);
+  rc= mysql_query(mysql, "DROP TABLE t_fetch_stream");
+  check_mysql_rc(rc, mysql);
+  return OK;
+}
+
 struct my_tests_st my_tests[] = {
   {"test_fetch_seek", test_fetch_seek, 1, 0, NULL , NULL},
   {"test_fetch_offset", test_fetch_offset, 1, 0, NULL , NULL},
@@ -919,6 +1148,8 @@ struct my_tests_st my_tests[] = {
   {"test_fetch_bigint", test_fetch_bigint, 1, 0, NULL , NULL},
   {"test_fetch_float", test_fetch_float, 1, 0, NULL , NULL},
   {"test_fetch_double", test_fetch_double, 1, 0, NULL , NULL},
+  {"test_fetch_batch", test_fetch_batch, 1, 0, NULL , NULL},
+  {"test_fetch_stream", test_fetch_stream, 1, 0, NULL , NULL},
   {NULL, NULL, 0, 0, NULL, NULL}
 };
 
@@ -22,6 +22,23 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "my_test.h"
 #include "ma_common.h"
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+static double perf_now(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
 
 static int perf1(MYSQL *mysql)
 {
@@ -57,8 +74,163 @@ static int perf1(MYSQL *mysql)
   return OK;
 }
 
+unsigned char* mysql_stmt_execute_generate_request(MYSQL_STMT *stmt, size_t *request_len);
+
+/*
+  Counts the network reads per fetched row of an unbuffered result set.
+  While the server is ahead of the client, pvio_socket_read doesn't poll
+  before reading, so each read costs a single system call instead of two.
+  Reads which had to poll are reported as waits.
+*/
+static int perf_read_syscalls(MYSQL *mysql)
+{
+  int rc, i;
+  unsigned long rows= 0;
+  MYSQL_RES *res;
+  MARIADB_STATS stats;
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS t_perf_read");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "CREATE TABLE t_perf_read (a int, b varchar(100))");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "INSERT INTO t_perf_read VALUES (1, REPEAT('a', 100))");
+  check_mysql_rc(rc, mysql);
+  /* 2^16 rows */
+  for (i=0; i < 16; i++)
+  {
+    rc= mysql_query(mysql, "INSERT INTO t_perf_read SELECT a + 1, b FROM t_perf_read");
+    check_mysql_rc(rc, mysql);
+  }
+
+  mariadb_reset_stats(mysql);
+
+  rc= mysql_query(mysql, "SELECT a, b FROM t_perf_read");
+  check_mysql_rc(rc, mysql);
+  res= mysql_use_result(mysql);
+  FAIL_IF(!res, mysql_error(mysql));
+  while (mysql_fetch_row(res))
+    rows++;
+  mysql_free_result(res);
+
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_STATS, &stats);
+  FAIL_IF(rc, "mariadb_get_infov failed");
+
+  diag("rows: %lu reads: %llu reads/row: %.4f reads without poll: %llu",
+       rows, stats.read_calls,
+       rows ? (double)stats.read_calls / rows : 0.0,
+       stats.read_calls - stats.read_waits);
+
+  rc= mysql_query(mysql, "DROP TABLE t_perf_read");
+  check_mysql_rc(rc, mysql);
+  return OK;
+}
+
+#define PERF_BULK_ROWS 100000
+
+/*
+  Inserts 100000 rows with a single array bound execute and reports the
+  rows per second, for the execution and for the client side encoding of
+  the request only.
+*/
+static int perf_bulk_insert(MYSQL *mysql)
+{
+  int rc;
+  MYSQL_STMT *stmt;
+  MYSQL_BIND bind[4];
+  unsigned int i, array_size= PERF_BULK_ROWS;
+  int *ids;
+  long long *counts;
+  double *prices, start, elapsed;
+  char **names;
+  unsigned long *lengths;
+  const char *stmtstr= "INSERT INTO t_perf_bulk VALUES (?,?,?,?)";
+
+  if (mysql->server_capabilities & CLIENT_MYSQL ||
+      !(mysql->extension->mariadb_server_capabilities &
+        (MARIADB_CLIENT_STMT_BULK_OPERATIONS >> 32)))
+  {
+    diag("Server doesn't support bulk operations");
+    return SKIP;
+  }
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS t_perf_bulk");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "CREATE TABLE t_perf_bulk (a int, b bigint, c double, d varchar(30))");
+  check_mysql_rc(rc, mysql);
+
+  ids= (int *)malloc(PERF_BULK_ROWS * sizeof(int));
+  counts= (long long *)malloc(PERF_BULK_ROWS * sizeof(long long));
+  prices= (double *)malloc(PERF_BULK_ROWS * sizeof(double));
+  names= (char **)malloc(PERF_BULK_ROWS * sizeof(char *));
+  lengths= (unsigned long *)malloc(PERF_BULK_ROWS * sizeof(unsigned long));
+  FAIL_IF(!ids || !counts || !prices || !names || !lengths, "Not enough memory");
+  for (i=0; i < PERF_BULK_ROWS; i++)
+  {
+    ids[i]= i;
+    counts[i]= (long long)i * 1000003;
+    prices[i]= i * 0.25;
+    names[i]= (char *)"abcdefghijklmnopqrstuvwxyz" + i % 20;
+    lengths[i]= 26 - i % 20;
+  }
+
+  stmt= mysql_stmt_init(mysql);
+  rc= mysql_stmt_prepare(stmt, stmtstr, strlen(stmtstr));
+  check_stmt_rc(rc, stmt);
+
+  memset(bind, 0, sizeof(MYSQL_BIND) * 4);
+  bind[0].buffer_type= MYSQL_TYPE_LONG;
+  bind[0].buffer= ids;
+  bind[1].buffer_type= MYSQL_TYPE_LONGLONG;
+  bind[1].buffer= counts;
+  bind[2].buffer_type= MYSQL_TYPE_DOUBLE;
+  bind[2].buffer= prices;
+  bind[3].buffer_type= MYSQL_TYPE_STRING;
+  bind[3].buffer= names;
+  bind[3].length= lengths;
+
+  rc= mysql_stmt_attr_set(stmt, STMT_ATTR_ARRAY_SIZE, &array_size);
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_bind_param(stmt, bind);
+  check_stmt_rc(rc, stmt);
+
+  start= perf_now();
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+  elapsed= perf_now() - start;
+  FAIL_IF(mysql_stmt_affected_rows(stmt) != PERF_BULK_ROWS, "wrong number of affected rows");
+  diag("execute: %u rows in %.3f s, %.0f rows/sec", array_size, elapsed,
+       elapsed > 0 ? array_size / elapsed : 0.0);
+
+  /* client side encoding only */
+  {
+    size_t request_len;
+    unsigned int iterations= 20;
+
+    start= perf_now();
+    for (i=0; i < iterations; i++)
+      FAIL_IF(!mysql_stmt_execute_generate_request(stmt, &request_len),
+              mysql_stmt_error(stmt));
+    elapsed= perf_now() - start;
+    diag("encode: %u bytes per request, %.0f rows/sec", (unsigned int)request_len,
+         elapsed > 0 ? (double)array_size * iterations / elapsed : 0.0);
+  }
+
+  mysql_stmt_close(stmt);
+  free(ids);
+  free(counts);
+  free(prices);
+  free(names);
+  free(lengths);
+
+  rc= mysql_query(mysql, "DROP TABLE t_perf_bulk");
+  check_mysql_rc(rc, mysql);
+  return OK;
+}
+
 struct my_tests_st my_tests[] = {
   {"perf1", perf1, TEST_CONNECTION_NEW, 0,  NULL,  NULL},
+  {"perf_read_syscalls", perf_read_syscalls, TEST_CONNECTION_NEW, 0,  NULL,  NULL},
+  {"perf_bulk_insert", perf_bulk_insert, TEST_CONNECTION_NEW, 0,  NULL,  NULL},
   {NULL, NULL, 0, 0, NULL, NULL}
 };
 
@@ -481,6 +481,185 @@ int test_query(MYSQL *mysql)
   return OK;
 }
 
+#define STMT_CACHE_QUERIES 4
+
+static int test_stmt_cache_entries(MYSQL *mysql)
+{
+  const char *queries[STMT_CACHE_QUERIES]= {"SELECT 1", "SELECT 2", "SELECT 3",
+                                           "SELECT 4"};
+  MYSQL_STMT *stmts[STMT_CACHE_QUERIES];
+  unsigned long ids[STMT_CACHE_QUERIES];
+  unsigned int cache_size= 3;
+  int rc, i, round;
+
+  rc= mysql_optionsv(mysql, MARIADB_OPT_STMT_CACHE_SIZE, &cache_size);
+  FAIL_IF(rc, "mysql_optionsv failed");
+
+  /* prepare all statements at the same time, so each one is prepared on
+     the server, then cache the first three */
+  for (i=0; i < STMT_CACHE_QUERIES; i++)
+  {
+    stmts[i]= mysql_stmt_init(mysql);
+    FAIL_IF(!stmts[i], mysql_error(mysql));
+    rc= mysql_stmt_prepare(stmts[i], queries[i], strlen(queries[i]));
+    check_stmt_rc(rc, stmts[i]);
+    ids[i]= stmts[i]->stmt_id;
+  }
+  for (i=0; i < STMT_CACHE_QUERIES - 1; i++)
+    mysql_stmt_close(stmts[i]);
+
+  /* every statement finds its own entry */
+  for (round=0; round < 2; round++)
+    for (i=0; i < STMT_CACHE_QUERIES - 1; i++)
+    {
+      MYSQL_STMT *stmt= mysql_stmt_init(mysql);
+      rc= mysql_stmt_prepare(stmt, queries[i], strlen(queries[i]));
+      check_stmt_rc(rc, stmt);
+      FAIL_IF(stmt->stmt_id != ids[i], "cached statement wasn't reused");
+      rc= mysql_stmt_execute(stmt);
+      check_stmt_rc(rc, stmt);
+      rc= mysql_stmt_store_result(stmt);
+      check_stmt_rc(rc, stmt);
+      mysql_stmt_close(stmt);
+    }
+
+  /* the cache is full: caching the 4th statement evicts the 1st one */
+  mysql_stmt_close(stmts[STMT_CACHE_QUERIES - 1]);
+  for (i=STMT_CACHE_QUERIES - 1; i >= 0; i--)
+  {
+    stmts[i]= mysql_stmt_init(mysql);
+    rc= mysql_stmt_prepare(stmts[i], queries[i], strlen(queries[i]));
+    check_stmt_rc(rc, stmts[i]);
+    FAIL_IF((stmts[i]->stmt_id == ids[i]) != (i > 0),
+            i ? "cached statement wasn't reused" : "evicted statement was reused");
+  }
+  for (i=0; i < STMT_CACHE_QUERIES; i++)
+    mysql_stmt_close(stmts[i]);
+  return OK;
+}
+
+static int test_stmt_cache(MYSQL *unused __attribute__((unused)))
+{
+  int rc, i;
+  MYSQL *mysql= mysql_init(NULL);
+  MYSQL_STMT *stmt;
+  unsigned int cache_size= 2, size;
+  unsigned long stmt_id= 0;
+  const char *query= "SELECT 1 FROM DUAL";
+
+  rc= mysql_optionsv(mysql, MARIADB_OPT_STMT_CACHE_SIZE, &cache_size);
+  FAIL_IF(rc, "mysql_optionsv failed");
+  mysql_get_optionv(mysql, MARIADB_OPT_STMT_CACHE_SIZE, &size);
+  FAIL_IF(size != cache_size, "wrong statement cache size");
+
+  FAIL_IF(!my_test_connect(mysql, hostname, username, password, schema,
+                           port, socketname, 0), mysql_error(mysql));
+
+  /* closed statements are kept, so the same server side id is reused */
+  for (i=0; i < 3; i++)
+  {
+    stmt= mysql_stmt_init(mysql);
+    rc= mysql_stmt_prepare(stmt, query, strlen(query));
+    check_stmt_rc(rc, stmt);
+    if (i)
+      FAIL_IF(stmt->stmt_id != stmt_id, "cached statement wasn't reused");
+    stmt_id= stmt->stmt_id;
+    FAIL_IF(mysql_stmt_field_count(stmt) != 1, "wrong field count");
+    rc= mysql_stmt_execute(stmt);
+    check_stmt_rc(rc, stmt);
+    rc= mysql_stmt_store_result(stmt);
+    check_stmt_rc(rc, stmt);
+    FAIL_IF(mysql_stmt_num_rows(stmt) != 1, "expected 1 row");
+    mysql_stmt_close(stmt);
+  }
+
+  /* several statements: hits find their own entry, the statement which
+     was idle for the longest time is evicted */
+  rc= test_stmt_cache_entries(mysql);
+  if (rc != OK)
+    return rc;
+
+  /* statements are released on the server after change_user */
+  rc= mysql_change_user(mysql, username, password, schema);
+  check_mysql_rc(rc, mysql);
+
+  stmt= mysql_stmt_init(mysql);
+  rc= mysql_stmt_prepare(stmt, query, strlen(query));
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+  mysql_stmt_close(stmt);
+
+  mysql_close(mysql);
+  return OK;
+}
+
+/* the execute request buffer is reused, values of different sizes must not
+   leak into the following executions */
+static int test_execute_request_reuse(MYSQL *mysql)
+{
+  int rc, i;
+  MYSQL_STMT *stmt;
+  MYSQL_BIND bind[2];
+  MYSQL_RES *res;
+  MYSQL_ROW row;
+  unsigned long length, lengths[]= {100, 5000, 3, (unsigned long)-1, 2000000, 10};
+  char *buffer;
+  const char *stmtstr= "INSERT INTO t_exec_reuse VALUES (?,?)";
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS t_exec_reuse");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "CREATE TABLE t_exec_reuse (a int, b longtext)");
+  check_mysql_rc(rc, mysql);
+
+  buffer= (char *)malloc(2000001);
+  FAIL_IF(!buffer, "Not enough memory");
+  memset(buffer, 'x', 2000000);
+  buffer[2000000]= 0;
+  buffer[7]= 0;
+
+  stmt= mysql_stmt_init(mysql);
+  rc= mysql_stmt_prepare(stmt, stmtstr, strlen(stmtstr));
+  check_stmt_rc(rc, stmt);
+
+  memset(bind, 0, sizeof(MYSQL_BIND) * 2);
+  bind[0].buffer_type= MYSQL_TYPE_LONG;
+  bind[0].buffer= &i;
+  bind[1].buffer_type= MYSQL_TYPE_LONG_BLOB;
+  bind[1].buffer= buffer;
+  bind[1].length= &length;
+  rc= mysql_stmt_bind_param(stmt, bind);
+  check_stmt_rc(rc, stmt);
+
+  for (i=0; i < 6; i++)
+  {
+    length= lengths[i];
+    /* lengths[3] is a null terminated string */
+    if (i == 4)
+      buffer[7]= 'x';
+    rc= mysql_stmt_execute(stmt);
+    check_stmt_rc(rc, stmt);
+  }
+  mysql_stmt_close(stmt);
+  free(buffer);
+
+  rc= mysql_query(mysql, "SELECT a, LENGTH(b) FROM t_exec_reuse ORDER BY a");
+  check_mysql_rc(rc, mysql);
+  res= mysql_store_result(mysql);
+  FAIL_IF(!res, mysql_error(mysql));
+  for (i=0; i < 6; i++)
+  {
+    unsigned long expected= (i == 3) ? 7 : lengths[i];
+    row= mysql_fetch_row(res);
+    FAIL_IF(!row, "missing row");
+    FAIL_IF(strtoul(row[1], NULL, 10) != expected, "wrong length");
+  }
+  mysql_free_result(res);
+
+  rc= mysql_query(mysql, "DROP TABLE t_exec_reuse");
+  check_mysql_rc(rc, mysql);
+  return OK;
+}
 
 struct my_tests_st my_tests[] = {
   {"test_query", test_query, TEST_CONNECTION_DEFAULT, CLIENT_MULTI_RESULTS , NULL , NULL},
@@ -489,6 +668,8 @@ struct my_tests_st my_tests[] = {
   {"test_sp_reset1", test_sp_reset1, TEST_CONNECTION_DEFAULT, CLIENT_MULTI_STATEMENTS, NULL , NULL},
   {"test_sp_reset2", test_sp_reset2, TEST_CONNECTION_DEFAULT, CLIENT_MULTI_STATEMENTS, NULL , NULL},
   {"test_multi_result", test_multi_result, TEST_CONNECTION_DEFAULT, CLIENT_MULTI_STATEMENTS, NULL , NULL},
+  {"test_stmt_cache", test_stmt_cache, TEST_CONNECTION_NONE, 0, NULL , NULL},
+  {"test_execute_request_reuse", test_execute_request_reuse, TEST_CONNECTION_DEFAULT, 0, NULL , NULL},
   {NULL, NULL, 0, 0, NULL, NULL}
 };
 
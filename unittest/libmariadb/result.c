@@ -1046,9 +1046,237 @@ static int test_conc160(MYSQL *mysql)
 }
 
 
+static int test_store_result_lengths(MYSQL *mysql)
+{
+  MYSQL_RES *result;
+  MYSQL_ROW row;
+  unsigned long *lengths;
+  int rc, rowcount= 0;
+
+  rc= mysql_query(mysql, "SELECT 'foo', NULL, REPEAT('x', 300), '', REPEAT('y', 70000) "
+                         "UNION ALL SELECT 'ab', 'c', NULL, 'd', NULL");
+  check_mysql_rc(rc, mysql);
+
+  result= mysql_store_result(mysql);
+  FAIL_IF(!result, "Invalid result set");
+
+  while ((row= mysql_fetch_row(result)))
+  {
+    lengths= mysql_fetch_lengths(result);
+    FAIL_IF(!lengths, "mysql_fetch_lengths failed");
+    if (!rowcount)
+    {
+      FAIL_IF(lengths[0] != 3 || strcmp(row[0], "foo"), "wrong value for column 1");
+      FAIL_IF(row[1] || lengths[1], "NULL expected for column 2");
+      FAIL_IF(lengths[2] != 300 || strlen(row[2]) != 300, "wrong length for column 3");
+      FAIL_IF(lengths[3] || row[3][0], "empty string expected for column 4");
+      FAIL_IF(lengths[4] != 70000 || strlen(row[4]) != 70000, "wrong length for column 5");
+    }
+    else
+    {
+      FAIL_IF(lengths[0] != 2 || strcmp(row[0], "ab"), "wrong value for column 1");
+      FAIL_IF(lengths[1] != 1 || strcmp(row[1], "c"), "wrong value for column 2");
+      FAIL_IF(row[2] || lengths[2], "NULL expected for column 3");
+      FAIL_IF(lengths[3] != 1 || strcmp(row[3], "d"), "wrong value for column 4");
+      FAIL_IF(row[4] || lengths[4], "NULL expected for column 5");
+    }
+    rowcount++;
+  }
+  FAIL_IF(rowcount != 2, "rowcount != 2");
+  FAIL_IF(mysql_fetch_field_direct(result, 4)->max_length != 70000, "wrong max_length");
+
+  mysql_free_result(result);
+  return OK;
+}
+
+static int test_data_seek_index(MYSQL *mysql)
+{
+  MYSQL_RES *result;
+  MYSQL_STMT *stmt;
+  MYSQL_ROW row;
+  MYSQL_BIND bind;
+  int rc, i, val;
+  char query[64];
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS t_seek");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "CREATE TABLE t_seek (a int)");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "INSERT INTO t_seek VALUES (0)");
+  check_mysql_rc(rc, mysql);
+  /* 4096 rows, so the row index spans multiple chunks */
+  for (i=0; i < 12; i++)
+  {
+    sprintf(query, "INSERT INTO t_seek SELECT a + %d FROM t_seek", 1 << i);
+    rc= mysql_query(mysql, query);
+    check_mysql_rc(rc, mysql);
+  }
+
+  rc= mysql_query(mysql, "SELECT a FROM t_seek ORDER BY a");
+  check_mysql_rc(rc, mysql);
+  result= mysql_store_result(mysql);
+  FAIL_IF(!result, "Invalid result set");
+  FAIL_IF(mysql_num_rows(result) != 4096, "Expected 4096 rows");
+
+  mysql_data_seek(result, 3000);
+  row= mysql_fetch_row(result);
+  FAIL_IF(!row || atoi(row[0]) != 3000, "Wrong row after seek");
+  mysql_data_seek(result, 1024);
+  row= mysql_fetch_row(result);
+  FAIL_IF(!row || atoi(row[0]) != 1024, "Wrong row after seek");
+  row= mysql_fetch_row(result);
+  FAIL_IF(!row || atoi(row[0]) != 1025, "Wrong row after fetch");
+  mysql_data_seek(result, 4096);
+  FAIL_IF(mysql_fetch_row(result), "Expected end of result set");
+  mysql_free_result(result);
+
+  stmt= mysql_stmt_init(mysql);
+  rc= mysql_stmt_prepare(stmt, "SELECT a FROM t_seek ORDER BY a", -1);
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+  memset(&bind, 0, sizeof(MYSQL_BIND));
+  bind.buffer_type= MYSQL_TYPE_LONG;
+  bind.buffer= &val;
+  rc= mysql_stmt_bind_result(stmt, &bind);
+  check_stmt_rc(rc, stmt);
+  rc= mysql_stmt_store_result(stmt);
+  check_stmt_rc(rc, stmt);
+
+  mysql_stmt_data_seek(stmt, 2049);
+  rc= mysql_stmt_fetch(stmt);
+  check_stmt_rc(rc, stmt);
+  FAIL_IF(val != 2049, "Wrong row after seek");
+  mysql_stmt_data_seek(stmt, 4096);
+  FAIL_IF(mysql_stmt_fetch(stmt) != MYSQL_NO_DATA, "Expected MYSQL_NO_DATA");
+  mysql_stmt_close(stmt);
+
+  rc= mysql_query(mysql, "DROP TABLE t_seek");
+  check_mysql_rc(rc, mysql);
+  return OK;
+}
+
+
+/*
+  Unbuffered result sets with read ahead: all rows have to be returned
+  in order, also if the result is freed or the statement reset before the
+  last row was fetched.
+*/
+static int test_result_prefetch(MYSQL *my __attribute__((unused)))
+{
+  MYSQL *mysql= mysql_init(NULL);
+  MYSQL_RES *result;
+  MYSQL_STMT *stmt;
+  MYSQL_ROW row;
+  MYSQL_BIND bind;
+  unsigned int prefetch_rows= 64;
+  int rc, i, val;
+  char query[128];
+  MARIADB_STATS stats;
+  unsigned long long bytes_received= 0;
+  size_t read_ahead_size;
+
+  rc= mysql_optionsv(mysql, MARIADB_OPT_RESULT_PREFETCH_ROWS, &prefetch_rows);
+  check_mysql_rc(rc, mysql);
+  FAIL_IF(!my_test_connect(mysql, hostname, username, password, schema,
+                           port, socketname, 0), mysql_error(mysql));
+
+  rc= mysql_query(mysql, "DROP TABLE IF EXISTS t_prefetch");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "CREATE TABLE t_prefetch (a int, b varchar(300))");
+  check_mysql_rc(rc, mysql);
+  rc= mysql_query(mysql, "INSERT INTO t_prefetch VALUES (0, '')");
+  check_mysql_rc(rc, mysql);
+  /* 4096 rows of different length */
+  for (i=0; i < 12; i++)
+  {
+    sprintf(query, "INSERT INTO t_prefetch SELECT a + %d, REPEAT('x', (a + %d) %% 300) FROM t_prefetch", 1 << i, 1 << i);
+    rc= mysql_query(mysql, query);
+    check_mysql_rc(rc, mysql);
+  }
+
+  rc= mysql_query(mysql, "SELECT a, b FROM t_prefetch ORDER BY a");
+  check_mysql_rc(rc, mysql);
+  result= mysql_use_result(mysql);
+  FAIL_IF(!result, "Invalid result set");
+  for (i=0; (row= mysql_fetch_row(result)); i++)
+  {
+    FAIL_IF(atoi(row[0]) != i, "Wrong row");
+    FAIL_IF(strlen(row[1]) != (size_t)(i % 300), "Wrong column length");
+    /* statistics and cache size can be read while the reader runs */
+    if (i % 512 == 0)
+    {
+      rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_STATS, &stats);
+      FAIL_IF(rc, "MARIADB_CONNECTION_STATS failed");
+      FAIL_IF(stats.bytes_received < bytes_received, "bytes_received decreased");
+      bytes_received= stats.bytes_received;
+      rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_READ_AHEAD_SIZE, &read_ahead_size);
+      FAIL_IF(rc || !read_ahead_size, "MARIADB_CONNECTION_READ_AHEAD_SIZE failed");
+    }
+  }
+  FAIL_IF(mysql_errno(mysql), mysql_error(mysql));
+  FAIL_IF(i != 4096, "Expected 4096 rows");
+  mysql_free_result(result);
+  rc= mariadb_get_infov(mysql, MARIADB_CONNECTION_STATS, &stats);
+  FAIL_IF(rc, "MARIADB_CONNECTION_STATS failed");
+  FAIL_IF(stats.bytes_received <= bytes_received, "rows read ahead not counted");
+
+  /* free the result while the reader is still running */
+  rc= mysql_query(mysql, "SELECT a, b FROM t_prefetch ORDER BY a");
+  check_mysql_rc(rc, mysql);
+  result= mysql_use_result(mysql);
+  FAIL_IF(!result, "Invalid result set");
+  for (i=0; i < 10; i++)
+    FAIL_IF(!mysql_fetch_row(result), "Expected a row");
+  mysql_free_result(result);
+
+  stmt= mysql_stmt_init(mysql);
+  rc= mysql_stmt_prepare(stmt, "SELECT a FROM t_prefetch ORDER BY a", -1);
+  check_stmt_rc(rc, stmt);
+  memset(&bind, 0, sizeof(MYSQL_BIND));
+  bind.buffer_type= MYSQL_TYPE_LONG;
+  bind.buffer= &val;
+  rc= mysql_stmt_bind_result(stmt, &bind);
+  check_stmt_rc(rc, stmt);
+
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+  for (i=0; !(rc= mysql_stmt_fetch(stmt)); i++)
+    FAIL_IF(val != i, "Wrong row");
+  FAIL_IF(rc != MYSQL_NO_DATA, mysql_stmt_error(stmt));
+  FAIL_IF(i != 4096, "Expected 4096 rows");
+
+  rc= mysql_stmt_execute(stmt);
+  check_stmt_rc(rc, stmt);
+  for (i=0; i < 10; i++)
+  {
+    rc= mysql_stmt_fetch(stmt);
+    check_stmt_rc(rc, stmt);
+  }
+  rc= mysql_stmt_reset(stmt);
+  check_stmt_rc(rc, stmt);
+  mysql_stmt_close(stmt);
+
+  rc= mysql_query(mysql, "SELECT COUNT(*) FROM t_prefetch");
+  check_mysql_rc(rc, mysql);
+  result= mysql_store_result(mysql);
+  FAIL_IF(!result, "Invalid result set");
+  row= mysql_fetch_row(result);
+  FAIL_IF(!row || atoi(row[0]) != 4096, "Expected 4096 rows");
+  mysql_free_result(result);
+
+  rc= mysql_query(mysql, "DROP TABLE t_prefetch");
+  check_mysql_rc(rc, mysql);
+  mysql_close(mysql);
+  return OK;
+}
+
 
 struct my_tests_st my_tests[] = {
   {"test_conc160", test_conc160, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
+  {"test_store_result_lengths", test_store_result_lengths, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
+  {"test_data_seek_index", test_data_seek_index, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
+  {"test_result_prefetch", test_result_prefetch, TEST_CONNECTION_NONE, 0,  NULL,  NULL},
   {"client_store_result", client_store_result, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"client_use_result", client_use_result, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},
   {"test_free_result", test_free_result, TEST_CONNECTION_DEFAULT, 0,  NULL,  NULL},